@@ -0,0 +1,57 @@
+#include "bench.hpp"
+
+#include "device.hpp"
+
+namespace vkd {
+    namespace bench {
+        namespace {
+            std::map<std::string, Throughput> _throughputs;
+            int32_t _next_id = 1000;
+        }
+
+        void throughput(const std::string& name, int64_t pixels, const std::string& baseline) {
+            _throughputs[name] = Throughput{pixels, baseline};
+        }
+
+        const std::map<std::string, Throughput>& throughputs() {
+            return _throughputs;
+        }
+
+        int32_t next_id() {
+            return _next_id++;
+        }
+
+        Pipeline bake(std::unique_ptr<GraphBuilder> builder) {
+            Pipeline pipeline;
+            pipeline.graph = builder->bake(device());
+            pipeline.builder = std::move(builder);
+            if (pipeline.graph) {
+                // the first run allocates and records everything
+                run(*pipeline.graph);
+            }
+            return pipeline;
+        }
+
+        Pipeline source_graph(const std::string& node_type, glm::ivec2 size, int32_t inputs) {
+            auto builder = std::make_unique<GraphBuilder>();
+            auto source = std::make_shared<FakeNode>(next_id(), "constant", "constant");
+            source->set_param("size", size);
+            builder->add(source);
+
+            if (node_type != "constant") {
+                auto node = std::make_shared<FakeNode>(next_id(), node_type, node_type);
+                for (int32_t i = 0; i < inputs; ++i) {
+                    node->add_input(source);
+                }
+                builder->add(node);
+            }
+            return bake(std::move(builder));
+        }
+
+        void run(Graph& graph) {
+            graph.update(ExecutionType::Execution, stream());
+            graph.execute(ExecutionType::Execution, stream(), {});
+            stream()->flush();
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include "stream.hpp"
+#include "graph/graph.hpp"
+#include "graph/fake_node.hpp"
+
+namespace vkd {
+    class Device;
+
+    namespace bench {
+        // made headless in main, on the first device or whichever VKD_DEVICE names
+        std::shared_ptr<Device> device();
+        StreamPtr stream();
+
+        // what a benchmark pushes through a run, reported as megapixels a second. with a baseline
+        // its mean comes off first, so a node's figure leaves out the source feeding it
+        struct Throughput {
+            int64_t pixels = 0;
+            std::string baseline;
+        };
+        void throughput(const std::string& name, int64_t pixels, const std::string& baseline = "");
+        const std::map<std::string, Throughput>& throughputs();
+
+        struct Pipeline {
+            // real nodes only hold on to their fake nodes weakly, so the builder stays too
+            std::unique_ptr<GraphBuilder> builder = nullptr;
+            std::unique_ptr<Graph> graph = nullptr;
+            explicit operator bool() const { return graph != nullptr; }
+        };
+        // bakes and runs once, so what's measured after is just the work
+        Pipeline bake(std::unique_ptr<GraphBuilder> builder);
+        // a constant of size feeding node_type, inputs times over. just the constant for "constant"
+        Pipeline source_graph(const std::string& node_type, glm::ivec2 size, int32_t inputs = 1);
+        // one full execution, back when the device has finished
+        void run(Graph& graph);
+        // unique across bakes, so params in the cache don't carry over between graphs
+        int32_t next_id();
+    }
+}
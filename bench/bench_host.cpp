@@ -0,0 +1,157 @@
+#include "catch.hpp"
+
+#include <vector>
+
+#include "bench.hpp"
+#include "device.hpp"
+#include "memory.hpp"
+#include "memory/memory_pool.hpp"
+#include "host_cache.hpp"
+#include "hash.hpp"
+#include "make_param.hpp"
+#include "image.hpp"
+#include "command_buffer.hpp"
+#include "compute/kernel.hpp"
+
+TEST_CASE("MemoryPool", "[host][memory]") {
+    auto device = vkd::bench::device();
+    auto& pool = device->pool();
+    auto flags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    auto type = vkd::find_memory_index(device->memory_properties(), ~0u, flags);
+    const VkDeviceSize size = 1920 * 1080 * 16;
+
+    // one in the pool first, so it's the reuse every node allocate hits after the first run
+    pool.deallocate(pool.allocate(size, flags, type));
+    BENCHMARK("pool allocate and return, pooled") {
+        auto mem = pool.allocate(size, flags, type);
+        pool.deallocate(mem);
+        return mem;
+    };
+
+    BENCHMARK("pool heaps") {
+        return pool.heaps();
+    };
+
+    BENCHMARK("pool trim") {
+        pool.trim();
+    };
+
+    // the vkimage and view are remade each allocate, the memory comes from the pool
+    auto image = vkd::Image::float_image(device, {1920, 1080});
+    auto buf = vkd::CommandBuffer::make(device);
+    BENCHMARK("image allocate and deallocate, pooled") {
+        {
+            auto scope = buf->record();
+            image->allocate(buf->get());
+        }
+        image->deallocate();
+    };
+}
+
+TEST_CASE("HostCache", "[host]") {
+    vkd::HostCache cache;
+    const int32_t entries = 64;
+    std::vector<vkd::Hash> names;
+    for (int32_t i = 0; i < entries; ++i) {
+        names.emplace_back(std::string("bench"), i);
+        cache.add(names.back(), vkd::StaticHostImage::make(64, 64, 4, sizeof(uint16_t)));
+    }
+
+    int32_t next = 0;
+    BENCHMARK("host cache get, 64 entries") {
+        return cache.get(names[next++ % entries]);
+    };
+
+    vkd::Hash extra{std::string("bench extra")};
+    BENCHMARK("host cache add and remove, 1080p half") {
+        cache.add(extra, vkd::StaticHostImage::make(1920, 1080, 4, sizeof(uint16_t)));
+        return cache.remove(extra);
+    };
+}
+
+TEST_CASE("ParameterCache", "[host]") {
+    const int32_t count = 1000;
+    std::vector<std::string> names;
+    for (int32_t i = 0; i < count; ++i) {
+        names.push_back("bench_param_" + std::to_string(i));
+        vkd::make_param<float>(names.back(), "value", 0);
+    }
+
+    int32_t next = 0;
+    BENCHMARK("parameter cache get, 1000 params") {
+        return vkd::ParameterCache::get(vkd::ParameterType::p_float, names[next++ % count] + "value");
+    };
+
+    BENCHMARK("parameter cache make_param, cached") {
+        return vkd::make_param<float>(names[next++ % count], "value", 0);
+    };
+
+    // every graph update ends with this
+    BENCHMARK("parameter cache reset_changed") {
+        vkd::ParameterCache::reset_changed();
+    };
+}
+
+TEST_CASE("Kernel dispatch", "[host][kernel]") {
+    auto device = vkd::bench::device();
+    auto stream = vkd::bench::stream();
+
+    auto in = vkd::Image::float_image(device, {64, 64});
+    auto out = vkd::Image::float_image(device, {64, 64});
+    auto buf = vkd::CommandBuffer::make(device);
+    {
+        auto scope = buf->record();
+        in->allocate(buf->get());
+        out->allocate(buf->get());
+    }
+    stream->submit(buf);
+    stream->flush();
+
+    auto kernel = std::make_shared<vkd::Kernel>(device, "____bench_dispatch");
+    kernel->init("shaders/compute/exposure.comp.spv", "main", vkd::Kernel::default_local_sizes);
+    kernel->set_arg(0, in);
+    kernel->set_arg(1, out);
+
+    // descriptor sets are rebuilt on every dispatch, this is most of it
+    BENCHMARK("kernel dispatch, record only") {
+        auto scope = buf->record();
+        kernel->dispatch(*buf, 64, 64);
+    };
+
+    BENCHMARK("kernel dispatch, submit and wait") {
+        {
+            auto scope = buf->record();
+            kernel->dispatch(*buf, 64, 64);
+        }
+        stream->submit(buf);
+        stream->flush();
+    };
+}
+
+TEST_CASE("GraphBuilder::bake", "[host][graph]") {
+    auto make_builder = []() {
+        auto builder = std::make_unique<vkd::GraphBuilder>();
+        auto source = std::make_shared<vkd::FakeNode>(vkd::bench::next_id(), "constant", "constant");
+        source->set_param("size", glm::ivec2{256, 256});
+        auto exposure = std::make_shared<vkd::FakeNode>(vkd::bench::next_id(), "exposure", "exposure");
+        exposure->add_input(source);
+        auto blur = std::make_shared<vkd::FakeNode>(vkd::bench::next_id(), "gaussian", "gaussian");
+        blur->add_input(exposure);
+        builder->add(source);
+        builder->add(exposure);
+        builder->add(blur);
+        return builder;
+    };
+
+    // fresh fake nodes every time, a builder that's baked before only rebuilds what changed
+    BENCHMARK_ADVANCED("bake constant, exposure, gaussian")(Catch::Benchmark::Chronometer meter) {
+        std::vector<std::unique_ptr<vkd::GraphBuilder>> builders;
+        for (int i = 0; i < meter.runs(); ++i) {
+            builders.push_back(make_builder());
+        }
+        std::vector<std::unique_ptr<vkd::Graph>> graphs(meter.runs());
+        meter.measure([&](int i) {
+            graphs[i] = builders[i]->bake(vkd::bench::device());
+        });
+    };
+}
@@ -0,0 +1,125 @@
+#include "catch.hpp"
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/packing.hpp>
+
+#include "ghc/filesystem.hpp"
+
+#include "bench.hpp"
+#include "device.hpp"
+#include "host_cache.hpp"
+#include "inputs/exr.hpp"
+#include "outputs/exr.hpp"
+#include "services/raw_decode_service.hpp"
+#include "compute/image_node.hpp"
+#include "image.hpp"
+
+TEST_CASE("EXR", "[io][exr]") {
+    const int32_t width = 1920, height = 1080;
+    const int64_t pixels = (int64_t)width * height;
+
+    // a gradient, so the compressors have something other than zeroes to work on
+    std::vector<uint16_t> image(pixels * 4);
+    for (int32_t y = 0; y < height; ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            auto p = &image[((size_t)y * width + x) * 4];
+            p[0] = glm::packHalf1x16(x / (float)width);
+            p[1] = glm::packHalf1x16(y / (float)height);
+            p[2] = glm::packHalf1x16((x ^ y) / 2048.0f);
+            p[3] = glm::packHalf1x16(1.0f);
+        }
+    }
+
+    auto path = (ghc::filesystem::temp_directory_path() / "vkd_bench.exr").string();
+    std::vector<vkd::ExrOutput::PartData> parts = {{image.data(), width, height, ""}};
+
+    struct CompressionCase {
+        std::string name;
+        vkd::ExrOutput::Compression compression;
+    };
+    const std::vector<CompressionCase> compressions = {
+        {"none", vkd::ExrOutput::Compression::None},
+        {"zip", vkd::ExrOutput::Compression::ZIP},
+        {"piz", vkd::ExrOutput::Compression::PIZ},
+        {"dwaa", vkd::ExrOutput::Compression::DWAA}
+    };
+
+    for (auto&& c : compressions) {
+        vkd::ExrOutput::WriteSettings settings;
+        settings.compression = c.compression;
+
+        auto name = "exr write " + c.name;
+        vkd::bench::throughput(name, pixels);
+        BENCHMARK(std::string(name)) {
+            vkd::ExrOutput::write(path, parts, settings);
+        };
+
+        // reads back the file just written
+        std::vector<uint16_t> dst(pixels * 4);
+        name = "exr read " + c.name;
+        vkd::bench::throughput(name, pixels);
+        BENCHMARK(std::string(name)) {
+            return vkd::Exr::read_frame(path, 0, "", vkd::Exr::Window{0, 0, width - 1, height - 1}, dst.data());
+        };
+    }
+
+    ghc::filesystem::remove(path);
+}
+
+// needs a file, there's no raw we can write ourselves
+TEST_CASE("RAW", "[io][raw]") {
+    auto env = std::getenv("VKD_BENCH_RAW");
+    if (!env) {
+        WARN("VKD_BENCH_RAW not set, skipping");
+        return;
+    }
+    std::string path = env;
+    auto device = vkd::bench::device();
+    auto& service = vkd::RawDecodeService::Get();
+
+    // the size is only what the service budgets for
+    BENCHMARK("raw unpack") {
+        auto job = service.unpack(device, nullptr, path, 6000, 4000);
+        service.wait(job);
+        service.release(job, nullptr);
+    };
+
+    BENCHMARK("raw develop") {
+        auto job = service.develop(device, nullptr, path, 0, 6000, 4000);
+        service.wait(job);
+        service.release(job, nullptr);
+        // otherwise the next one is just a cache hit
+        device->host_cache().remove(vkd::RawDecodeService::develop_key(path, 0));
+    };
+}
+
+TEST_CASE("ffmpeg", "[io][ffmpeg]") {
+    auto env = std::getenv("VKD_BENCH_VIDEO");
+    if (!env) {
+        WARN("VKD_BENCH_VIDEO not set, skipping");
+        return;
+    }
+
+    auto builder = std::make_unique<vkd::GraphBuilder>();
+    auto node = std::make_shared<vkd::FakeNode>(vkd::bench::next_id(), "ffmpeg", "ffmpeg");
+    node->set_param("path", std::string(env));
+    builder->add(node);
+    auto pipeline = vkd::bench::bake(std::move(builder));
+    REQUIRE(pipeline);
+    REQUIRE(!pipeline.graph->terminals().empty());
+
+    auto image_node = std::dynamic_pointer_cast<vkd::ImageNode>(pipeline.graph->terminals().front());
+    REQUIRE(image_node);
+    auto dim = image_node->get_output_image()->dim();
+
+    // decodes forward a frame a run, the way playback does
+    int64_t frame = 1;
+    vkd::bench::throughput("ffmpeg decode", (int64_t)dim.x * dim.y);
+    BENCHMARK("ffmpeg decode") {
+        pipeline.graph->set_frame(vkd::Frame{frame++});
+        vkd::bench::run(*pipeline.graph);
+    };
+}
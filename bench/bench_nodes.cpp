@@ -0,0 +1,49 @@
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+#include "bench.hpp"
+
+namespace {
+    std::string size_name(glm::ivec2 size) {
+        return std::to_string(size.x) + "x" + std::to_string(size.y);
+    }
+
+    const std::vector<glm::ivec2> sizes = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+}
+
+// each node is fed from a constant, which is timed on its own as the baseline
+TEST_CASE("Node throughput", "[nodes]") {
+    struct NodeCase {
+        std::string type;
+        int32_t inputs = 1;
+    };
+    const std::vector<NodeCase> nodes = {
+        {"exposure"}, {"saturation"}, {"whitebalance"}, {"cdl"}, {"invert"}, {"log"}, {"exp"},
+        {"crop"}, {"rotate"}, {"merge", 2}, {"gaussian"}, {"median"}, {"bilateral"}
+    };
+
+    for (auto&& size : sizes) {
+        int64_t pixels = (int64_t)size.x * size.y;
+        std::string baseline = "constant " + size_name(size);
+        {
+            auto pipeline = vkd::bench::source_graph("constant", size);
+            REQUIRE(pipeline);
+            vkd::bench::throughput(baseline, pixels);
+            BENCHMARK(std::string(baseline)) {
+                vkd::bench::run(*pipeline.graph);
+            };
+        }
+
+        for (auto&& node : nodes) {
+            auto name = node.type + " " + size_name(size);
+            auto pipeline = vkd::bench::source_graph(node.type, size, node.inputs);
+            REQUIRE(pipeline);
+            vkd::bench::throughput(name, pixels, baseline);
+            BENCHMARK(std::string(name)) {
+                vkd::bench::run(*pipeline.graph);
+            };
+        }
+    }
+}
@@ -0,0 +1,174 @@
+#define CATCH_CONFIG_RUNNER
+#include "catch.hpp"
+
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include "bench.hpp"
+#include "vulkan.hpp"
+#include "device.hpp"
+#include "stream.hpp"
+
+namespace {
+    std::shared_ptr<vkd::Device> _device = nullptr;
+    vkd::StreamPtr _stream = nullptr;
+    std::string _json_path;
+
+    std::string quoted(const std::string& str) {
+        std::string out = "\"";
+        for (auto&& c : str) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+                out += c;
+            } else if ((unsigned char)c < 0x20) {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            } else {
+                out += c;
+            }
+        }
+        return out + "\"";
+    }
+
+    // everything the console reporter prints, kept for --json. one file a run, so
+    // results from different builds or devices can be diffed against each other
+    class JsonListener : public Catch::TestEventListenerBase {
+    public:
+        using TestEventListenerBase::TestEventListenerBase;
+
+        void testCaseStarting(Catch::TestCaseInfo const& info) override {
+            TestEventListenerBase::testCaseStarting(info);
+            _test_case = info.name;
+        }
+
+        void benchmarkEnded(Catch::BenchmarkStats<> const& stats) override {
+            _results.push_back(Result{_test_case, stats.info.name, stats.info.samples, stats.info.iterations,
+                stats.mean.point.count(), stats.mean.lower_bound.count(), stats.mean.upper_bound.count(),
+                stats.standardDeviation.point.count(), stats.outlierVariance});
+        }
+
+        void testRunEnded(Catch::TestRunStats const& stats) override {
+            TestEventListenerBase::testRunEnded(stats);
+            if (!_json_path.empty()) {
+                _write(_json_path);
+            }
+        }
+
+    private:
+        struct Result {
+            std::string test_case;
+            std::string name;
+            int samples = 0;
+            int iterations = 0;
+            double mean = 0.0, mean_lower = 0.0, mean_upper = 0.0;
+            double stddev = 0.0;
+            double outlier_variance = 0.0;
+        };
+
+        double _mean(const std::string& name) const {
+            for (auto&& result : _results) {
+                if (result.name == name) {
+                    return result.mean;
+                }
+            }
+            return 0.0;
+        }
+
+        void _write(const std::string& path) const {
+            std::ofstream out(path);
+            if (!out) {
+                Catch::cerr() << "Couldn't write benchmark results to " << path << std::endl;
+                return;
+            }
+
+            VkPhysicalDeviceProperties props;
+            vkGetPhysicalDeviceProperties(_device->physical_device(), &props);
+
+            auto now = std::time(nullptr);
+            std::stringstream time;
+            time << std::put_time(std::gmtime(&now), "%Y-%m-%dT%H:%M:%SZ");
+
+            out << std::setprecision(10);
+            out << "{\n";
+            out << "  \"device\": " << quoted(props.deviceName) << ",\n";
+            out << "  \"driver_version\": " << props.driverVersion << ",\n";
+            out << "  \"api_version\": \"" << VK_VERSION_MAJOR(props.apiVersion) << "." << VK_VERSION_MINOR(props.apiVersion) << "." << VK_VERSION_PATCH(props.apiVersion) << "\",\n";
+            out << "  \"time\": " << quoted(time.str()) << ",\n";
+            out << "  \"benchmarks\": [";
+            bool first = true;
+            for (auto&& result : _results) {
+                out << (first ? "\n" : ",\n");
+                first = false;
+                out << "    {\n";
+                out << "      \"test_case\": " << quoted(result.test_case) << ",\n";
+                out << "      \"name\": " << quoted(result.name) << ",\n";
+                out << "      \"samples\": " << result.samples << ",\n";
+                out << "      \"iterations\": " << result.iterations << ",\n";
+                out << "      \"mean_ns\": " << result.mean << ",\n";
+                out << "      \"mean_lower_ns\": " << result.mean_lower << ",\n";
+                out << "      \"mean_upper_ns\": " << result.mean_upper << ",\n";
+                out << "      \"stddev_ns\": " << result.stddev << ",\n";
+                out << "      \"outlier_variance\": " << result.outlier_variance;
+
+                auto search = vkd::bench::throughputs().find(result.name);
+                if (search != vkd::bench::throughputs().end()) {
+                    double ns = result.mean;
+                    if (!search->second.baseline.empty()) {
+                        out << ",\n      \"baseline\": " << quoted(search->second.baseline);
+                        ns -= _mean(search->second.baseline);
+                    }
+                    out << ",\n      \"pixels\": " << search->second.pixels;
+                    // a node lost in the noise of its source has no meaningful rate
+                    if (ns > 0.0) {
+                        out << ",\n      \"megapixels_per_second\": " << search->second.pixels / ns * 1000.0;
+                    }
+                }
+                out << "\n    }";
+            }
+            out << "\n  ]\n}\n";
+        }
+
+        std::string _test_case;
+        std::vector<Result> _results;
+    };
+}
+
+CATCH_REGISTER_LISTENER(JsonListener)
+
+namespace vkd {
+    namespace bench {
+        std::shared_ptr<Device> device() { return _device; }
+        StreamPtr stream() { return _stream; }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    Catch::Session session;
+    // a hundred samples of a 4k blur on lavapipe is a long wait, pass more for a stable run
+    session.configData().benchmarkSamples = 20;
+
+    using namespace Catch::clara;
+    auto cli = session.cli() | Opt(_json_path, "path")["--json"]("also write the benchmark results to path as json");
+    session.cli(cli);
+
+    int ret = session.applyCommandLine(argc, argv);
+    if (ret != 0) {
+        return ret;
+    }
+
+    _device = vkd::init_headless();
+    _stream = std::make_shared<vkd::Stream>(_device);
+    _stream->init();
+
+    ret = session.run();
+
+    _stream->flush();
+    _stream = nullptr;
+    _device = nullptr;
+    vkd::shutdown_headless();
+    return ret;
+}
@@ -5,6 +5,11 @@ layout (location = 1) in vec2 inTex;
 
 layout (location = 0) out vec2 outTex;
 
+// the part of the image the viewport shows, x0, y0, x1, y1 in uv
+layout (push_constant) uniform PushConstants {
+    vec4 uv_rect;
+} push;
+
 out gl_PerVertex 
 {
     vec4 gl_Position;   
@@ -12,6 +17,6 @@ out gl_PerVertex
 
 void main() 
 {
-	outTex = inTex;
+	outTex = mix(push.uv_rect.xy, push.uv_rect.zw, inTex);
 	gl_Position = vec4(inPos.xy, 0.0, 1.0);
 }
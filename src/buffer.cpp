@@ -73,6 +73,35 @@ namespace vkd {
             0, nullptr);
     }
 
+    namespace {
+        VkAccessFlags access_for_stage(VkPipelineStageFlags stage_mask) {
+            if (stage_mask == VK_PIPELINE_STAGE_TRANSFER_BIT) {
+                return VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+            }
+            return VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        }
+    }
+
+    void Buffer::release(VkCommandBuffer buf, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags src_stage_mask) {
+        VkBufferMemoryBarrier buffer_memory_barrier = barrier_info(src_stage_mask, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+        buffer_memory_barrier.srcQueueFamilyIndex = src_family;
+        buffer_memory_barrier.dstQueueFamilyIndex = dst_family;
+        buffer_memory_barrier.srcAccessMask = access_for_stage(src_stage_mask);
+        buffer_memory_barrier.dstAccessMask = 0;
+
+        vkCmdPipelineBarrier(buf, src_stage_mask, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &buffer_memory_barrier, 0, nullptr);
+    }
+
+    void Buffer::acquire(VkCommandBuffer buf, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags dst_stage_mask) {
+        VkBufferMemoryBarrier buffer_memory_barrier = barrier_info(VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage_mask);
+        buffer_memory_barrier.srcQueueFamilyIndex = src_family;
+        buffer_memory_barrier.dstQueueFamilyIndex = dst_family;
+        buffer_memory_barrier.srcAccessMask = 0;
+        buffer_memory_barrier.dstAccessMask = access_for_stage(dst_stage_mask);
+
+        vkCmdPipelineBarrier(buf, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, dst_stage_mask, 0, 0, nullptr, 1, &buffer_memory_barrier, 0, nullptr);
+    }
+
     void Buffer::_create(size_t size, VkBufferUsageFlags buffer_usage_flags, VkMemoryPropertyFlags mem_prop_flags) {
         VkBufferCreateInfo buffer_info = {};
         buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -20,6 +20,9 @@ namespace vkd {
 
         VkBufferMemoryBarrier barrier_info(VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask);
         void barrier(VkCommandBuffer buf,  VkPipelineStageFlags src_stage_mask, VkPipelineStageFlags dst_stage_mask);
+        // queue family ownership transfer, release recorded on the giving queue and acquire on the taking one
+        void release(VkCommandBuffer buf, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags src_stage_mask);
+        void acquire(VkCommandBuffer buf, uint32_t src_family, uint32_t dst_family, VkPipelineStageFlags dst_stage_mask);
 
         auto buffer() { return _buffer; }
         auto get() { return _buffer; }
@@ -74,9 +77,10 @@ namespace vkd {
             Bidirectional
         };
 
-        AutoMapStagingBuffer(std::shared_ptr<Device> device, Mode mode, size_t size) : StagingBuffer(device), _mode(mode) {
+        // extra_usage and extra_memory for buffers kernels read straight from, see ImageUploader
+        AutoMapStagingBuffer(std::shared_ptr<Device> device, Mode mode, size_t size, VkBufferUsageFlags extra_usage = 0, VkMemoryPropertyFlags extra_memory = 0) : StagingBuffer(device), _mode(mode) {
             _debug_name = "Anonymous AutoMap Staging Buffer";
-            int extra_flags = 0;
+            int extra_flags = extra_usage;
             if (_mode == Mode::Upload) {
                 extra_flags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
             } else if (_mode == Mode::Download) {
@@ -84,7 +88,7 @@ namespace vkd {
             } else if (_mode == Mode::Bidirectional) {
                 extra_flags |= VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
             }
-            init(size, extra_flags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+            init(size, extra_flags, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | extra_memory);
             _mapped = map();
         }
         
@@ -92,8 +96,8 @@ namespace vkd {
             unmap();
         }
 
-        static auto make(const std::shared_ptr<Device>& device, Mode mode, size_t size) {
-            auto buf = std::make_shared<AutoMapStagingBuffer>(device, mode, size);
+        static auto make(const std::shared_ptr<Device>& device, Mode mode, size_t size, VkBufferUsageFlags extra_usage = 0, VkMemoryPropertyFlags extra_memory = 0) {
+            auto buf = std::make_shared<AutoMapStagingBuffer>(device, mode, size, extra_usage, extra_memory);
             return buf;
         }
 
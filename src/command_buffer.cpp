@@ -56,7 +56,10 @@ namespace vkd {
 		VkFence fence = create_fence(device, false);
 
 		// Submit to the queue
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submit_info, fence));
+		{
+			std::scoped_lock lock(Device::mutex_for_queue(queue));
+			VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submit_info, fence));
+		}
 		// Wait for the fence to signal that command buffer has finished executing
 #define DEFAULT_FENCE_TIMEOUT 100000000000
 		VK_CHECK_RESULT(vkWaitForFences(device, 1, &fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
@@ -92,18 +95,23 @@ namespace vkd {
 		}
 	}
 
-	void submit_compute_buffer_timeline(VkQueue queue, VkCommandBuffer buf, VkPipelineStageFlags wait_stage_mask, TimelineSemaphore& semaphore) {
+	uint64_t submit_compute_buffer_timeline(VkQueue queue, VkCommandBuffer buf, VkPipelineStageFlags wait_stage_mask, TimelineSemaphore& semaphore, const TimelineWait& also) {
 		VkSubmitInfo submit_info = {};
 
 		auto sem = semaphore.get();
         uint64_t signal_value = semaphore.increment();
 		uint64_t wait_value = signal_value - 1;
 
+		VkSemaphore wait_semaphores[2] = {sem, also.semaphore};
+		uint64_t wait_values[2] = {wait_value, also.value};
+		VkPipelineStageFlags wait_stage_masks[2] = {wait_stage_mask, wait_stage_mask};
+		uint32_t wait_count = (also.semaphore != VK_NULL_HANDLE) ? 2 : 1;
+
 		VkTimelineSemaphoreSubmitInfo timeline_info;
 		timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
 		timeline_info.pNext = NULL;
-		timeline_info.waitSemaphoreValueCount = 1;
-		timeline_info.pWaitSemaphoreValues = &wait_value;
+		timeline_info.waitSemaphoreValueCount = wait_count;
+		timeline_info.pWaitSemaphoreValues = wait_values;
 		timeline_info.signalSemaphoreValueCount = 1;
 		timeline_info.pSignalSemaphoreValues = &signal_value;
 
@@ -111,18 +119,19 @@ namespace vkd {
 		submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 		submit_info.commandBufferCount = (buf != VK_NULL_HANDLE) ? 1 : 0;
 		submit_info.pCommandBuffers = (buf != VK_NULL_HANDLE) ? &buf : VK_NULL_HANDLE;
-		submit_info.waitSemaphoreCount = 1;
-		submit_info.pWaitSemaphores = &sem;
-		submit_info.pWaitDstStageMask = &wait_stage_mask;
+		submit_info.waitSemaphoreCount = wait_count;
+		submit_info.pWaitSemaphores = wait_semaphores;
+		submit_info.pWaitDstStageMask = wait_stage_masks;
 		submit_info.signalSemaphoreCount = 1;
 		submit_info.pSignalSemaphores = &sem;
 
 		auto res = vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
 		if (res == VK_NOT_READY) {
-			return; // gpu device waiting
+			return signal_value; // gpu device waiting
 		} else if (res < 0) {
 			VK_CHECK_RESULT(res);
 		}
+		return signal_value;
 	}
 
 
@@ -137,18 +146,23 @@ namespace vkd {
 	}
 
 	void submit_compute_buffer(Device& device, VkCommandBuffer buf, const SemaphorePtr& wait, const SemaphorePtr& signal, const Fence * fence) {
-		std::scoped_lock lock(device.queue_mutex());
+		// the VkSemaphore overload takes the queue lock
 		submit_compute_buffer(device, buf, wait ? wait->get() : VK_NULL_HANDLE, signal->get(), fence);
 	}
 
-	void submit_compute_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphore& semaphore) {
+	uint64_t submit_compute_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphore& semaphore, const TimelineWait& also) {
 		std::scoped_lock lock(device.queue_mutex());
-		submit_compute_buffer_timeline(device.compute_queue(), buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, semaphore);
+		return submit_compute_buffer_timeline(device.compute_queue(), buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, semaphore, also);
 	}
 
-	void submit_compute_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphorePtr& semaphore) {
+	uint64_t submit_compute_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphorePtr& semaphore, const TimelineWait& also) {
 		std::scoped_lock lock(device.queue_mutex());
-		submit_compute_buffer_timeline(device.compute_queue(), buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, *semaphore);
+		return submit_compute_buffer_timeline(device.compute_queue(), buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, *semaphore, also);
+	}
+
+	uint64_t submit_transfer_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphore& semaphore, const TimelineWait& also) {
+		std::scoped_lock lock(device.transfer_queue_mutex());
+		return submit_compute_buffer_timeline(device.transfer_queue(), buf, VK_PIPELINE_STAGE_TRANSFER_BIT, semaphore, also);
 	}
 
 	
@@ -158,7 +172,7 @@ namespace vkd {
 		}
 		if (_buf != VK_NULL_HANDLE)
 		{
-			vkFreeCommandBuffers(_device->logical_device(), _device->command_pool(), 1, &_buf);
+			_device->free_command_buffer(_pool, _buf);
 		}
 	}
 	
@@ -176,14 +190,34 @@ namespace vkd {
 		return ptr;
 	}
 	
+	CommandBufferPtr CommandBuffer::make_transfer(const std::shared_ptr<Device>& device) {
+		auto ptr = std::make_unique<CommandBuffer>();
+		ptr->create(device, device->transfer_queue_index());
+		return ptr;
+	}
+	
 	void CommandBuffer::create(const std::shared_ptr<Device>& device) {
+		create(device, device->compute_queue_index());
+	}
+
+	void CommandBuffer::create(const std::shared_ptr<Device>& device, uint32_t queue_family) {
 		_device = device;
-		_buf = create_command_buffer(_device->logical_device(), _device->command_pool());
+		_queue_family = queue_family;
+		_pool = _device->command_pool(_queue_family);
+		_buf = create_command_buffer(_device->logical_device(), _pool);
 		_default_signal = Semaphore::make(_device);
 	}
 
 	void CommandBuffer::begin() {
 		_desc_sets.clear();
+		auto pool = _device->command_pool(_queue_family);
+		if (pool != _pool) {
+			// made on another thread (nodes init on workers), move it to a pool this thread owns
+			_device->free_command_buffer(_pool, _buf);
+			_pool = pool;
+			_buf = create_command_buffer(_device->logical_device(), _pool);
+			update_debug_name();
+		}
 		begin_command_buffer(_buf);
 	}
 
@@ -193,7 +227,8 @@ namespace vkd {
 
 	void CommandBuffer::flush() {
 		_flush_on_destruct = false;
-		submit_immediate_command_buffer(_device->logical_device(), _device->compute_queue(), _buf);
+		auto queue = (_queue_family == _device->compute_queue_index()) ? _device->compute_queue() : _device->transfer_queue();
+		submit_immediate_command_buffer(_device->logical_device(), queue, _buf);
 	}
 
 	void CommandBuffer::submit(const SemaphorePtr& wait, const SemaphorePtr& signal, Fence * fence) {
@@ -202,13 +237,18 @@ namespace vkd {
 		submit_compute_buffer(*_device, _buf, wait, _last_submitted_signal, fence);
 	}
 
-	void CommandBuffer::submit_timeline(TimelineSemaphorePtr& signal) {
-		submit_timeline(*signal);
+	void CommandBuffer::submit_timeline(TimelineSemaphorePtr& signal, const TimelineWait& also) {
+		submit_timeline(*signal, also);
+	}
+
+	void CommandBuffer::submit_timeline(TimelineSemaphore& signal, const TimelineWait& also) {
+		_flush_on_destruct = false;
+		_last_timeline_value = submit_compute_buffer_timeline(*_device, _buf, signal, also);
 	}
 
-	void CommandBuffer::submit_timeline(TimelineSemaphore& signal) {
+	void CommandBuffer::submit_transfer_timeline(TimelineSemaphore& signal, const TimelineWait& also) {
 		_flush_on_destruct = false;
-		submit_compute_buffer_timeline(*_device, _buf, signal);
+		_last_timeline_value = submit_transfer_buffer_timeline(*_device, _buf, signal, also);
 	}
 
     void CommandBuffer::update_debug_name() {
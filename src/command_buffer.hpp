@@ -3,6 +3,7 @@
 #include "vulkan.hpp"
 #include "fence.hpp"
 #include "semaphore.hpp"
+#include "vkd_dll.h"
 
 namespace vkd {
 	class Kernel;
@@ -26,13 +27,21 @@ namespace vkd {
 	void submit_compute_buffer(Device& device, VkCommandBuffer buf, std::nullptr_t, std::nullptr_t, const Fence * fence = nullptr);
 	void submit_compute_buffer(Device& device, VkCommandBuffer buf, const SemaphorePtr& wait = nullptr, const SemaphorePtr& signal = nullptr, const Fence * fence = nullptr);
 
-	void submit_compute_buffer_timeline(VkQueue queue, VkCommandBuffer buf, VkPipelineStageFlags wait_stage_mask, TimelineSemaphore& semaphore);
-	void submit_compute_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphore& semaphore);
-	void submit_compute_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphorePtr& semaphore);
+	// a second timeline for a submit to wait on, the other queue's
+	struct TimelineWait {
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		uint64_t value = 0;
+	};
+
+	// these return the value the submit will signal
+	uint64_t submit_compute_buffer_timeline(VkQueue queue, VkCommandBuffer buf, VkPipelineStageFlags wait_stage_mask, TimelineSemaphore& semaphore, const TimelineWait& also = {});
+	uint64_t submit_compute_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphore& semaphore, const TimelineWait& also = {});
+	uint64_t submit_compute_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphorePtr& semaphore, const TimelineWait& also = {});
+	uint64_t submit_transfer_buffer_timeline(Device& device, VkCommandBuffer buf, TimelineSemaphore& semaphore, const TimelineWait& also = {});
 
 	class CommandBuffer;
 	using CommandBufferPtr = std::unique_ptr<CommandBuffer>;
-	class CommandBuffer {
+	class VKDEXPORT CommandBuffer {
 	public:
 		CommandBuffer() = default;
 		~CommandBuffer();
@@ -40,9 +49,12 @@ namespace vkd {
 		CommandBuffer(const CommandBuffer&) = delete;
 
 		void create(const std::shared_ptr<Device>& device);
+		void create(const std::shared_ptr<Device>& device, uint32_t queue_family);
 
 		static CommandBufferPtr make(const std::shared_ptr<Device>& device);
 		static CommandBufferPtr make_immediate(const std::shared_ptr<Device>& device);
+		// for the device's transfer queue, submit through Stream::submit_transfer
+		static CommandBufferPtr make_transfer(const std::shared_ptr<Device>& device);
 
 		class ScopedRecord {
 		public:
@@ -69,10 +81,13 @@ namespace vkd {
 		void flush();
 
 		void submit(const SemaphorePtr& wait = nullptr, const SemaphorePtr& signal = nullptr, Fence * fence = nullptr);
-		void submit_timeline(TimelineSemaphorePtr& signal);
-		void submit_timeline(TimelineSemaphore& signal);
+		void submit_timeline(TimelineSemaphorePtr& signal, const TimelineWait& also = {});
+		void submit_timeline(TimelineSemaphore& signal, const TimelineWait& also = {});
+		void submit_transfer_timeline(TimelineSemaphore& signal, const TimelineWait& also = {});
 
 		const SemaphorePtr& signal() const { return _last_submitted_signal; }
+		// what the last timeline submit signals, anything reusing this buffer's resources waits on it
+		uint64_t last_timeline_value() const { return _last_timeline_value; }
 
 		auto get() const { return _buf; }
 
@@ -84,9 +99,12 @@ namespace vkd {
 		void update_debug_name();
 		std::string _debug_name = "Anonymous Command Buffer";
 		std::shared_ptr<Device> _device = nullptr;
+		uint32_t _queue_family = 0;
+		VkCommandPool _pool = VK_NULL_HANDLE;
 		VkCommandBuffer _buf = VK_NULL_HANDLE;
 		SemaphorePtr _default_signal = VK_NULL_HANDLE;
 		SemaphorePtr _last_submitted_signal = nullptr;
+		uint64_t _last_timeline_value = 0;
 
 		std::vector<std::shared_ptr<DescriptorSet>> _desc_sets;
 
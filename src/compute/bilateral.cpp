@@ -1,4 +1,5 @@
 #include "bilateral.hpp"
+#include <algorithm>
 #include <random>
 #include "command_buffer.hpp"
 #include "device.hpp"
@@ -63,16 +64,42 @@ namespace vkd {
             }
         }
 
-        if (update) {
-            command_buffer().begin();
-            _blur->dispatch(command_buffer(), _size.x, _size.y);
-            command_buffer().end();
+        bool extent = take_extent_change();
+        if (update || extent) {
+            _record();
         }
 
-        return update;
+        return update || extent;
+    }
+
+    void Bilateral::_record() {
+        _blur->clear_push_overrides();
+        if (proxy_scale() > 1) {
+            // sigma_s is per pixel squared, so it grows as pixels get bigger
+            float sigma_s = _blur->get_param_by_name("sigma_s")->as<float>().get() * proxy_scale();
+            int half_window = std::max(_blur->get_param_by_name("halfWindow")->as<int>().get() / proxy_scale(), 1);
+            _blur->override_push_arg("sigma_s", sigma_s);
+            _blur->override_push_arg("halfWindow", half_window);
+        }
+
+        auto r = dispatch_region(_size);
+        _recorded_generation = _image_node->get_output_image()->generation();
+        command_buffer().begin();
+        _blur->set_offset(r.x, r.y);
+        _blur->dispatch(command_buffer(), r.z - r.x, r.w - r.y);
+        command_buffer().end();
+    }
+
+    glm::ivec4 Bilateral::input_region(const glm::ivec4& region) const {
+        int32_t reach = _blur ? _blur->get_param_by_name("halfWindow")->as<int>().get() : 0;
+        return region + glm::ivec4{-reach, -reach, reach, reach};
     }
 
     void Bilateral::execute(ExecutionType type, Stream& stream) {
+        if (_image_node->get_output_image()->generation() != _recorded_generation) {
+            // the input was spilled or freed since, its image and view are new
+            _record();
+        }
         stream.submit(command_buffer());
     }
 }
\ No newline at end of file
@@ -67,10 +67,16 @@ namespace vkd {
 
     void Crop::execute(ExecutionType type, Stream& stream) {
 
-        auto crop = _crop_margin->as<glm::ivec4>().get();
+        auto crop = _crop_margin->as<glm::ivec4>().get() / proxy_scale();
+        // only as much of the crop as the region covers
+        auto r = dispatch_region(_size);
+        crop = {std::max(crop.x, r.x), std::max(crop.y, r.y), std::min(crop.z, r.z), std::min(crop.w, r.w)};
 
         if (crop.z - crop.x > 0 && crop.w - crop.y > 0) {
 
+            _crop->clear_push_overrides();
+            _crop->override_push_arg("_crop_offset", glm::ivec2{crop.x, crop.y});
+
             command_buffer().begin();
             _crop->dispatch(command_buffer(), crop.z - crop.x, crop.w - crop.y);
             command_buffer().end();
@@ -57,7 +57,7 @@ void main()
         _size = {0, 0};
         
         _recompile = make_param<ParameterType::p_bool>(*this, "recompile", 0, {"button"});
-        _custom_kernel = make_param<std::string>(*this, "kernel", 0, {"code"});
+        _custom_kernel = make_param<std::string>(*this, "kernel", 0, {"code", "init"});
         _custom_kernel->as<std::string>().set_default(R"src(vec4 CustomMain(vec4 inp) {
     vec4 weights = vec4(0.2126, 0.7152, 0.0722, 0.0);
     float luma = dot(weights, inp);
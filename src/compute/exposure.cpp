@@ -65,8 +65,10 @@ namespace vkd {
     }
 
     void Exposure::execute(ExecutionType type, Stream& stream) {
+        auto r = dispatch_region(_size);
+        _exposure->set_offset(r.x, r.y);
         command_buffer().begin();
-        _exposure->dispatch(command_buffer(), _size.x, _size.y);
+        _exposure->dispatch(command_buffer(), r.z - r.x, r.w - r.y);
         command_buffer().end();
         stream.submit(command_buffer());
     }
@@ -159,6 +159,7 @@ namespace vkd {
         command_buffer().end();
 
         stream.submit(command_buffer());
+        _downloader->readback(command_buffer(), stream);
         stream.flush();
 
         std::shared_ptr<AVFrame> avFrame(av_frame_alloc(), [](AVFrame* a){ av_frame_free(&a); });
@@ -169,7 +170,11 @@ namespace vkd {
         static int64_t pts = 0;
         avFrame->pts = pts++;
         
-        av_image_fill_arrays(avFrame->data, avFrame->linesize, (const uint8_t *)_downloader->get_main(), AV_PIX_FMT_YUV420P, _size.x, _size.y, 1);
+        for (int32_t i = 0; i < _downloader->video_plane_count(); ++i) {
+            auto&& plane = _downloader->video_planes()[i];
+            avFrame->data[i] = (uint8_t *)_downloader->get_main() + plane.offset;
+            avFrame->linesize[i] = (int)plane.stride;
+        }
 
         int ret = avcodec_send_frame(_enc_codec_context, avFrame.get());
         if (ret < 0) {
@@ -268,7 +273,7 @@ namespace vkd {
         }
 
         command_buffer().begin();
-        _uploader->commands(command_buffer());
+        _uploader->commands(command_buffer(), stream);
         _ocio_in->execute(command_buffer(), _size.x, _size.y);
         command_buffer().end();
 
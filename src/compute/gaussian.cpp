@@ -1,4 +1,5 @@
 #include "gaussian.hpp"
+#include <algorithm>
 #include <random>
 #include "command_buffer.hpp"
 #include "device.hpp"
@@ -79,17 +80,52 @@ namespace vkd {
             }
         }
 
-        if (update) {
-            command_buffer().begin();
-            _horiz->dispatch(command_buffer(), _size.x, _size.y);
-            _vert->dispatch(command_buffer(), _size.x, _size.y);
-            command_buffer().end();
+        bool extent = take_extent_change();
+        if (update || extent) {
+            _record();
         }
 
-        return update;
+        return update || extent;
+    }
+
+    void Gaussian::_record() {
+        int half_window = _horiz->get_param_by_name("half_window")->as<int>().get();
+        _horiz->clear_push_overrides();
+        _vert->clear_push_overrides();
+        if (proxy_scale() > 1) {
+            // both are in pixels, which are bigger at proxy scale
+            float sigma = _horiz->get_param_by_name("sigma")->as<float>().get() / proxy_scale();
+            half_window = std::max(half_window / proxy_scale(), 1);
+            for (auto&& kernel : {_horiz, _vert}) {
+                kernel->override_push_arg("sigma", sigma);
+                kernel->override_push_arg("half_window", half_window);
+            }
+        }
+
+        // the vertical pass reads the stage half a window above and below the region
+        auto r = dispatch_region(_size);
+        int32_t stage_top = std::max(r.y - half_window, 0);
+        int32_t stage_bottom = std::min(r.w + half_window, (int32_t)proxy_size(_size).y);
+
+        _recorded_generation = _image_node->get_output_image()->generation();
+        command_buffer().begin();
+        _horiz->set_offset(r.x, stage_top);
+        _horiz->dispatch(command_buffer(), r.z - r.x, stage_bottom - stage_top);
+        _vert->set_offset(r.x, r.y);
+        _vert->dispatch(command_buffer(), r.z - r.x, r.w - r.y);
+        command_buffer().end();
+    }
+
+    glm::ivec4 Gaussian::input_region(const glm::ivec4& region) const {
+        int32_t reach = _horiz ? _horiz->get_param_by_name("half_window")->as<int>().get() : 0;
+        return region + glm::ivec4{-reach, -reach, reach, reach};
     }
 
     void Gaussian::execute(ExecutionType type, Stream& stream) {
+        if (_image_node->get_output_image()->generation() != _recorded_generation) {
+            // the input was spilled or freed since, its image and view are new
+            _record();
+        }
         stream.submit(command_buffer());
     }
 }
\ No newline at end of file
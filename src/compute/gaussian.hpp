@@ -37,11 +37,16 @@ namespace vkd {
         bool update(ExecutionType type) override;
         void commands(VkCommandBuffer buf, uint32_t width, uint32_t height) override {}
         void execute(ExecutionType type, Stream& stream) override;
+        bool supports_proxy() const override { return true; }
+        bool supports_region() const override { return true; }
+        glm::ivec4 input_region(const glm::ivec4& region) const override;
 
         
         std::shared_ptr<Image> get_output_image() const override { return _image; }
         float get_output_ratio() const override { return _size[0] / (float)_size[1]; }
     private:
+        void _record();
+
         std::shared_ptr<ImageNode> _image_node = nullptr;
         std::shared_ptr<Kernel> _horiz = nullptr;
         std::shared_ptr<Kernel> _vert = nullptr;
@@ -51,6 +56,8 @@ namespace vkd {
         
 
         glm::uvec2 _size;
+        // of the input image the command buffer was recorded against
+        uint64_t _recorded_generation = 0;
 
     };
 }
\ No newline at end of file
@@ -218,6 +218,10 @@ namespace vkd {
                 set_push_arg(buf, *param.second);
             //}
         }
+        for (auto&& over : _push_overrides) {
+            auto&& param = *_params.at(over.first);
+            vkCmdPushConstants(buf, _full_pipeline.pipeline->layout()->get(), VK_SHADER_STAGE_COMPUTE_BIT, (uint32_t)param.offset(), (uint32_t)over.second.size(), over.second.data());
+        }
 
         debug_print(_shader->path(), trim_x*local_group_sizes_[0], trim_y*local_group_sizes_[1], trim_z*local_group_sizes_[2]);
         _push_execution_offset(buf, {0,0,0,0});
@@ -4,6 +4,7 @@
 #include <map>
 #include <array>
 #include <vector>
+#include <cstring>
 
 #include "vulkan.hpp"
 #include "shader.hpp"
@@ -99,6 +100,20 @@ namespace vkd {
             vkCmdPushConstants(buf, _full_pipeline.pipeline->layout()->get(), VK_SHADER_STAGE_COMPUTE_BIT, (uint32_t)offset, (uint32_t)size, data);
         }
 
+        // pushed over the named param at dispatch without touching the param itself, so
+        // proxy evaluation can shrink sizes the ui still shows at full
+        template<typename T>
+        void override_push_arg(const std::string& name, T val) {
+            auto search = _params.find(name);
+            if (search == _params.end() || search->second->size() != sizeof(T)) {
+                return;
+            }
+            std::vector<uint8_t> bytes(sizeof(T));
+            memcpy(bytes.data(), &val, sizeof(T));
+            _push_overrides[name] = std::move(bytes);
+        }
+        void clear_push_overrides() { _push_overrides.clear(); }
+
         void set_arg(int32_t index, std::shared_ptr<Buffer> buffer);
         void set_arg(int32_t index, std::shared_ptr<Image> buffer);
 
@@ -168,5 +183,6 @@ namespace vkd {
         
         std::map<std::string, std::shared_ptr<ParameterInterface>> _params;
         std::map<std::string, std::shared_ptr<ParameterInterface>> _public_params;
+        std::map<std::string, std::vector<uint8_t>> _push_overrides;
     };
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "median.hpp"
+#include <algorithm>
 #include <random>
 #include "command_buffer.hpp"
 #include "device.hpp"
@@ -12,14 +13,48 @@
 namespace vkd {
     REGISTER_NODE("median", "median", Median);
 
+    namespace {
+        // the shaders fix these, their tiles and histograms are sized by them
+        constexpr std::array<int32_t, 3> network_local_sizes = {16, 16, 1};
+        constexpr std::array<int32_t, 3> histogram_local_sizes = {32, 1, 1};
+        constexpr int32_t max_network_radius = 2;
+        constexpr int32_t histogram_strip = 64;
+
+        int32_t whole_groups(int32_t size, int32_t group) {
+            return (size + group - 1) / group * group;
+        }
+    }
+
+    void Median::post_setup() {
+        _radius_param = make_param<ParameterType::p_int>(param_hash_name(), "radius", 0);
+        _radius_param->as<int>().set_default(1);
+        _radius_param->as<int>().min(1);
+        _radius_param->as<int>().soft_max(32);
+        // histogram counts are 16 bit
+        _radius_param->as<int>().max(127);
+
+        _mode_param = make_param<ParameterType::p_int>(param_hash_name(), "mode", 0, {"enum"});
+        _mode_param->enum_names({"per channel", "luma"});
+        _mode_param->as<int>().min(0);
+        _mode_param->as<int>().max(1);
+        _mode_param->as<int>().set_default((int)Mode::PerChannel);
+
+        _params["_"].emplace(_radius_param->name(), _radius_param);
+        _params["_"].emplace(_mode_param->name(), _mode_param);
+    }
+
     void Median::init() {
         
 
         _size = {0, 0};
         
         _median = std::make_shared<Kernel>(_device, param_hash_name());
-        _median->init("shaders/compute/median.comp.spv", "main", Kernel::default_local_sizes);
+        _median->init("shaders/compute/median.comp.spv", "main", network_local_sizes);
         register_params(*_median);
+
+        _histogram = std::make_shared<Kernel>(_device, param_hash_name());
+        _histogram->init("shaders/compute/median_histogram.comp.spv", "main", histogram_local_sizes);
+        register_params(*_histogram);
         
         
         auto image = _image_node->get_output_image();
@@ -36,9 +71,37 @@ namespace vkd {
 
         _median->set_arg(0, image);
         _median->set_arg(1, _image);
-        
+        _histogram->set_arg(0, image);
+        _histogram->set_arg(1, _image);
+
+        _record();
+    }
+
+    void Median::_record() {
+        int32_t radius = std::clamp(_radius_param->as<int>().get() / proxy_scale(), 1, 127);
+        bool luma = _mode_param->as<int>().get() == (int)Mode::Luma;
+        auto r = dispatch_region(_size);
+        glm::ivec2 size = {r.z - r.x, r.w - r.y};
+
+        _recorded_generation = _image_node->get_output_image()->generation();
         command_buffer().begin();
-        _median->dispatch(command_buffer(), _size.x, _size.y);
+        if (radius <= max_network_radius) {
+            _median->set_push_arg_by_name("_radius", radius);
+            _median->set_push_arg_by_name("_luma", luma ? 1 : 0);
+            _median->set_offset(r.x, r.y);
+            _median->dispatch(command_buffer(), whole_groups(size.x, network_local_sizes[0]), whole_groups(size.y, network_local_sizes[1]));
+        } else {
+            _histogram->set_push_arg_by_name("_radius", radius);
+            _histogram->set_push_arg_by_name("_strip", histogram_strip);
+            int32_t strips = (size.y + histogram_strip - 1) / histogram_strip;
+            // a pass a channel, each reads back what the last wrote
+            std::vector<int32_t> channels = luma ? std::vector<int32_t>{3} : std::vector<int32_t>{0, 1, 2};
+            _histogram->set_offset(r.x, r.y);
+            for (auto channel : channels) {
+                _histogram->set_push_arg_by_name("_channel", channel);
+                _histogram->dispatch(command_buffer(), whole_groups(size.x, histogram_local_sizes[0]), strips);
+            }
+        }
         command_buffer().end();
     }
 
@@ -53,16 +116,24 @@ namespace vkd {
             }
         }
 
-        if (update) {
-            command_buffer().begin();
-            _median->dispatch(command_buffer(), _size.x, _size.y);
-            command_buffer().end();
+        bool extent = take_extent_change();
+        if (update || extent) {
+            _record();
         }
 
-        return update;
+        return update || extent;
+    }
+
+    glm::ivec4 Median::input_region(const glm::ivec4& region) const {
+        int32_t reach = _radius_param ? _radius_param->as<int>().get() : 0;
+        return region + glm::ivec4{-reach, -reach, reach, reach};
     }
 
     void Median::execute(ExecutionType type, Stream& stream) {
+        if (_image_node->get_output_image()->generation() != _recorded_generation) {
+            // the input was spilled or freed since, its image and view are new
+            _record();
+        }
         stream.submit(command_buffer());
     }
 }
\ No newline at end of file
@@ -30,27 +30,37 @@ namespace vkd {
         }
         std::shared_ptr<EngineNode> clone() const override { return std::make_shared<Median>(); }
 
+        void post_setup() override;
         void init() override;
         
         bool update(ExecutionType type) override;
         void commands(VkCommandBuffer buf, uint32_t width, uint32_t height) override {}
         void execute(ExecutionType type, Stream& stream) override;
+        bool supports_proxy() const override { return true; }
+        bool supports_region() const override { return true; }
+        glm::ivec4 input_region(const glm::ivec4& region) const override;
 
         std::shared_ptr<Image> get_output_image() const override { return _image; }
         float get_output_ratio() const override { return _size[0] / (float)_size[1]; }
+
+        enum class Mode {
+            PerChannel,
+            Luma
+        };
     private:
-        void _check_param_sanity();
+        void _record();
         
         std::shared_ptr<ImageNode> _image_node = nullptr;
+        // sorting networks up to 5x5, running histograms past that
         std::shared_ptr<Kernel> _median = nullptr;
+        std::shared_ptr<Kernel> _histogram = nullptr;
         std::shared_ptr<Image> _image = nullptr;
 
-        
-
         glm::uvec2 _size;
+        // of the input image the command buffer was recorded against
+        uint64_t _recorded_generation = 0;
         
-        std::shared_ptr<ParameterInterface> _sat_param = nullptr;
-    private:
-
+        std::shared_ptr<ParameterInterface> _radius_param = nullptr;
+        std::shared_ptr<ParameterInterface> _mode_param = nullptr;
     };
 }
\ No newline at end of file
@@ -63,14 +63,17 @@ namespace vkd {
     }
 
     void Merge::execute(ExecutionType type, Stream& stream) {
+        auto r = dispatch_region(_size);
+        _blank->set_offset(r.x, r.y);
+        _merge->set_offset(r.x, r.y);
         _command_buffer->begin();
-        _blank->dispatch(*_command_buffer.get(), _size.x, _size.y);
+        _blank->dispatch(*_command_buffer.get(), r.z - r.x, r.w - r.y);
 
         for (auto&& i : _inputs) {
             _merge->set_arg(0, _image);
             _merge->set_arg(1, i->get_output_image());
 
-            _merge->dispatch(*_command_buffer.get(), _size.x, _size.y);
+            _merge->dispatch(*_command_buffer.get(), r.z - r.x, r.w - r.y);
         }
         _command_buffer->end();
         stream.submit(_command_buffer);
@@ -40,6 +40,8 @@ namespace vkd {
         bool update(ExecutionType type) override;
         void commands(VkCommandBuffer buf, uint32_t width, uint32_t height) override {}
         void execute(ExecutionType type, Stream& stream) override;
+        bool supports_proxy() const override { return true; }
+        bool supports_region() const override { return true; }
 
         
         std::shared_ptr<Image> get_output_image() const override { return _image; }
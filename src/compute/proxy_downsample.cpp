@@ -0,0 +1,38 @@
+#include "proxy_downsample.hpp"
+
+#include "command_buffer.hpp"
+#include "image.hpp"
+#include "kernel.hpp"
+
+namespace vkd {
+    void ProxyDownsample::commands(VkCommandBuffer buf, const std::shared_ptr<Image>& image, int32_t scale) {
+        if (scale <= 1 || !image || !image->allocated()) {
+            return;
+        }
+
+        auto dim = image->dim();
+        glm::ivec2 size = (dim + scale - 1) / scale;
+        if (!_scratch || _scratch->dim() != size) {
+            _scratch = Image::float_image(_device, size);
+            _scratch->debug_name("Proxy Scratch");
+            auto immediate = CommandBuffer::make_immediate(_device);
+            _scratch->allocate(immediate->get());
+        }
+        if (!_downsample) {
+            _downsample = std::make_shared<Kernel>(_device, "____proxy");
+            _downsample->init("shaders/compute/proxy_downsample.comp.spv", "main", Kernel::default_local_sizes);
+            _place = std::make_shared<Kernel>(_device, "____proxy");
+            _place->init("shaders/compute/proxy_place.comp.spv", "main", Kernel::default_local_sizes);
+        }
+
+        _downsample->set_arg(0, image);
+        _downsample->set_arg(1, _scratch);
+        _downsample->set_push_arg_by_name("_scale", scale);
+        // over the whole image, the source isn't read again until its consumers run
+        _place->set_arg(0, _scratch);
+        _place->set_arg(1, image);
+
+        _downsample->dispatch(buf, size.x, size.y);
+        _place->dispatch(buf, dim.x, dim.y);
+    }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+
+#include <vulkan/vulkan.h>
+
+namespace vkd {
+    class Device;
+    class Image;
+    class Kernel;
+
+    // box filters an image into its own top left by scale for proxy evaluation, and repeats the
+    // proxy's last row and column over the rest, as filters that clamp to the edge would read them.
+    // record while the buffer it went into last time has finished, as re-recording that needs anyway
+    class ProxyDownsample {
+    public:
+        ProxyDownsample(const std::shared_ptr<Device>& device) : _device(device) {}
+        ~ProxyDownsample() = default;
+        ProxyDownsample(ProxyDownsample&&) = delete;
+        ProxyDownsample(const ProxyDownsample&) = delete;
+
+        // nothing at scale 1 or if image isn't allocated
+        void commands(VkCommandBuffer buf, const std::shared_ptr<Image>& image, int32_t scale);
+
+    private:
+        std::shared_ptr<Device> _device = nullptr;
+        std::shared_ptr<Image> _scratch = nullptr;
+        std::shared_ptr<Kernel> _downsample = nullptr;
+        std::shared_ptr<Kernel> _place = nullptr;
+    };
+}
@@ -25,6 +25,8 @@ namespace vkd {
         _mode->as<int>().set_default((int)Mode::None);
         _mode->as<int>().min((int)Mode::None);
         _mode->as<int>().max((int)Mode::Max - 1);
+        // turning by 90 swaps the output's size, which is only set here
+        _mode->tag("init");
 
         
         auto image = _image_node->get_output_image();
@@ -62,9 +64,34 @@ namespace vkd {
         return update;
     }
 
+    glm::ivec4 Rotate::input_region(const glm::ivec4& r) const {
+        // the same mapping as rotate.comp, a region's corners through it
+        glm::ivec2 in = _image_node->get_output_image()->dim();
+        switch ((Mode)_mode->as<int>().get()) {
+            case Mode::Clockwise90:
+                return {r.y, r.x, r.w, r.z};
+            case Mode::Full180:
+                return {in.x - r.z, in.y - r.w, in.x - r.x, in.y - r.y};
+            case Mode::AntiClockwise90:
+                return {in.y - r.w, in.x - r.z, in.y - r.y, in.x - r.x};
+            case Mode::FlipHoriz:
+                return {in.x - r.z, r.y, in.x - r.x, r.w};
+            case Mode::FlipVert:
+                return {r.x, in.y - r.w, r.z, in.y - r.y};
+            default:
+                return r;
+        }
+    }
+
     void Rotate::execute(ExecutionType type, Stream& stream) {
+        // flips mirror about the proxy's edge, not the image's
+        auto r = dispatch_region(_size);
+        auto in_size = proxy_size(_image_node->get_output_image()->dim());
+        _rotate->set_push_arg_by_name("_extent", in_size);
+        _rotate->set_offset(r.x, r.y);
+
         command_buffer().begin();
-        _rotate->dispatch(command_buffer(), _size.x, _size.y);
+        _rotate->dispatch(command_buffer(), r.z - r.x, r.w - r.y);
         command_buffer().end();
         stream.submit(command_buffer());
     }
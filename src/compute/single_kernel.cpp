@@ -61,8 +61,9 @@ namespace vkd {
     void SingleKernel::execute(ExecutionType type, Stream& stream) {
         {
             auto scope = _command_buffer->record();
-            auto sz = kernel_dim();
-            _kernel->dispatch(*_command_buffer, sz.x, sz.y);
+            auto r = dispatch_region(kernel_dim());
+            _kernel->set_offset(r.x, r.y);
+            _kernel->dispatch(*_command_buffer, r.z - r.x, r.w - r.y);
         }
         stream.submit(_command_buffer);
     }
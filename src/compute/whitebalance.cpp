@@ -80,8 +80,10 @@ namespace vkd {
     }
 
     void WhiteBalance::execute(ExecutionType type, Stream& stream) {
+        auto r = dispatch_region(_size);
+        _whitebalance->set_offset(r.x, r.y);
         command_buffer().begin();
-        _whitebalance->dispatch(command_buffer(), _size.x, _size.y);
+        _whitebalance->dispatch(command_buffer(), r.z - r.x, r.w - r.y);
         command_buffer().end();
 
         stream.submit(command_buffer());
@@ -0,0 +1,434 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "cpu_kernels.hpp"
+#include "simd.hpp"
+#include "host_cache.hpp"
+#include "host_scheduler.hpp"
+#include "graph_exception.hpp"
+
+#if VKD_SIMD_SSE
+// the avx2 paths are picked at runtime, only the functions marked with this are built for it
+#define VKD_CPU_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define VKD_AVX2_TARGET
+#else
+#define VKD_AVX2_TARGET __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+namespace vkd {
+    namespace cpu {
+        using simd::f32x4;
+
+        namespace {
+            const float * pixels(const StaticHostImage& image) { return reinterpret_cast<const float *>(image.data()); }
+            float * pixels(StaticHostImage& image) { return reinterpret_cast<float *>(image.data()); }
+
+            void check(const StaticHostImage& image) {
+                if (image.channels() != 4 || image.element_size() != sizeof(float)) {
+                    throw ImageException("CPU kernels only take rgba float images");
+                }
+            }
+
+            void check(const StaticHostImage& in, const StaticHostImage& out) {
+                check(in);
+                check(out);
+                if (in.dim() != out.dim()) {
+                    throw ImageException("CPU kernel input and output differ in size");
+                }
+            }
+
+            // imageLoad past the edge reads zero
+            f32x4 load(const StaticHostImage& image, int32_t x, int32_t y) {
+                auto dim = image.dim();
+                if (x < 0 || y < 0 || x >= dim.x || y >= dim.y) {
+                    return f32x4(0.0f);
+                }
+                return f32x4::load(pixels(image) + (size_t(y) * dim.x + x) * 4);
+            }
+
+            // the start of row first and the pixels from there to row last
+            const float * rows(const StaticHostImage& image, int32_t first) { return pixels(image) + size_t(first) * image.dim().x * 4; }
+            float * rows(StaticHostImage& image, int32_t first) { return pixels(image) + size_t(first) * image.dim().x * 4; }
+            size_t count(const StaticHostImage& image, int32_t first, int32_t last) { return size_t(last - first) * image.dim().x; }
+
+            // every pixel of in through func, into the same place in out. the first done are
+            // already there
+            template<typename F>
+            void pointwise(const StaticHostImage& in, StaticHostImage& out, int32_t first, int32_t last, F&& func, size_t done = 0) {
+                const float * src = rows(in, first);
+                float * dst = rows(out, first);
+                size_t n = count(in, first, last);
+                for (size_t i = done; i < n; ++i) {
+                    func(f32x4::load(src + i * 4)).store(dst + i * 4);
+                }
+            }
+
+#if VKD_CPU_AVX2
+            bool avx2_supported() {
+#if defined(_MSC_VER) && !defined(__clang__)
+                int info[4];
+                __cpuid(info, 0);
+                if (info[0] < 7) {
+                    return false;
+                }
+                __cpuid(info, 1);
+                bool fma = info[2] & (1 << 12);
+                bool osxsave = info[2] & (1 << 27);
+                bool avx = info[2] & (1 << 28);
+                // and the os saves the ymm registers
+                if (!fma || !osxsave || !avx || (_xgetbv(0) & 6) != 6) {
+                    return false;
+                }
+                __cpuidex(info, 7, 0);
+                return info[1] & (1 << 5);
+#else
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+            }
+            const bool has_avx2 = avx2_supported();
+
+            // two pixels a vector, each returns how many pixels it did and leaves the odd one over.
+            // they only run when has_avx2 is set and call nothing outside this namespace, so none
+            // of the code built for avx2 is shared with the sse2 path. the sums are in the same
+            // order as that path's and nothing is fused, the results are the same to the bit
+            namespace avx2 {
+                VKD_AVX2_TARGET __m256 both(__m128 p) { return _mm256_insertf128_ps(_mm256_castps128_ps256(p), p, 1); }
+                // rgb from p, alpha from a
+                VKD_AVX2_TARGET __m256 with_alpha(__m256 p, __m256 a) { return _mm256_blend_ps(p, a, 0x88); }
+
+                VKD_AVX2_TARGET size_t matrix(const float * src, float * dst, size_t count, __m128 r4, __m128 g4, __m128 b4) {
+                    __m256 r = both(r4);
+                    __m256 g = both(g4);
+                    __m256 b = both(b4);
+                    size_t i = 0;
+                    for (; i + 2 <= count; i += 2) {
+                        __m256 p = _mm256_loadu_ps(src + i * 4);
+                        __m256 sum = _mm256_add_ps(_mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(0, 0, 0, 0)), r), _mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(1, 1, 1, 1)), g));
+                        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_permute_ps(p, _MM_SHUFFLE(2, 2, 2, 2)), b));
+                        _mm256_storeu_ps(dst + i * 4, with_alpha(sum, p));
+                    }
+                    return i;
+                }
+
+                VKD_AVX2_TARGET size_t scale(const float * src, float * dst, size_t count, __m128 scale4) {
+                    __m256 scale = both(scale4);
+                    size_t i = 0;
+                    for (; i + 2 <= count; i += 2) {
+                        _mm256_storeu_ps(dst + i * 4, _mm256_mul_ps(_mm256_loadu_ps(src + i * 4), scale));
+                    }
+                    return i;
+                }
+
+                VKD_AVX2_TARGET size_t invert(const float * src, float * dst, size_t count, __m128 lo4, __m128 scale4) {
+                    __m256 lo = both(lo4);
+                    __m256 scale = both(scale4);
+                    __m256 one = _mm256_set1_ps(1.0f);
+                    size_t i = 0;
+                    for (; i + 2 <= count; i += 2) {
+                        __m256 p = _mm256_loadu_ps(src + i * 4);
+                        __m256 inv = _mm256_sub_ps(one, _mm256_div_ps(_mm256_sub_ps(p, lo), scale));
+                        _mm256_storeu_ps(dst + i * 4, with_alpha(inv, p));
+                    }
+                    return i;
+                }
+
+                VKD_AVX2_TARGET size_t merge(float * final, const float * merge, size_t count) {
+                    __m256 one = _mm256_set1_ps(1.0f);
+                    size_t i = 0;
+                    for (; i + 2 <= count; i += 2) {
+                        __m256 over = _mm256_loadu_ps(merge + i * 4);
+                        __m256 under = _mm256_loadu_ps(final + i * 4);
+                        __m256 alpha = _mm256_permute_ps(over, _MM_SHUFFLE(3, 3, 3, 3));
+                        _mm256_storeu_ps(final + i * 4, _mm256_add_ps(over, _mm256_mul_ps(under, _mm256_sub_ps(one, alpha))));
+                    }
+                    return i;
+                }
+
+                // zero past the edge, as load
+                VKD_AVX2_TARGET __m128 pixel(const float * image, int32_t width, int32_t height, int32_t x, int32_t y) {
+                    if (x < 0 || y < 0 || x >= width || y >= height) {
+                        return _mm_setzero_ps();
+                    }
+                    return _mm_loadu_ps(image + (size_t(y) * width + x) * 4);
+                }
+
+                // one row of a gaussian pass, returns the x it got to
+                VKD_AVX2_TARGET int32_t gaussian(const float * src, int32_t width, int32_t height, float * row, int32_t y, int32_t step_x, int32_t step_y, const float * weights, int32_t half_window, float inv_div) {
+                    int32_t x = 0;
+                    for (; x + 2 <= width; x += 2) {
+                        __m256 sum = _mm256_setzero_ps();
+                        for (int32_t j = -half_window; j < half_window; ++j) {
+                            int32_t sx = x + j * step_x;
+                            int32_t sy = y + j * step_y;
+                            __m256 p;
+                            if (sx >= 0 && sy >= 0 && sx + 1 < width && sy < height) {
+                                p = _mm256_loadu_ps(src + (size_t(sy) * width + sx) * 4);
+                            } else {
+                                p = _mm256_insertf128_ps(_mm256_castps128_ps256(pixel(src, width, height, sx, sy)), pixel(src, width, height, sx + 1, sy), 1);
+                            }
+                            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[j + half_window]), p));
+                        }
+                        _mm256_storeu_ps(row + x * 4, _mm256_mul_ps(sum, _mm256_set1_ps(inv_div)));
+                    }
+                    return x;
+                }
+            }
+#endif
+
+            float lin_to_aces_cct(float x) {
+                const float X_BRK = 0.0078125f;
+                const float A = 10.5402377416545f;
+                const float B = 0.0729055341958355f;
+                if (x <= X_BRK) {
+                    return A * x + B;
+                }
+                return (std::log2(x) + 9.72f) / 17.52f;
+            }
+
+            float aces_cct_to_lin(float x) {
+                const float Y_BRK = 0.155251141552511f;
+                const float A = 10.5402377416545f;
+                const float B = 0.0729055341958355f;
+                if (x > Y_BRK) {
+                    return std::pow(2.0f, x * 17.52f - 9.72f);
+                }
+                return (x - B) / A;
+            }
+
+            std::vector<float> gaussian_weights(float sigma, int32_t half_window) {
+                const float pi = 3.14159265358979f;
+                float mult_fac = 1.0f / std::sqrt(pi * 2.0f * sigma * sigma);
+                float denom = 2.0f * sigma * sigma;
+                std::vector<float> weights;
+                for (int32_t j = -half_window; j < half_window; ++j) {
+                    float jf = float(j);
+                    weights.push_back(mult_fac * std::exp(-(jf * jf / denom)));
+                }
+                return weights;
+            }
+        }
+
+        void Kernels::_rows(int32_t height, const std::function<void(int32_t, int32_t)>& func) {
+            // a few strips a thread so a slow one doesn't hold the rest up
+            int32_t threads = std::max<int32_t>(1, _scheduler.ts().GetNumTaskThreads());
+            int32_t strip = std::max<int32_t>(8, (height + threads * 4 - 1) / (threads * 4));
+            if (strip >= height) {
+                func(0, height);
+                return;
+            }
+
+            std::vector<TaskHandle> tasks;
+            for (int32_t first = 0; first < height; first += strip) {
+                int32_t last = std::min(first + strip, height);
+                tasks.push_back(_scheduler.add("cpu kernel strip", [&func, first, last]() { func(first, last); }));
+            }
+            for (auto&& task : tasks) {
+                _scheduler.wait(task);
+            }
+        }
+
+        void Kernels::exposure(const StaticHostImage& in, StaticHostImage& out, float exposure, float gamma) {
+            check(in, out);
+            f32x4 scale(std::pow(2.0f, exposure));
+            _rows(in.dim().y, [&](int32_t first, int32_t last) {
+                pointwise(in, out, first, last, [&](f32x4 p) {
+                    f32x4 g(std::pow(p[0], gamma), std::pow(p[1], gamma), std::pow(p[2], gamma), p[3]);
+                    return g * scale;
+                });
+            });
+        }
+
+        void Kernels::saturation(const StaticHostImage& in, StaticHostImage& out, float saturation) {
+            check(in, out);
+            float isat = 1.0f - saturation;
+            // columns of the matrix, alpha passes through
+            f32x4 r(isat * 0.2126f + saturation, isat * 0.2126f, isat * 0.2126f, 0.0f);
+            f32x4 g(isat * 0.7152f, isat * 0.7152f + saturation, isat * 0.7152f, 0.0f);
+            f32x4 b(isat * 0.0722f, isat * 0.0722f, isat * 0.0722f + saturation, 0.0f);
+            _rows(in.dim().y, [&](int32_t first, int32_t last) {
+                size_t done = 0;
+#if VKD_CPU_AVX2
+                if (has_avx2) {
+                    done = avx2::matrix(rows(in, first), rows(out, first), count(in, first, last), r.v, g.v, b.v);
+                }
+#endif
+                pointwise(in, out, first, last, [&](f32x4 p) {
+                    return (p.splat<0>() * r + p.splat<1>() * g + p.splat<2>() * b).with_alpha(p);
+                }, done);
+            });
+        }
+
+        void Kernels::whitebalance(const StaticHostImage& in, StaticHostImage& out, glm::vec3 white_balance) {
+            check(in, out);
+            f32x4 scale(1.0f / white_balance.x, 1.0f / white_balance.y, 1.0f / white_balance.z, 1.0f);
+            _rows(in.dim().y, [&](int32_t first, int32_t last) {
+                size_t done = 0;
+#if VKD_CPU_AVX2
+                if (has_avx2) {
+                    done = avx2::scale(rows(in, first), rows(out, first), count(in, first, last), scale.v);
+                }
+#endif
+                pointwise(in, out, first, last, [&](f32x4 p) {
+                    return p * scale;
+                }, done);
+            });
+        }
+
+        void Kernels::cdl(const StaticHostImage& in, StaticHostImage& out, const Cdl& params) {
+            check(in, out);
+            auto slope = glm::max(glm::vec3(params.slope_master) + params.slope, glm::vec3(0.0f));
+            auto offset = glm::vec3(params.offset_master) + params.offset;
+            auto power = glm::max(glm::vec3(params.power_master) + params.power, glm::vec3(0.0f));
+            f32x4 s(slope.x, slope.y, slope.z, 1.0f);
+            f32x4 o(offset.x, offset.y, offset.z, 0.0f);
+            f32x4 sat(params.saturation);
+            f32x4 weights(0.2126f, 0.7152f, 0.0722f, 0.0f);
+            _rows(in.dim().y, [&](int32_t first, int32_t last) {
+                pointwise(in, out, first, last, [&](f32x4 p) {
+                    f32x4 graded = max(p * s + o, f32x4(0.0f));
+                    f32x4 rgb(std::pow(graded[0], power.x), std::pow(graded[1], power.y), std::pow(graded[2], power.z), 0.0f);
+                    f32x4 w = rgb * weights;
+                    f32x4 luma(w[0] + w[1] + w[2]);
+                    return (luma + sat * (rgb - luma)).with_alpha(p);
+                });
+            });
+        }
+
+        void Kernels::invert(const StaticHostImage& in, StaticHostImage& out, glm::vec3 min_point, glm::vec3 max_point) {
+            check(in, out);
+            f32x4 lo(min_point.x, min_point.y, min_point.z, 0.0f);
+            f32x4 scale(max_point.x - min_point.x, max_point.y - min_point.y, max_point.z - min_point.z, 1.0f);
+            _rows(in.dim().y, [&](int32_t first, int32_t last) {
+                size_t done = 0;
+#if VKD_CPU_AVX2
+                if (has_avx2) {
+                    done = avx2::invert(rows(in, first), rows(out, first), count(in, first, last), lo.v, scale.v);
+                }
+#endif
+                pointwise(in, out, first, last, [&](f32x4 p) {
+                    return (f32x4(1.0f) - (p - lo) / scale).with_alpha(p);
+                }, done);
+            });
+        }
+
+        void Kernels::log_image(const StaticHostImage& in, StaticHostImage& out) {
+            check(in, out);
+            _rows(in.dim().y, [&](int32_t first, int32_t last) {
+                pointwise(in, out, first, last, [&](f32x4 p) {
+                    return max(p, f32x4(0.0f)).map(lin_to_aces_cct).with_alpha(p);
+                });
+            });
+        }
+
+        void Kernels::exp_image(const StaticHostImage& in, StaticHostImage& out) {
+            check(in, out);
+            _rows(in.dim().y, [&](int32_t first, int32_t last) {
+                pointwise(in, out, first, last, [&](f32x4 p) {
+                    return p.map(aces_cct_to_lin).with_alpha(p);
+                });
+            });
+        }
+
+        void Kernels::crop(const StaticHostImage& in, StaticHostImage& out, glm::ivec2 offset, glm::ivec2 size) {
+            check(in, out);
+            auto dim = in.dim();
+            glm::ivec2 start = glm::clamp(offset, glm::ivec2(0), dim);
+            glm::ivec2 end = glm::clamp(offset + size, start, dim);
+            _rows(end.y - start.y, [&](int32_t first, int32_t last) {
+                for (int32_t y = start.y + first; y < start.y + last; ++y) {
+                    size_t row = (size_t(y) * dim.x + start.x) * 4;
+                    std::copy_n(pixels(in) + row, size_t(end.x - start.x) * 4, pixels(out) + row);
+                }
+            });
+        }
+
+        void Kernels::rotate(const StaticHostImage& in, StaticHostImage& out, int32_t mode, glm::ivec2 extent) {
+            check(in);
+            check(out);
+            auto dim = out.dim();
+            _rows(dim.y, [&](int32_t first, int32_t last) {
+                for (int32_t y = first; y < last; ++y) {
+                    float * dst = pixels(out) + size_t(y) * dim.x * 4;
+                    for (int32_t x = 0; x < dim.x; ++x) {
+                        glm::ivec2 src = {x, y};
+                        if (mode == 1) {
+                            src = {y, x};
+                        } else if (mode == 2) {
+                            src = {extent.x - x - 1, extent.y - y - 1};
+                        } else if (mode == 3) {
+                            src = {extent.y - y - 1, extent.x - x - 1};
+                        } else if (mode == 4) {
+                            src = {extent.x - x - 1, y};
+                        } else if (mode == 5) {
+                            src = {x, extent.y - y - 1};
+                        }
+                        load(in, src.x, src.y).store(dst + x * 4);
+                    }
+                }
+            });
+        }
+
+        void Kernels::merge(StaticHostImage& final, const StaticHostImage& merge) {
+            check(merge, final);
+            _rows(final.dim().y, [&](int32_t first, int32_t last) {
+                float * dst = rows(final, first);
+                const float * src = rows(merge, first);
+                size_t n = count(final, first, last);
+                size_t i = 0;
+#if VKD_CPU_AVX2
+                if (has_avx2) {
+                    i = avx2::merge(dst, src, n);
+                }
+#endif
+                for (; i < n; ++i) {
+                    f32x4 over = f32x4::load(src + i * 4);
+                    f32x4 under = f32x4::load(dst + i * 4);
+                    (over + under * (f32x4(1.0f) - over.splat<3>())).store(dst + i * 4);
+                }
+            });
+        }
+
+        void Kernels::gaussian(const StaticHostImage& in, StaticHostImage& out, float sigma, int32_t half_window) {
+            check(in, out);
+            auto dim = in.dim();
+            auto weights = gaussian_weights(sigma, half_window);
+            float div = 0.0f;
+            for (auto&& w : weights) {
+                div += w;
+            }
+            f32x4 inv_div(1.0f / div);
+
+            StaticHostImage scratch;
+            scratch.create_image(dim.x, dim.y, 4, sizeof(float));
+
+            auto pass = [&](const StaticHostImage& src, StaticHostImage& dst, glm::ivec2 step) {
+                _rows(dim.y, [&](int32_t first, int32_t last) {
+                    for (int32_t y = first; y < last; ++y) {
+                        float * row = pixels(dst) + size_t(y) * dim.x * 4;
+                        int32_t x = 0;
+#if VKD_CPU_AVX2
+                        if (has_avx2) {
+                            x = avx2::gaussian(pixels(src), dim.x, dim.y, row, y, step.x, step.y, weights.data(), half_window, 1.0f / div);
+                        }
+#endif
+                        for (; x < dim.x; ++x) {
+                            f32x4 sum(0.0f);
+                            for (int32_t j = -half_window; j < half_window; ++j) {
+                                sum = sum + f32x4(weights[j + half_window]) * load(src, x + j * step.x, y + j * step.y);
+                            }
+                            (sum * inv_div).store(row + x * 4);
+                        }
+                    }
+                });
+            };
+            pass(in, scratch, {1, 0});
+            pass(scratch, out, {0, 1});
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include <glm/glm.hpp>
+
+#include "vkd_dll.h"
+
+namespace vkd {
+    class HostScheduler;
+    class StaticHostImage;
+
+    namespace cpu {
+        // the compute shaders for the pointwise and separable nodes, on host images. rgba float
+        // only, as the graph's images are. rows are split into strips across the host scheduler
+        // and every call waits for its strips, so the results are in out when it returns.
+        // the maths follows the .comp files line for line; pow, exp and log2 go through the c
+        // library a lane at a time, so agreement with the device is to float tolerance
+        // where the cpu has avx2 the kernels that never take a lane out do two pixels a vector.
+        // HostGraph runs whole graphs of these
+        class VKDEXPORT Kernels {
+        public:
+            Kernels(HostScheduler& scheduler) : _scheduler(scheduler) {}
+            ~Kernels() = default;
+            Kernels(Kernels&&) = delete;
+            Kernels(const Kernels&) = delete;
+
+            // as the cdl push constants
+            struct Cdl {
+                glm::vec3 slope = {0.0f, 0.0f, 0.0f};
+                float slope_master = 1.0f;
+                glm::vec3 offset = {0.0f, 0.0f, 0.0f};
+                float offset_master = 0.0f;
+                glm::vec3 power = {0.0f, 0.0f, 0.0f};
+                float power_master = 1.0f;
+                float saturation = 1.0f;
+            };
+
+            // in and out are the same size for all but rotate
+            void exposure(const StaticHostImage& in, StaticHostImage& out, float exposure, float gamma);
+            void saturation(const StaticHostImage& in, StaticHostImage& out, float saturation);
+            void whitebalance(const StaticHostImage& in, StaticHostImage& out, glm::vec3 white_balance);
+            void cdl(const StaticHostImage& in, StaticHostImage& out, const Cdl& params);
+            void invert(const StaticHostImage& in, StaticHostImage& out, glm::vec3 min_point, glm::vec3 max_point);
+            // lin to acescct and back
+            void log_image(const StaticHostImage& in, StaticHostImage& out);
+            void exp_image(const StaticHostImage& in, StaticHostImage& out);
+            // copies the region across, the rest of out is left alone
+            void crop(const StaticHostImage& in, StaticHostImage& out, glm::ivec2 offset, glm::ivec2 size);
+            // mode as Rotate::Mode, extent is the valid region of in
+            void rotate(const StaticHostImage& in, StaticHostImage& out, int32_t mode, glm::ivec2 extent);
+            // over, onto final
+            void merge(StaticHostImage& final, const StaticHostImage& merge);
+            // horizontal then vertical through a scratch image, edges read as zero
+            void gaussian(const StaticHostImage& in, StaticHostImage& out, float sigma, int32_t half_window);
+
+        private:
+            // func(first, last) for every strip of rows, last exclusive
+            void _rows(int32_t height, const std::function<void(int32_t, int32_t)>& func);
+
+            HostScheduler& _scheduler;
+        };
+    }
+}
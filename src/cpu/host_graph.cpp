@@ -0,0 +1,189 @@
+#include <set>
+
+#include <glm/gtc/packing.hpp>
+
+#include "host_graph.hpp"
+#include "host_cache.hpp"
+#include "parameter.hpp"
+#include "graph_exception.hpp"
+#include "graph/fake_node.hpp"
+#include "inputs/exr.hpp"
+#include "compute/rotate.hpp"
+
+namespace vkd {
+    namespace cpu {
+        namespace {
+            // the first param called name in any of the node's maps, fallback if none has that type
+            template<typename T>
+            T param(const FakeNode& node, const std::string& name, const T& fallback) {
+                for (auto&& map : node.params()) {
+                    auto search = map.second.find(name);
+                    if (search == map.second.end()) {
+                        continue;
+                    }
+                    if (auto typed = dynamic_cast<const Parameter<T> *>(search->second.get())) {
+                        return typed->get();
+                    }
+                }
+                return fallback;
+            }
+
+            std::unique_ptr<StaticHostImage> make_image(glm::ivec2 dim) {
+                return StaticHostImage::make(dim.x, dim.y, 4, sizeof(float));
+            }
+
+            const StaticHostImage& input(const std::vector<StaticHostImage *>& inputs, size_t i) {
+                if (i >= inputs.size() || !inputs[i]) {
+                    throw GraphException("Input image not found");
+                }
+                return *inputs[i];
+            }
+        }
+
+        bool HostGraph::supported(const std::string& node_type) {
+            static const std::set<std::string> types = {
+                "exr", "constant", "exposure", "saturation", "whitebalance", "cdl", "invert",
+                "log", "exp", "crop", "rotate", "merge", "gaussian"
+            };
+            return types.find(node_type) != types.end();
+        }
+
+        void HostGraph::build(const GraphBuilder& builder) {
+            _nodes.clear();
+            _by_name.clear();
+            for (auto&& terminal : builder.unbaked_terminals()) {
+                _add(terminal);
+            }
+        }
+
+        HostGraph::Node * HostGraph::_add(const std::shared_ptr<FakeNode>& fake) {
+            auto search = _by_name.find(fake->node_name());
+            if (search != _by_name.end()) {
+                return search->second;
+            }
+            if (!supported(fake->node_type())) {
+                throw GraphException("No host path for " + fake->node_type() + " nodes.");
+            }
+
+            auto node = std::make_unique<Node>();
+            node->fake = fake;
+            for (auto&& in : fake->inputs()) {
+                node->inputs.push_back(_add(in));
+            }
+            _by_name[fake->node_name()] = node.get();
+            _nodes.push_back(std::move(node));
+            return _nodes.back().get();
+        }
+
+        void HostGraph::execute(int64_t frame) {
+            // inputs were added before the nodes reading them
+            for (auto&& node : _nodes) {
+                _run(*node, frame);
+            }
+        }
+
+        const StaticHostImage * HostGraph::output(const FakeNode& node) const {
+            auto search = _by_name.find(node.node_name());
+            if (search == _by_name.end()) {
+                return nullptr;
+            }
+            return search->second->image.get();
+        }
+
+        void HostGraph::_run(Node& node, int64_t frame) {
+            auto& fake = *node.fake;
+            auto type = fake.node_type();
+
+            std::vector<StaticHostImage *> inputs;
+            for (auto&& in : node.inputs) {
+                inputs.push_back(in->image.get());
+            }
+
+            if (type == "exr") {
+                auto path = param<std::string>(fake, "path", "");
+                if (path.size() < 3) {
+                    throw GraphException("No path provided to exr node.");
+                }
+                if (Exr::is_sequence(path)) {
+                    path = Exr::frame_path(path, frame);
+                }
+                auto part = param<int>(fake, "part", 0);
+                auto display = Exr::display_window(path, part);
+                std::vector<uint16_t> half((size_t)display.width() * display.height() * 4);
+                if (!Exr::read_frame(path, part, param<std::string>(fake, "layer", ""), display, half.data())) {
+                    throw GraphException("Error reading EXR file: " + path);
+                }
+                node.image = make_image({display.width(), display.height()});
+                auto dst = reinterpret_cast<float *>(node.image->data());
+                for (size_t i = 0; i < half.size(); ++i) {
+                    dst[i] = glm::unpackHalf1x16(half[i]);
+                }
+                return;
+            }
+
+            if (type == "constant") {
+                auto size = param<glm::ivec2>(fake, "size", {1920, 1080});
+                auto colour = param<glm::vec4>(fake, "colour", glm::vec4(0.0f));
+                node.image = make_image(size);
+                auto dst = reinterpret_cast<float *>(node.image->data());
+                for (size_t i = 0; i < (size_t)size.x * size.y; ++i) {
+                    dst[i * 4 + 0] = colour.x;
+                    dst[i * 4 + 1] = colour.y;
+                    dst[i * 4 + 2] = colour.z;
+                    dst[i * 4 + 3] = colour.w;
+                }
+                return;
+            }
+
+            auto& in = input(inputs, 0);
+            if (type == "rotate") {
+                auto mode = param<int>(fake, "mode", (int)Rotate::Mode::None);
+                bool turned = mode == (int)Rotate::Mode::Clockwise90 || mode == (int)Rotate::Mode::AntiClockwise90;
+                node.image = make_image(turned ? glm::ivec2{in.dim().y, in.dim().x} : in.dim());
+                _kernels.rotate(in, *node.image, mode, in.dim());
+                return;
+            }
+
+            node.image = make_image(in.dim());
+            auto& out = *node.image;
+            if (type == "exposure") {
+                _kernels.exposure(in, out, param<float>(fake, "exposure", 0.0f), param<float>(fake, "gamma", 1.0f));
+            } else if (type == "saturation") {
+                _kernels.saturation(in, out, param<float>(fake, "saturation", 1.0f));
+            } else if (type == "whitebalance") {
+                _kernels.whitebalance(in, out, glm::vec3(param<glm::vec4>(fake, "white_balance", glm::vec4(1.0f))));
+            } else if (type == "cdl") {
+                Kernels::Cdl cdl;
+                cdl.slope = glm::vec3(param<glm::vec4>(fake, "slope", glm::vec4(1.0f)));
+                cdl.slope_master = param<float>(fake, "slope_master", 0.0f);
+                cdl.offset = glm::vec3(param<glm::vec4>(fake, "offset", glm::vec4(0.0f)));
+                cdl.offset_master = param<float>(fake, "offset_master", 0.0f);
+                cdl.power = glm::vec3(param<glm::vec4>(fake, "power", glm::vec4(1.0f)));
+                cdl.power_master = param<float>(fake, "power_master", 0.0f);
+                cdl.saturation = param<float>(fake, "saturation", 1.0f);
+                _kernels.cdl(in, out, cdl);
+            } else if (type == "invert") {
+                glm::vec3 min_point, max_point;
+                const char * channels[] = {"r", "g", "b"};
+                for (int i = 0; i < 3; ++i) {
+                    min_point[i] = param<float>(fake, std::string(channels[i]) + "_min_point", 0.0f);
+                    max_point[i] = param<float>(fake, std::string(channels[i]) + "_max_point", 1.0f);
+                }
+                _kernels.invert(in, out, min_point, max_point);
+            } else if (type == "log") {
+                _kernels.log_image(in, out);
+            } else if (type == "exp") {
+                _kernels.exp_image(in, out);
+            } else if (type == "crop") {
+                auto crop = param<glm::ivec4>(fake, "crop", {0, 0, in.dim().x - 1, in.dim().y - 1});
+                _kernels.crop(in, out, {crop.x, crop.y}, {crop.z - crop.x, crop.w - crop.y});
+            } else if (type == "merge") {
+                for (size_t i = 0; i < inputs.size(); ++i) {
+                    _kernels.merge(out, input(inputs, i));
+                }
+            } else if (type == "gaussian") {
+                _kernels.gaussian(in, out, param<float>(fake, "sigma", 0.2f), param<int>(fake, "half_window", 5));
+            }
+        }
+    }
+}
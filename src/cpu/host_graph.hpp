@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "cpu_kernels.hpp"
+#include "vkd_dll.h"
+
+namespace vkd {
+    class FakeNode;
+    class GraphBuilder;
+    class HostScheduler;
+    class StaticHostImage;
+
+    namespace cpu {
+        // a graph run on host images through Kernels, no device needed. takes the nodes Kernels
+        // covers, with exr and constant as sources; build throws GraphException on anything else.
+        // params are read off the fake nodes by name, the ones never set take the defaults the
+        // nodes' inits give them. exrs come in as stored, there's no ocio on this path
+        class VKDEXPORT HostGraph {
+        public:
+            HostGraph(HostScheduler& scheduler) : _kernels(scheduler) {}
+            ~HostGraph() = default;
+            HostGraph(HostGraph&&) = delete;
+            HostGraph(const HostGraph&) = delete;
+
+            static bool supported(const std::string& node_type);
+
+            // everything upstream of the builder's terminals, inputs first
+            void build(const GraphBuilder& builder);
+            // frame is the file number for exr sequences
+            void execute(int64_t frame = 0);
+
+            // null if the node isn't in the graph or hasn't run yet
+            const StaticHostImage * output(const FakeNode& node) const;
+
+        private:
+            struct Node {
+                std::shared_ptr<FakeNode> fake = nullptr;
+                std::vector<Node *> inputs;
+                std::unique_ptr<StaticHostImage> image = nullptr;
+            };
+
+            Node * _add(const std::shared_ptr<FakeNode>& fake);
+            void _run(Node& node, int64_t frame);
+
+            Kernels _kernels;
+            std::vector<std::unique_ptr<Node>> _nodes;
+            std::map<std::string, Node *> _by_name;
+        };
+    }
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VKD_SIMD_SSE 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define VKD_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace vkd {
+    namespace simd {
+        // four floats, one rgba pixel. sse2 or neon where there is one, plain floats otherwise.
+        // only what the cpu kernels need, anything transcendental goes a lane at a time
+        struct f32x4 {
+#if VKD_SIMD_SSE
+            __m128 v;
+            f32x4() : v(_mm_setzero_ps()) {}
+            f32x4(__m128 v) : v(v) {}
+            f32x4(float s) : v(_mm_set1_ps(s)) {}
+            f32x4(float x, float y, float z, float w) : v(_mm_setr_ps(x, y, z, w)) {}
+            static f32x4 load(const float * p) { return _mm_loadu_ps(p); }
+            void store(float * p) const { _mm_storeu_ps(p, v); }
+            float operator[](int i) const { alignas(16) float f[4]; _mm_store_ps(f, v); return f[i]; }
+            friend f32x4 operator+(f32x4 a, f32x4 b) { return _mm_add_ps(a.v, b.v); }
+            friend f32x4 operator-(f32x4 a, f32x4 b) { return _mm_sub_ps(a.v, b.v); }
+            friend f32x4 operator*(f32x4 a, f32x4 b) { return _mm_mul_ps(a.v, b.v); }
+            friend f32x4 operator/(f32x4 a, f32x4 b) { return _mm_div_ps(a.v, b.v); }
+            friend f32x4 min(f32x4 a, f32x4 b) { return _mm_min_ps(a.v, b.v); }
+            friend f32x4 max(f32x4 a, f32x4 b) { return _mm_max_ps(a.v, b.v); }
+            template<int i> f32x4 splat() const { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i)); }
+            // rgb from this, alpha from a
+            f32x4 with_alpha(f32x4 a) const {
+                const __m128 rgb = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+                return _mm_or_ps(_mm_and_ps(rgb, v), _mm_andnot_ps(rgb, a.v));
+            }
+#elif VKD_SIMD_NEON
+            float32x4_t v;
+            f32x4() : v(vdupq_n_f32(0.0f)) {}
+            f32x4(float32x4_t v) : v(v) {}
+            f32x4(float s) : v(vdupq_n_f32(s)) {}
+            f32x4(float x, float y, float z, float w) { alignas(16) float f[4] = {x, y, z, w}; v = vld1q_f32(f); }
+            static f32x4 load(const float * p) { return vld1q_f32(p); }
+            void store(float * p) const { vst1q_f32(p, v); }
+            float operator[](int i) const { alignas(16) float f[4]; vst1q_f32(f, v); return f[i]; }
+            friend f32x4 operator+(f32x4 a, f32x4 b) { return vaddq_f32(a.v, b.v); }
+            friend f32x4 operator-(f32x4 a, f32x4 b) { return vsubq_f32(a.v, b.v); }
+            friend f32x4 operator*(f32x4 a, f32x4 b) { return vmulq_f32(a.v, b.v); }
+            friend f32x4 operator/(f32x4 a, f32x4 b) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+                return vdivq_f32(a.v, b.v);
+#else
+                return f32x4(a[0] / b[0], a[1] / b[1], a[2] / b[2], a[3] / b[3]);
+#endif
+            }
+            friend f32x4 min(f32x4 a, f32x4 b) { return vminq_f32(a.v, b.v); }
+            friend f32x4 max(f32x4 a, f32x4 b) { return vmaxq_f32(a.v, b.v); }
+            template<int i> f32x4 splat() const { return vdupq_n_f32(vgetq_lane_f32(v, i)); }
+            f32x4 with_alpha(f32x4 a) const { return vsetq_lane_f32(vgetq_lane_f32(a.v, 3), v, 3); }
+#else
+            float v[4];
+            f32x4() : v{0.0f, 0.0f, 0.0f, 0.0f} {}
+            f32x4(float s) : v{s, s, s, s} {}
+            f32x4(float x, float y, float z, float w) : v{x, y, z, w} {}
+            static f32x4 load(const float * p) { return f32x4(p[0], p[1], p[2], p[3]); }
+            void store(float * p) const { p[0] = v[0]; p[1] = v[1]; p[2] = v[2]; p[3] = v[3]; }
+            float operator[](int i) const { return v[i]; }
+            friend f32x4 operator+(f32x4 a, f32x4 b) { return f32x4(a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]); }
+            friend f32x4 operator-(f32x4 a, f32x4 b) { return f32x4(a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]); }
+            friend f32x4 operator*(f32x4 a, f32x4 b) { return f32x4(a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]); }
+            friend f32x4 operator/(f32x4 a, f32x4 b) { return f32x4(a.v[0] / b.v[0], a.v[1] / b.v[1], a.v[2] / b.v[2], a.v[3] / b.v[3]); }
+            friend f32x4 min(f32x4 a, f32x4 b) { return f32x4(std::fmin(a.v[0], b.v[0]), std::fmin(a.v[1], b.v[1]), std::fmin(a.v[2], b.v[2]), std::fmin(a.v[3], b.v[3])); }
+            friend f32x4 max(f32x4 a, f32x4 b) { return f32x4(std::fmax(a.v[0], b.v[0]), std::fmax(a.v[1], b.v[1]), std::fmax(a.v[2], b.v[2]), std::fmax(a.v[3], b.v[3])); }
+            template<int i> f32x4 splat() const { return f32x4(v[i]); }
+            f32x4 with_alpha(f32x4 a) const { return f32x4(v[0], v[1], v[2], a.v[3]); }
+#endif
+            // a lane at a time
+            template<typename F>
+            f32x4 map(F&& func) const { return f32x4(func((*this)[0]), func((*this)[1]), func((*this)[2]), func((*this)[3])); }
+        };
+
+        inline f32x4 clamp(f32x4 x, f32x4 lo, f32x4 hi) { return min(max(x, lo), hi); }
+    }
+}
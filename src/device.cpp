@@ -6,22 +6,40 @@
 #include "vulkan/vulkan_beta.h"
 #endif
 #include <algorithm>
+#include <cstdlib>
+#include <optional>
 
 #include "memory/memory_pool.hpp"
+#include "memory/residency.hpp"
 
 namespace vkd {
+    namespace {
+        std::mutex queue_registry_mutex;
+        std::map<VkQueue, std::mutex *> queue_registry;
+    }
     
-    Device::Device(std::shared_ptr<Instance> instance) : _instance(instance), _host_cache(std::make_unique<HostCache>()), _memory_manager(std::make_unique<MemoryManager>()), _memory_pool(std::make_unique<MemoryPool>(*this)) {}
+    Device::Device(std::shared_ptr<Instance> instance) : _instance(instance), _host_cache(std::make_unique<HostCache>()), _memory_manager(std::make_unique<MemoryManager>()), _memory_pool(std::make_unique<MemoryPool>(*this)), _residency(std::make_unique<Residency>(*this)) {}
 
     Device::~Device() {
         _host_cache = nullptr;
+        _residency = nullptr;
         _memory_pool = nullptr; // has to be before mem mgr
         _memory_manager = nullptr;
 
+        {
+            std::scoped_lock lock(queue_registry_mutex);
+            queue_registry.erase(_queue);
+            queue_registry.erase(_transfer_queue);
+        }
         _queue = VK_NULL_HANDLE;
+        _transfer_queue = VK_NULL_HANDLE;
         
-        vkResetCommandPool(_logical_device, _command_pool, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
-        vkDestroyCommandPool(_logical_device, _command_pool, nullptr);
+        for (auto&& pool : _command_pools) {
+            vkResetCommandPool(_logical_device, pool.second, VK_COMMAND_POOL_RESET_RELEASE_RESOURCES_BIT);
+            vkDestroyCommandPool(_logical_device, pool.second, nullptr);
+        }
+        _command_pools.clear();
+        _deferred_frees.clear();
         vkDestroyDevice(_logical_device, nullptr);
 
         _instance = nullptr;
@@ -31,21 +49,31 @@ namespace vkd {
         _physical_device = physical_device;
 
         ext_vkGetPhysicalDeviceFeatures2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(_instance->instance(), "vkGetPhysicalDeviceFeatures2KHR"));
+        ext_vkGetPhysicalDeviceMemoryProperties2KHR = reinterpret_cast<PFN_vkGetPhysicalDeviceMemoryProperties2KHR>(vkGetInstanceProcAddr(_instance->instance(), "vkGetPhysicalDeviceMemoryProperties2KHR"));
 
         populate_physical_device_props(physical_device);
 
-		const float defaultQueuePriority = 0.0f;
+		const float defaultQueuePriority[2] = {0.0f, 0.0f};
+
+        uint32_t transfer_queue = 0;
+        pick_transfer_queue(_transfer_queue_index, transfer_queue);
 
         std::vector<VkDeviceQueueCreateInfo> queue_create_infos;
         VkDeviceQueueCreateInfo queue_create_info = {};
         memset(&queue_create_info, 0, sizeof(VkDeviceQueueCreateInfo));
         queue_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-        queue_create_info.queueFamilyIndex = 0; // only one queue family itt touch wood
-        queue_create_info.queueCount = 1;
-        queue_create_info.pQueuePriorities = &defaultQueuePriority;
+        queue_create_info.queueFamilyIndex = _queue_index; // only one queue family itt touch wood
+        queue_create_info.queueCount = (_transfer_queue_index == _queue_index) ? transfer_queue + 1 : 1;
+        queue_create_info.pQueuePriorities = defaultQueuePriority;
 
         queue_create_infos.push_back(queue_create_info);
 
+        if (_transfer_queue_index != _queue_index) {
+            queue_create_info.queueFamilyIndex = _transfer_queue_index;
+            queue_create_info.queueCount = 1;
+            queue_create_infos.push_back(queue_create_info);
+        }
+
 		VkDeviceCreateInfo device_create_info = {};
 		device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 		device_create_info.queueCreateInfoCount = (uint32_t)queue_create_infos.size();
@@ -83,6 +111,11 @@ namespace vkd {
 		// If the device will be used for presenting to a display via a swapchain we need to request the swapchain extension
 		_device_extensions_enabled.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
 		_device_extensions_enabled.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        // the pool trims to real heap budgets where it can, optional
+        if (ext_vkGetPhysicalDeviceMemoryProperties2KHR && std::find(_device_supported_extensions.begin(), _device_supported_extensions.end(), VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) != _device_supported_extensions.end()) {
+            _device_extensions_enabled.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+            _memory_budget = true;
+        }
 
 #ifdef __APPLE__
 		_device_extensions_enabled.push_back(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME);
@@ -107,9 +140,101 @@ namespace vkd {
 		}
         
         vkGetDeviceQueue(_logical_device, _queue_index, 0, &_queue);
+        vkGetDeviceQueue(_logical_device, _transfer_queue_index, transfer_queue, &_transfer_queue);
+        {
+            std::scoped_lock lock(queue_registry_mutex);
+            queue_registry[_queue] = &_queue_mutex;
+            if (separate_transfer_queue()) {
+                queue_registry[_transfer_queue] = &_transfer_queue_mutex;
+            }
+        }
+
+        if (separate_transfer_queue()) {
+            console << "Using queue family " << _transfer_queue_index << " for transfers." << std::endl;
+        }
+
+        command_pool(); // the creating thread's
+    }
+
+    void Device::pick_transfer_queue(uint32_t& family, uint32_t& queue) const {
+        family = _queue_index;
+        queue = 0;
+
+        if (std::getenv("VKD_SINGLE_QUEUE")) {
+            return;
+        }
+
+        // a dma only family is what actually runs alongside compute, failing that any other
+        // family that can copy, failing that a second queue from our own
+        constexpr VkQueueFlags busy = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+        std::optional<uint32_t> dedicated, other;
+        for (uint32_t i = 0; i < (uint32_t)_logicalDeviceQueueFamilyProps.size(); ++i) {
+            auto&& props = _logicalDeviceQueueFamilyProps[i];
+            if (i == _queue_index || props.queueCount == 0 || !(props.queueFlags & (VK_QUEUE_TRANSFER_BIT | busy))) {
+                continue;
+            }
+            if (!dedicated && (props.queueFlags & VK_QUEUE_TRANSFER_BIT) && !(props.queueFlags & busy)) {
+                dedicated = i;
+            } else if (!other) {
+                other = i; // graphics and compute queues can always transfer
+            }
+        }
+
+        if (dedicated) {
+            family = *dedicated;
+        } else if (other) {
+            family = *other;
+        } else if (_logicalDeviceQueueFamilyProps.size() > _queue_index && _logicalDeviceQueueFamilyProps[_queue_index].queueCount > 1) {
+            queue = 1;
+        }
+    }
+
+    VkCommandPool Device::command_pool(uint32_t queue_family) {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> frees;
+        {
+            std::scoped_lock lock(_command_pool_mutex);
+            auto id = std::make_pair(std::this_thread::get_id(), queue_family);
+            auto search = _command_pools.find(id);
+            if (search == _command_pools.end()) {
+                pool = create_command_pool(queue_family);
+                _command_pools.emplace(id, pool);
+            } else {
+                pool = search->second;
+            }
+
+            auto deferred = _deferred_frees.find(pool);
+            if (deferred != _deferred_frees.end()) {
+                frees.swap(deferred->second);
+            }
+        }
+
+        if (frees.size()) {
+            vkFreeCommandBuffers(_logical_device, pool, (uint32_t)frees.size(), frees.data());
+        }
+        return pool;
+    }
 
-        _command_pool = create_command_pool(queue_index());
+    void Device::free_command_buffer(VkCommandPool pool, VkCommandBuffer buf) {
+        {
+            std::scoped_lock lock(_command_pool_mutex);
+            auto id = std::this_thread::get_id();
+            auto search = std::find_if(_command_pools.begin(), _command_pools.end(), [&](auto&& entry) { return entry.second == pool; });
+            if (search == _command_pools.end() || search->first.first != id) {
+                _deferred_frees[pool].push_back(buf);
+                return;
+            }
+        }
+        vkFreeCommandBuffers(_logical_device, pool, 1, &buf);
+    }
 
+    std::mutex& Device::mutex_for_queue(VkQueue queue) {
+        std::scoped_lock lock(queue_registry_mutex);
+        auto search = queue_registry.find(queue);
+        if (search == queue_registry.end()) {
+            throw std::runtime_error("Queue submitted to without a device.");
+        }
+        return *search->second;
     }
 
     VkCommandPool Device::create_command_pool(uint32_t queue_index) {
@@ -159,6 +284,34 @@ namespace vkd {
         */
     }
 
+    std::vector<Device::HeapBudget> Device::memory_budgets() const {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget;
+        memset(&budget, 0, sizeof(VkPhysicalDeviceMemoryBudgetPropertiesEXT));
+        budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        if (_memory_budget) {
+            VkPhysicalDeviceMemoryProperties2 props;
+            memset(&props, 0, sizeof(VkPhysicalDeviceMemoryProperties2));
+            props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            props.pNext = &budget;
+            ext_vkGetPhysicalDeviceMemoryProperties2KHR(_physical_device, &props);
+        }
+
+        std::vector<HeapBudget> heaps(_memory_properties.memoryHeapCount);
+        for (uint32_t i = 0; i < _memory_properties.memoryHeapCount; ++i) {
+            auto&& heap = _memory_properties.memoryHeaps[i];
+            heaps[i].size = heap.size;
+            heaps[i].device_local = (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+            if (_memory_budget) {
+                heaps[i].budget = budget.heapBudget[i];
+                heaps[i].usage = budget.heapUsage[i];
+            } else {
+                // other processes and the driver have some of it, assume a fifth
+                heaps[i].budget = heap.size / 5 * 4;
+            }
+        }
+        return heaps;
+    }
+
     void Device::set_debug_utils_object_name(const std::string& name, VkObjectType type, uint64_t object) {
         VkDebugUtilsObjectNameInfoEXT object_name_info;
         memset(&object_name_info, 0, sizeof(VkDebugUtilsObjectNameInfoEXT));
@@ -1,7 +1,10 @@
 #pragma once
 #include <vector>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include "vulkan/vulkan.h"
 
 #include "instance.hpp"
@@ -13,6 +16,7 @@ namespace vkd {
     class HostCache;
     class MemoryManager;
     class MemoryPool;
+    class Residency;
     class VKDEXPORT Device {
     public:
         Device(std::shared_ptr<Instance> instance);
@@ -32,7 +36,21 @@ namespace vkd {
         auto& queue_mutex() { return _queue_mutex; }
         auto compute_queue() const { return _queue; }
         auto compute_queue_index() const { return _queue_index; }
-        auto command_pool() { return _command_pool; }
+        // copies go here so they can overlap compute. same as the compute queue on devices with only the one
+        auto transfer_queue() const { return _transfer_queue; }
+        auto transfer_queue_index() const { return _transfer_queue_index; }
+        auto& transfer_queue_mutex() { return _transfer_queue_mutex; }
+        bool separate_transfer_queue() const { return _transfer_queue != _queue; }
+        // buffers handed between the two need queue family ownership transfers
+        bool transfer_ownership() const { return _transfer_queue_index != _queue_index; }
+
+        // vulkan pools aren't thread safe, so each thread records into its own
+        VkCommandPool command_pool() { return command_pool(_queue_index); }
+        VkCommandPool command_pool(uint32_t queue_family);
+        // frees straight away on the pool's own thread, otherwise leaves it for that thread to pick up
+        void free_command_buffer(VkCommandPool pool, VkCommandBuffer buf);
+        // for the helpers which are only handed a VkQueue
+        static std::mutex& mutex_for_queue(VkQueue queue);
 
         const auto& queue_family_props() const { return _logicalDeviceQueueFamilyProps; }
         const auto& device_extension_props() const { return _device_extension_props; }
@@ -40,6 +58,17 @@ namespace vkd {
         const auto& device_extensions_enabled() const { return _device_extensions_enabled; }
         const auto& memory_properties() const { return _memory_properties; }
 
+        // what the driver says this process can use and is using on each heap. without
+        // VK_EXT_memory_budget the budget's a guess from the heap size and usage is left at 0
+        struct HeapBudget {
+            VkDeviceSize size = 0;
+            VkDeviceSize budget = 0;
+            VkDeviceSize usage = 0;
+            bool device_local = false;
+        };
+        std::vector<HeapBudget> memory_budgets() const;
+        bool has_memory_budget() const { return _memory_budget; }
+
         const auto& features() const { return _physical_features.features; }
         const auto& ext_8bit_features() const { return _8bit_features; }
         const auto& ext_16bit_features() const { return _16bit_features; }
@@ -47,17 +76,24 @@ namespace vkd {
         auto& host_cache() { return *_host_cache; }
         auto& memory_manager() { return *_memory_manager; }
         auto& pool() { return *_memory_pool; }
+        auto& residency() { return *_residency; }
 
         void set_debug_utils_object_name(const std::string& name, VkObjectType type, uint64_t object);
     private:
         void populate_physical_device_props(VkPhysicalDevice device);
+        void pick_transfer_queue(uint32_t& family, uint32_t& queue) const;
         std::shared_ptr<Instance> _instance = nullptr;
         VkPhysicalDevice _physical_device = VK_NULL_HANDLE;
         VkDevice _logical_device = VK_NULL_HANDLE;
         static constexpr uint32_t _queue_index = 0;
         std::mutex _queue_mutex;
         VkQueue _queue = VK_NULL_HANDLE;
-        VkCommandPool _command_pool = VK_NULL_HANDLE;
+        uint32_t _transfer_queue_index = 0;
+        std::mutex _transfer_queue_mutex;
+        VkQueue _transfer_queue = VK_NULL_HANDLE;
+        std::mutex _command_pool_mutex;
+        std::map<std::pair<std::thread::id, uint32_t>, VkCommandPool> _command_pools;
+        std::map<VkCommandPool, std::vector<VkCommandBuffer>> _deferred_frees;
 
         std::vector<VkQueueFamilyProperties> _logicalDeviceQueueFamilyProps;
         std::vector<VkExtensionProperties> _device_extension_props;
@@ -65,14 +101,17 @@ namespace vkd {
         std::vector<std::string> _device_supported_extensions;
 
         VkPhysicalDeviceMemoryProperties _memory_properties;
+        bool _memory_budget = false;
         VkPhysicalDeviceFeatures2 _physical_features;
         VkPhysicalDevice8BitStorageFeaturesKHR _8bit_features;
         VkPhysicalDevice16BitStorageFeatures _16bit_features;
 
         PFN_vkGetPhysicalDeviceFeatures2KHR ext_vkGetPhysicalDeviceFeatures2KHR = nullptr;
+        PFN_vkGetPhysicalDeviceMemoryProperties2KHR ext_vkGetPhysicalDeviceMemoryProperties2KHR = nullptr;
 
         std::unique_ptr<HostCache> _host_cache; // these three are not default initialised to nullptr to avoid
         std::unique_ptr<MemoryManager> _memory_manager; // compile issue on
         std::unique_ptr<MemoryPool> _memory_pool; // clang
+        std::unique_ptr<Residency> _residency;
     };
 }
\ No newline at end of file
@@ -48,6 +48,26 @@ namespace vkd {
         }
     }
     
+    std::string EngineNode::init_signature() const {
+        std::string signature;
+        for (auto&& param_map : _params) {
+            for (auto&& param : param_map.second) {
+                auto&& tags = param.second->tags();
+                if (tags.find("filepath") == tags.end() && tags.find("init") == tags.end()) {
+                    continue;
+                }
+                signature += param_map.first + "/" + param.first + "=";
+                if (param.second->type() == ParameterType::p_string) {
+                    signature += param.second->as<std::string>().get();
+                } else {
+                    signature.append((const char *)param.second->data(), param.second->size());
+                }
+                signature += ";";
+            }
+        }
+        return signature;
+    }
+
     void EngineNode::set_state(UINodeState state) {
         auto ptr = _fake_node.lock();
         if (ptr) {
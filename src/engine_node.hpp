@@ -108,8 +108,19 @@ namespace vkd {
         virtual void ui() {};
         virtual void finish() {};
 
+        // from the ui thread, only once initialising() has gone false
         virtual bool working() const { return false; }
 
+        // the filepath and init tagged params as init() saw them, a rebake keeps the node while these match
+        std::string init_signature() const;
+        void mark_initialised() { _initialised_with = init_signature(); }
+        // the next rebake runs init() again whatever the signature says
+        void mark_uninitialised() { _initialised_with = std::nullopt; }
+        const auto& initialised_with() const { return _initialised_with; }
+        // set while init() is queued or running on a worker
+        bool initialising() const { return _initialising.load(std::memory_order_acquire); }
+        void initialising(bool initialising) { _initialising.store(initialising, std::memory_order_release); }
+
         void set_device(std::shared_ptr<Device> device) { _device = device; }
         void set_renderpass(std::shared_ptr<Renderpass> renderpass) { _renderpass = renderpass; }
         void set_pipeline_cache(std::shared_ptr<PipelineCache> pipeline_cache) { _pipeline_cache = pipeline_cache; }
@@ -162,6 +173,43 @@ namespace vkd {
         virtual void deallocate() {}
 
         virtual std::optional<BlockEditParams> block_edit_params() const { return std::nullopt; }
+
+        // proxy evaluation: at scale s images keep their size but nodes only compute the top
+        // left 1/s of them, with spatial params shrunk to match. the graph downsamples sources into it
+        virtual bool supports_proxy() const { return false; }
+        // sources that shrink themselves before their colour transform, the graph leaves them be
+        virtual bool proxies_itself() const { return false; }
+        int32_t proxy_scale() const { return _proxy_scale; }
+        void proxy_scale(int32_t scale) { _proxy_scale = scale; }
+        template<typename T>
+        T proxy_size(T full) const { return (full + T(_proxy_scale - 1)) / T(_proxy_scale); }
+
+        // region of interest: the part of the output the graph wants this run, x0, y0, x1, y1 in
+        // full resolution pixels. nullopt is all of it
+        virtual bool supports_region() const { return false; }
+        const auto& region() const { return _region; }
+        void region(const std::optional<glm::ivec4>& region) { _region = region; }
+        // the part of the input needed to make region of the output, widened by any filter footprint
+        virtual glm::ivec4 input_region(const glm::ivec4& region) const { return region; }
+        // what to dispatch over an output of full size, in proxied pixels and clamped to it
+        glm::ivec4 dispatch_region(glm::ivec2 full) const {
+            auto size = proxy_size(full);
+            if (!_region) {
+                return {0, 0, size.x, size.y};
+            }
+            auto r = *_region;
+            glm::ivec2 lo = glm::clamp(glm::ivec2{r.x, r.y} / _proxy_scale, glm::ivec2{0}, size);
+            glm::ivec2 hi = glm::clamp((glm::ivec2{r.z, r.w} + _proxy_scale - 1) / _proxy_scale, lo, size);
+            return {lo.x, lo.y, hi.x, hi.y};
+        }
+
+        // true once after the scale or region moves, for nodes that record in update
+        bool take_extent_change() {
+            bool changed = _proxy_scale != _recorded_proxy_scale || _region != _recorded_region;
+            _recorded_proxy_scale = _proxy_scale;
+            _recorded_region = _region;
+            return changed;
+        }
     protected:
         std::shared_ptr<Device> _device = nullptr;
         std::shared_ptr<Renderpass> _renderpass = nullptr;
@@ -183,10 +231,17 @@ namespace vkd {
 
         size_t _output_count = 0;
 
+        int32_t _proxy_scale = 1;
+        int32_t _recorded_proxy_scale = 1;
+        std::optional<glm::ivec4> _region;
+        std::optional<glm::ivec4> _recorded_region;
+
         const int64_t _hash = _next_hash++;
         static std::atomic_int64_t _next_hash;
 
         std::optional<CommandBufferPtr> _compute_command_buffer;
+        std::optional<std::string> _initialised_with;
+        std::atomic<bool> _initialising = false;
     };
 }
 
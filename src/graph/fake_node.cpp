@@ -1,6 +1,9 @@
 #include "fake_node.hpp"
 #include "graph.hpp"
 #include "compute/image_node.hpp"
+#include "trace.hpp"
+
+#include <functional>
 
 namespace vkd {
     void FakeNode::flush() {
@@ -37,14 +40,69 @@ namespace vkd {
         return ret;
     }
 
+    bool GraphBuilder::_needs_init(const FakeNode& fake_node) {
+        auto real_node = fake_node.real_node();
+        if (!real_node || !real_node->initialised_with() || fake_node.get_state() != UINodeState::normal) {
+            return true;
+        }
+        if (*real_node->initialised_with() != real_node->init_signature()) {
+            return true;
+        }
+
+        auto&& previous = real_node->graph_inputs();
+        if (previous.size() != fake_node.inputs().size()) {
+            return true;
+        }
+        for (size_t i = 0; i < previous.size(); ++i) {
+            if (!previous[i] || previous[i]->fake_node() != fake_node.inputs()[i]) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     std::unique_ptr<Graph> GraphBuilder::bake(const std::shared_ptr<Device>& device) {
+        VKD_TRACE("GraphBuilder::bake");
+        auto graph = bake_async(device);
+        if (graph) {
+            graph->wait_init();
+        }
+        return finish_bake(std::move(graph));
+    }
+
+    std::unique_ptr<Graph> GraphBuilder::bake_async(const std::shared_ptr<Device>& device) {
+        VKD_TRACE("GraphBuilder::bake_async");
         auto graph = std::make_unique<Graph>(device);
         bool failed_any = false;
+
+        // a node is only rebuilt if it or something upstream of it changed, downstream nodes
+        // grab their inputs' images in init so anything below a rebuilt node goes too
+        std::map<FakeNode *, bool> rebuild;
+        std::function<bool(const FakeNodePtr&)> needs_rebuild = [&](const FakeNodePtr& fake_node) {
+            auto search = rebuild.find(fake_node.get());
+            if (search != rebuild.end()) {
+                return search->second;
+            }
+            rebuild[fake_node.get()] = true;
+            bool result = _needs_init(*fake_node);
+            for (auto&& input : fake_node->inputs()) {
+                result = needs_rebuild(input) || result;
+            }
+            rebuild[fake_node.get()] = result;
+            return result;
+        };
+        for (auto&& fake_node : _nodes) {
+            needs_rebuild(fake_node);
+        }
+
         try {
             for (auto&& fake_node : _nodes) {
                 try {
                     fake_node->set_state(UINodeState::normal);
-                    auto real_node = vkd::make(fake_node->node_type(), fake_node->node_name());
+                    auto real_node = fake_node->real_node();
+                    if (rebuild[fake_node.get()]) {
+                        real_node = vkd::make(fake_node->node_type(), fake_node->node_name());
+                    }
                 
                     if (real_node) {
                         fake_node->real_node(real_node);
@@ -68,7 +126,10 @@ namespace vkd {
             for (auto&& fake_node : _nodes) {
                 try {
                     auto real_node = fake_node->real_node();
-                    if (real_node) {
+                    if (real_node && !rebuild[fake_node.get()]) {
+                        // kept as is, only who reads from it can have changed
+                        real_node->output_count(fake_node->outputs().size());
+                    } else if (real_node) {
                         std::vector<std::shared_ptr<vkd::EngineNode>> inputs;
                         for (auto&& input : fake_node->inputs()) {
                             if (input->real_node()) {
@@ -92,11 +153,23 @@ namespace vkd {
             }
 
             graph->sort();
-            graph->init();
+            graph->init_async();
 
         } catch (GraphException&) {
             graph = nullptr;
         }
+
+        return graph;
+    }
+
+    std::unique_ptr<Graph> GraphBuilder::finish_bake(std::unique_ptr<Graph> graph) {
+        if (graph) {
+            try {
+                graph->finish_init();
+            } catch (GraphException&) {
+                graph = nullptr;
+            }
+        }
         
         // still do this in case the errors are resolvable through configuration
         for (auto&& fake_node : _nodes) {
@@ -8,6 +8,7 @@
 
 #include "vulkan.hpp"
 #include "engine_node.hpp"
+#include "vkd_dll.h"
 
 namespace vkd {
     struct Frame;
@@ -16,7 +17,7 @@ namespace vkd {
     class FakeNode;
     using FakeNodePtr = std::shared_ptr<FakeNode>;
 
-    class FakeNode : public std::enable_shared_from_this<FakeNode> {
+    class VKDEXPORT FakeNode : public std::enable_shared_from_this<FakeNode> {
     public:
         FakeNode(int32_t ui_id, std::string node_name, std::string node_type) 
             : _node_name(std::to_string(ui_id) + "_" + node_name), _node_type(node_type), _ui_id(ui_id) {
@@ -73,7 +74,7 @@ namespace vkd {
             if (search != set.end()) {
                 search->second->as<T>().set_force(value);
             } else {
-                auto param = make_param<T>(node_name(), "path", 0);
+                auto param = make_param<T>(node_name(), name, 0);
                 set[name] = param;
                 param->template as<T>().set_default(value);
             }
@@ -102,7 +103,7 @@ namespace vkd {
         std::string _saved_as;
     };
 
-    class GraphBuilder {
+    class VKDEXPORT GraphBuilder {
     public:
         GraphBuilder() = default;
         ~GraphBuilder() = default;
@@ -114,7 +115,12 @@ namespace vkd {
         std::vector<FakeNodePtr> unbaked_terminals() const;
 
         std::unique_ptr<Graph> bake(const std::shared_ptr<Device>& device);
+        // returns as soon as the nodes are made and their inits queued, hand the graph
+        // to finish_bake once init_complete(). null if the graph couldn't be made
+        std::unique_ptr<Graph> bake_async(const std::shared_ptr<Device>& device);
+        std::unique_ptr<Graph> finish_bake(std::unique_ptr<Graph> graph);
     private:
+        static bool _needs_init(const FakeNode& fake_node);
         std::vector<FakeNodePtr> _nodes;
 
     };
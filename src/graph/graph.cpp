@@ -5,12 +5,24 @@
 #include "stream.hpp"
 #include "command_buffer.hpp"
 #include "memory/memory_pool.hpp"
+#include "memory/residency.hpp"
 #include "fake_node.hpp"
+#include "image.hpp"
+#include "compute/kernel.hpp"
+#include "compute/image_node.hpp"
+#include "compute/proxy_downsample.hpp"
 
 #include "host_scheduler.hpp"
+#include "trace.hpp"
 
 namespace vkd {
 
+    Graph::~Graph() {
+        wait_init();
+        // dealloc tasks hold on to this for the command buffers
+        ts().wait(_dealloc_chain);
+    }
+
     void Graph::add(std::shared_ptr<vkd::EngineNode> node) {
         _nodes.push_back(node);
     }
@@ -36,39 +48,122 @@ namespace vkd {
     }
 
     void Graph::init() {
+        init_async();
+        wait_init();
+        finish_init();
+    }
+
+    void Graph::init_async() {
         if (!_device) {
             throw std::runtime_error("Graph had no device.");
         }
 
+        VKD_TRACE("Graph::init_async");
+        // sorted inputs first, so an input's task is always in here before anything reading it
+        std::map<EngineNode *, TaskHandle> tasks;
         for (auto&& node : _nodes) {
+            if (node->initialised_with() || tasks.find(node.get()) != tasks.end()) {
+                continue; // kept from the last bake, or already seen down another branch
+            }
+
+            std::vector<TaskHandle> deps;
+            for (auto&& input : node->graph_inputs()) {
+                auto search = tasks.find(input.get());
+                if (search != tasks.end()) {
+                    deps.push_back(search->second);
+                }
+            }
+
+            node->initialising(true);
+            _inits_total++;
+            auto task = ts().after(deps, "init", [this, node]() { _init_node(node); }, TaskPriority::High);
+            tasks.emplace(node.get(), task);
+            _init_tasks.push_back(task);
+        }
+    }
+
+    void Graph::_init_node(const std::shared_ptr<EngineNode>& node) {
+        bool skip = false;
+        {
+            std::scoped_lock lock(_init_mutex);
+            skip = _init_error != nullptr;
+        }
+        for (auto&& input : node->graph_inputs()) {
+            if (!input->initialised_with()) {
+                skip = true; // upstream failed, nothing to read from
+            }
+        }
+
+        if (!skip) {
             try {
+                VKD_TRACE("init", node->param_hash_name());
                 node->init();
+                node->mark_initialised();
             } catch (GraphException& e) {
                 console << "Error in graph init: " << e.what() << std::endl;
                 node->set_state(UINodeState::error);
-                throw;
+                std::scoped_lock lock(_init_mutex);
+                if (!_init_error) {
+                    _init_error = std::current_exception();
+                }
+            } catch (std::exception& e) {
+                console << "Error in graph init: " << e.what() << std::endl;
+                std::scoped_lock lock(_init_mutex);
+                if (!_init_error) {
+                    _init_error = std::current_exception();
+                }
             }
         }
-        /* for (auto&& rit = _nodes.rbegin(); rit != _nodes.rend(); rit++) {
-            try {
-                (*rit)->post_init();
-            } catch (GraphException& e) {
-                console << "Error in graph post_init: " << e.what() << std::endl;
-                (*rit)->set_state(UINodeState::error);
-                throw;
+
+        node->initialising(false);
+        _inits_done++;
+    }
+
+    bool Graph::init_complete() const {
+        for (auto&& task : _init_tasks) {
+            if (!ts().is_complete(task)) {
+                return false;
             }
-        } */
+        }
+        return true;
+    }
+
+    void Graph::wait_init() {
+        for (auto&& task : _init_tasks) {
+            ts().wait(task);
+        }
+    }
+
+    void Graph::finish_init() {
+        wait_init();
+        _init_tasks.clear();
+
+        std::exception_ptr error = nullptr;
+        {
+            std::scoped_lock lock(_init_mutex);
+            std::swap(error, _init_error);
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
     }
     
     Graph::GraphUpdate Graph::update(ExecutionType type, const StreamPtr& stream) {
         //stream.flush();
+        VKD_TRACE("Graph::update");
 
         GraphUpdate do_update = GraphUpdate::NoUpdate;
+        _updated_itself = false;
+        _apply_proxy(type, {});
+        _apply_region(type);
         for (auto&& node : _nodes) {
             try {
                 if (node->range_contains(frame())) {
+                    VKD_TRACE("update", node->param_hash_name());
+                    _wait_node(node.get(), *stream);
                     if (node->update(type)) {
                         do_update = GraphUpdate::Updated;
+                        _updated_itself = _updated_itself || !_params_changed(*node);
                     }
                 }
                 node->set_state(UINodeState::normal);
@@ -82,11 +177,19 @@ namespace vkd {
                 break;
             } catch (RebakeException& e) {
                 console << "Graph asked to rebake: " << e.what() << std::endl;
+                // what changed needn't be in its signature, the node asked so it gets init again
+                node->mark_uninitialised();
                 do_update = GraphUpdate::Rebake;
                 break;
             }
         }
 
+        if (do_update == GraphUpdate::Updated && type == ExecutionType::UI) {
+            // nodes change without a param moving too, a raw finishing its develop or a new scan.
+            // whatever this run computes is marked valid again after it
+            invalidate_region();
+        }
+
         ParameterCache::reset_changed();
         return do_update;
     }
@@ -99,7 +202,8 @@ namespace vkd {
         }
     }
 
-    void Graph::execute(ExecutionType type, const StreamPtr& stream, const std::vector<std::shared_ptr<EngineNode>>& extra_nodes) {
+    void Graph::execute(ExecutionType type, const StreamPtr& stream, const std::vector<std::shared_ptr<EngineNode>>& extra_nodes, const std::atomic<bool> * cancel) {
+        VKD_TRACE("Graph::execute");
         
         std::vector<vkd::EngineNode *> _nodes_to_run;
         _nodes_to_run.reserve(_nodes.size() / 2);
@@ -116,11 +220,47 @@ namespace vkd {
         }
 
         std::map<EngineNode *, int> output_counts;
+        int32_t proxy_scale = _apply_proxy(type, extra_nodes);
+
+        bool regional = type == ExecutionType::UI && _region_in_use;
+        for (auto&& node : extra_nodes) {
+            if (node && !node->supports_region()) {
+                regional = false;
+            }
+        }
+        if (!regional && _region_in_use) {
+            // something wants the whole image after update planned a region, record it all again
+            _propagate_region(std::nullopt);
+            for (auto&& node : _nodes) {
+                if (node->range_contains(frame())) {
+                    node->update(type);
+                }
+            }
+            _region_in_use = std::nullopt;
+        }
+        if (regional) {
+            auto r = *_region_in_use;
+            if (r.z <= r.x || r.w <= r.y) {
+                return; // it's all on screen already
+            }
+        }
+        bool drawn = false;
+        for (auto&& node : extra_nodes) {
+            if (node) {
+                node->region(_region_in_use);
+                drawn = drawn || node->supports_region();
+            }
+        }
 
+        size_t ran = 0;
         if (_nodes_to_run.size()) {
-            stream->flush();
             //std::vector<CommandBufferPtr> cmd_buffers;
             for (auto&& node : _nodes_to_run) {
+                if (cancel && cancel->load()) {
+                    break;
+                }
+                VKD_TRACE("execute", node->param_hash_name());
+                _wait_node(node, *stream);
                 auto buf = CommandBuffer::make(_device);
                 {
                     auto scope = buf->record();
@@ -134,50 +274,317 @@ namespace vkd {
                     console << "Node execution failed at " << (node->fake_node() ? node->fake_node()->node_name() : "unknown node") << ": " << e.what() << std::endl;
                 }
 
-                _command_buffers.emplace(buf.get(), std::move(buf));
+                if (proxy_scale > 1 && node->graph_inputs().empty() && !node->proxies_itself()) {
+                    _proxy_source(*node, *stream, proxy_scale);
+                }
+                _node_done[node] = stream->semaphore().value();
+
+                auto buf_ptr = buf.get();
+                {
+                    std::scoped_lock lock(_command_buffer_mutex);
+                    _command_buffers.emplace(buf_ptr, std::move(buf));
+                }
                 
+                // everything this node finished with goes in one task, one slot on the timeline
+                std::vector<std::shared_ptr<EngineNode>> finished_inputs;
                 for (auto&& input : node->graph_inputs()) {
                     output_counts[input.get()]++;
                     if (output_counts[input.get()] >= input->output_count()) {
-                        
-                        auto task = std::make_unique<enki::TaskSet>(1, [this, input, stream, buf = buf.get()](enki::TaskSetPartition range, uint32_t threadnum) mutable {
-                            try {
-                                
-                                if (stream) {
-                                    auto val = stream->semaphore().increment();
-                                    stream->semaphore().wait(val - 1);
-                                    // important to uncomment to resume deallocing things
-                                    if (input) {
-                                        input->deallocate();
-                                    }
-                                    stream->semaphore().signal(val);
-                                    stream->flush();
-                                }
-                                if (buf) {
-                                    release_command_buffer(buf);
-                                }
-
-                            } catch (...) {
-                                console << "Unknown error in deallocation task." << std::endl;
+                        finished_inputs.push_back(input);
+                    }
+                }
+
+                // chained so only one worker is ever parked on the semaphore
+                _dealloc_chain = ts().then(_dealloc_chain, "dealloc", [this, finished_inputs, stream, buf_ptr]() {
+                    try {
+                        if (stream) {
+                            auto val = stream->semaphore().increment();
+                            stream->semaphore().wait(val - 1);
+                            for (auto&& input : finished_inputs) {
+                                input->deallocate();
                             }
-                        });
+                            stream->semaphore().signal(val);
+                            stream->flush();
+                        }
+                        release_command_buffer(buf_ptr);
 
-                        ts().add(std::move(task));
+                    } catch (...) {
+                        console << "Unknown error in deallocation task." << std::endl;
                     }
+                });
+                for (auto&& input : finished_inputs) {
+                    _freeing[input.get()] = _dealloc_chain;
                 }
+                ++ran;
             }
             //for (auto&& task : dealloc_tasks) {
             //    ts().WaitforTask(task.get());
             //}
-            // look into moving tasks
+        }
+
+        bool stopped = ran < _nodes_to_run.size();
+        if (stopped) {
+            // the skipped nodes would have freed their inputs, anything that ran and was waiting on them goes now
+            ts().wait(_dealloc_chain);
             stream->flush();
+            std::set<EngineNode *> waiting;
+            for (size_t i = ran; i < _nodes_to_run.size(); ++i) {
+                for (auto&& input : _nodes_to_run[i]->graph_inputs()) {
+                    waiting.insert(input.get());
+                }
+            }
+            std::set<EngineNode *> freed;
+            for (size_t i = 0; i < ran; ++i) {
+                auto node = _nodes_to_run[i];
+                if (waiting.count(node) && output_counts[node] < node->output_count() && freed.insert(node).second) {
+                    node->deallocate();
+                }
+            }
+        }
+
+        for (size_t i = 0; i < ran; ++i) {
+            _nodes_to_run[i]->post_execute(type);
         }
 
-        for (auto&& node : _nodes_to_run) {
-            node->post_execute(type);
+        if (type == ExecutionType::UI && drawn && !stopped) {
+            if (regional) {
+                auto r = *_region_in_use;
+                for (int32_t ty = r.y / _tile_size; ty * _tile_size < r.w; ++ty) {
+                    for (int32_t tx = r.x / _tile_size; tx * _tile_size < r.z; ++tx) {
+                        _valid_tiles.emplace(tx, ty);
+                    }
+                }
+                // later runs this frame have nothing left to do
+                _region_in_use = glm::ivec4{0};
+            } else {
+                _all_valid = true;
+            }
+        }
+        VKD_TRACE("pool trim");
+        _device->pool().trim();
+
+        bool spill = _device->residency().over_budget();
+        if (spill) {
+            // the dealloc chain frees images on workers, it has to be done before any are spilled.
+            // spills copy out on their own buffers
+            ts().wait(_dealloc_chain);
+            _freeing.clear();
+            stream->flush();
+        }
+
+        // what's still on the device after a run can be spilled if it goes cold
+        for (auto&& node : _nodes) {
+            auto image_node = std::dynamic_pointer_cast<ImageNode>(node);
+            auto image = image_node ? image_node->get_output_image() : nullptr;
+            if (image && image->allocated() && image->reallocates()) {
+                _device->residency().track(image);
+            }
+        }
+        // anything that ran was used, whether or not it allocated this time
+        for (size_t i = 0; i < ran; ++i) {
+            auto image_node = dynamic_cast<ImageNode *>(_nodes_to_run[i]);
+            if (image_node && image_node->get_output_image()) {
+                _device->residency().touch(image_node->get_output_image().get());
+            }
+        }
+        _device->residency().trim(spill);
+    }
+
+    bool Graph::_params_changed(const EngineNode& node) {
+        for (auto&& pmap : node.params()) {
+            for (auto&& param : pmap.second) {
+                if (param.second->changed()) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void Graph::_wait_node(EngineNode * node, Stream& stream) {
+        auto done = _node_done.find(node);
+        if (done != _node_done.end()) {
+            stream.semaphore().wait(done->second);
+        }
+        auto freeing = _freeing.find(node);
+        if (freeing != _freeing.end()) {
+            ts().wait(freeing->second);
+            _freeing.erase(freeing);
+        }
+    }
+
+    bool Graph::supports_proxy() const {
+        for (auto&& node : _nodes) {
+            if (node->graph_inputs().empty()) {
+                // the graph shrinks sources itself, so any image will do
+                if (!std::dynamic_pointer_cast<ImageNode>(node)) {
+                    return false;
+                }
+            } else if (!node->supports_proxy()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Graph::supports_region() const {
+        for (auto&& node : _nodes) {
+            // sources load the whole image either way
+            if (!node->graph_inputs().empty() && !node->supports_region()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Graph::invalidate_region() {
+        _valid_tiles.clear();
+        _all_valid = false;
+    }
+
+    bool Graph::region_dirty() const {
+        if (!_visible || !supports_region()) {
+            return false;
+        }
+        auto r = _dirty_region();
+        return r.z > r.x && r.w > r.y;
+    }
+
+    glm::ivec4 Graph::_dirty_region() const {
+        glm::ivec4 dirty = {0, 0, 0, 0};
+        if (!_visible || _all_valid) {
+            return dirty;
+        }
+        auto v = glm::max(*_visible, glm::ivec4{0});
+        bool any = false;
+        for (int32_t ty = v.y / _tile_size; ty * _tile_size < v.w; ++ty) {
+            for (int32_t tx = v.x / _tile_size; tx * _tile_size < v.z; ++tx) {
+                if (_valid_tiles.find({tx, ty}) != _valid_tiles.end()) {
+                    continue;
+                }
+                glm::ivec4 tile = {tx * _tile_size, ty * _tile_size, (tx + 1) * _tile_size, (ty + 1) * _tile_size};
+                if (!any) {
+                    dirty = tile;
+                    any = true;
+                } else {
+                    dirty = {glm::min(dirty.x, tile.x), glm::min(dirty.y, tile.y), glm::max(dirty.z, tile.z), glm::max(dirty.w, tile.w)};
+                }
+            }
+        }
+        return dirty;
+    }
+
+    void Graph::_apply_region(ExecutionType type) {
+        if (type != ExecutionType::UI) {
+            _region_in_use = std::nullopt;
+            _propagate_region(std::nullopt);
+            return;
+        }
+
+        if (ParameterCache::user_changed() || frame().index != _tiles_frame || _proxy_in_use != _tiles_proxy) {
+            invalidate_region();
+        }
+        _tiles_frame = frame().index;
+        _tiles_proxy = _proxy_in_use;
+
+        if (!_visible || !supports_region()) {
+            _region_in_use = std::nullopt;
+            _propagate_region(std::nullopt);
+            return;
+        }
+
+        _region_in_use = _dirty_region();
+        auto r = *_region_in_use;
+        if (r.z > r.x && r.w > r.y) {
+            _propagate_region(r);
+        }
+    }
+
+    void Graph::_propagate_region(const std::optional<glm::ivec4>& region) {
+        if (!region) {
+            for (auto&& node : _nodes) {
+                node->region(std::nullopt);
+            }
+            return;
+        }
+
+        std::map<EngineNode *, glm::ivec4> wanted;
+        std::map<EngineNode *, int32_t> remaining;
+        for (auto&& node : _nodes) {
+            remaining[node.get()]++;
+        }
+        for (auto&& node : _terminals) {
+            wanted[node.get()] = *region;
+        }
+
+        // backwards a node's last appearance comes after every one of its consumers
+        for (auto it = _nodes.rbegin(); it != _nodes.rend(); ++it) {
+            auto node = it->get();
+            if (--remaining[node] > 0) {
+                continue;
+            }
+            auto search = wanted.find(node);
+            auto r = search != wanted.end() ? search->second : *region;
+            node->region(r);
+
+            for (auto&& input : node->graph_inputs()) {
+                auto in = node->input_region(r);
+                auto existing = wanted.find(input.get());
+                if (existing == wanted.end()) {
+                    wanted.emplace(input.get(), in);
+                } else {
+                    auto& w = existing->second;
+                    w = {glm::min(w.x, in.x), glm::min(w.y, in.y), glm::max(w.z, in.z), glm::max(w.w, in.w)};
+                }
+            }
+        }
+    }
+
+    int32_t Graph::_apply_proxy(ExecutionType type, const std::vector<std::shared_ptr<EngineNode>>& extra_nodes) {
+        int32_t scale = 1;
+        if (type == ExecutionType::UI && _proxy > 1 && supports_proxy()) {
+            scale = _proxy;
+            for (auto&& node : extra_nodes) {
+                if (node && !node->supports_proxy()) {
+                    scale = 1;
+                }
+            }
+        }
+
+        for (auto&& node : _nodes) {
+            node->proxy_scale(scale);
+        }
+        for (auto&& node : extra_nodes) {
+            if (node) {
+                node->proxy_scale(scale);
+            }
+        }
+        _proxy_in_use = scale;
+        return scale;
+    }
+
+    void Graph::_proxy_source(EngineNode& node, Stream& stream, int32_t scale) {
+        auto image_node = dynamic_cast<ImageNode *>(&node);
+        auto image = image_node ? image_node->get_output_image() : nullptr;
+        if (!image || !image->allocated()) {
+            return;
+        }
+
+        auto&& source = _proxy_sources[&node];
+        if (!source.commands) {
+            source.downsample = std::make_unique<ProxyDownsample>(_device);
+            source.commands = CommandBuffer::make(_device);
+            source.commands->debug_name("Proxy Source");
+        }
+
+        // the last run's copy has to be done before the buffer's recorded again
+        stream.semaphore().wait(source.commands->last_timeline_value());
+
+        {
+            auto scope = source.commands->record();
+            source.downsample->commands(source.commands->get(), image, scale);
         }
-        constexpr size_t trim_limit = 6ULL * 1024ULL * 1024ULL * 1024ULL;
-        _device->pool().trim(trim_limit);
+        stream.submit(*source.commands);
     }
 
     void Graph::finish(Stream& stream) {
@@ -1,25 +1,33 @@
 #pragma once
         
+#include <algorithm>
+#include <atomic>
+#include <exception>
 #include <memory>
 #include <vector>
 #include <set>
+#include <map>
+#include <mutex>
 
 #include "fence.hpp"
 #include "engine_node.hpp"
+#include "task_handle.hpp"
+#include "vkd_dll.h"
 
 namespace vkd {
     class Device;
     class Fence;
     class Stream;
+    class ProxyDownsample;
 
     struct GraphPreferences {
         std::string _working_space = "";
     };
 
-    class Graph {
+    class VKDEXPORT Graph {
     public:
         Graph(const std::shared_ptr<Device>& device) : _device(device) {}
-        ~Graph() = default;
+        ~Graph();
         Graph(Graph&&) = delete;
         Graph(const Graph&) = delete;
 
@@ -34,7 +42,16 @@ namespace vkd {
         }
 
         void sort();
+        // blocking, same as init_async then finish_init
         void init();
+        // each node inits on the host scheduler as soon as its inputs have, so independent
+        // branches load and compile side by side
+        void init_async();
+        bool init_complete() const;
+        void wait_init();
+        // rethrows the first error any node's init hit
+        void finish_init();
+        std::pair<int32_t, int32_t> init_progress() const { return {_inits_done.load(), _inits_total}; }
 
         enum class GraphUpdate {
             NoUpdate,
@@ -43,12 +60,19 @@ namespace vkd {
         };
 
         GraphUpdate update(ExecutionType type, const StreamPtr& stream);
+        // the last update had a node change with none of its params moving, a raw's develop landing
+        // or a scan finishing. frames rendered before it are stale
+        bool updated_itself() const { return _updated_itself; }
         void commands(VkCommandBuffer buf, uint32_t width, uint32_t height);
-        void execute(ExecutionType type, const StreamPtr& stream, const std::vector<std::shared_ptr<EngineNode>>& extra_nodes);
+        // cancel is checked between nodes, a stopped run leaves nothing allocated it would have freed
+        void execute(ExecutionType type, const StreamPtr& stream, const std::vector<std::shared_ptr<EngineNode>>& extra_nodes, const std::atomic<bool> * cancel = nullptr);
         void ui();
         void finish(Stream& stream);
 
-        void release_command_buffer(CommandBuffer * ptr) { _command_buffers.erase(ptr); }
+        void release_command_buffer(CommandBuffer * ptr) {
+            std::scoped_lock lock(_command_buffer_mutex);
+            _command_buffers.erase(ptr);
+        }
 
         const auto& graph() { return _nodes; }
         const auto& terminals() { return _terminals; }
@@ -59,11 +83,70 @@ namespace vkd {
             _frame = frame;
         }
         auto frame() const { return _frame; }
+
+        // ui runs evaluate at 1/scale while every node can, see EngineNode::supports_proxy
+        void proxy(int32_t scale) { _proxy = std::max(scale, 1); }
+        int32_t proxy() const { return _proxy; }
+        // what the last update or execute actually ran at
+        int32_t proxy_in_use() const { return _proxy_in_use; }
+        bool supports_proxy() const;
+
+        // ui runs only compute what's visible, x0, y0, x1, y1 in the terminals' pixels, nullopt for
+        // everything. computed 256 pixel tiles are kept until the params, frame or proxy change
+        void region(const std::optional<glm::ivec4>& visible) { _visible = visible; }
+        // the viewer's image was replaced, nothing in it is computed
+        void invalidate_region();
+        // some of the visible region still needs a run
+        bool region_dirty() const;
+        // the part the next ui run computes, nullopt when it's the whole image
+        const auto& region_in_use() const { return _region_in_use; }
+        bool supports_region() const;
     private:
+        void _init_node(const std::shared_ptr<EngineNode>& node);
+        int32_t _apply_proxy(ExecutionType type, const std::vector<std::shared_ptr<EngineNode>>& extra_nodes);
+        // shrinks a source's output into its own top left after it runs
+        void _proxy_source(EngineNode& node, Stream& stream, int32_t scale);
+        void _wait_node(EngineNode * node, Stream& stream);
+        static bool _params_changed(const EngineNode& node);
+
+        struct ProxySource {
+            std::unique_ptr<ProxyDownsample> downsample = nullptr;
+            CommandBufferPtr commands = nullptr;
+        };
+        std::map<EngineNode *, ProxySource> _proxy_sources;
+
+        void _apply_region(ExecutionType type);
+        // hands each node the part of its output its consumers read
+        void _propagate_region(const std::optional<glm::ivec4>& region);
+        // bounding box of the visible tiles not computed yet, empty if there's none
+        glm::ivec4 _dirty_region() const;
+        static constexpr int32_t _tile_size = 256;
+        std::optional<glm::ivec4> _visible;
+        std::optional<glm::ivec4> _region_in_use;
+        std::set<std::pair<int32_t, int32_t>> _valid_tiles;
+        // a whole image run covered every tile
+        bool _all_valid = false;
+        int64_t _tiles_frame = -1;
+        int32_t _tiles_proxy = 1;
+        int32_t _proxy = 1;
+        int32_t _proxy_in_use = 1;
+        bool _updated_itself = false;
+
         std::shared_ptr<Device> _device = nullptr;
         std::vector<std::shared_ptr<vkd::EngineNode>> _nodes;
         std::vector<std::shared_ptr<vkd::EngineNode>> _terminals;
+        std::mutex _command_buffer_mutex;
         std::map<CommandBuffer *, CommandBufferPtr> _command_buffers;
+        TaskHandle _dealloc_chain;
+        // nothing waits on the stream between runs, instead each node waits for its own last run
+        // before it records again, and for the task freeing it before it allocates
+        std::map<EngineNode *, uint64_t> _node_done;
+        std::map<EngineNode *, TaskHandle> _freeing;
+        std::vector<TaskHandle> _init_tasks;
+        std::atomic<int32_t> _inits_done = 0;
+        int32_t _inits_total = 0;
+        std::mutex _init_mutex;
+        std::exception_ptr _init_error = nullptr;
         ShaderParamMap _params;
         Frame _frame; 
     };
@@ -42,6 +42,8 @@ namespace vkd {
             return *this;
         }
 
+        uint64_t value() const { return _hash; }
+
     private:
         template <typename T, typename... Rest>
         uint64_t hash_combine(uint64_t& seed, const T& v, Rest... rest)
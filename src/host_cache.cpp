@@ -17,6 +17,7 @@ namespace vkd {
     }
 
     bool HostCache::add(const Hash& name, std::unique_ptr<StaticHostImage> image) {
+        std::scoped_lock lock(_mutex);
         bool was_new = true;
         if (_cache.find(name) != _cache.end()) {
             was_new = false;
@@ -27,6 +28,7 @@ namespace vkd {
     }
 
     bool HostCache::remove(const Hash& name) {
+        std::scoped_lock lock(_mutex);
         if (_cache.find(name) == _cache.end()) {
             return false;
         }
@@ -34,12 +36,13 @@ namespace vkd {
         return true;
     }
 
-    StaticHostImage * HostCache::get(const Hash& name) {
+    std::shared_ptr<StaticHostImage> HostCache::get(const Hash& name) {
+        std::scoped_lock lock(_mutex);
         auto search = _cache.find(name);
         if (search != _cache.end()) {
             _least_recent_used.erase(std::remove(std::begin(_least_recent_used), std::end(_least_recent_used), name), std::end(_least_recent_used));
             _least_recent_used.push_back(name);
-            return search->second.get();
+            return search->second;
         }
 
         return nullptr;
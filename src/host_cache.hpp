@@ -3,6 +3,7 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <mutex>
 #include <deque>
 #include <vector>
 
@@ -10,10 +11,11 @@
 #include <vulkan/vulkan.h>
 
 #include "hash.hpp"
+#include "vkd_dll.h"
 
 namespace vkd {
 
-    class StaticHostImage {
+    class VKDEXPORT StaticHostImage {
     public:
         StaticHostImage() = default;
         ~StaticHostImage() = default;
@@ -26,6 +28,7 @@ namespace vkd {
 
         auto size() const { return _data.size(); }
         auto data() { return _data.data(); }
+        auto data() const { return _data.data(); }
         auto dim() const { return _dim; }
         auto channels() const { return _channels; }
         auto element_size() const { return _element_size; }
@@ -37,7 +40,7 @@ namespace vkd {
         int32_t _element_size = 0; 
     };
 
-    class HostCache {
+    class VKDEXPORT HostCache {
     public:
         HostCache() = default;
         ~HostCache() = default;
@@ -46,11 +49,13 @@ namespace vkd {
 
         bool add(const Hash& name, std::unique_ptr<StaticHostImage> image);
         bool remove(const Hash& name);
-        StaticHostImage * get(const Hash& name);
+        // shared, a decode landing or a remove can drop the entry while the caller's still reading it
+        std::shared_ptr<StaticHostImage> get(const Hash& name);
         void trim();
 
     private:
-        std::map<Hash, std::unique_ptr<StaticHostImage>> _cache;
+        std::mutex _mutex; // decodes land from worker threads
+        std::map<Hash, std::shared_ptr<StaticHostImage>> _cache;
         std::deque<Hash> _least_recent_used;
     };
 }
\ No newline at end of file
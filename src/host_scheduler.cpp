@@ -0,0 +1,232 @@
+#include "host_scheduler.hpp"
+
+#include <thread>
+
+#include "console.hpp"
+#include "trace.hpp"
+
+namespace vkd {
+    namespace {
+#if ENKITS_TASK_PRIORITIES_NUM > 2
+        enki::TaskPriority enki_priority(TaskPriority priority) {
+            switch (priority) {
+            case TaskPriority::High: return enki::TASK_PRIORITY_HIGH;
+            case TaskPriority::Low: return enki::TASK_PRIORITY_LOW;
+            default: return enki::TASK_PRIORITY_MED;
+            }
+        }
+#endif
+    }
+
+    void HostTask::ExecuteRange(enki::TaskSetPartition range, uint32_t threadnum) {
+        if (Trace::enabled()) { Trace::worker_thread(threadnum); }
+        {
+            VKD_TRACE(_name ? _name : "host task");
+            try {
+                _func();
+            } catch (std::exception& e) {
+                console << "Error in host task " << (_name ? _name : "") << ": " << e.what() << std::endl;
+            } catch (...) {
+                console << "Unknown error in host task " << (_name ? _name : "") << "." << std::endl;
+            }
+        }
+        _scheduler->_complete(this);
+    }
+
+    bool HostTask::_try_claim() {
+        auto state = _state.load(std::memory_order_acquire);
+        if (state == State::Done) {
+            // enki still owns the task until it has marked it complete
+            if (!GetIsComplete()) {
+                return false;
+            }
+        } else if (state != State::Free) {
+            return false;
+        }
+
+        // under the continuation lock, so a stale handle can't slip a continuation in between
+        // the claim and the generation moving on
+        std::scoped_lock lock(_continuation_mutex);
+        if (!_state.compare_exchange_strong(state, State::Claimed, std::memory_order_acq_rel)) {
+            return false;
+        }
+        _generation.fetch_add(1, std::memory_order_acq_rel);
+        _continuations.clear();
+        _dependencies.clear();
+        return true;
+    }
+
+    bool HostTask::_add_continuation(HostTask * task, uint32_t generation) {
+        std::scoped_lock lock(_continuation_mutex);
+        if (_state.load(std::memory_order_acquire) == State::Done || _generation.load(std::memory_order_acquire) != generation) {
+            return false;
+        }
+        _continuations.push_back(task);
+        return true;
+    }
+
+    HostScheduler::~HostScheduler() {
+        if (_task_scheduler) {
+            wait_all();
+            _task_scheduler = nullptr;
+        }
+
+        for (auto&& chunk : _chunks) {
+            delete [] chunk.load();
+        }
+    }
+
+    void HostScheduler::init() {
+        _task_scheduler = std::make_unique<enki::TaskScheduler>();
+        _task_scheduler->Initialize();
+        _grow(0);
+    }
+
+    HostTask * HostScheduler::_acquire() {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            size_t chunks = _chunk_count.load(std::memory_order_acquire);
+            size_t total = chunks * _chunk_size;
+            size_t start = _cursor.fetch_add(1, std::memory_order_relaxed);
+            for (size_t i = 0; i < total; ++i) {
+                size_t index = (start + i) % total;
+                HostTask * task = &_chunks[index / _chunk_size].load(std::memory_order_acquire)[index % _chunk_size];
+                if (task->_try_claim()) {
+                    _cursor.store(index + 1, std::memory_order_relaxed);
+                    return task;
+                }
+            }
+            _grow(chunks);
+        }
+        return nullptr;
+    }
+
+    void HostScheduler::_grow(size_t seen_chunks) {
+        std::scoped_lock lock(_grow_mutex);
+        size_t chunks = _chunk_count.load(std::memory_order_acquire);
+        if (chunks != seen_chunks || chunks >= _max_chunks) {
+            return; // someone else grew it, or we're full
+        }
+
+        auto chunk = new HostTask[_chunk_size];
+        for (size_t i = 0; i < _chunk_size; ++i) {
+            chunk[i]._scheduler = this;
+        }
+        _chunks[chunks].store(chunk, std::memory_order_release);
+        _chunk_count.store(chunks + 1, std::memory_order_release);
+    }
+
+    TaskHandle HostScheduler::add(const char * name, std::function<void()> func, TaskPriority priority) {
+        return after({}, name, std::move(func), priority);
+    }
+
+    TaskHandle HostScheduler::after(const std::vector<TaskHandle>& dependencies, const char * name, std::function<void()> func, TaskPriority priority) {
+        HostTask * task = _acquire();
+        if (task == nullptr) {
+            console << "Host task pool exhausted, running " << (name ? name : "task") << " inline." << std::endl;
+            for (auto&& dep : dependencies) {
+                wait(dep);
+            }
+            func();
+            return {};
+        }
+
+        _in_flight.fetch_add(1, std::memory_order_relaxed);
+
+        task->_name = name;
+        task->_func = std::move(func);
+        task->_priority = priority;
+
+        TaskHandle handle{task, task->_generation.load(std::memory_order_acquire)};
+
+        {
+            std::scoped_lock lock(task->_continuation_mutex);
+            task->_dependencies = dependencies;
+        }
+
+        // hold one count ourselves so the task can't launch halfway through wiring dependencies
+        task->_waiting_on.store(1, std::memory_order_release);
+        for (auto&& dep : dependencies) {
+            if (!dep._task) {
+                continue;
+            }
+            task->_waiting_on.fetch_add(1, std::memory_order_acq_rel);
+            if (!dep._task->_add_continuation(task, dep._generation)) {
+                task->_waiting_on.fetch_sub(1, std::memory_order_acq_rel); // already finished
+            }
+        }
+        _release(task);
+
+        return handle;
+    }
+
+    void HostScheduler::_release(HostTask * task) {
+        if (task->_waiting_on.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            _submit(task);
+        }
+    }
+
+    void HostScheduler::_submit(HostTask * task) {
+        task->_state.store(HostTask::State::Queued, std::memory_order_release);
+#if ENKITS_TASK_PRIORITIES_NUM > 2
+        task->m_Priority = enki_priority(task->_priority);
+#endif
+        _task_scheduler->AddTaskSetToPipe(task);
+    }
+
+    void HostScheduler::_complete(HostTask * task) {
+        std::vector<HostTask *> continuations;
+        {
+            std::scoped_lock lock(task->_continuation_mutex);
+            task->_func = nullptr;
+            task->_state.store(HostTask::State::Done, std::memory_order_release);
+            continuations.swap(task->_continuations);
+            task->_dependencies.clear();
+        }
+        _in_flight.fetch_sub(1, std::memory_order_relaxed);
+
+        for (auto&& next : continuations) {
+            _release(next);
+        }
+    }
+
+    bool HostScheduler::is_complete(TaskHandle handle) const {
+        if (!handle._task) {
+            return true;
+        }
+        auto task = handle._task;
+        return task->_generation.load(std::memory_order_acquire) != handle._generation
+            || task->_state.load(std::memory_order_acquire) == HostTask::State::Done;
+    }
+
+    void HostScheduler::wait(TaskHandle handle) {
+        while (!is_complete(handle)) {
+            auto task = handle._task;
+            if (task->_state.load(std::memory_order_acquire) == HostTask::State::Queued) {
+                _task_scheduler->WaitforTask(task);
+                continue;
+            }
+
+            // still held on its dependencies, wait on those so this thread runs tasks through
+            // enki instead of sitting on a worker
+            std::vector<TaskHandle> dependencies;
+            {
+                std::scoped_lock lock(task->_continuation_mutex);
+                if (task->_generation.load(std::memory_order_acquire) == handle._generation) {
+                    dependencies = task->_dependencies;
+                }
+            }
+            for (auto&& dep : dependencies) {
+                wait(dep);
+            }
+            // the last dependency to finish is between marking itself done and queueing this
+            std::this_thread::yield();
+        }
+    }
+
+    void HostScheduler::wait_all() {
+        while (_in_flight.load(std::memory_order_acquire) > 0) {
+            _task_scheduler->WaitforAll();
+            std::this_thread::yield();
+        }
+    }
+}
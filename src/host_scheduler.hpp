@@ -1,70 +1,97 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
 #include "TaskScheduler.h"
+#include "task_handle.hpp"
+#include "vkd_dll.h"
 
 namespace vkd {
-    
-    class HostScheduler {
+    class HostTask : public enki::ITaskSet {
+    public:
+        HostTask() = default;
+        ~HostTask() = default;
+        HostTask(HostTask&&) = delete;
+        HostTask(const HostTask&) = delete;
+
+        void ExecuteRange(enki::TaskSetPartition range, uint32_t threadnum) override;
+
+    private:
+        friend class HostScheduler;
+
+        enum class State : uint32_t {
+            Free,
+            Claimed, // waiting on dependencies
+            Queued,
+            Done
+        };
+
+        bool _try_claim();
+        bool _add_continuation(HostTask * task, uint32_t generation);
+
+        HostScheduler * _scheduler = nullptr;
+        std::atomic<State> _state = State::Free;
+        std::atomic<uint32_t> _generation = 0;
+        std::atomic<int32_t> _waiting_on = 0;
+
+        const char * _name = nullptr;
+        std::function<void()> _func;
+        TaskPriority _priority = TaskPriority::Normal;
+
+        // per-task, only taken to hand over continuations and for waiters to read the dependencies
+        std::mutex _continuation_mutex;
+        std::vector<HostTask *> _continuations;
+        // what a claimed task is held on, so a wait can go and help with those
+        std::vector<TaskHandle> _dependencies;
+    };
+
+    class VKDEXPORT HostScheduler {
     public:
         HostScheduler() = default;
-        ~HostScheduler() = default;
+        ~HostScheduler();
         HostScheduler(HostScheduler&&) = delete;
         HostScheduler(const HostScheduler&) = delete;
 
-        void init() {
-            _task_scheduler = std::make_unique<enki::TaskScheduler>();
-            _task_scheduler->Initialize();
-        }
+        void init();
 
         enki::TaskScheduler& ts() { return *_task_scheduler; }
 
-        enki::TaskSet * add(std::unique_ptr<enki::TaskSet> task) {
-            enki::TaskSet * ptr = task.get();
-
-            std::scoped_lock<std::mutex> lock(_task_mutex);
-            _active_tasks.emplace(ptr, std::move(task));
-            ts().AddTaskSetToPipe(ptr);
-            return ptr;
+        TaskHandle add(const char * name, std::function<void()> func, TaskPriority priority = TaskPriority::Normal);
+        // runs func once every dependency has finished, without blocking anyone in the meantime
+        TaskHandle after(const std::vector<TaskHandle>& dependencies, const char * name, std::function<void()> func, TaskPriority priority = TaskPriority::Normal);
+        TaskHandle then(TaskHandle dependency, const char * name, std::function<void()> func, TaskPriority priority = TaskPriority::Normal) {
+            return after({dependency}, name, std::move(func), priority);
         }
 
-        void wait(enki::TaskSet * task) {
-            std::scoped_lock lock(_task_mutex);
-            auto search = _active_tasks.find(task);
-            if (search == _active_tasks.end()) {
-                return; // no task whatever
-            }
-
-            _task_scheduler->WaitforTask(task);
-        }
+        void wait(TaskHandle task);
+        bool is_complete(TaskHandle task) const;
+        void wait_all();
 
-        bool is_complete(enki::TaskSet * task) {
-            std::scoped_lock lock(_task_mutex);
-            auto search = _active_tasks.find(task);
-            if (search == _active_tasks.end()) {
-                return true; // no task whatever
-            }
+        int32_t in_flight() const { return _in_flight.load(std::memory_order_relaxed); }
 
-            return task->GetIsComplete();
-        }
+    private:
+        friend class HostTask;
 
-        void cleanup() {
-            std::scoped_lock lock(_task_mutex);
-
-            std::vector<enki::TaskSet *> to_erase;
-            for (auto&& task : _active_tasks) {
-                if (task.first->GetIsComplete()) {
-                    to_erase.push_back(task.first);
-                }
-            }
-            for (auto&& t : to_erase) {
-                _active_tasks.erase(t);
-            }
-        }
+        HostTask * _acquire();
+        void _grow(size_t seen_chunks);
+        void _release(HostTask * task);
+        void _submit(HostTask * task);
+        void _complete(HostTask * task);
 
-    private:
         std::unique_ptr<enki::TaskScheduler> _task_scheduler = nullptr;
 
-        std::mutex _task_mutex;
-        std::map<enki::TaskSet *, std::unique_ptr<enki::TaskSet>> _active_tasks;
+        static constexpr size_t _chunk_size = 64;
+        static constexpr size_t _max_chunks = 256;
+
+        std::array<std::atomic<HostTask *>, _max_chunks> _chunks = {};
+        std::atomic<size_t> _chunk_count = 0;
+        std::atomic<size_t> _cursor = 0;
+        std::atomic<int32_t> _in_flight = 0;
+        std::mutex _grow_mutex; // only taken when the pool is full
     };
-}
\ No newline at end of file
+}
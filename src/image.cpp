@@ -1,4 +1,5 @@
 #include <cstring>
+#include <glm/gtc/packing.hpp>
 #include "image.hpp"
 #include "vulkan.hpp"
 #include "memory.hpp"
@@ -7,6 +8,7 @@
 #include "command_buffer.hpp"
 #include "memory/memory_manager.hpp"
 #include "memory/memory_pool.hpp"
+#include "memory/residency.hpp"
 
 
 namespace vkd {
@@ -28,6 +30,21 @@ namespace vkd {
         return im;
     }
 
+    std::shared_ptr<Image> Image::half_image(const std::shared_ptr<Device>& device, glm::ivec2 size, VkImageUsageFlags usage_flags) {
+        auto im = std::make_shared<vkd::Image>(device);
+        im->create_image(VK_FORMAT_R16G16B16A16_SFLOAT, size, usage_flags | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        im->allocate(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        im->create_view(VK_IMAGE_ASPECT_COLOR_BIT);
+        im->deallocate();
+
+        {
+            auto buf = CommandBuffer::make_immediate(device);
+            im->allocate(buf->get());
+        }
+
+        return im;
+    }
+
     Image::~Image() {
         if (_ui_desc_set != VK_NULL_HANDLE) {
             ImGui_ImplVulkan_RemoveTexture(_ui_desc_set);
@@ -51,6 +68,7 @@ namespace vkd {
         _width = sz.x;
         _height = sz.y;
         _usage_flags = usage_flags;
+        _generation++;
         VkImageCreateInfo image_create_info{};
         memset(&image_create_info, 0, sizeof(VkImageCreateInfo));
         image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -114,9 +132,67 @@ namespace vkd {
             create_view(_aspect);
 
             _allocated = true;
+            _reallocates = true;
 
-            set_layout(buf, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+            if (_spilled) {
+                _restore();
+            } else {
+                set_layout(buf, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+            }
         }
+        _device->residency().touch(this);
+    }
+
+    bool Image::spill(bool half) {
+        bool float32 = _format == VK_FORMAT_R32G32B32A32_SFLOAT;
+        if (!_allocated || !_reallocates || _spilled || _no_dealloc || !(float32 || _format == VK_FORMAT_R16G16B16A16_SFLOAT)) {
+            return false;
+        }
+
+        AutoMapStagingBuffer staging{_device, AutoMapStagingBuffer::Mode::Download, size_in_memory()};
+        {
+            auto buf = CommandBuffer::make_immediate(_device);
+            auto layout = _layout;
+            set_layout(buf->get(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            staging.copy(buf->get(), *this, 0, 0, 0, _width, _height);
+            set_layout(buf->get(), layout, VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        }
+
+        auto host = StaticHostImage::make(_width, _height, 4, (float32 && !half) ? 4 : 2);
+        if (float32 && half) {
+            auto src = reinterpret_cast<const float *>(staging.get());
+            auto dst = reinterpret_cast<uint16_t *>(host->data());
+            size_t count = (size_t)_width * _height * 4;
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = glm::packHalf1x16(src[i]);
+            }
+        } else {
+            memcpy(host->data(), staging.get(), host->size());
+        }
+
+        deallocate();
+        _spilled = std::move(host);
+        return true;
+    }
+
+    void Image::_restore() {
+        // back from host memory. waits, so whatever the caller records after sees the contents
+        AutoMapStagingBuffer staging{_device, AutoMapStagingBuffer::Mode::Upload, size_in_memory()};
+        if (_format == VK_FORMAT_R32G32B32A32_SFLOAT && _spilled->element_size() == 2) {
+            auto src = reinterpret_cast<const uint16_t *>(_spilled->data());
+            auto dst = reinterpret_cast<float *>(staging.get());
+            size_t count = (size_t)_width * _height * 4;
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = glm::unpackHalf1x16(src[i]);
+            }
+        } else {
+            memcpy(staging.get(), _spilled->data(), _spilled->size());
+        }
+        _spilled = nullptr;
+
+        auto buf = CommandBuffer::make_immediate(_device);
+        set_layout(buf->get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        copy(buf->get(), staging);
     }
 
     void Image::deallocate() {
@@ -132,6 +208,8 @@ namespace vkd {
             _memory = VK_NULL_HANDLE;
         }
 
+        // the owner's done with it, so are the spilled contents
+        _spilled = nullptr;
         _allocated = false;
     }
 
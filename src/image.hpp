@@ -6,6 +6,8 @@
 #include "buffer.hpp"
 #include "command_buffer.hpp"
 #include "sampler.hpp"
+#include "host_cache.hpp"
+#include "vkd_dll.h"
 
 typedef void* ImTextureID;
 extern ImTextureID ImGui_ImplVulkan_AddTexture(VkSampler sampler, VkImageView image_view, VkImageLayout image_layout);
@@ -13,7 +15,7 @@ extern void ImGui_ImplVulkan_RemoveTexture(ImTextureID tex);
 
 namespace vkd {
     class Buffer;
-    class Image {
+    class VKDEXPORT Image {
     public:
         Image(std::shared_ptr<Device> device) : _device(device) {}
         Image(std::shared_ptr<Device> device, VkImage image, VkImageView view) : _device(device), _image(image), _view(view), _no_dealloc(true) {}
@@ -22,11 +24,15 @@ namespace vkd {
         Image(const Image&) = delete;
 
         static std::shared_ptr<Image> float_image(const std::shared_ptr<Device>& device, glm::ivec2 size, VkImageUsageFlags usage_flags = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+        // comes back allocated, for images that live outside a graph's allocate/deallocate
+        static std::shared_ptr<Image> half_image(const std::shared_ptr<Device>& device, glm::ivec2 size, VkImageUsageFlags usage_flags = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 
         static constexpr size_t size_in_memory(glm::ivec2 size, const VkFormat format) {
             size_t sz = size.x * size.y;
             if (format == VK_FORMAT_R32G32B32A32_SFLOAT) {
                 sz *= 4 * 4;
+            } else if (format == VK_FORMAT_R16G16B16A16_SFLOAT) {
+                sz *= 4 * 2;
             } else {
                 //static_assert(false);
             }
@@ -44,6 +50,17 @@ namespace vkd {
         void allocate(VkMemoryPropertyFlags memory_property_flags);
         void deallocate();
         bool allocated() const { return _allocated; }
+        // copies the contents to host memory and frees the device image, the next allocate puts
+        // them back. half keeps float images as half float. false if there was nothing to spill
+        bool spill(bool half);
+        // comes back through allocate(buf) each run. images made once in init are recorded
+        // against and resubmitted by their owners, so they never spill
+        bool reallocates() const { return _reallocates; }
+        bool spilled() const { return _spilled != nullptr; }
+        size_t spilled_size() const { return _spilled ? _spilled->size() : 0; }
+        // goes up each time the vkimage is made again, after a spill or a deallocate. commands
+        // recorded against an older one have to be recorded again
+        uint64_t generation() const { return _generation; }
         void create_view(VkImageAspectFlags aspect);
 
         void copy(Image& src, VkCommandBuffer buf);
@@ -106,6 +123,7 @@ namespace vkd {
         void debug_name(const std::string& debugName) { _debug_name = debugName; update_debug_name(); }
     protected:
         void update_debug_name();
+        void _restore();
 
         static void insert_image_memory_barrier(
             VkCommandBuffer buf,
@@ -137,6 +155,9 @@ namespace vkd {
         const bool _no_dealloc = false;
 
         bool _allocated = false;
+        bool _reallocates = false;
+        uint64_t _generation = 0;
+        std::unique_ptr<StaticHostImage> _spilled = nullptr;
         std::string _debug_name = "Anonymous Image";
     };
 
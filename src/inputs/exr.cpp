@@ -1,19 +1,74 @@
 #include <mutex>
 #include <thread>
+#include <cctype>
+#include <cstring>
+#include <limits>
 #include "exr.hpp"
 #include "image.hpp"
 #include "command_buffer.hpp"
 #include "buffer.hpp"
+#include "console.hpp"
+#include "host_scheduler.hpp"
 #include "compute/kernel.hpp"
 #include "imgui/imgui.h"
 #include "ImfThreading.h"
-#include "ImfRgbaFile.h"
+#include "ImfMultiPartInputFile.h"
+#include "ImfInputPart.h"
+#include "ImfFrameBuffer.h"
+#include "ImfChannelList.h"
+#include "ImfHeader.h"
+#include "ghc/filesystem.hpp"
 
 #include "ocio/ocio_functional.hpp"
+#include "trace.hpp"
 
 namespace vkd {
     REGISTER_NODE("exr", "exr", Exr);
 
+    namespace {
+        struct SequenceToken {
+            std::string prefix;
+            std::string suffix;
+            size_t width = 0;
+        };
+
+        // finds the last #### run or printf %0Nd in the file name
+        bool split_pattern(const std::string& pattern, SequenceToken& token) {
+            auto name_start = pattern.find_last_of("/\\");
+            name_start = (name_start == std::string::npos) ? 0 : name_start + 1;
+
+            auto hash_end = pattern.find_last_of('#');
+            if (hash_end != std::string::npos && hash_end >= name_start) {
+                auto hash_start = hash_end;
+                while (hash_start > name_start && pattern[hash_start - 1] == '#') {
+                    --hash_start;
+                }
+                token.prefix = pattern.substr(0, hash_start);
+                token.suffix = pattern.substr(hash_end + 1);
+                token.width = hash_end - hash_start + 1;
+                return true;
+            }
+
+            auto percent = pattern.find_last_of('%');
+            if (percent == std::string::npos || percent < name_start) {
+                return false;
+            }
+            size_t pos = percent + 1;
+            size_t width = 0;
+            while (pos < pattern.size() && std::isdigit((unsigned char)pattern[pos])) {
+                width = width * 10 + (pattern[pos] - '0');
+                ++pos;
+            }
+            if (pos >= pattern.size() || pattern[pos] != 'd') {
+                return false;
+            }
+            token.prefix = pattern.substr(0, percent);
+            token.suffix = pattern.substr(pos + 1);
+            token.width = width;
+            return true;
+        }
+    }
+
     Exr::Exr() : _block() {
 
         static std::once_flag initFlag;
@@ -27,7 +82,7 @@ namespace vkd {
         _uploader->allocate(buf);
     }
 
-    void Exr::deallocate() { 
+    void Exr::deallocate() {
         _uploader->deallocate();
     }
 
@@ -39,117 +94,361 @@ namespace vkd {
 
         _frame_param = make_param<ParameterType::p_frame>(param_hash_name(), "frame", 0);
         _single_frame = make_param<ParameterType::p_bool>(param_hash_name(), "single_frame", 0);
-        
+
+        _part_param = make_param<ParameterType::p_int>(param_hash_name(), "part", 0, {"init"});
+        _part_param->as<int>().set_default(0);
+        _part_param->as<int>().soft_min(0);
+        _part_param->as<int>().soft_max(8);
+
+        _layer_param = make_param<ParameterType::p_string>(param_hash_name(), "layer", 0);
+        _layer_param->as<std::string>().set_default("");
+
+        _read_ahead_param = make_param<ParameterType::p_int>(param_hash_name(), "read ahead", 0, {"init"});
+        _read_ahead_param->as<int>().set_default(4);
+        _read_ahead_param->as<int>().soft_min(0);
+        _read_ahead_param->as<int>().soft_max(32);
+
         _params["_"].emplace(_path_param->name(), _path_param);
         _params["_"].emplace(_frame_param->name(), _frame_param);
         _params["_"].emplace(_single_frame->name(), _single_frame);
+        _params["_"].emplace(_part_param->name(), _part_param);
+        _params["_"].emplace(_layer_param->name(), _layer_param);
+        _params["_"].emplace(_read_ahead_param->name(), _read_ahead_param);
     }
 
     Exr::~Exr() {
+        for (auto&& slot : _ring) {
+            ts().wait(slot->task);
+        }
+    }
+
+    bool Exr::is_sequence(const std::string& pattern) {
+        SequenceToken token;
+        return split_pattern(pattern, token);
+    }
+
+    std::string Exr::frame_path(const std::string& pattern, int64_t number) {
+        SequenceToken token;
+        if (!split_pattern(pattern, token)) {
+            return pattern;
+        }
+        auto digits = std::to_string(std::abs(number));
+        if (digits.size() < token.width) {
+            digits.insert(0, token.width - digits.size(), '0');
+        }
+        return token.prefix + (number < 0 ? "-" : "") + digits + token.suffix;
+    }
+
+    void Exr::_find_sequence() {
+        namespace fs = ghc::filesystem;
+        _sequence = false;
+        _first_number = 0;
+        _frame_count = 1;
+
+        SequenceToken token;
+        if (!split_pattern(_pattern, token)) {
+            return;
+        }
+
+        fs::path dir = fs::path(token.prefix).parent_path();
+        auto name_prefix = fs::path(token.prefix + "0").filename().string();
+        name_prefix.pop_back();
+        auto& name_suffix = token.suffix;
+        if (dir.empty()) {
+            dir = ".";
+        }
+
+        std::error_code ec;
+        int64_t first = std::numeric_limits<int64_t>::max(), last = std::numeric_limits<int64_t>::min();
+        for (auto&& entry : fs::directory_iterator(dir, ec)) {
+            auto name = entry.path().filename().string();
+            if (name.size() <= name_prefix.size() + name_suffix.size()
+                || name.compare(0, name_prefix.size(), name_prefix) != 0
+                || name.compare(name.size() - name_suffix.size(), name_suffix.size(), name_suffix) != 0) {
+                continue;
+            }
+            auto digits = name.substr(name_prefix.size(), name.size() - name_prefix.size() - name_suffix.size());
+            if (digits.size() < token.width || !std::all_of(digits.begin(), digits.end(), [](char c) { return std::isdigit((unsigned char)c); })) {
+                continue;
+            }
+            auto number = std::stoll(digits);
+            first = std::min(first, number);
+            last = std::max(last, number);
+        }
+
+        if (ec || first > last) {
+            throw GraphException("No frames found for exr sequence " + _pattern);
+        }
+
+        _sequence = true;
+        _first_number = first;
+        _frame_count = last - first + 1;
     }
 
     void Exr::init() {
-        if (_path_param->as<std::string>().get().size() < 3) {
+        _pattern = _path_param->as<std::string>().get();
+        if (_pattern.size() < 3) {
             throw GraphException("No path provided to exr node.");
-        } 
+        }
 
-        try {
-            Imf::RgbaInputFile in(_path_param->as<std::string>().get().c_str());
-        
-            Imath::Box2i win = in.dataWindow();
-            
-            Imath::V2i dim(win.max.x - win.min.x + 1, win.max.y - win.min.y + 1);
-                
-            int dx = win.min.x;
-            int dy = win.min.y;
+        _find_sequence();
+        _part = _part_param->as<int>().get();
+        _layer = _layer_param->as<std::string>().get();
+        _ahead = _sequence ? std::max(_read_ahead_param->as<int>().get(), 0) : 0;
 
-            _width = dim.x;
-            _height = dim.y;
+        auto first_path = _sequence ? frame_path(_pattern, _first_number) : _pattern;
+        _display = display_window(first_path, _part);
 
-    /*
-            _frame_count = _video_stream->nb_frames + 1 - ((_video_stream->nb_frames + 1) % 2);
-            _block.total_frame_count->as<int>().set_force(_frame_count > 0 ? _frame_count : 100);
-    */
+        _width = _display.width();
+        _height = _display.height();
 
-            _uploader = std::make_unique<ImageUploader>(_device);
-            _uploader->init(_width, _height, ImageUploader::InFormat::half_rgba, ImageUploader::OutFormat::float32, param_hash_name());
-            for (auto&& kern : _uploader->kernels()) {
-                register_params(*kern);
-            }
+        _block.total_frame_count->as<int>().set_force(_frame_count);
 
-            in.setFrameBuffer(reinterpret_cast<Imf::Rgba *>(_uploader->get_main()) - dx - dy * dim.x, 1, dim.x);
-            in.readPixels(win.min.y, win.max.y);
-        } catch (...) {
-            throw GraphException("Error reading EXR file.");
+        _uploader = std::make_unique<ImageUploader>(_device);
+        _uploader->init(_width, _height, ImageUploader::InFormat::half_rgba, ImageUploader::OutFormat::float32, param_hash_name());
+        for (auto&& kern : _uploader->kernels()) {
+            register_params(*kern);
         }
 
-        _current_frame = 0;
+        _blank_staging = _uploader->make_staging();
+        memset(_blank_staging->get(), 0, _blank_staging->size());
+
+        // the one on screen, the one being read for it and the ones after
+        _ring.clear();
+        for (int32_t i = 0; i < _ahead + 2; ++i) {
+            auto slot = std::make_unique<Slot>();
+            slot->staging = _uploader->make_staging();
+            _ring.push_back(std::move(slot));
+        }
+
+        _current_frame = -1;
+
+        _proxy = std::make_unique<ProxyDownsample>(_device);
 
         _ocio = std::make_unique<OcioNode>(OcioNode::Type::In);
         _ocio->init(*this);
     }
 
+    Exr::Window Exr::display_window(const std::string& path, int32_t part) {
+        try {
+            Imf::MultiPartInputFile in(path.c_str());
+            if (part < 0 || part >= in.parts()) {
+                throw GraphException("EXR file has no part " + std::to_string(part) + ".");
+            }
+            Imath::Box2i win = in.header(part).displayWindow();
+            return Window{win.min.x, win.min.y, win.max.x, win.max.y};
+        } catch (GraphException&) {
+            throw;
+        } catch (std::exception& e) {
+            throw GraphException(std::string("Error reading EXR file: ") + e.what());
+        }
+    }
+
+    bool Exr::read_frame(const std::string& path, int32_t part, const std::string& layer, const Window& display, uint16_t * dst) {
+        VKD_TRACE("exr read");
+        const size_t width = display.width(), height = display.height();
+        try {
+            Imf::MultiPartInputFile file(path.c_str());
+            if (part < 0 || part >= file.parts()) {
+                throw std::runtime_error("no part " + std::to_string(part));
+            }
+            Imf::InputPart in(file, part);
+            auto data = in.header().dataWindow();
+            auto&& channels = in.header().channels();
+
+            std::string prefix = layer.empty() ? "" : layer + ".";
+            auto has = [&](const char * c) { return channels.findChannel(prefix + c) != nullptr; };
+            bool luma = !has("R") && has("Y");
+
+            Window read{std::max(data.min.x, display.min_x), std::max(data.min.y, display.min_y), std::min(data.max.x, display.max_x), std::min(data.max.y, display.max_y)};
+            bool inside = read.min_x == data.min.x && read.min_y == data.min.y && read.max_x == data.max.x && read.max_y == data.max.y;
+
+            if (!inside || data.min.x != display.min_x || data.min.y != display.min_y || data.max.x != display.max_x || data.max.y != display.max_y) {
+                memset(dst, 0, width * height * 4 * sizeof(uint16_t));
+            }
+            if (read.max_x < read.min_x || read.max_y < read.min_y) {
+                return true; // nothing of it is on screen
+            }
+
+            // a data window inside the display window decodes in place, otherwise via scratch and a copy
+            std::vector<uint16_t> scratch;
+            uint16_t * base = dst;
+            Window target = display;
+            if (!inside) {
+                target = Window{data.min.x, data.min.y, data.max.x, data.max.y};
+                scratch.resize((size_t)target.width() * target.height() * 4);
+                base = scratch.data();
+            }
+            const size_t xstride = 4 * sizeof(uint16_t);
+            const size_t ystride = xstride * target.width();
+            char * origin = (char *)base - target.min_x * (ptrdiff_t)xstride - target.min_y * (ptrdiff_t)ystride;
+
+            Imf::FrameBuffer fb;
+            const char * names[] = {luma ? "Y" : "R", "G", "B", "A"};
+            for (int c = 0; c < (luma ? 1 : 3); ++c) {
+                fb.insert(prefix + names[c], Imf::Slice(Imf::HALF, origin + c * sizeof(uint16_t), xstride, ystride, 1, 1, 0.0));
+            }
+            fb.insert(prefix + "A", Imf::Slice(Imf::HALF, origin + 3 * sizeof(uint16_t), xstride, ystride, 1, 1, 1.0));
+            in.setFrameBuffer(fb);
+            in.readPixels(data.min.y, data.max.y);
+
+            if (luma) {
+                for (int32_t y = read.min_y; y <= read.max_y; ++y) {
+                    auto row = (uint16_t *)(origin + y * (ptrdiff_t)ystride);
+                    for (int32_t x = read.min_x; x <= read.max_x; ++x) {
+                        row[x * 4 + 1] = row[x * 4 + 2] = row[x * 4];
+                    }
+                }
+            }
+
+            if (!inside) {
+                for (int32_t y = read.min_y; y <= read.max_y; ++y) {
+                    auto src = scratch.data() + ((size_t)(y - target.min_y) * target.width() + (read.min_x - target.min_x)) * 4;
+                    auto out = dst + ((size_t)(y - display.min_y) * width + (read.min_x - display.min_x)) * 4;
+                    memcpy(out, src, (size_t)read.width() * xstride);
+                }
+            }
+        } catch (std::exception& e) {
+            console << "Error reading EXR frame " << path << ": " << e.what() << std::endl;
+            memset(dst, 0, width * height * 4 * sizeof(uint16_t));
+            return false;
+        }
+        return true;
+    }
+
+    Exr::Slot * Exr::_free_slot(int64_t frame) {
+        // never the one the uploader is using, and nothing we'd want again soon
+        Slot * best = nullptr;
+        for (auto&& slot : _ring) {
+            if (_current_frame >= 0 && slot->frame == _current_frame) {
+                continue;
+            }
+            if (slot->frame >= frame && slot->frame <= frame + _ahead) {
+                continue;
+            }
+            if (!best || (!ts().is_complete(best->task) && ts().is_complete(slot->task)) || slot->frame < 0) {
+                best = slot.get();
+            }
+        }
+        return best;
+    }
+
+    Exr::Slot& Exr::_request(int64_t frame, TaskPriority priority, Slot * slot) {
+        for (auto&& existing : _ring) {
+            if (existing->frame == frame) {
+                return *existing;
+            }
+        }
+
+        if (!slot) {
+            slot = _free_slot(frame);
+        }
+        ts().wait(slot->task); // a stale read ahead, after a jump
+
+        slot->frame = frame;
+        slot->ok = false;
+        auto path = _sequence ? frame_path(_pattern, _first_number + frame) : _pattern;
+        auto dst = (uint16_t *)slot->staging->get();
+        slot->task = ts().add("exr read", [slot, path, part = _part, layer = _layer, display = _display, dst]() {
+            slot->ok = read_frame(path, part, layer, display, dst);
+        }, priority);
+        return *slot;
+    }
+
+    void Exr::_read_ahead(int64_t frame) {
+        for (int64_t next = frame + 1; next <= frame + _ahead && next < _frame_count; ++next) {
+            bool have = std::any_of(_ring.begin(), _ring.end(), [next](auto&& slot) { return slot->frame == next; });
+            if (have) {
+                continue;
+            }
+            auto slot = _free_slot(frame);
+            if (!slot || !ts().is_complete(slot->task)) {
+                return;
+            }
+            // chosen around the playhead, a slot picked around next could be one just read ahead
+            _request(next, TaskPriority::Normal, slot);
+        }
+    }
+
+    void Exr::_invalidate() {
+        for (auto&& slot : _ring) {
+            ts().wait(slot->task);
+            slot->frame = -1;
+        }
+        _current_frame = -1;
+    }
+
     bool Exr::update(ExecutionType type) {
-        
+        VKD_TRACE("Exr::update");
+
         bool update = false;
         for (auto&& pmap : _params) {
             for (auto&& el : pmap.second) {
-                if (el.second->changed()) {
+                if (el.first != "frame" && el.second->changed()) {
                     update = true;
                 }
             }
         }
-        if (update) {
-            if (_single_frame->as<bool>().get()) {
+        bool params_changed = update;
 
-            }
-
-            _ocio->update(*this, _uploader->get_gpu());
+        if (_layer_param->as<std::string>().get() != _layer) {
+            _layer = _layer_param->as<std::string>().get();
+            _invalidate();
         }
-/*
+
         auto frame = _frame_param->as<Frame>().get();
 
         auto start_block = _block.frame_start_block->as<Frame>().get();
         auto end_block = _block.frame_end_block->as<Frame>().get();
-
         if (frame.index < start_block.index || frame.index > end_block.index) {
-            memset(_staging_buffer_ptr, 0, _buffer_size);
+            _uploader->use_staging(_blank_staging);
+            _current_frame = -1;
             if (!_blanked) {
                 _blanked = true;
                 update = true;
             }
-            return update;
-        }
+        } else {
+            _blanked = false;
 
-        _blanked = false;
-*/
-
-        // Wait for new frame
-        if (_decode_next_frame) {
-            
-            // read frame here
-/*
-            uint8_t * ptr = nullptr;
+            int64_t index = 0;
+            if (_sequence && !_single_frame->as<bool>().get()) {
+                index = std::min(_block.translate(frame, true).index, _frame_count - 1);
+            }
 
-            for (int j = 0; j < _height; ++j) {
-                memcpy((uint8_t*)_staging_buffer_ptr + j * _width * 4 *sizeof(uint16_t), ptr + j * _width * 4 * sizeof(uint16_t), _width * 4 * sizeof(uint16_t));
+            if (index != _current_frame) {
+                VKD_TRACE("exr wait");
+                auto& slot = _request(index, TaskPriority::High);
+                ts().wait(slot.task);
+                if (slot.ok) {
+                    _uploader->use_staging(slot.staging);
+                } else {
+                    // read_frame's said why, blank rather than whatever the slot last held. read again next visit
+                    _uploader->use_staging(_blank_staging);
+                    slot.frame = -1;
+                }
+                _current_frame = index;
+                update = true;
             }
-*/
-            _decode_next_frame = false;
-            update = true;
+            _read_ahead(index);
         }
 
+        if (params_changed) {
+            _ocio->update(*this, _uploader->get_gpu());
+        }
 
         return update;
     }
 
     void Exr::execute(ExecutionType type, Stream& stream) {
         command_buffer().begin();
-        _uploader->commands(command_buffer());
-        _ocio->execute(command_buffer(), _width, _height);
+        _uploader->commands(command_buffer(), stream);
+        // shrunk before the colour transform, so that only runs over the proxy
+        _proxy->commands(command_buffer().get(), _uploader->get_gpu(), proxy_scale());
+        auto size = proxy_size(glm::ivec2{_width, _height});
+        _ocio->execute(command_buffer(), size.x, size.y);
         command_buffer().end();
 
         stream.submit(command_buffer());
     }
 
-}
\ No newline at end of file
+}
@@ -2,25 +2,30 @@
         
 #include <memory>
 #include <string>
+#include <vector>
 #include <algorithm>
 
 #include "vulkan.hpp"
 #include "engine_node.hpp"
 #include "compute/image_node.hpp"
+#include "compute/proxy_downsample.hpp"
 #include "imgui/ImSequencer.h"
 #include "ui/timeline.hpp"
 #include "blockedit.hpp"
 
 #include "image_uploader.hpp"
+#include "task_handle.hpp"
+#include "vkd_dll.h"
 
 namespace vkd {
     class Kernel;
     class StagingBuffer;
     class StorageBuffer;
+    class AutoMapStagingBuffer;
     struct Frame;
     class OcioNode;
 
-    class Exr : public EngineNode, public ImageNode {
+    class VKDEXPORT Exr : public EngineNode, public ImageNode {
     public:
         Exr();
         ~Exr();
@@ -45,32 +50,74 @@ namespace vkd {
 
         
         std::shared_ptr<Image> get_output_image() const override { return _uploader ? _uploader->get_gpu() : nullptr; }
+        bool proxies_itself() const override { return true; }
         float get_output_ratio() const override { return _width / (float)_height; }
         
         void allocate(VkCommandBuffer buf) override;
         void deallocate() override;
 
+        // a path with #### or %04d in it is a sequence, the number filled in and zero padded
+        static bool is_sequence(const std::string& pattern);
+        static std::string frame_path(const std::string& pattern, int64_t number);
+
+        struct Window {
+            int32_t min_x = 0, min_y = 0;
+            int32_t max_x = 0, max_y = 0;
+            int32_t width() const { return max_x - min_x + 1; }
+            int32_t height() const { return max_y - min_y + 1; }
+        };
+        // decodes one part into half rgba covering the display window. safe to call from any thread
+        static bool read_frame(const std::string& path, int32_t part, const std::string& layer, const Window& display, uint16_t * dst);
+        // of the part, throws GraphException if it can't be read
+        static Window display_window(const std::string& path, int32_t part);
+
     private:
+        // frames are read on workers into a ring of staging buffers ahead of the playhead
+        struct Slot {
+            int64_t frame = -1;
+            std::shared_ptr<AutoMapStagingBuffer> staging = nullptr;
+            TaskHandle task;
+            bool ok = false; // the read succeeded, false until its task is done
+        };
+
+        void _find_sequence();
+        // reads into slot, or whatever _free_slot(frame) gives if that's null
+        Slot& _request(int64_t frame, TaskPriority priority, Slot * slot = nullptr);
+        Slot * _free_slot(int64_t frame);
+        void _read_ahead(int64_t frame);
+        void _invalidate();
+
         int32_t _width = 1, _height = 1;
-        
-        
+        Window _display;
 
-        bool _decode_next_frame = true;
         std::shared_ptr<ParameterInterface> _single_frame = nullptr;
 
         std::shared_ptr<ParameterInterface> _path_param = nullptr;
         std::shared_ptr<ParameterInterface> _frame_param = nullptr;
+        std::shared_ptr<ParameterInterface> _part_param = nullptr;
+        std::shared_ptr<ParameterInterface> _layer_param = nullptr;
+        std::shared_ptr<ParameterInterface> _read_ahead_param = nullptr;
+
+        std::string _pattern;
+        bool _sequence = false;
+        int64_t _first_number = 0;
+        int32_t _part = 0;
+        std::string _layer;
+        int32_t _ahead = 0;
+
+        std::vector<std::unique_ptr<Slot>> _ring;
+        std::shared_ptr<AutoMapStagingBuffer> _blank_staging = nullptr;
 
         std::unique_ptr<ImageUploader> _uploader = nullptr;
 
         BlockEditParams _block;
 
-        int64_t _frame_count = 0; // may not be available.
-
+        int64_t _frame_count = 0;
 
         int64_t _current_frame = -1;
 
         bool _blanked = false;
         std::unique_ptr<OcioNode> _ocio = nullptr;
+        std::unique_ptr<ProxyDownsample> _proxy = nullptr;
     };
 }
\ No newline at end of file
@@ -10,13 +10,57 @@
 
 extern "C" {
 #include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
 }
 
 #include "ffmpeg_init.hpp"
+#include "trace.hpp"
 
 namespace vkd {
     REGISTER_NODE("ffmpeg", "ffmpeg", Ffmpeg);
 
+    namespace {
+        // how the decoder's planes sit, the uploader does the conversion
+        std::optional<ImageUploader::VideoFormat> video_format(AVPixelFormat format) {
+            using Layout = ImageUploader::VideoFormat::Layout;
+            switch (format) {
+            case AV_PIX_FMT_YUV420P:
+            case AV_PIX_FMT_YUVJ420P: return ImageUploader::VideoFormat{Layout::Planar, 1, 8, false, 1, 1};
+            case AV_PIX_FMT_YUV422P:
+            case AV_PIX_FMT_YUVJ422P: return ImageUploader::VideoFormat{Layout::Planar, 1, 8, false, 1, 0};
+            case AV_PIX_FMT_YUV444P:
+            case AV_PIX_FMT_YUVJ444P: return ImageUploader::VideoFormat{Layout::Planar, 1, 8, false, 0, 0};
+            case AV_PIX_FMT_YUV420P10LE: return ImageUploader::VideoFormat{Layout::Planar, 2, 10, false, 1, 1};
+            case AV_PIX_FMT_YUV422P10LE: return ImageUploader::VideoFormat{Layout::Planar, 2, 10, false, 1, 0};
+            case AV_PIX_FMT_YUV444P10LE: return ImageUploader::VideoFormat{Layout::Planar, 2, 10, false, 0, 0};
+            case AV_PIX_FMT_YUV422P12LE: return ImageUploader::VideoFormat{Layout::Planar, 2, 12, false, 1, 0};
+            case AV_PIX_FMT_YUV444P12LE: return ImageUploader::VideoFormat{Layout::Planar, 2, 12, false, 0, 0};
+            case AV_PIX_FMT_NV12: return ImageUploader::VideoFormat{Layout::SemiPlanar, 1, 8, false, 1, 1};
+            case AV_PIX_FMT_P010LE: return ImageUploader::VideoFormat{Layout::SemiPlanar, 2, 10, true, 1, 1};
+            case AV_PIX_FMT_RGB24: return ImageUploader::VideoFormat{Layout::PackedRGB, 1, 8, false, 0, 0};
+            case AV_PIX_FMT_RGB48LE: return ImageUploader::VideoFormat{Layout::PackedRGB, 2, 16, false, 0, 0};
+            case AV_PIX_FMT_GBRP: return ImageUploader::VideoFormat{Layout::PlanarGBR, 1, 8, false, 0, 0};
+            case AV_PIX_FMT_GBRP10LE: return ImageUploader::VideoFormat{Layout::PlanarGBR, 2, 10, false, 0, 0};
+            case AV_PIX_FMT_GBRP12LE: return ImageUploader::VideoFormat{Layout::PlanarGBR, 2, 12, false, 0, 0};
+            default: return std::nullopt;
+            }
+        }
+
+        ImageUploader::Matrix video_matrix(AVColorSpace space, int32_t height) {
+            switch (space) {
+            case AVCOL_SPC_BT709: return ImageUploader::Matrix::BT709;
+            case AVCOL_SPC_BT470BG:
+            case AVCOL_SPC_SMPTE170M:
+            case AVCOL_SPC_SMPTE240M: return ImageUploader::Matrix::BT601;
+            case AVCOL_SPC_BT2020_NCL:
+            case AVCOL_SPC_BT2020_CL: return ImageUploader::Matrix::BT2020;
+            default:
+                // untagged, go by size like everyone else
+                return height > 576 ? ImageUploader::Matrix::BT709 : ImageUploader::Matrix::BT601;
+            }
+        }
+    }
+
     Ffmpeg::Ffmpeg() : _block() {
 
     }
@@ -101,23 +145,41 @@ namespace vkd {
         _block.total_frame_count->as<int>().set_force(_frame_count > 0 ? _frame_count : 100);
         
 
+        auto pix_fmt = _codec_context->pix_fmt != AV_PIX_FMT_NONE ? _codec_context->pix_fmt : (AVPixelFormat)_video_stream->codecpar->format;
+        auto format = video_format(pix_fmt);
+        if (!format) {
+            auto name = av_get_pix_fmt_name(pix_fmt);
+            throw GraphException(std::string("Unsupported pixel format ") + (name ? name : "unknown"));
+        }
+        _pix_fmt = pix_fmt;
+
         _uploader = std::make_unique<ImageUploader>(_device);
-        _uploader->init(_width, _height, ImageUploader::InFormat::yuv420p, ImageUploader::OutFormat::float32, param_hash_name());
+        _uploader->set_video_format(*format);
+        _uploader->init(_width, _height, ImageUploader::InFormat::video, ImageUploader::OutFormat::float32, param_hash_name());
         for (auto&& kern : _uploader->kernels()) {
             register_params(*kern);
         }
 
+        auto range = _codec_context->color_range != AVCOL_RANGE_UNSPECIFIED ? _codec_context->color_range : _video_stream->codecpar->color_range;
+        auto space = _codec_context->colorspace != AVCOL_SPC_UNSPECIFIED ? _codec_context->colorspace : _video_stream->codecpar->color_space;
+        bool full = format->rgb() ? range != AVCOL_RANGE_MPEG : (range == AVCOL_RANGE_JPEG || pix_fmt == AV_PIX_FMT_YUVJ420P || pix_fmt == AV_PIX_FMT_YUVJ422P || pix_fmt == AV_PIX_FMT_YUVJ444P);
+        _uploader->set_video_colour(video_matrix(space, _height), full);
+        _buffer_size = _uploader->get_main_size();
+
         //_local_timeline->frame_count = _frame_count;
 
         //_local_timeline->name = _path_param->as<std::string>().get().c_str();
 
         _current_frame = 0;
 
+        _proxy = std::make_unique<ProxyDownsample>(_device);
+
         _ocio = std::make_unique<OcioNode>(OcioNode::Type::In);
         _ocio->init(*this);
     }
 
     bool Ffmpeg::update(ExecutionType type) {
+        VKD_TRACE("Ffmpeg::update");
         bool updated = false;
 
         auto frame = _frame_param->as<Frame>().get();
@@ -144,6 +206,7 @@ namespace vkd {
 
         // Wait for new frame
         if (_decode_next_frame) {
+            VKD_TRACE("ffmpeg decode");
             std::shared_ptr<AVFrame> avFrame(av_frame_alloc(), [](AVFrame* a){ av_frame_free(&a); });
 
             bool got_frame = false;
@@ -199,11 +262,17 @@ namespace vkd {
             //console << "avframe:" << _codec_context->pix_fmt << std::endl;
 
             if (got_frame) {
-                for (int j = 0; j < _height; ++j) {
-                    memcpy((uint8_t*)_uploader->get_main() + j * _width, avFrame->data[0] + j * avFrame->linesize[0], _width);
-                    if (j < _height / 2) {
-                        memcpy((uint8_t*)_uploader->get_main() + _width * _height       + j * _width/2,   avFrame->data[1] + j * avFrame->linesize[1], _width/2);
-                        memcpy((uint8_t*)_uploader->get_main() + _width * _height * 5/4 + j * _width/2,   avFrame->data[2] + j * avFrame->linesize[2], _width/2);
+                if (avFrame->format != _pix_fmt) {
+                    throw UpdateException("Decoder changed pixel format mid stream");
+                }
+                // just the planes as decoded, the uploader's kernel converts them
+                auto&& planes = _uploader->video_planes();
+                for (int p = 0; p < _uploader->video_plane_count(); ++p) {
+                    auto&& plane = planes[p];
+                    auto dst = (uint8_t*)_uploader->get_main() + plane.offset;
+                    size_t row = std::min(plane.stride, (size_t)std::abs(avFrame->linesize[p]));
+                    for (int j = 0; j < plane.rows; ++j) {
+                        memcpy(dst + j * plane.stride, avFrame->data[p] + j * avFrame->linesize[p], row);
                     }
                 }
             }
@@ -243,8 +312,11 @@ namespace vkd {
 
     void Ffmpeg::execute(ExecutionType type, Stream& stream) {
         command_buffer().begin();
-        _uploader->commands(command_buffer());
-        _ocio->execute(command_buffer(), _width, _height);
+        _uploader->commands(command_buffer(), stream);
+        // shrunk before the colour transform, so that only runs over the proxy
+        _proxy->commands(command_buffer().get(), _uploader->get_gpu(), proxy_scale());
+        auto size = proxy_size(glm::ivec2{_width, _height});
+        _ocio->execute(command_buffer(), size.x, size.y);
         command_buffer().end();
 
         stream.submit(command_buffer());
@@ -7,6 +7,7 @@
 #include "vulkan.hpp"
 #include "engine_node.hpp"
 #include "compute/image_node.hpp"
+#include "compute/proxy_downsample.hpp"
 #include "imgui/ImSequencer.h"
 #include "ui/timeline.hpp"
 
@@ -53,6 +54,7 @@ namespace vkd {
         void deallocate() override;
         
         std::shared_ptr<Image> get_output_image() const override { return _uploader ? _uploader->get_gpu() : nullptr;; }
+        bool proxies_itself() const override { return true; }
         float get_output_ratio() const override { return _width / (float)_height; }
 
         std::optional<BlockEditParams> block_edit_params() const override { return _block; }
@@ -85,8 +87,10 @@ namespace vkd {
         int64_t _current_frame = -1;
 
         size_t _buffer_size = 0;
+        int _pix_fmt = -1; // AVPixelFormat the uploader was set up for
         bool _blanked = false;
 
         std::unique_ptr<OcioNode> _ocio = nullptr;
+        std::unique_ptr<ProxyDownsample> _proxy = nullptr;
     };
 }
\ No newline at end of file
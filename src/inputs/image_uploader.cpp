@@ -1,79 +1,152 @@
 #include "image_uploader.hpp"
 #include "command_buffer.hpp"
+#include "stream.hpp"
 
 namespace vkd {
     
-    void ImageUploader::init(int32_t width, int32_t height, InFormat ifmt, OutFormat ofmt, std::string param_hash_name) {
+    void ImageUploader::init(int32_t width, int32_t height, InFormat ifmt, OutFormat ofmt, std::string param_hash_name, std::shared_ptr<Image> target) {
 
         _width = width;
         _height = height;
         _ifmt = ifmt;
         _ofmt = ofmt;
+        if (_ifmt == InFormat::video) {
+            _plane_count = layout_video_planes(_width, _height, _video_format, 1, _planes);
+        }
 
         auto buffer_size = _buffer_size();
 
-        _staging_buffer = AutoMapStagingBuffer::make(_device, AutoMapStagingBuffer::Mode::Upload, buffer_size);
+        _path = _choose_path(*_device, buffer_size);
+        _staging_buffer = make_staging();
+        std::shared_ptr<Buffer> source = nullptr;
+        if (_path == Path::Direct) {
+            _staging_buffer->debug_name(param_hash_name + " UL (Direct Buffer)");
+            _gpu_buffer = nullptr;
+            source = _staging_buffer;
+        } else {
 
-        _gpu_buffer = std::make_shared<StorageBuffer>(_device);
-        _gpu_buffer->debug_name(param_hash_name + " UL (GPU Buffer)");
-        _gpu_buffer->create(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+            _gpu_buffer = std::make_shared<StorageBuffer>(_device);
+            _gpu_buffer->debug_name(param_hash_name + " UL (GPU Buffer)");
+            _gpu_buffer->create(buffer_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+            source = _gpu_buffer;
+        }
 
-        _image = Image::float_image(_device, {_width, _height}, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+        if (_path == Path::Copy && _device->separate_transfer_queue()) {
+            _transfer_command_buffer = CommandBuffer::make_transfer(_device);
+            _transfer_command_buffer->debug_name(param_hash_name + " UL (transfer)");
+        }
+
+        _owns_image = target == nullptr;
+        _image = _owns_image ? Image::float_image(_device, {_width, _height}, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT) : target;
 
         if (_ifmt == InFormat::yuv420p) {
             _yuv420 = std::make_shared<Kernel>(_device, param_hash_name);
             _yuv420->init("shaders/compute/yuv420.comp.spv", "main", Kernel::default_local_sizes);
             //register_params(*_yuv420);
-            _yuv420->set_arg(0, _gpu_buffer);
+            _yuv420->set_arg(0, source);
             _yuv420->set_arg(1, _image);
         } else if (_ifmt == InFormat::half_rgba) {
             _half_buffer_to_image = std::make_shared<Kernel>(_device, param_hash_name);
             _half_buffer_to_image->init("shaders/compute/half_buffer_to_image.comp.spv", "main", Kernel::default_local_sizes);
             //register_params(*_half_buffer_to_image);
-            _half_buffer_to_image->set_arg(0, _gpu_buffer);
+            _half_buffer_to_image->set_arg(0, source);
             _half_buffer_to_image->set_arg(1, _image);
         } else if (_ifmt == InFormat::bayer_short) {
             _bayer = std::make_shared<Kernel>(_device, param_hash_name);
-            _bayer->init("shaders/compute/short_buffer_to_image.comp.spv", "main", Kernel::default_local_sizes);
-            //register_params(*_half_buffer_to_image);
-            _bayer->set_arg(0, _gpu_buffer);
+            _bayer->init("shaders/compute/bayer_demosaic.comp.spv", "main", Kernel::default_local_sizes);
+            _bayer->set_arg(0, source);
             _bayer->set_arg(1, _image);
         } else if (_ifmt == InFormat::libraw_short) {
             _libraw_short = std::make_shared<Kernel>(_device, param_hash_name);
             _libraw_short->init("shaders/compute/libraw_short.comp.spv", "main", Kernel::default_local_sizes);
-            _libraw_short->set_arg(0, _gpu_buffer);
+            _libraw_short->set_arg(0, source);
             _libraw_short->set_arg(1, _image);
         } else if (_ifmt == InFormat::r8) {
             _r8 = std::make_shared<Kernel>(_device, param_hash_name);
             _r8->init("shaders/compute/r8_buffer_to_image.comp.spv", "main", Kernel::default_local_sizes);
-            _r8->set_arg(0, _gpu_buffer);
+            _r8->set_arg(0, source);
             _r8->set_arg(1, _image);
         } else if (_ifmt == InFormat::rgb8) {
             _rgb8 = std::make_shared<Kernel>(_device, param_hash_name);
             _rgb8->init("shaders/compute/rgb8_buffer_to_image.comp.spv", "main", Kernel::default_local_sizes);
-            _rgb8->set_arg(0, _gpu_buffer);
+            _rgb8->set_arg(0, source);
             _rgb8->set_arg(1, _image);
         }  else if (_ifmt == InFormat::r16) {
             _r16 = std::make_shared<Kernel>(_device, param_hash_name);
             _r16->init("shaders/compute/r16_buffer_to_image.comp.spv", "main", Kernel::default_local_sizes);
-            _r16->set_arg(0, _gpu_buffer);
+            _r16->set_arg(0, source);
             _r16->set_arg(1, _image);
         } else if (_ifmt == InFormat::rgb16) {
             _rgb16 = std::make_shared<Kernel>(_device, param_hash_name);
             _rgb16->init("shaders/compute/rgb16_buffer_to_image.comp.spv", "main", Kernel::default_local_sizes);
-            _rgb16->set_arg(0, _gpu_buffer);
+            _rgb16->set_arg(0, source);
             _rgb16->set_arg(1, _image);
-        } 
+        } else if (_ifmt == InFormat::video) {
+            _video = std::make_shared<Kernel>(_device, param_hash_name);
+            _video->init("shaders/compute/video_to_image.comp.spv", "main", Kernel::default_local_sizes);
+            _video->set_arg(0, source);
+            _video->set_arg(1, _image);
+
+            auto&& f = _video_format;
+            _video->set_push_arg_by_name("_offsets", glm::ivec4(_planes[0].offset, _planes[1].offset, _planes[2].offset, 0));
+            _video->set_push_arg_by_name("_strides", glm::ivec4(_planes[0].stride, _planes[1].stride, _planes[2].stride, 0));
+            _video->set_push_arg_by_name("_format", glm::ivec4((int)f.layout, f.bytes, f.depth | (f.msb ? 1 << 8 : 0), f.chroma_shift_x | (f.chroma_shift_y << 4)));
+            set_video_colour(Matrix::BT709, f.rgb());
+        }
     }
 
     void ImageUploader::allocate(VkCommandBuffer buf) {
-        _image->allocate(buf);
-        _gpu_buffer->allocate();
+        if (_owns_image) {
+            _image->allocate(buf);
+        }
+        if (_gpu_buffer) {
+            _gpu_buffer->allocate();
+        }
     }
 
     void ImageUploader::deallocate() { 
-        _image->deallocate();
-        _gpu_buffer->deallocate();
+        if (_owns_image) {
+            _image->deallocate();
+        }
+        if (_gpu_buffer) {
+            _gpu_buffer->deallocate();
+        }
+    }
+
+    std::shared_ptr<AutoMapStagingBuffer> ImageUploader::make_staging() const {
+        if (_path == Path::Direct) {
+            return AutoMapStagingBuffer::make(_device, AutoMapStagingBuffer::Mode::Upload, _buffer_size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        }
+        return AutoMapStagingBuffer::make(_device, AutoMapStagingBuffer::Mode::Upload, _buffer_size());
+    }
+
+    void ImageUploader::use_staging(const std::shared_ptr<AutoMapStagingBuffer>& staging) {
+        if (staging == _staging_buffer) {
+            return;
+        }
+        _staging_buffer = staging;
+        if (_path == Path::Direct) {
+            // the kernels read it themselves
+            for (auto&& kernel : {_yuv420, _video, _half_buffer_to_image, _bayer, _libraw_short, _r8, _r16, _rgb8, _rgb16}) {
+                if (kernel) {
+                    kernel->set_arg(0, _staging_buffer);
+                }
+            }
+        }
+    }
+
+    ImageUploader::Path ImageUploader::_choose_path(Device& device, size_t size) {
+        // memory that's both mapped and device local (integrated, resizable bar, lavapipe) is fast
+        // enough for the kernels to read directly. a small bar window is left for others
+        constexpr VkMemoryPropertyFlags direct = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        auto&& props = device.memory_properties();
+        for (uint32_t i = 0; i < props.memoryTypeCount; ++i) {
+            auto&& type = props.memoryTypes[i];
+            if ((type.propertyFlags & direct) == direct && props.memoryHeaps[type.heapIndex].size >= size * 8) {
+                return Path::Direct;
+            }
+        }
+        return Path::Copy;
     }
 
     size_t ImageUploader::_buffer_size() const {
@@ -82,7 +155,7 @@ namespace vkd {
         } else if (_ifmt == InFormat::yuv420p) {
             return _width * _height * 1.5 * sizeof(uint8_t);
         } else if (_ifmt == InFormat::bayer_short) {
-            return _width * _height * 4 * sizeof(uint16_t);
+            return ((_width * _height + 1) / 2) * sizeof(uint32_t); // read as uint pairs
         } else if (_ifmt == InFormat::libraw_short) {
             return _width * _height * 4 * sizeof(uint16_t);
         } else if (_ifmt == InFormat::r8) {
@@ -93,7 +166,35 @@ namespace vkd {
             return _width * _height * 1 * sizeof(uint16_t);
         } else if (_ifmt == InFormat::rgb16) {
             return _width * _height * 3 * sizeof(uint16_t);
+        } else if (_ifmt == InFormat::video) {
+            return video_buffer_size(_planes, _plane_count);
+        }
+        return 0;
+    }
+
+    void ImageUploader::set_video_colour(Matrix matrix, bool full_range) {
+        if (!_video) {
+            return;
         }
+
+        float kr, kb;
+        video_matrix_weights(matrix, kr, kb);
+        float kg = 1.0f - kr - kb;
+        glm::vec4 coeffs = {2.0f * (1.0f - kr), -2.0f * kb * (1.0f - kb) / kg, -2.0f * kr * (1.0f - kr) / kg, 2.0f * (1.0f - kb)};
+
+        // limited range codes scale with the bit depth, 16-235 and 16-240 at 8 bits
+        auto&& f = _video_format;
+        float max = (float)((1 << f.depth) - 1);
+        float step = (float)(1 << (f.depth - 8));
+        glm::vec4 range;
+        if (full_range) {
+            range = {0.0f, 1.0f, (float)(1 << (f.depth - 1)) / max, 1.0f};
+        } else {
+            range = {16.0f * step / max, max / (219.0f * step), 128.0f * step / max, max / (224.0f * step)};
+        }
+
+        _video->set_push_arg_by_name("_coeffs", coeffs);
+        _video->set_push_arg_by_name("_range", range);
     }
 
     VkFormat ImageUploader::_output_format() const {
@@ -109,9 +210,40 @@ namespace vkd {
     }
 
     void ImageUploader::commands(VkCommandBuffer buf) {
-        _gpu_buffer->copy(*_staging_buffer, _buffer_size(), buf);
-        _gpu_buffer->barrier(buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        if (_gpu_buffer) {
+            _gpu_buffer->copy(*_staging_buffer, _buffer_size(), buf);
+            _gpu_buffer->barrier(buf, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        }
+
+        _dispatch(buf);
+    }
+
+    void ImageUploader::commands(CommandBuffer& buf, Stream& stream) {
+        if (!stream.has_transfer() || !_transfer_command_buffer) {
+            commands(buf.get());
+            return;
+        }
+
+        auto compute_family = _device->compute_queue_index();
+        auto transfer_family = _device->transfer_queue_index();
+        {
+            auto scope = _transfer_command_buffer->record();
+            auto tbuf = _transfer_command_buffer->get();
+            _gpu_buffer->copy(*_staging_buffer, _buffer_size(), tbuf);
+            if (_device->transfer_ownership()) {
+                _gpu_buffer->release(tbuf, transfer_family, compute_family, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            }
+        }
+        // buf's last run read the buffer we're about to overwrite
+        stream.submit_transfer(*_transfer_command_buffer, buf.last_timeline_value(), true);
+
+        if (_device->transfer_ownership()) {
+            _gpu_buffer->acquire(buf.get(), transfer_family, compute_family, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        }
+        _dispatch(buf.get());
+    }
 
+    void ImageUploader::_dispatch(VkCommandBuffer buf) {
         if (_ifmt == InFormat::half_rgba) {
             _half_buffer_to_image->dispatch(buf, _width, _height);
         } else if (_ifmt == InFormat::yuv420p) {
@@ -128,6 +260,8 @@ namespace vkd {
             _r16->dispatch(buf, _width, _height);
         } else if (_ifmt == InFormat::rgb16) {
             _rgb16->dispatch(buf, _width, _height);
+        } else if (_ifmt == InFormat::video) {
+            _video->dispatch(buf, _width, _height);
         }
     }
 
@@ -1,12 +1,15 @@
 #pragma once
         
+#include <array>
 #include <memory>
 
 #include "buffer.hpp"
 #include "image.hpp"
+#include "video_format.hpp"
 #include "compute/kernel.hpp"
 
 namespace vkd {
+    class Stream;
     class ImageUploader {
     public:
         ImageUploader(const std::shared_ptr<Device>& device) : _device(device) {}
@@ -18,22 +21,43 @@ namespace vkd {
             yuv420p,
             half_rgba,
             libraw_short,
-            bayer_short,
+            bayer_short, // single channel cfa mosaic, demosaiced on the gpu
             r8,
             rgb8,
             r16,
-            rgb16
+            rgb16,
+            video // decoder output, laid out as set_video_format says
         };
 
+        using VideoFormat = vkd::VideoFormat;
+        using Matrix = VideoMatrix;
+        using Plane = VideoPlane;
+
         enum class OutFormat {
             half16,
             float32
         };
 
-        void init(int32_t width, int32_t height, InFormat ifmt, OutFormat ofmt, std::string param_hash_name);
+        enum class Path {
+            Copy, // staging copied to a device local buffer the kernel reads
+            Direct // the kernel reads the mapped buffer itself
+        };
+
+        // target lets two uploaders take turns writing the same image
+        void init(int32_t width, int32_t height, InFormat ifmt, OutFormat ofmt, std::string param_hash_name, std::shared_ptr<Image> target = nullptr);
+        // before init, for InFormat::video
+        void set_video_format(const VideoFormat& format) { _video_format = format; }
+        // after init, can change whenever
+        void set_video_colour(Matrix matrix, bool full_range);
+        // where each plane goes in get_main(), for the decoder to copy rows into
+        const auto& video_planes() const { return _planes; }
+        int32_t video_plane_count() const { return _plane_count; }
         
         void commands(CommandBuffer& buf);
         void commands(VkCommandBuffer buf);
+        // with a transfer queue the staging copy is submitted there now, ahead of buf,
+        // and buf just takes the buffer over. otherwise it's all recorded into buf
+        void commands(CommandBuffer& buf, Stream& stream);
         void execute();
 
         std::vector<std::shared_ptr<Kernel>> kernels() const {
@@ -41,6 +65,9 @@ namespace vkd {
             if (_yuv420) {
                 ks.push_back(_yuv420);
             }
+            if (_video) {
+                ks.push_back(_video);
+            }
             if (_half_buffer_to_image) {
                 ks.push_back(_half_buffer_to_image);
             }
@@ -58,6 +85,9 @@ namespace vkd {
             if (_yuv420) {
                 _yuv420->set_push_arg_by_name(name, value);
             }
+            if (_video) {
+                _video->set_push_arg_by_name(name, value);
+            }
             if (_half_buffer_to_image) {
                 _half_buffer_to_image->set_push_arg_by_name(name, value);
             }
@@ -71,25 +101,41 @@ namespace vkd {
 
         void * get_main() const { return _staging_buffer->get(); }
         size_t get_main_size() const { return _staging_buffer->size(); }
+
+        // another staging buffer like ours, so frames can be decoded ahead into a ring of them
+        std::shared_ptr<AutoMapStagingBuffer> make_staging() const;
+        // upload from this one from now on
+        void use_staging(const std::shared_ptr<AutoMapStagingBuffer>& staging);
         auto get_gpu() const { return _image; }
+        Path path() const { return _path; }
 
         void allocate(VkCommandBuffer buf);
         void deallocate();
     private:
+        static Path _choose_path(Device& device, size_t size);
+        void _dispatch(VkCommandBuffer buf);
         size_t _buffer_size() const;
         VkFormat _output_format() const;
         InFormat _ifmt = InFormat::yuv420p;
         OutFormat _ofmt = OutFormat::float32;
+        Path _path = Path::Copy;
 
         std::shared_ptr<Device> _device = nullptr;
 
         int32_t _width = 1, _height = 1;
 
+        VideoFormat _video_format;
+        std::array<Plane, 3> _planes;
+        int32_t _plane_count = 0;
+
         std::shared_ptr<AutoMapStagingBuffer> _staging_buffer = nullptr;
         std::shared_ptr<StorageBuffer> _gpu_buffer = nullptr;
         std::shared_ptr<Image> _image = nullptr;
+        bool _owns_image = true;
+        CommandBufferPtr _transfer_command_buffer = nullptr;
 
         std::shared_ptr<Kernel> _yuv420 = nullptr;
+        std::shared_ptr<Kernel> _video = nullptr;
         std::shared_ptr<Kernel> _half_buffer_to_image = nullptr;
         std::shared_ptr<Kernel> _bayer = nullptr;
         std::shared_ptr<Kernel> _libraw_short = nullptr;
@@ -9,14 +9,61 @@
 #include "ocio/ocio_functional.hpp"
 #include "ocio/ocio_static.hpp"
 
-#include "host_scheduler.hpp"
-
 #define LIBRAW_NO_WINSOCK2 
 #include "libraw/libraw.h"
 
 namespace vkd {
     REGISTER_NODE("raw", "raw", Raw);
 
+    namespace {
+        constexpr float libraw_short_max = 16000.0f;
+
+        glm::dvec3 xy_to_xyz(glm::dvec2 xy) {
+            return {xy.x / xy.y, 1.0, (1.0 - xy.x - xy.y) / xy.y};
+        }
+
+        glm::dmat3 rgb_to_xyz(glm::dvec2 r, glm::dvec2 g, glm::dvec2 b, glm::dvec2 white) {
+            glm::dmat3 primaries{xy_to_xyz(r), xy_to_xyz(g), xy_to_xyz(b)};
+            glm::dvec3 scale = glm::inverse(primaries) * xy_to_xyz(white);
+            return {primaries[0] * scale.x, primaries[1] * scale.y, primaries[2] * scale.z};
+        }
+
+        glm::dmat3 bradford(glm::dvec2 from, glm::dvec2 to) {
+            const glm::dmat3 cone = glm::transpose(glm::dmat3{
+                0.8951, 0.2664, -0.1614,
+                -0.7502, 1.7135, 0.0367,
+                0.0389, -0.0685, 1.0296
+            });
+            glm::dvec3 ratio = (cone * xy_to_xyz(to)) / (cone * xy_to_xyz(from));
+            glm::dmat3 scale{1.0};
+            scale[0][0] = ratio.x;
+            scale[1][1] = ratio.y;
+            scale[2][2] = ratio.z;
+            return glm::inverse(cone) * scale * cone;
+        }
+
+        // linear srgb to the dcraw output spaces, close enough to libraw's tables for a preview
+        glm::mat3 dcraw_space_from_srgb(int32_t colour_space) {
+            const glm::dvec2 d65{0.3127, 0.3290};
+            const glm::dvec2 d50{0.3457, 0.3585};
+            const glm::dvec2 aces{0.32168, 0.33767};
+
+            auto srgb = rgb_to_xyz({0.64, 0.33}, {0.30, 0.60}, {0.15, 0.06}, d65);
+            glm::dmat3 space{1.0}; // xyz
+            switch (colour_space) {
+            case 0: space = srgb; break;
+            case 1: space = rgb_to_xyz({0.64, 0.33}, {0.21, 0.71}, {0.15, 0.06}, d65); break;
+            case 2: space = bradford(d50, d65) * rgb_to_xyz({0.7347, 0.2653}, {0.1152, 0.8264}, {0.1566, 0.0177}, d50); break;
+            case 3: space = bradford(d50, d65) * rgb_to_xyz({0.7347, 0.2653}, {0.1596, 0.8404}, {0.0366, 0.0001}, d50); break;
+            case 5: space = bradford(aces, d65) * rgb_to_xyz({0.7347, 0.2653}, {0.0, 1.0}, {0.0001, -0.0770}, aces); break;
+            case 6: space = rgb_to_xyz({0.680, 0.320}, {0.265, 0.690}, {0.150, 0.060}, d65); break;
+            case 7: space = rgb_to_xyz({0.708, 0.292}, {0.170, 0.797}, {0.131, 0.046}, d65); break;
+            default: break;
+            }
+            return glm::mat3(glm::inverse(space) * srgb);
+        }
+    }
+
     Raw::Raw() : _block() {
 
     }
@@ -31,49 +78,28 @@ namespace vkd {
         _info_box->as<std::string>().set_default("");
 
         _reset = make_param<ParameterType::p_bool>(*this, "reset", 0, {"button"});
+
+        // demosaic on the gpu straight after unpack, dcraw catches up in the background
+        _fast_preview = make_param<ParameterType::p_bool>(*this, "fast preview", 0);
+        _fast_preview->as<bool>().set_default(true);
     }
 
     Raw::~Raw() {
-        if (_process_task) {
-            ts().wait(_process_task);
-        }
-        
-        _process_task = nullptr;
+        release_jobs();
     }
 
-
-    std::string Raw::get_metadata(LibRaw& imProc) const {
-            std::stringstream strm;
-
-            strm << "make: " << imProc.imgdata.idata.make << "\n";
-            strm << "model: " << imProc.imgdata.idata.model << "\n";
-            strm << "n-make: " << imProc.imgdata.idata.normalized_make << "\n";
-            strm << "n-model: " << imProc.imgdata.idata.normalized_model << "\n";
-            strm << "software: " << imProc.imgdata.idata.software << "\n";
-            strm << "raw count: " << imProc.imgdata.idata.raw_count << "\n";
-            strm << "colours: " << imProc.imgdata.idata.colors << "\n";
-            strm << "filters: " << std::hex << imProc.imgdata.idata.colors << std::dec <<"\n";
-            strm << "raw width: " << imProc.imgdata.sizes.raw_width <<"\n";        
-            strm << "raw height: " << imProc.imgdata.sizes.raw_height <<"\n";
-            strm << "width: " << imProc.imgdata.sizes.width <<"\n";        
-            strm << "height: " << imProc.imgdata.sizes.height <<"\n";     
-            strm << "black level: " << imProc.imgdata.color.black <<"\n";  
-            strm << "c-black level: r: " << imProc.imgdata.color.cblack[0] << " g: " << imProc.imgdata.color.cblack[1] << " b: " << imProc.imgdata.color.cblack[2] << "\n";  
-            strm << "c-black level: r2: " << imProc.imgdata.color.cblack[3] << " g2: " << imProc.imgdata.color.cblack[4] << " b2: " << imProc.imgdata.color.cblack[5] << "\n"; 
-            strm << "data max: " << imProc.imgdata.color.data_maximum <<"\n";
-            strm << "max: " << imProc.imgdata.color.maximum <<"\n";
-            strm << "iso: " << imProc.imgdata.other.iso_speed <<"\n";
-            strm << "shutter: " << imProc.imgdata.other.shutter <<"\n";
-            strm << "aperture: " << imProc.imgdata.other.aperture <<"\n";
-            strm << "focal length: " << imProc.imgdata.other.focal_len <<"\n";
-            strm << "time: " << imProc.imgdata.other.timestamp <<"\n";
-            strm << "num: " << imProc.imgdata.other.shot_order <<"\n";
-
-            return strm.str();
+    void Raw::release_jobs() {
+        // jobs don't touch the node, anything already running just finishes into the cache
+        RawDecodeService::Get().release(_unpack, this);
+        RawDecodeService::Get().release(_develop, this);
+        _unpack = nullptr;
+        _develop = nullptr;
     }
 
+
     void Raw::init() {
-        
+        release_jobs();
+
         if (_path_param->as<std::string>().get().size() < 3) {
             throw GraphException("No path provided to raw node.");
         } 
@@ -108,10 +134,12 @@ namespace vkd {
             register_params(*kern);
         }
 
-        _uploader->set_push_arg_by_name("vkd_shortmax", (float)16000.0f);//imProc.imgdata.color.maximum);
+        _uploader->set_push_arg_by_name("vkd_shortmax", libraw_short_max);//imProc.imgdata.color.maximum);
 
         _current_frame = 0;
 
+        _proxy = std::make_unique<ProxyDownsample>(_device);
+
         _ocio = std::make_unique<OcioNode>(OcioNode::Type::In);
         _ocio->init(*this);
 
@@ -120,75 +148,136 @@ namespace vkd {
         imProc.open_file(_path_param->as<std::string>().get().c_str());
         _width = imProc.imgdata.sizes.width;
         _height = imProc.imgdata.sizes.height;
+        _info_box->as<std::string>().set(RawDecodeService::metadata(imProc));
 
         _uploader->init(_width, _height, ImageUploader::InFormat::libraw_short, ImageUploader::OutFormat::float32, param_hash_name());
+
+        _preview = std::make_unique<ImageUploader>(_device);
+        _preview->init(_width, _height, ImageUploader::InFormat::bayer_short, ImageUploader::OutFormat::float32, param_hash_name(), _uploader->get_gpu());
+        for (auto&& kern : _preview->kernels()) {
+            register_params(*kern);
+        }
+
+        _mosaic = nullptr;
+        _mosaic_tried = false;
+        _showing_preview = false;
+        _current_dcraw_col_space = -1;
+        _decode_error.clear();
     }
 
-    void Raw::load_to_uploader() {        
-        auto ptr = _device->host_cache().get(hash());
+    void Raw::load_to_uploader() {
+        int32_t colour_space = _dcraw_colour_space->as<int>().get();
+        auto ptr = _device->host_cache().get(hash(colour_space));
 
         if (ptr) {
             auto dim = ptr->dim();
             _width = dim.x;
             _height = dim.y;
-        } else {
-            auto task = std::make_unique<enki::TaskSet>(1, [this](enki::TaskSetPartition range, uint32_t threadnum) mutable {
-                libraw_process();
-            });
-            _process_task = task.get();
-            ts().add(std::move(task));
-            throw PendingException{"dcraw processing..."};
+
+            _current_dcraw_col_space = colour_space;
+            _showing_preview = false;
+            memcpy(_uploader->get_main(), ptr->data(), ptr->size());
+            return;
         }
 
-        _current_dcraw_col_space = _dcraw_colour_space->as<int>().get();
-        
-        memcpy(_uploader->get_main(), ptr->data(), ptr->size());
-    }
+        auto&& service = RawDecodeService::Get();
+        auto path = _path_param->as<std::string>().get();
+        bool fast_preview = _fast_preview->as<bool>().get();
 
-    bool Raw::working() const {
-        if (_process_task && !ts().is_complete(_process_task)) {
-            return true;
+        if (fast_preview && !_mosaic && !_mosaic_tried) {
+            _mosaic_tried = true;
+            _unpack = service.unpack(_device, this, path, _width, _height);
         }
-        return false;
-    }
 
-    void Raw::libraw_process() {
-        
-        std::unique_ptr<LibRaw> imProcPtr = std::make_unique<LibRaw>();
-        auto&& imProc = *imProcPtr;
+        if (_develop && _develop->key().value() != hash(colour_space).value()) {
+            // colour space moved on while it was queued
+            service.release(_develop, this);
+            _develop = nullptr;
+        }
+        if (!_develop) {
+            // queued behind the unpack so it can carry on from it
+            _develop = service.develop(_device, this, path, colour_space, _width, _height, _unpack);
+        }
 
-        imProc.imgdata.params.output_bps = 16;
-        imProc.imgdata.params.output_color = _dcraw_colour_space->as<int>().get() + 1;
+        if (fast_preview && _mosaic) {
+            load_preview(colour_space);
+            return;
+        }
 
-        imProc.open_file(_path_param->as<std::string>().get().c_str());
+        throw PendingException{_unpack ? "unpacking raw..." : "dcraw processing..."};
+    }
+
+    void Raw::load_preview(int32_t colour_space) {
+        auto matrix = dcraw_space_from_srgb(colour_space) * _mosaic->rgb_cam;
 
-        imProc.unpack();
-        imProc.dcraw_process();
+        _preview->set_push_arg_by_name("vkd_cfa", _mosaic->cfa);
+        _preview->set_push_arg_by_name("vkd_levels", glm::vec4(_mosaic->black, _mosaic->white));
+        _preview->set_push_arg_by_name("vkd_wb", glm::vec4(_mosaic->wb, 65535.0f / libraw_short_max));
+        _preview->set_push_arg_by_name("vkd_cam_r", glm::vec4(matrix[0][0], matrix[1][0], matrix[2][0], 0.0f));
+        _preview->set_push_arg_by_name("vkd_cam_g", glm::vec4(matrix[0][1], matrix[1][1], matrix[2][1], 0.0f));
+        _preview->set_push_arg_by_name("vkd_cam_b", glm::vec4(matrix[0][2], matrix[1][2], matrix[2][2], 0.0f));
 
-        _info_box->as<std::string>().set(get_metadata(imProc));
+        memcpy(_preview->get_main(), _mosaic->data.data(), _mosaic->data.size() * sizeof(uint16_t));
 
-        auto cr = StaticHostImage::make(_width, _height, 4, sizeof(uint16_t));
-        memcpy(cr->data(), imProc.imgdata.image, cr->size());
+        _current_dcraw_col_space = colour_space;
+        _showing_preview = true;
+    }
 
-        _device->host_cache().add(hash(), std::move(cr));
+    bool Raw::working() const {
+        return (_unpack && !_unpack->complete()) || (_develop && !_develop->complete());
     }
 
     void Raw::allocate(VkCommandBuffer buf) {
         _uploader->allocate(buf);
+        if (_showing_preview) {
+            _preview->allocate(buf);
+        }
     }
 
     void Raw::deallocate() { 
         _uploader->deallocate();
+        _preview->deallocate();
     }
 
     bool Raw::update(ExecutionType type) {
+        if (!_decode_error.empty()) {
+            if (!_reset->as<bool>().get()) {
+                throw GraphException(_decode_error);
+            }
+            _decode_error.clear(); // try the file again
+        }
 
         bool update = false;
-        if (_process_task && !_process_task->GetIsComplete()) {
+        if (_unpack && !_unpack->complete()) {
             return false;
-        } else if (_process_task) {
-            _process_task = nullptr;
+        } else if (_unpack) {
+            _mosaic = _unpack->mosaic();
+            if (_mosaic && (_mosaic->width != _width || _mosaic->height != _height)) {
+                _mosaic = nullptr;
+            }
+            RawDecodeService::Get().release(_unpack, this);
+            _unpack = nullptr;
+            update = true;
+        }
+
+        bool reload = false;
+        if (_develop && _develop->complete()) {
+            if (!_develop->metadata().empty()) {
+                _info_box->as<std::string>().set(_develop->metadata());
+            }
+            bool failed = _develop->failed();
+            if (failed) {
+                _decode_error = "Error decoding raw file " + _path_param->as<std::string>().get() + ", " + _develop->error();
+            }
+            RawDecodeService::Get().release(_develop, this);
+            _develop = nullptr;
+            if (failed) {
+                throw GraphException(_decode_error);
+            }
             update = true;
+            reload = true; // swap the full render in over the preview
+        } else if (_develop && !(_fast_preview->as<bool>().get() && _mosaic)) {
+            return false;
         }
         
         for (auto&& pmap : _params) {
@@ -200,15 +289,14 @@ namespace vkd {
         }
         if (update) {
 
-            if (_current_dcraw_col_space != _dcraw_colour_space->as<int>().get()) {
+            if (reload || _current_dcraw_col_space != _dcraw_colour_space->as<int>().get()) {
                 load_to_uploader();
             }
 
             if (_reset->as<bool>().get()) {
                 _reset->as<bool>().set(false);
 
-                Hash h{_path_param->as<std::string>().get(), _current_dcraw_col_space};
-                _device->host_cache().remove(h);
+                _device->host_cache().remove(hash(_current_dcraw_col_space));
             }
 
             _ocio->update(*this, _uploader->get_gpu());
@@ -219,8 +307,15 @@ namespace vkd {
 
     void Raw::execute(ExecutionType type, Stream& stream) {
         command_buffer().begin();
-        _uploader->commands(command_buffer());
-        _ocio->execute(command_buffer(), _width, _height);
+        if (_showing_preview) {
+            _preview->commands(command_buffer(), stream);
+        } else {
+            _uploader->commands(command_buffer(), stream);
+        }
+        // shrunk before the colour transform, so that only runs over the proxy
+        _proxy->commands(command_buffer().get(), _uploader->get_gpu(), proxy_scale());
+        auto size = proxy_size(glm::ivec2{_width, _height});
+        _ocio->execute(command_buffer(), size.x, size.y);
         command_buffer().end();
 
         stream.submit(command_buffer());
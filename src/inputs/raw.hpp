@@ -7,6 +7,7 @@
 #include "vulkan.hpp"
 #include "engine_node.hpp"
 #include "compute/image_node.hpp"
+#include "compute/proxy_downsample.hpp"
 #include "imgui/ImSequencer.h"
 #include "ui/timeline.hpp"
 #include "blockedit.hpp"
@@ -14,10 +15,7 @@
 
 #include "image_uploader.hpp"
 #include "ocio/ocio_functional.hpp"
-
-namespace enki {
-    class TaskSet;
-}
+#include "services/raw_decode_service.hpp"
 
 class LibRaw;
 
@@ -46,7 +44,6 @@ namespace vkd {
         void post_setup() override;
 
         void init() override;
-        std::string get_metadata(LibRaw& improc) const;
         
         bool update(ExecutionType type) override;
         void commands(VkCommandBuffer buf, uint32_t width, uint32_t height) override {}
@@ -54,17 +51,19 @@ namespace vkd {
 
         
         std::shared_ptr<Image> get_output_image() const override { return _uploader ? _uploader->get_gpu() : nullptr; }
+        bool proxies_itself() const override { return true; }
         float get_output_ratio() const override { return _width / (float)_height; }
         
         void allocate(VkCommandBuffer buf) override;
         void deallocate() override;
 
-        Hash hash() { return Hash{_path_param->as<std::string>().get(), _current_dcraw_col_space}; }
+        Hash hash(int32_t colour_space) { return RawDecodeService::develop_key(_path_param->as<std::string>().get(), colour_space); }
 
         bool working() const override;
     private:
-        void libraw_process();
         void load_to_uploader();
+        void load_preview(int32_t colour_space);
+        void release_jobs();
         int32_t _width = 1, _height = 1;
         
         
@@ -73,11 +72,13 @@ namespace vkd {
         std::shared_ptr<ParameterInterface> _frame_param = nullptr;
         std::shared_ptr<ParameterInterface> _info_box = nullptr;
         std::shared_ptr<ParameterInterface> _reset = nullptr;
+        std::shared_ptr<ParameterInterface> _fast_preview = nullptr;
 
         std::shared_ptr<ParameterInterface> _dcraw_colour_space = nullptr;
         int32_t _current_dcraw_col_space = 0;
 
         std::unique_ptr<ImageUploader> _uploader = nullptr;
+        std::unique_ptr<ImageUploader> _preview = nullptr;
 
         BlockEditParams _block;
 
@@ -87,7 +88,14 @@ namespace vkd {
 
         bool _blanked = false;
 
-        enki::TaskSet * _process_task = nullptr;
+        RawDecodeService::JobPtr _unpack = nullptr;
+        RawDecodeService::JobPtr _develop = nullptr;
+        std::shared_ptr<RawMosaic> _mosaic = nullptr;
+        bool _mosaic_tried = false;
+        bool _showing_preview = false;
+        // a develop that failed, nothing's asked for again until the path changes or reset's pressed
+        std::string _decode_error;
         std::unique_ptr<OcioNode> _ocio = nullptr;
+        std::unique_ptr<ProxyDownsample> _proxy = nullptr;
     };
 }
\ No newline at end of file
@@ -37,14 +37,15 @@ namespace vkd {
 
         auto devices = sane::Service::Get().devices();
         
-        _scan_device = make_param<int>(*this, "sane device", 0, {"enum"});
+        _scan_device = make_param<int>(*this, "sane device", 0, {"enum", "init"});
         _scan_device->as<int>().max(devices.size());
         _scan_device->as<int>().set_default(0);
         _scan_device->enum_names(devices);
 
-        _format_width = make_param<int>(*this, "_format_width", 0, {});
-        _format_height = make_param<int>(*this, "_format_height", 0, {});
-        _format_format = make_param<int>(*this, "_format_format", 0, {});
+        // the uploader's made to fit these in init
+        _format_width = make_param<int>(*this, "_format_width", 0, {"init"});
+        _format_height = make_param<int>(*this, "_format_height", 0, {"init"});
+        _format_format = make_param<int>(*this, "_format_format", 0, {"init"});
     }
 
     Sane::~Sane() {
@@ -76,6 +77,8 @@ namespace vkd {
         }
         recreate_uploader();
 
+        _proxy = std::make_unique<ProxyDownsample>(_device);
+
         _ocio = std::make_unique<OcioNode>(OcioNode::Type::In);
         _ocio->init(*this, ocio_functional::scan_space_index());
     }
@@ -92,6 +95,10 @@ namespace vkd {
 
         // service params
         _dynamic_params = sane::Service::Get().params(*this, _scan_device->as<int>().get());
+        // resolution, mode and the scan area all change the format init reads
+        for (auto&& param : _dynamic_params) {
+            param.second->tag("init");
+        }
 
         update_params();
         
@@ -134,11 +141,9 @@ namespace vkd {
             throw UpdateException("Failed to launch scan.");
         }
         _scan_complete = false;
-        auto task = std::make_unique<enki::TaskSet>(1, [this](enki::TaskSetPartition range, uint32_t threadnum) mutable {
+        _process_task = ts().add("sane scan", [this]() {
             sane_scan();
         });
-        _process_task = task.get();
-        ts().add(std::move(task));
         throw PendingException{"SANE processing..."};
     }
 
@@ -153,10 +158,10 @@ namespace vkd {
         
         bool update = false;
 
-        if (_process_task && !_process_task->GetIsComplete()) {
+        if (_process_task && !ts().is_complete(_process_task)) {
             return false;
         } else if (_process_task) {
-            _process_task = nullptr;
+            _process_task = {};
             update = true;
         }
 
@@ -222,8 +227,11 @@ namespace vkd {
     void Sane::execute(ExecutionType type, Stream& stream) {
 
         command_buffer().begin();
-        _uploader->commands(command_buffer());
-        _ocio->execute(command_buffer(), _format.width, _format.height);
+        _uploader->commands(command_buffer(), stream);
+        // shrunk before the colour transform, so that only runs over the proxy
+        _proxy->commands(command_buffer().get(), _uploader->get_gpu(), proxy_scale());
+        auto size = proxy_size(glm::ivec2{_format.width, _format.height});
+        _ocio->execute(command_buffer(), size.x, size.y);
         command_buffer().end();
 
         stream.submit(command_buffer());
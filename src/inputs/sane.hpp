@@ -7,6 +7,7 @@
 #include "vulkan.hpp"
 #include "engine_node.hpp"
 #include "compute/image_node.hpp"
+#include "compute/proxy_downsample.hpp"
 #include "imgui/ImSequencer.h"
 #include "ui/timeline.hpp"
 #include "blockedit.hpp"
@@ -49,6 +50,7 @@ namespace vkd {
         void execute(ExecutionType type, Stream& stream) override;
 
         std::shared_ptr<Image> get_output_image() const override { return _uploader ? _uploader->get_gpu() : nullptr; }
+        bool proxies_itself() const override { return true; }
         float get_output_ratio() const override { return _format.width / (float)_format.height; }
 
         void allocate(VkCommandBuffer buf) override;
@@ -81,10 +83,11 @@ namespace vkd {
 
         BlockEditParams _block;
 
-        enki::TaskSet * _process_task = nullptr;
+        TaskHandle _process_task;
 
         std::atomic_bool _scan_complete = false;
 
         std::unique_ptr<OcioNode> _ocio = nullptr;
+        std::unique_ptr<ProxyDownsample> _proxy = nullptr;
     };
 }
\ No newline at end of file
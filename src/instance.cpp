@@ -2,6 +2,7 @@
 #include "instance.hpp"
 #include "vulkan.hpp"
 #include <algorithm>
+#include <cstdlib>
 
 namespace vkd {
 
@@ -142,8 +143,8 @@ namespace vkd {
         // GPU selection
 
         // Select physical device to be used for the Vulkan example
-        // Defaults to the first device unless specified by command line
-        uint32_t selectedDevice = 0;
+        // Defaults to the first device unless VKD_DEVICE names another, eg. llvmpipe for headless runs
+        _selected_device = 0;
 
         _physical_device_props.resize(gpuCount);
         _physical_device_feats.resize(gpuCount);
@@ -156,6 +157,17 @@ namespace vkd {
             i++;
         }
 
+        if (auto env = std::getenv("VKD_DEVICE")) {
+            auto found = std::find_if(_physical_device_props.begin(), _physical_device_props.end(), [env](const VkPhysicalDeviceProperties& props) {
+                return std::string(props.deviceName).find(env) != std::string::npos;
+            });
+            if (found != _physical_device_props.end()) {
+                _selected_device = found - _physical_device_props.begin();
+            } else {
+                console << "No device named like " << env << ", using " << _physical_device_props[0].deviceName << std::endl;
+            }
+        }
+
         if (_validation) {
             VkDebugUtilsMessengerCreateInfoEXT debug_messenger_info{};
             debug_messenger_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
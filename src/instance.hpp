@@ -20,7 +20,8 @@ namespace vkd {
         const auto& enabled_instance_extensions() const { return _enabled_instance_extensions; }
         const auto& instance_layer_properties() const { return _instance_layer_properties; }
 
-        VkPhysicalDevice get_physical_device() const { return _physical_devices[0]; }
+        // the first, or the first named like VKD_DEVICE
+        VkPhysicalDevice get_physical_device() const { return _physical_devices[_selected_device]; }
 
         const auto& physical_device_props() const { return _physical_device_props; }
         const auto& physical_device_feats() const { return _physical_device_feats; }
@@ -37,6 +38,7 @@ namespace vkd {
         std::vector<VkLayerProperties> _instance_layer_properties;
 
         std::vector<VkPhysicalDevice> _physical_devices;
+        size_t _selected_device = 0;
         std::vector<VkPhysicalDeviceProperties> _physical_device_props;
         std::vector<VkPhysicalDeviceFeatures> _physical_device_feats;
         std::vector<VkPhysicalDeviceMemoryProperties> _physical_device_mem_props;
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include <iostream>
+#include <limits>
 
 #include "memory_pool.hpp"
 #include "device.hpp"
@@ -14,6 +15,7 @@ namespace vkd {
     }
 
     VkDeviceMemory MemoryPool::allocate(VkDeviceSize size, VkMemoryPropertyFlags memory_property_flags, uint32_t memory_type_index) {
+        std::scoped_lock lock(_mutex);
         int i = 0;
         for (auto&& entry : _pool) {
             if (size > entry.size || entry.memory_type_index != memory_type_index || entry.memory_property_flags != memory_property_flags) {
@@ -30,6 +32,15 @@ namespace vkd {
             i++;
         }
 
+        // make room from the pool before asking the driver for more
+        uint32_t heap_index = _heap_index(memory_type_index);
+        {
+            auto heap = _heaps()[heap_index];
+            if (heap.usage + size + _headroom > heap.budget) {
+                _free_pooled(heap_index, heap.usage + size + _headroom - heap.budget);
+            }
+        }
+
         VkDeviceMemory mem = VK_NULL_HANDLE;
 
         // or alloc
@@ -39,6 +50,16 @@ namespace vkd {
         mem_alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
         mem_alloc_info.allocationSize = size;
         mem_alloc_info.memoryTypeIndex = memory_type_index;
+
+        console << "Pool allocating " << size / (1024.0 * 1024.0) << "mb allocation." << std::endl;
+        VkResult result = vkAllocateMemory(_device.logical_device(), &mem_alloc_info, nullptr, &mem);
+        if (result == VK_ERROR_OUT_OF_DEVICE_MEMORY || result == VK_ERROR_OUT_OF_HOST_MEMORY) {
+            // the budget was off, give back everything pooled on the heap and try once more
+            if (_free_pooled(heap_index, std::numeric_limits<VkDeviceSize>::max()) > 0) {
+                result = vkAllocateMemory(_device.logical_device(), &mem_alloc_info, nullptr, &mem);
+            }
+        }
+        VK_CHECK_RESULT(result);
         
         if (memory_property_flags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
             _device.memory_manager().add_host_buffer(size);
@@ -46,21 +67,20 @@ namespace vkd {
             _device.memory_manager().add_device_image(size);
         }
 
-        console << "Pool allocating " << size / (1024.0 * 1024.0) << "mb allocation." << std::endl;
-        VK_CHECK_RESULT(vkAllocateMemory(_device.logical_device(), &mem_alloc_info, nullptr, &mem));
         _allocs[mem] = {size, memory_property_flags, memory_type_index};
-
+        _heap_allocated[heap_index] += size;
 
         return mem;
     }
 
     bool MemoryPool::deallocate(VkDeviceMemory mem) {
+        std::scoped_lock lock(_mutex);
         auto search = _allocs.find(mem);
         if (search == _allocs.end()) {
             return false;
         }
 
-        _pool.push_back({mem, search->second.size, search->second.memory_property_flags, search->second.memory_type_index});
+        _pool.push_back({mem, search->second.size, search->second.memory_property_flags, search->second.memory_type_index, ++_returns});
         std::sort(_pool.begin(), _pool.end(), [](const Alloc& lhs, const Alloc& rhs) { return lhs.size < rhs.size; });
 
         return true;
@@ -80,24 +100,71 @@ namespace vkd {
             _device.memory_manager().remove_device_image(search->second.size);
         }
 
+        _heap_allocated[_heap_index(search->second.memory_type_index)] -= search->second.size;
         _allocs.erase(mem);
 
         return true;
     }
 
-    void MemoryPool::trim(size_t limit) {
-        auto current_mem = _device.memory_manager().device_memory_used();
+    uint32_t MemoryPool::_heap_index(uint32_t memory_type_index) const {
+        return _device.memory_properties().memoryTypes[memory_type_index].heapIndex;
+    }
+
+    std::vector<MemoryPool::Heap> MemoryPool::_heaps() {
+        auto budgets = _device.memory_budgets();
+        std::vector<Heap> heaps(budgets.size());
+        for (uint32_t i = 0; i < budgets.size(); ++i) {
+            heaps[i].size = budgets[i].size;
+            heaps[i].budget = budgets[i].budget;
+            heaps[i].device_local = budgets[i].device_local;
+            heaps[i].allocated = _heap_allocated[i];
+            heaps[i].usage = _device.has_memory_budget() ? budgets[i].usage : heaps[i].allocated;
+        }
+        for (auto&& entry : _pool) {
+            heaps[_heap_index(entry.memory_type_index)].pooled += entry.size;
+        }
+        return heaps;
+    }
+
+    std::vector<MemoryPool::Heap> MemoryPool::heaps() {
+        std::scoped_lock lock(_mutex);
+        return _heaps();
+    }
+
+    VkDeviceSize MemoryPool::_free_pooled(uint32_t heap, VkDeviceSize bytes) {
+        VkDeviceSize freed = 0;
+        while (freed < bytes) {
+            auto oldest = _pool.end();
+            for (auto it = _pool.begin(); it != _pool.end(); ++it) {
+                if (_heap_index(it->memory_type_index) == heap && (oldest == _pool.end() || it->returned < oldest->returned)) {
+                    oldest = it;
+                }
+            }
+            if (oldest == _pool.end()) {
+                break;
+            }
+            auto entry = *oldest;
+            _pool.erase(oldest);
+            console << "Pool trim deallocating " << entry.size / (1024.0 * 1024.0) << "mb allocation." << std::endl;
+            _destroy(entry.mem);
+            freed += entry.size;
+        }
+        return freed;
+    }
 
-        while (current_mem > limit) {
-            if (_pool.empty()) {
-                console << "Warning: Pool emptied without reaching allocation limit." << std::endl;
-                return;
+    void MemoryPool::trim() {
+        std::scoped_lock lock(_mutex);
+        auto heaps = _heaps();
+        for (uint32_t i = 0; i < heaps.size(); ++i) {
+            auto&& heap = heaps[i];
+            auto target = heap.budget > _headroom ? heap.budget - _headroom : 0;
+            if (heap.usage <= target) {
+                continue;
+            }
+            auto over = heap.usage - target;
+            if (_free_pooled(i, over) < over && heap.pooled > 0) {
+                console << "Warning: Pool emptied without reaching heap " << i << "'s budget." << std::endl;
             }
-            auto rbeg = _pool.back();
-            _pool.pop_back();
-            console << "Pool trim deallocating " << rbeg.size / (1024.0 * 1024.0) << "mb allocation." << std::endl;
-            _destroy(rbeg.mem);
-            current_mem = _device.memory_manager().device_memory_used();
         }
     }
 }
\ No newline at end of file
@@ -3,18 +3,21 @@
 #include <deque>
 #include <vector>
 #include <map>
+#include <mutex>
 
 #include "vulkan/vulkan.hpp"
+#include "vkd_dll.h"
 
 namespace vkd {
     class Device;
-    class MemoryPool {
+    class VKDEXPORT MemoryPool {
     public:
         struct Alloc {
             VkDeviceMemory mem;
             VkDeviceSize size; 
             VkMemoryPropertyFlags memory_property_flags;
             uint32_t memory_type_index;
+            uint64_t returned = 0; // when it came back to the pool, oldest are trimmed first
         };
 
         struct AllocInfo {
@@ -31,13 +34,38 @@ namespace vkd {
         VkDeviceMemory allocate(VkDeviceSize size, VkMemoryPropertyFlags memory_property_flags, uint32_t memory_type_index);
         bool deallocate(VkDeviceMemory mem);
 
-        void trim(size_t limit);
+        // frees the least recently returned pooled allocations on any heap using more than its
+        // budget less the headroom
+        void trim();
+        // kept free on each heap, for everything that isn't allocated through here
+        void headroom(VkDeviceSize bytes) { std::scoped_lock lock(_mutex); _headroom = bytes; }
+        VkDeviceSize headroom() { std::scoped_lock lock(_mutex); return _headroom; }
 
-        const auto pool() { return _pool; }
+        struct Heap {
+            VkDeviceSize size = 0;
+            VkDeviceSize budget = 0;
+            // the driver's figure with VK_EXT_memory_budget, otherwise what's allocated here
+            VkDeviceSize usage = 0;
+            VkDeviceSize allocated = 0;
+            VkDeviceSize pooled = 0;
+            bool device_local = false;
+        };
+        std::vector<Heap> heaps();
+
+        const auto pool() { std::scoped_lock lock(_mutex); return _pool; }
     private:
         bool _destroy(VkDeviceMemory mem);
+        std::vector<Heap> _heaps();
+        uint32_t _heap_index(uint32_t memory_type_index) const;
+        // least recently returned first, until bytes are freed or the heap's got nothing pooled
+        VkDeviceSize _free_pooled(uint32_t heap, VkDeviceSize bytes);
+
+        std::mutex _mutex; // nodes init and dealloc from workers
         std::deque<Alloc> _pool;
         std::map<VkDeviceMemory, AllocInfo> _allocs;
+        std::map<uint32_t, VkDeviceSize> _heap_allocated;
+        uint64_t _returns = 0;
+        VkDeviceSize _headroom = 512ULL * 1024ULL * 1024ULL;
         Device& _device;
     };
 }
\ No newline at end of file
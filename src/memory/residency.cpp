@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <vector>
+
+#include "residency.hpp"
+#include "memory_pool.hpp"
+#include "device.hpp"
+#include "image.hpp"
+
+namespace vkd {
+    void Residency::track(const std::shared_ptr<Image>& image) {
+        std::scoped_lock lock(_mutex);
+        auto&& entry = _images[image.get()];
+        if (entry.image.lock() != image) {
+            entry = Entry{image, _run};
+        }
+    }
+
+    void Residency::touch(const Image * image) {
+        std::scoped_lock lock(_mutex);
+        auto search = _images.find(image);
+        if (search != _images.end()) {
+            search->second.used = _run;
+        }
+    }
+
+    VkDeviceSize Residency::_over() const {
+        VkDeviceSize over = 0;
+        auto headroom = _device.pool().headroom();
+        for (auto&& heap : _device.pool().heaps()) {
+            auto target = heap.budget > headroom ? heap.budget - headroom : 0;
+            if (heap.device_local && heap.usage > target) {
+                over += heap.usage - target;
+            }
+        }
+        return over;
+    }
+
+    void Residency::trim(bool spill) {
+        auto over = spill ? _over() : 0;
+
+        std::vector<std::pair<uint64_t, std::shared_ptr<Image>>> cold;
+        bool half = false;
+        {
+            std::scoped_lock lock(_mutex);
+            half = _half;
+            for (auto it = _images.begin(); it != _images.end();) {
+                auto image = it->second.image.lock();
+                if (!image) {
+                    it = _images.erase(it);
+                    continue;
+                }
+                if (over > 0 && it->second.used < _run && image->allocated()) {
+                    cold.emplace_back(it->second.used, std::move(image));
+                }
+                ++it;
+            }
+            _run++;
+        }
+
+        if (cold.empty()) {
+            return;
+        }
+
+        std::sort(cold.begin(), cold.end(), [](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+        VkDeviceSize spilled = 0;
+        for (auto&& image : cold) {
+            if (spilled >= over) {
+                break;
+            }
+            auto size = image.second->size_in_memory();
+            if (image.second->spill(half)) {
+                spilled += size;
+            }
+        }
+        if (spilled > 0) {
+            console << "Spilled " << spilled / (1024.0 * 1024.0) << "mb of images to host memory." << std::endl;
+            // the freed memory's back in the pool, give it up
+            _device.pool().trim();
+        }
+    }
+
+    Residency::Report Residency::report() {
+        std::scoped_lock lock(_mutex);
+        Report report;
+        for (auto&& entry : _images) {
+            auto image = entry.second.image.lock();
+            if (!image) {
+                continue;
+            }
+            report.tracked++;
+            if (image->spilled()) {
+                report.spilled++;
+                report.spilled_memory += image->spilled_size();
+            }
+        }
+        return report;
+    }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <memory>
+#include <map>
+#include <mutex>
+
+#include "vulkan.hpp"
+
+namespace vkd {
+    class Device;
+    class Image;
+    // node images that can leave the device when it's short. when a device local heap goes over its
+    // budget less the pool's headroom the least recently used go to host memory, and come back on
+    // their next allocate
+    class Residency {
+    public:
+        Residency(Device& device) : _device(device) {}
+        ~Residency() = default;
+        Residency(Residency&&) = delete;
+        Residency(const Residency&) = delete;
+
+        void track(const std::shared_ptr<Image>& image);
+        // from Image::allocate and after each run, for every node that ran
+        void touch(const Image * image);
+        // after a run. spill only once the stream is idle and nothing else is freeing images,
+        // images used in the run stay either way
+        void trim(bool spill);
+        // trim would spill something, the stream has to be idle first
+        bool over_budget() const { return _over() > 0; }
+
+        // spilled float images are kept as half float, half the host memory and lossy
+        void half(bool set) { std::scoped_lock lock(_mutex); _half = set; }
+
+        struct Report {
+            int64_t tracked = 0;
+            int64_t spilled = 0;
+            int64_t spilled_memory = 0;
+        };
+        Report report();
+    private:
+        VkDeviceSize _over() const;
+
+        struct Entry {
+            std::weak_ptr<Image> image;
+            uint64_t used = 0;
+        };
+
+        Device& _device;
+        std::mutex _mutex; // nodes allocate on workers and the engine thread
+        std::map<const Image *, Entry> _images;
+        uint64_t _run = 1;
+        bool _half = false;
+    };
+}
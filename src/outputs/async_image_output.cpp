@@ -33,7 +33,7 @@ namespace vkd {
         //command_buffer().end();
         command_buffer().flush();
 
-        enki::TaskSet * task = nullptr;
+        TaskHandle task;
         auto fake_node = _input_node_e->fake_node();
         if (fake_node) {
             auto str = immediate_exr(_device, fake_node->node_name(), _format, _input_node->get_output_image(), task);
@@ -4,62 +4,150 @@
 #include "image.hpp"
 #include "command_buffer.hpp"
 #include "buffer.hpp"
+#include "console.hpp"
+#include "host_scheduler.hpp"
+#include "trace.hpp"
 #include "compute/kernel.hpp"
+#include "graph/fake_node.hpp"
 
 #include "image_downloader.hpp"
 
 #include "compute/image_node.hpp"
 
 #include "ImfThreading.h"
-#include "ImfRgbaFile.h"
+#include "ImfHeader.h"
+#include "ImfChannelList.h"
+#include "ImfFrameBuffer.h"
+#include "ImfMultiPartOutputFile.h"
+#include "ImfOutputPart.h"
+#include "ImfTiledOutputPart.h"
+#include "ImfTileDescription.h"
+#include "ImfStandardAttributes.h"
+#include "ImfPartType.h"
 #include "ghc/filesystem.hpp"
 
 namespace vkd {
     REGISTER_NODE("exr_output", "exr_output", ExrOutput);
 
+    namespace {
+        Imf::Compression imf_compression(ExrOutput::Compression compression) {
+            switch (compression) {
+            case ExrOutput::Compression::None: return Imf::NO_COMPRESSION;
+            case ExrOutput::Compression::RLE: return Imf::RLE_COMPRESSION;
+            case ExrOutput::Compression::ZIPS: return Imf::ZIPS_COMPRESSION;
+            case ExrOutput::Compression::PIZ: return Imf::PIZ_COMPRESSION;
+            case ExrOutput::Compression::DWAA: return Imf::DWAA_COMPRESSION;
+            case ExrOutput::Compression::DWAB: return Imf::DWAB_COMPRESSION;
+            default: return Imf::ZIP_COMPRESSION;
+            }
+        }
+    }
+
     ExrOutput::ExrOutput() {
-        
+
         static std::once_flag initFlag;
         std::call_once(initFlag, []() {
             Imf::setGlobalThreadCount(std::thread::hardware_concurrency());
         });
 
+    }
+
+    void ExrOutput::post_setup() {
         _path_param = make_param<ParameterType::p_string>(param_hash_name(), "path", 0);
         _path_param->as<std::string>().set_default("");
         _path_param->tag("filepath");
 
+        _compression_param = make_param<ParameterType::p_int>(param_hash_name(), "compression", 0, {"enum"});
+        _compression_param->enum_names({"none", "rle", "zips", "zip", "piz", "dwaa", "dwab"});
+        _compression_param->as<int>().min(0);
+        _compression_param->as<int>().max(6);
+        _compression_param->as<int>().set_default((int)Compression::ZIP);
+
+        _dwa_level_param = make_param<ParameterType::p_float>(param_hash_name(), "dwa level", 0);
+        _dwa_level_param->as<float>().set_default(45.0f);
+        _dwa_level_param->as<float>().soft_min(0.0f);
+        _dwa_level_param->as<float>().soft_max(200.0f);
+
+        // these change what the downloaders produce
+        _float_param = make_param<ParameterType::p_bool>(param_hash_name(), "float", 0, {"init"});
+        _tiled_param = make_param<ParameterType::p_bool>(param_hash_name(), "tiled", 0);
+        _tile_size_param = make_param<ParameterType::p_int>(param_hash_name(), "tile size", 0);
+        _tile_size_param->as<int>().set_default(64);
+        _tile_size_param->as<int>().soft_min(16);
+        _tile_size_param->as<int>().soft_max(512);
+
+        _buffers_param = make_param<ParameterType::p_int>(param_hash_name(), "write buffers", 0, {"init"});
+        _buffers_param->as<int>().set_default(3);
+        _buffers_param->as<int>().soft_min(1);
+        _buffers_param->as<int>().soft_max(8);
+
         _params["_"].emplace(_path_param->name(), _path_param);
+        _params["_"].emplace(_compression_param->name(), _compression_param);
+        _params["_"].emplace(_dwa_level_param->name(), _dwa_level_param);
+        _params["_"].emplace(_float_param->name(), _float_param);
+        _params["_"].emplace(_tiled_param->name(), _tiled_param);
+        _params["_"].emplace(_tile_size_param->name(), _tile_size_param);
+        _params["_"].emplace(_buffers_param->name(), _buffers_param);
     }
 
     ExrOutput::~ExrOutput() {
+        for (auto&& slot : _slots) {
+            ts().wait(slot->task);
+        }
     }
 
     void ExrOutput::init() {
-        auto image = _input_node->get_output_image();
-        auto sz = image->dim();
+        std::string path = _path_param->as<std::string>().get();
 
-        _width = sz[0];
-        _height = sz[1];
+        if (path.size() < 3) {
+            throw GraphException("No path provided to exr node.");
+        }
 
-        _downloader = std::make_unique<ImageDownloader>(_device);
-        _downloader->init(_input_node->get_output_image(), ImageDownloader::OutFormat::half_rgba, param_hash_name());
-        for (auto&& kern : _downloader->kernels()) {
-            register_params(*kern);
+        for (auto&& slot : _slots) {
+            ts().wait(slot->task);
         }
+        _slots.clear();
 
-        
+        auto format = _float_param->as<bool>().get() ? ImageDownloader::OutFormat::float_rgba : ImageDownloader::OutFormat::half_rgba;
+        int32_t buffers = std::max(_buffers_param->as<int>().get(), 1);
 
-        command_buffer().begin();
-        _downloader->commands(command_buffer());
-        command_buffer().end();
-        
-        std::string path = _path_param->as<std::string>().get();
+        for (int32_t i = 0; i < buffers; ++i) {
+            auto slot = std::make_unique<Slot>();
+            slot->commands = CommandBuffer::make(_device);
+            slot->commands->debug_name(param_hash_name() + " write " + std::to_string(i));
 
-        if (path.size() < 3) {
-            throw GraphException("No path provided to exr node.");
-        } 
+            for (auto&& input : _input_nodes) {
+                auto downloader = std::make_unique<ImageDownloader>(_device);
+                downloader->init(input->get_output_image(), format, param_hash_name());
+                // every slot's kernels share the node's params, registering the first set is enough
+                if (i == 0) {
+                    for (auto&& kern : downloader->kernels()) {
+                        register_params(*kern);
+                    }
+                }
+                slot->downloaders.push_back(std::move(downloader));
+            }
+
+            _record(*slot);
+            _slots.push_back(std::move(slot));
+        }
+    }
+
+    std::vector<uint64_t> ExrOutput::_generations() const {
+        std::vector<uint64_t> generations;
+        for (auto&& input : _input_nodes) {
+            generations.push_back(input->get_output_image()->generation());
+        }
+        return generations;
+    }
 
-        _fence = Fence::create(_device, false);
+    void ExrOutput::_record(Slot& slot) {
+        slot.recorded = _generations();
+        slot.commands->begin();
+        for (auto&& downloader : slot.downloaders) {
+            downloader->commands(*slot.commands);
+        }
+        slot.commands->end();
     }
 
     bool ExrOutput::update(ExecutionType type) {
@@ -76,33 +164,121 @@ namespace vkd {
         return updated;
     }
 
+    ExrOutput::WriteSettings ExrOutput::_settings() const {
+        WriteSettings settings;
+        settings.compression = (Compression)std::clamp(_compression_param->as<int>().get(), 0, (int)Compression::DWAB);
+        settings.dwa_level = _dwa_level_param->as<float>().get();
+        settings.full_float = _float_param->as<bool>().get();
+        settings.tile_size = _tiled_param->as<bool>().get() ? std::max(_tile_size_param->as<int>().get(), 1) : 0;
+        return settings;
+    }
+
     void ExrOutput::execute(ExecutionType type, Stream& stream) {
         if (type != ExecutionType::Execution) {
             return;
         }
 
-        stream.submit(command_buffer());
+        auto& slot = *_slots[_frame_count % _slots.size()];
+        {
+            // only blocks when every buffer is still being written
+            VKD_TRACE("exr writer wait");
+            ts().wait(slot.task);
+        }
+
+        if (slot.recorded != _generations()) {
+            // an input was spilled or freed since, its image and view are new
+            _record(slot);
+        }
+        stream.submit(*slot.commands);
+        for (auto&& downloader : slot.downloaders) {
+            downloader->readback(*slot.commands, stream);
+        }
         stream.flush();
-        
-        uint8_t * buffer = (uint8_t *)_downloader->get_main();
 
-        //if (pixelBuffer == NULL) {throw Exception("Buffer NULL. Not created or deleted.");}
-	
-        Imf::RgbaOutputFile file(_filename().c_str(), _width, _height, Imf::WRITE_RGBA, 1.0f, Imath::V2f (0, 0), 1.0f, Imf::INCREASING_Y, Imf::ZIP_COMPRESSION);
-        file.setFrameBuffer((Imf::Rgba* )buffer, 1, _width);
-        file.writePixels(_height);
+        std::vector<PartData> parts;
+        for (size_t i = 0; i < slot.downloaders.size(); ++i) {
+            auto dim = _input_nodes[i]->get_output_image()->dim();
+            PartData part;
+            part.pixels = slot.downloaders[i]->get_main();
+            part.width = dim[0];
+            part.height = dim[1];
+            auto fake_node = _input_engine_nodes[i]->fake_node();
+            part.name = fake_node ? fake_node->node_name() : "part" + std::to_string(i);
+            parts.push_back(std::move(part));
+        }
+
+        slot.task = ts().add("exr write", [path = _filename(), parts = std::move(parts), settings = _settings()]() {
+            VKD_TRACE("write", path);
+            try {
+                write(path, parts, settings);
+            } catch (std::exception& e) {
+                console << "Error writing " << path << ": " << e.what() << std::endl;
+            }
+        }, TaskPriority::Low);
 
         _frame_count++;
     }
 
+    void ExrOutput::write(const std::string& path, const std::vector<PartData>& parts, const WriteSettings& settings) {
+        auto pixel_type = settings.full_float ? Imf::FLOAT : Imf::HALF;
+        const size_t channel_size = settings.full_float ? sizeof(float) : sizeof(uint16_t);
+        const size_t xstride = channel_size * 4;
+
+        std::vector<Imf::Header> headers;
+        for (auto&& part : parts) {
+            Imf::Header header(part.width, part.height, 1.0f, Imath::V2f(0, 0), 1.0f, Imf::INCREASING_Y, imf_compression(settings.compression));
+            for (auto&& name : {"R", "G", "B", "A"}) {
+                header.channels().insert(name, Imf::Channel(pixel_type));
+            }
+            if (settings.compression == Compression::DWAA || settings.compression == Compression::DWAB) {
+                Imf::addDwaCompressionLevel(header, settings.dwa_level);
+            }
+            if (settings.tile_size > 0) {
+                header.setTileDescription(Imf::TileDescription(settings.tile_size, settings.tile_size, Imf::ONE_LEVEL));
+                header.setType(Imf::TILEDIMAGE);
+            } else {
+                header.setType(Imf::SCANLINEIMAGE);
+            }
+            if (parts.size() > 1) {
+                header.setName(part.name);
+            }
+            headers.push_back(std::move(header));
+        }
+
+        Imf::MultiPartOutputFile file(path.c_str(), headers.data(), (int)headers.size());
+        for (size_t i = 0; i < parts.size(); ++i) {
+            auto&& part = parts[i];
+            // the downloader's mapped buffer goes straight to the encoder
+            char * base = (char *)part.pixels;
+            const size_t ystride = xstride * part.width;
+
+            Imf::FrameBuffer fb;
+            int c = 0;
+            for (auto&& name : {"R", "G", "B", "A"}) {
+                fb.insert(name, Imf::Slice(pixel_type, base + c * channel_size, xstride, ystride));
+                c++;
+            }
+
+            if (settings.tile_size > 0) {
+                Imf::TiledOutputPart out(file, (int)i);
+                out.setFrameBuffer(fb);
+                out.writeTiles(0, out.numXTiles() - 1, 0, out.numYTiles() - 1);
+            } else {
+                Imf::OutputPart out(file, (int)i);
+                out.setFrameBuffer(fb);
+                out.writePixels(part.height);
+            }
+        }
+    }
+
     std::string ExrOutput::_filename() const {
         ghc::filesystem::path path{_path_param->as<std::string>().get()};
 
         path.replace_extension("exr");
         path.replace_filename(path.stem().string() + std::string("_") + std::to_string(_frame_count));
         path.replace_extension("exr");
-        
+
         return path.string();
     }
 
-}
\ No newline at end of file
+}
@@ -1,59 +1,109 @@
 #pragma once
-        
+
 #include <memory>
 
 #include "engine_node.hpp"
 #include "fence.hpp"
+#include "task_handle.hpp"
+#include "command_buffer.hpp"
+#include "vkd_dll.h"
 
 
 namespace vkd {
     class ImageNode;
     class ImageDownloader;
-    class ExrOutput : public EngineNode {
+    class VKDEXPORT ExrOutput : public EngineNode {
     public:
         ExrOutput();
         ~ExrOutput();
         ExrOutput(ExrOutput&&) = delete;
         ExrOutput(const ExrOutput&) = delete;
 
-        static int32_t input_count() { return 1; }
+        static int32_t input_count() { return -1; }
         static int32_t output_count() { return 0; }
         static bool input_valid(int32_t input, const std::set<std::string>& tags) { return true; }
         static std::set<std::string> tags() { return {"exr"}; }
 
+        // more than one input writes a multipart file, a part each
         void inputs(const std::vector<std::shared_ptr<EngineNode>>& in) override {
             if (in.size() < 1) {
                 throw GraphException("Input required");
             }
-            auto conv = std::dynamic_pointer_cast<ImageNode>(in[0]);
-            if (!conv) {
-                throw GraphException("Invalid input");
+            _input_nodes.clear();
+            _input_engine_nodes = in;
+            for (auto&& i : in) {
+                auto conv = std::dynamic_pointer_cast<ImageNode>(i);
+                if (!conv) {
+                    throw GraphException("Invalid input");
+                }
+                _input_nodes.push_back(conv);
             }
-            _input_node = conv;
         }
         std::shared_ptr<EngineNode> clone() const override { return std::make_shared<ExrOutput>(); }
-        
+
+        void post_setup() override;
+
         void init() override;
-        
+
         bool update(ExecutionType type) override;
         void commands(VkCommandBuffer buf, uint32_t width, uint32_t height) override {}
         void execute(ExecutionType type, Stream& stream) override;
 
+        enum class Compression {
+            None,
+            RLE,
+            ZIPS,
+            ZIP,
+            PIZ,
+            DWAA,
+            DWAB
+        };
+
+        struct WriteSettings {
+            Compression compression = Compression::ZIP;
+            float dwa_level = 45.0f;
+            bool full_float = false;
+            int32_t tile_size = 0; // scanlines if zero
+        };
+
+        struct PartData {
+            const void * pixels = nullptr; // rgba, half or float as the settings say
+            int32_t width = 1, height = 1;
+            std::string name;
+        };
+
+        // safe to call from any thread
+        static void write(const std::string& path, const std::vector<PartData>& parts, const WriteSettings& settings);
+
     private:
         std::string _filename() const;
+        WriteSettings _settings() const;
 
-        int32_t _width = 1, _height = 1;
+        // frames are downloaded into one slot while the writers encode the others
+        struct Slot {
+            std::vector<std::unique_ptr<ImageDownloader>> downloaders;
+            CommandBufferPtr commands = nullptr;
+            TaskHandle task;
+            // the input images' generations the commands were recorded against
+            std::vector<uint64_t> recorded;
+        };
+        void _record(Slot& slot);
+        std::vector<uint64_t> _generations() const;
 
         uint32_t _frame_count = 0;
 
-        std::unique_ptr<ImageDownloader> _downloader = nullptr;
+        std::vector<std::unique_ptr<Slot>> _slots;
 
         std::shared_ptr<ParameterInterface> _path_param = nullptr;
+        std::shared_ptr<ParameterInterface> _compression_param = nullptr;
+        std::shared_ptr<ParameterInterface> _dwa_level_param = nullptr;
+        std::shared_ptr<ParameterInterface> _float_param = nullptr;
+        std::shared_ptr<ParameterInterface> _tiled_param = nullptr;
+        std::shared_ptr<ParameterInterface> _tile_size_param = nullptr;
+        std::shared_ptr<ParameterInterface> _buffers_param = nullptr;
 
-        std::shared_ptr<ImageNode> _input_node = nullptr;
-
-        FencePtr _fence = nullptr;
+        std::vector<std::shared_ptr<ImageNode>> _input_nodes;
+        std::vector<std::shared_ptr<EngineNode>> _input_engine_nodes;
 
-        
     };
-}
\ No newline at end of file
+}
@@ -1,4 +1,5 @@
 #include <mutex>
+#include <algorithm>
 #include "ffmpeg.hpp"
 #include "image.hpp"
 #include "command_buffer.hpp"
@@ -12,6 +13,7 @@
 
 extern "C" {
 #include <libavformat/avformat.h>
+#include <libavutil/pixdesc.h>
 }
 
 #include "ffmpeg_init.hpp"
@@ -20,12 +22,108 @@ extern "C" {
 namespace vkd {
     REGISTER_NODE("ffmpeg_output", "ffmpeg_output", FfmpegOutput);
 
+    namespace {
+        const char * encoder_name(FfmpegOutput::Codec codec) {
+            switch (codec) {
+            case FfmpegOutput::Codec::HEVC: return "libx265";
+            case FfmpegOutput::Codec::ProRes: return "prores_ks";
+            case FfmpegOutput::Codec::FFV1: return "ffv1";
+            default: return "libx264";
+            }
+        }
+
+        const char * container_name(FfmpegOutput::Container container) {
+            switch (container) {
+            case FfmpegOutput::Container::MOV: return "mov";
+            case FfmpegOutput::Container::MKV: return "matroska";
+            default: return "mp4";
+            }
+        }
+
+        AVPixelFormat pixel_format(int32_t depth, FfmpegOutput::Chroma chroma) {
+            if (depth > 8) {
+                switch (chroma) {
+                case FfmpegOutput::Chroma::s422: return AV_PIX_FMT_YUV422P10LE;
+                case FfmpegOutput::Chroma::s444: return AV_PIX_FMT_YUV444P10LE;
+                default: return AV_PIX_FMT_YUV420P10LE;
+                }
+            }
+            switch (chroma) {
+            case FfmpegOutput::Chroma::s422: return AV_PIX_FMT_YUV422P;
+            case FfmpegOutput::Chroma::s444: return AV_PIX_FMT_YUV444P;
+            default: return AV_PIX_FMT_YUV420P;
+            }
+        }
+
+        // the planes the encoder takes, so the downloader writes them as is
+        VideoFormat video_format(int32_t depth, FfmpegOutput::Chroma chroma) {
+            VideoFormat format;
+            format.layout = VideoFormat::Layout::Planar;
+            format.bytes = depth > 8 ? 2 : 1;
+            format.depth = depth;
+            format.chroma_shift_x = chroma == FfmpegOutput::Chroma::s444 ? 0 : 1;
+            format.chroma_shift_y = chroma == FfmpegOutput::Chroma::s420 ? 1 : 0;
+            return format;
+        }
+
+        bool takes_pixel_format(const AVCodec * codec, AVPixelFormat pix_fmt) {
+            if (!codec->pix_fmts) {
+                return true;
+            }
+            for (auto p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; ++p) {
+                if (*p == pix_fmt) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+
     FfmpegOutput::FfmpegOutput() {
+
+    }
+
+    void FfmpegOutput::post_setup() {
         _path_param = make_param<ParameterType::p_string>(param_hash_name(), "path", 0);
         _path_param->as<std::string>().set_default("test1111.mp4");
         _path_param->tag("filepath");
 
+        _codec_param = make_param<ParameterType::p_int>(param_hash_name(), "codec", 0, {"enum", "init"});
+        _codec_param->enum_names({"h264", "hevc", "prores", "ffv1"});
+        _codec_param->as<int>().min(0);
+        _codec_param->as<int>().max(3);
+        _codec_param->as<int>().set_default((int)Codec::H264);
+
+        _container_param = make_param<ParameterType::p_int>(param_hash_name(), "container", 0, {"enum", "init"});
+        _container_param->enum_names({"mp4", "mov", "mkv"});
+        _container_param->as<int>().min(0);
+        _container_param->as<int>().max(2);
+        _container_param->as<int>().set_default((int)Container::MP4);
+
+        _bit_depth_param = make_param<ParameterType::p_int>(param_hash_name(), "bit depth", 0, {"enum", "init"});
+        _bit_depth_param->enum_names({"8", "10"});
+        _bit_depth_param->as<int>().min(0);
+        _bit_depth_param->as<int>().max(1);
+        _bit_depth_param->as<int>().set_default(0);
+
+        _chroma_param = make_param<ParameterType::p_int>(param_hash_name(), "chroma", 0, {"enum", "init"});
+        _chroma_param->enum_names({"4:2:0", "4:2:2", "4:4:4"});
+        _chroma_param->as<int>().min(0);
+        _chroma_param->as<int>().max(2);
+        _chroma_param->as<int>().set_default((int)Chroma::s420);
+
+        // h264 and hevc only
+        _crf_param = make_param<ParameterType::p_int>(param_hash_name(), "crf", 0, {"init"});
+        _crf_param->as<int>().set_default(24);
+        _crf_param->as<int>().min(0);
+        _crf_param->as<int>().max(51);
+
         _params["_"].emplace(_path_param->name(), _path_param);
+        _params["_"].emplace(_codec_param->name(), _codec_param);
+        _params["_"].emplace(_container_param->name(), _container_param);
+        _params["_"].emplace(_bit_depth_param->name(), _bit_depth_param);
+        _params["_"].emplace(_chroma_param->name(), _chroma_param);
+        _params["_"].emplace(_crf_param->name(), _crf_param);
     }
 
     FfmpegOutput::~FfmpegOutput() {
@@ -48,51 +146,84 @@ namespace vkd {
         _width = sz[0];
         _height = sz[1];
 
+        auto codec = (Codec)std::clamp(_codec_param->as<int>().get(), 0, (int)Codec::FFV1);
+        auto container = (Container)std::clamp(_container_param->as<int>().get(), 0, (int)Container::MKV);
+        auto chroma = (Chroma)std::clamp(_chroma_param->as<int>().get(), 0, (int)Chroma::s444);
+        int32_t depth = _bit_depth_param->as<int>().get() > 0 ? 10 : 8;
+        auto pix_fmt = pixel_format(depth, chroma);
+
+        _codec = avcodec_find_encoder_by_name(encoder_name(codec));
+        if (!_codec) {
+            throw GraphException(std::string("FFMPEG: Encoder not available: ") + encoder_name(codec));
+        }
+        if (!takes_pixel_format(_codec, pix_fmt)) {
+            throw GraphException(std::string("FFMPEG: ") + encoder_name(codec) + " does not take " + av_get_pix_fmt_name(pix_fmt));
+        }
+
+        avformat_alloc_output_context2(&_format_context, NULL, container_name(container), NULL);
+        if (!_format_context) {
+            throw GraphException(std::string("FFMPEG: Container not available: ") + container_name(container));
+        }
+        if (avformat_query_codec(_format_context->oformat, _codec->id, FF_COMPLIANCE_NORMAL) != 1) {
+            throw GraphException(std::string("FFMPEG: ") + container_name(container) + " can not hold " + _codec->name);
+        }
+
         _downloader = std::make_unique<ImageDownloader>(_device);
-        _downloader->init(_buffer_node->get_output_image(), ImageDownloader::OutFormat::yuv420p, param_hash_name());
+        _downloader->set_video_format(video_format(depth, chroma));
+        _downloader->init(_buffer_node->get_output_image(), ImageDownloader::OutFormat::video, param_hash_name());
+        _downloader->set_video_colour(VideoMatrix::BT709, false);
         for (auto&& kern : _downloader->kernels()) {
             register_params(*kern);
         }
 
         // avcodec
 
-        AVCodecID codec_id = AV_CODEC_ID_H264;
-
-        _codec = avcodec_find_encoder(codec_id);
-
         _codec_context = avcodec_alloc_context3(_codec);
         
-        _codec_context->codec_id = codec_id;
+        _codec_context->codec_id = _codec->id;
         
         _codec_context->width = _width;
         _codec_context->height = _height;
         
-        //_codec_context->bit_rate = _bitrate;
-        
         _codec_context->time_base.den = _fps;
         _codec_context->time_base.num = 1;
         
-        _codec_context->pix_fmt = AV_PIX_FMT_YUV420P;
-        _codec_context->level = 52;
+        _codec_context->pix_fmt = pix_fmt;
+        _codec_context->color_range = AVCOL_RANGE_MPEG;
+        _codec_context->colorspace = AVCOL_SPC_BT709;
+        _codec_context->color_primaries = AVCOL_PRI_BT709;
+        _codec_context->color_trc = AVCOL_TRC_BT709;
+
+        if (_format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+            _codec_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        }
 
         AVDictionary * _dict = NULL;
 
-        av_dict_set(&_dict, "vprofile", "high", 0);
-        av_dict_set(&_dict, "preset", "slow", 0);    
-        av_dict_set(&_dict, "crf", "24", 0);
+        if (codec == Codec::H264 || codec == Codec::HEVC) {
+            // the profile follows the depth and chroma
+            av_dict_set(&_dict, "preset", "slow", 0);
+            av_dict_set(&_dict, "crf", std::to_string(_crf_param->as<int>().get()).c_str(), 0);
+        } else if (codec == Codec::ProRes) {
+            av_dict_set(&_dict, "profile", chroma == Chroma::s444 ? "4444" : "hq", 0);
+        } else if (codec == Codec::FFV1) {
+            _codec_context->level = 3;
+            av_dict_set(&_dict, "slicecrc", "1", 0);
+        }
         
         int err = avcodec_open2(_codec_context, _codec, &_dict);
+        av_dict_free(&_dict);
         if (err < 0) {
-            console << "avcodec_open2 failed: " << err << std::endl;
-            throw 0;
+            throw GraphException("FFMPEG: Could not open encoder: " + std::to_string(err));
         }
 
         // avformat
 
-        avformat_alloc_output_context2(&_format_context, NULL, "mp4", NULL);
         _video_stream = avformat_new_stream(_format_context, _codec_context->codec);
         _video_stream->codec = _codec_context;
         _video_stream->id = 0;
+        _video_stream->time_base = _codec_context->time_base;
+        avcodec_parameters_from_context(_video_stream->codecpar, _codec_context);
 
         std::string path = _path_param->as<std::string>().get();
 
@@ -152,22 +283,19 @@ namespace vkd {
         command_buffer().end();
 
         stream.submit(command_buffer());
+        _downloader->readback(command_buffer(), stream);
         stream.flush();
 
         uint8_t * buffer = (uint8_t *)_downloader->get_main();
 
         std::shared_ptr<AVFrame> avFrame(av_frame_alloc(), [](AVFrame* a){ av_frame_free(&a); });
-        
-        avFrame->data[0] = buffer;
-        //memset(buffer, 255, _width * _height);
-        avFrame->data[1] = buffer + _width * _height;
-        //memset(avFrame->data[1], 127, _width * _height * 1 / 4);
-        avFrame->data[2] = buffer + _width * _height * 5 / 4;
-        //memset(avFrame->data[2], 127, _width * _height * 1 / 4);
-
-        avFrame->linesize[0] = _width;
-        avFrame->linesize[1] = (_width / 2);
-        avFrame->linesize[2] = (_width / 2);
+
+        // the kernel wrote the encoder's own planes, nothing to repack
+        for (int32_t i = 0; i < _downloader->video_plane_count(); ++i) {
+            auto&& plane = _downloader->video_planes()[i];
+            avFrame->data[i] = buffer + plane.offset;
+            avFrame->linesize[i] = (int)plane.stride;
+        }
         
         avFrame->format = _codec_context->pix_fmt;
         avFrame->width = _codec_context->width;
@@ -31,11 +31,23 @@ namespace vkd {
         FfmpegOutput(FfmpegOutput&&) = delete;
         FfmpegOutput(const FfmpegOutput&) = delete;
 
-        enum class avcodec_codec {
-            x264,
-            x265,
-            vpx,
-            prores
+        enum class Codec {
+            H264,
+            HEVC,
+            ProRes,
+            FFV1
+        };
+
+        enum class Container {
+            MP4,
+            MOV,
+            MKV
+        };
+
+        enum class Chroma {
+            s420,
+            s422,
+            s444
         };
 
         static int32_t input_count() { return 1; }
@@ -54,6 +66,8 @@ namespace vkd {
             _buffer_node = conv;
         }
         std::shared_ptr<EngineNode> clone() const override { return std::make_shared<FfmpegOutput>(); }
+
+        void post_setup() override;
         
         void init() override;
         
@@ -82,6 +96,11 @@ namespace vkd {
         std::unique_ptr<ImageDownloader> _downloader = nullptr;
 
         std::shared_ptr<ParameterInterface> _path_param = nullptr;
+        std::shared_ptr<ParameterInterface> _codec_param = nullptr;
+        std::shared_ptr<ParameterInterface> _container_param = nullptr;
+        std::shared_ptr<ParameterInterface> _bit_depth_param = nullptr;
+        std::shared_ptr<ParameterInterface> _chroma_param = nullptr;
+        std::shared_ptr<ParameterInterface> _crf_param = nullptr;
 
         std::shared_ptr<ImageNode> _buffer_node = nullptr;
 
@@ -1,5 +1,7 @@
 #include "image_downloader.hpp"
 #include "command_buffer.hpp"
+#include "stream.hpp"
+#include "graph_exception.hpp"
 
 namespace vkd {
     
@@ -9,6 +11,16 @@ namespace vkd {
         _width = sz[0];
         _height = sz[1];
         _ofmt = ofmt;
+        if (_ofmt == OutFormat::yuv420p) {
+            _video_format = VideoFormat{};
+        }
+        if (_ofmt == OutFormat::yuv420p || _ofmt == OutFormat::video) {
+            if (_video_format.layout == VideoFormat::Layout::PackedRGB) {
+                throw GraphException("Packed rgb video output is not supported");
+            }
+            // whole blocks a row so the kernel writes whole uints
+            _plane_count = layout_video_planes(_width, _height, _video_format, 8, _planes);
+        }
 
         auto buffer_size = _buffer_size();
 
@@ -18,33 +30,33 @@ namespace vkd {
         _gpu_buffer->debug_name(param_hash_name + " DL (GPU Buffer)");
         _gpu_buffer->create(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
 
-        if (_ofmt == OutFormat::yuv420p) {
-            
-            _quantise_luma = std::make_shared<Kernel>(_device, param_hash_name);
-            _quantise_luma->init("shaders/output/quantise_luma.comp.spv", "main", Kernel::default_local_sizes);
-            _quantise_luma->set_push_arg_by_name("_size", glm::ivec2(_width, _height));
-
-            //_quantise_luma->set_arg(0, _gpu_buffer);
-            _quantise_luma->set_arg(0, image);
-            _quantise_luma->set_arg(1, _gpu_buffer);
-
-            _quantise_chroma_u = std::make_shared<Kernel>(_device, param_hash_name);
-            _quantise_chroma_u->init("shaders/output/quantise_chroma_u.comp.spv", "main", Kernel::default_local_sizes);
-            _quantise_chroma_u->set_push_arg_by_name("_size", glm::ivec2(_width, _height));
-            _quantise_chroma_u->set_arg(0, image);
-            _quantise_chroma_u->set_arg(1, _gpu_buffer);
-
-            _quantise_chroma_v = std::make_shared<Kernel>(_device, param_hash_name);
-            _quantise_chroma_v->init("shaders/output/quantise_chroma_v.comp.spv", "main", Kernel::default_local_sizes);
-            _quantise_chroma_v->set_push_arg_by_name("_size", glm::ivec2(_width, _height));
-            _quantise_chroma_v->set_arg(0, image);
-            _quantise_chroma_v->set_arg(1, _gpu_buffer);
+        if (_device->separate_transfer_queue()) {
+            _transfer_command_buffer = CommandBuffer::make_transfer(_device);
+            _transfer_command_buffer->debug_name(param_hash_name + " DL (transfer)");
+        }
 
+        if (_ofmt == OutFormat::yuv420p || _ofmt == OutFormat::video) {
+            _video = std::make_shared<Kernel>(_device, param_hash_name);
+            _video->init("shaders/output/video_quantise.comp.spv", "main", Kernel::default_local_sizes);
+            _video->set_arg(0, image);
+            _video->set_arg(1, _gpu_buffer);
+
+            auto&& f = _video_format;
+            _video->set_push_arg_by_name("_offsets", glm::ivec4(_planes[0].offset, _planes[1].offset, _planes[2].offset, 0));
+            _video->set_push_arg_by_name("_strides", glm::ivec4(_planes[0].stride, _planes[1].stride, _planes[2].stride, 0));
+            _video->set_push_arg_by_name("_format", glm::ivec4((int)f.layout, f.bytes, f.depth | (f.msb ? 1 << 8 : 0), f.chroma_shift_x | (f.chroma_shift_y << 4)));
+            // yuv420p has always been full range, ffmpeg_loop reads it back that way
+            set_video_colour(VideoMatrix::BT709, _ofmt == OutFormat::yuv420p || f.rgb());
         } else if (_ofmt == OutFormat::half_rgba) {
             _image_to_half_buffer = std::make_shared<Kernel>(_device, param_hash_name);
             _image_to_half_buffer->init("shaders/compute/image_to_half_buffer.comp.spv", "main", Kernel::default_local_sizes);
             _image_to_half_buffer->set_arg(0, image);
             _image_to_half_buffer->set_arg(1, _gpu_buffer);
+        } else if (_ofmt == OutFormat::float_rgba) {
+            _image_to_float_buffer = std::make_shared<Kernel>(_device, param_hash_name);
+            _image_to_float_buffer->init("shaders/compute/image_to_float_buffer.comp.spv", "main", Kernel::default_local_sizes);
+            _image_to_float_buffer->set_arg(0, image);
+            _image_to_float_buffer->set_arg(1, _gpu_buffer);
         } else if (_ofmt == OutFormat::uint8_rgba) {
             _image_to_uint8_rgba_buffer = std::make_shared<Kernel>(_device, param_hash_name);
             _image_to_uint8_rgba_buffer->init("shaders/compute/image_to_uint8_rgba_buffer.comp.spv", "main", Kernel::default_local_sizes);
@@ -57,18 +69,52 @@ namespace vkd {
             _image_to_uint8_rgbx_buffer->set_arg(0, image);
             _image_to_uint8_rgbx_buffer->set_arg(1, _gpu_buffer);
             _image_to_uint8_rgbx_buffer->set_push_arg_by_name("_srgb", 1);
-        } 
+        } else if (_ofmt == OutFormat::uint16_rgba) {
+            _image_to_uint16_rgba_buffer = std::make_shared<Kernel>(_device, param_hash_name);
+            _image_to_uint16_rgba_buffer->init("shaders/compute/image_to_uint16_rgba_buffer.comp.spv", "main", Kernel::default_local_sizes);
+            _image_to_uint16_rgba_buffer->set_arg(0, image);
+            _image_to_uint16_rgba_buffer->set_arg(1, _gpu_buffer);
+            _image_to_uint16_rgba_buffer->set_push_arg_by_name("_srgb", 1);
+        }
+
+    }
+
+    void ImageDownloader::set_video_colour(VideoMatrix matrix, bool full_range) {
+        if (!_video) {
+            return;
+        }
+
+        float kr, kb;
+        video_matrix_weights(matrix, kr, kb);
+
+        // in codes, limited range is 16-235 and 16-240 at 8 bits and scales with the bit depth
+        auto&& f = _video_format;
+        float max = (float)((1 << f.depth) - 1);
+        float step = (float)(1 << (f.depth - 8));
+        glm::vec4 range;
+        if (full_range) {
+            range = {0.0f, max, (float)(1 << (f.depth - 1)), max};
+        } else {
+            range = {16.0f * step, 219.0f * step, 128.0f * step, 224.0f * step};
+        }
 
+        _video->set_push_arg_by_name("_matrix", glm::vec4(kr, kb, 0.0f, 0.0f));
+        _video->set_push_arg_by_name("_range", range);
     }
 
     size_t ImageDownloader::_buffer_size() const {
-        if (_ofmt == OutFormat::yuv420p) {
-            return _width * _height * 1.5 * sizeof(uint8_t);
+        if (_ofmt == OutFormat::yuv420p || _ofmt == OutFormat::video) {
+            return video_buffer_size(_planes, _plane_count);
         } else if (_ofmt == OutFormat::half_rgba) {
             return _width * _height * 4 * sizeof(uint16_t);
+        } else if (_ofmt == OutFormat::float_rgba) {
+            return _width * _height * 4 * sizeof(float);
         } else if (_ofmt == OutFormat::uint8_rgba || _ofmt == OutFormat::uint8_rgbx) {
             return _width * _height * 4 * sizeof(uint8_t);
+        } else if (_ofmt == OutFormat::uint16_rgba) {
+            return _width * _height * 4 * sizeof(uint16_t);
         }
+        return 0;
     }
 
     void ImageDownloader::commands(CommandBuffer& buf) {
@@ -76,16 +122,50 @@ namespace vkd {
     }
 
     void ImageDownloader::commands(VkCommandBuffer buf) {
+        _record(buf, _transfer_command_buffer == nullptr);
+    }
+
+    void ImageDownloader::readback(CommandBuffer& buf, Stream& stream) {
+        if (!_transfer_command_buffer) {
+            return; // copied in buf already
+        }
+
+        auto compute_family = _device->compute_queue_index();
+        auto transfer_family = _device->transfer_queue_index();
+        {
+            auto scope = _transfer_command_buffer->record();
+            auto tbuf = _transfer_command_buffer->get();
+            if (_device->transfer_ownership()) {
+                _gpu_buffer->acquire(tbuf, compute_family, transfer_family, VK_PIPELINE_STAGE_TRANSFER_BIT);
+            }
+            _staging_buffer->copy(*_gpu_buffer, _buffer_size(), tbuf);
+        }
+        // nothing else touches the buffer until the next frame, which flushes first
+        stream.submit_transfer(*_transfer_command_buffer, buf.last_timeline_value(), false);
+    }
+
+    void ImageDownloader::_record(VkCommandBuffer buf, bool copy) {
         if (_ofmt == OutFormat::half_rgba) {
             _image_to_half_buffer->dispatch(buf, _width, _height);
+        } else if (_ofmt == OutFormat::float_rgba) {
+            _image_to_float_buffer->dispatch(buf, _width, _height);
         } else if (_ofmt == OutFormat::uint8_rgba) {
             _image_to_uint8_rgba_buffer->dispatch(buf, _width, _height);
         } else if (_ofmt == OutFormat::uint8_rgbx) {
             _image_to_uint8_rgbx_buffer->dispatch(buf, _width, _height);
-        } else if (_ofmt == OutFormat::yuv420p) {
-            _quantise_luma->dispatch(buf, (int32_t)std::ceil(_width / 4.0f), _height);
-            _quantise_chroma_u->dispatch(buf, (int32_t)std::ceil(_width / 8.0f), _height/2);
-            _quantise_chroma_v->dispatch(buf, (int32_t)std::ceil(_width / 8.0f), _height/2);
+        } else if (_ofmt == OutFormat::uint16_rgba) {
+            _image_to_uint16_rgba_buffer->dispatch(buf, _width, _height);
+        } else if (_ofmt == OutFormat::yuv420p || _ofmt == OutFormat::video) {
+            // a block of eight pixels by a chroma row each
+            int32_t rows = 1 << _video_format.chroma_shift_y;
+            _video->dispatch(buf, (_width + 7) / 8, (_height + rows - 1) / rows);
+        }
+
+        if (!copy) {
+            if (_device->transfer_ownership()) {
+                _gpu_buffer->release(buf, _device->compute_queue_index(), _device->transfer_queue_index(), VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+            }
+            return;
         }
 
         _gpu_buffer->barrier(buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
@@ -96,7 +176,7 @@ namespace vkd {
     void ImageDownloader::execute() {
         auto buf = begin_immediate_command_buffer(_device->logical_device(), _device->command_pool());
         allocate(buf);
-        commands(buf);
+        _record(buf, true);
         deallocate();
         flush_command_buffer(_device->logical_device(), _device->queue(), _device->command_pool(), buf);
     }
@@ -4,9 +4,11 @@
 
 #include "buffer.hpp"
 #include "image.hpp"
+#include "video_format.hpp"
 #include "compute/kernel.hpp"
 
 namespace vkd {
+    class Stream;
     class ImageDownloader {
     public:
         ImageDownloader(const std::shared_ptr<Device>& device) : _device(device) {}
@@ -15,25 +17,38 @@ namespace vkd {
         ImageDownloader(const ImageDownloader&) = delete;
 
         enum class OutFormat {
-            yuv420p,
+            yuv420p, // 8 bit full range bt709
+            video, // encoder input, laid out as set_video_format says
             half_rgba,
+            float_rgba,
             uint8_rgba,
-            uint8_rgbx
+            uint8_rgbx,
+            uint16_rgba
         };
 
         void init(const std::shared_ptr<Image>& image, OutFormat ofmt, std::string param_hash_name);
+        // before init, for OutFormat::video. packed rgb isn't written, encoders take planar gbr instead
+        void set_video_format(const VideoFormat& format) { _video_format = format; }
+        // after init, can change whenever
+        void set_video_colour(VideoMatrix matrix, bool full_range);
+        // where each plane is in get_main(), for the encoder's frame
+        const auto& video_planes() const { return _planes; }
+        int32_t video_plane_count() const { return _plane_count; }
         void commands(CommandBuffer& buf);
         void commands(VkCommandBuffer buf);
+        // with a transfer queue commands() leaves the copy out and hands the buffer over,
+        // call this once the stream has taken buf and the copy runs on the transfer queue
+        void readback(CommandBuffer& buf, Stream& stream);
         void execute();
 
         std::vector<std::shared_ptr<Kernel>> kernels() const {
             std::vector<std::shared_ptr<Kernel>> ks;
-            if (_quantise_luma) { ks.push_back(_quantise_luma); }
-            if (_quantise_chroma_u) { ks.push_back(_quantise_chroma_u); }
-            if (_quantise_chroma_v) { ks.push_back(_quantise_chroma_v); }
+            if (_video) { ks.push_back(_video); }
             if (_image_to_half_buffer) { ks.push_back(_image_to_half_buffer); }
+            if (_image_to_float_buffer) { ks.push_back(_image_to_float_buffer); }
             if (_image_to_uint8_rgba_buffer) { ks.push_back(_image_to_uint8_rgba_buffer); }
             if (_image_to_uint8_rgbx_buffer) { ks.push_back(_image_to_uint8_rgbx_buffer); }
+            if (_image_to_uint16_rgba_buffer) { ks.push_back(_image_to_uint16_rgba_buffer); }
             return ks;
         }
 
@@ -42,6 +57,7 @@ namespace vkd {
         void allocate(VkCommandBuffer buf);
         void deallocate();
     private:
+        void _record(VkCommandBuffer buf, bool copy);
         size_t _buffer_size() const;
         OutFormat _ofmt = OutFormat::yuv420p;
 
@@ -49,20 +65,25 @@ namespace vkd {
 
         int32_t _width = 1, _height = 1;
 
+        VideoFormat _video_format;
+        std::array<VideoPlane, 3> _planes;
+        int32_t _plane_count = 0;
+
         std::shared_ptr<AutoMapStagingBuffer> _staging_buffer = nullptr;
         std::shared_ptr<StorageBuffer> _gpu_buffer = nullptr;
         std::shared_ptr<Image> _image = nullptr;
+        CommandBufferPtr _transfer_command_buffer = nullptr;
 
-        // yuv420p
-        std::shared_ptr<Kernel> _quantise_luma = nullptr;
-        std::shared_ptr<Kernel> _quantise_chroma_u = nullptr;
-        std::shared_ptr<Kernel> _quantise_chroma_v = nullptr;
+        // yuv420p and video
+        std::shared_ptr<Kernel> _video = nullptr;
 
         // half
 
         std::shared_ptr<Kernel> _image_to_half_buffer = nullptr;
+        std::shared_ptr<Kernel> _image_to_float_buffer = nullptr;
         std::shared_ptr<Kernel> _image_to_uint8_rgba_buffer = nullptr;
         std::shared_ptr<Kernel> _image_to_uint8_rgbx_buffer = nullptr;
         std::shared_ptr<Kernel> _image_to_uint8_rgb_buffer = nullptr;
+        std::shared_ptr<Kernel> _image_to_uint16_rgba_buffer = nullptr;
     };
 }
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "image_writer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+#include <zlib.h>
+#include <jpeglib.h>
+
+#include "vulkan.hpp"
+#include "host_scheduler.hpp"
+#include "trace.hpp"
+
+namespace vkd {
+    namespace {
+        std::mutex _defaults_mutex;
+        ImageWriteSettings _defaults;
+
+        struct JpegError {
+            jpeg_error_mgr mgr;
+            jmp_buf jump;
+            char message[JMSG_LENGTH_MAX];
+        };
+
+        void jpeg_error_exit(j_common_ptr cinfo) {
+            auto err = reinterpret_cast<JpegError *>(cinfo->err);
+            (*cinfo->err->format_message)(cinfo, err->message);
+            longjmp(err->jump, 1);
+        }
+
+        void jpeg_quiet(j_common_ptr cinfo) {}
+
+        // raw input a deflate task gets through, small enough to keep every core busy
+        constexpr size_t png_chunk_bytes = 1 << 20;
+        constexpr size_t zlib_window = 1 << 15;
+
+        void put_be32(uint8_t * dst, uint32_t v) {
+            dst[0] = (v >> 24) & 0xFF;
+            dst[1] = (v >> 16) & 0xFF;
+            dst[2] = (v >> 8) & 0xFF;
+            dst[3] = v & 0xFF;
+        }
+
+        void write_png_chunk(FILE * fp, const char * type, const uint8_t * data, size_t size) {
+            uint8_t header[8];
+            put_be32(header, (uint32_t)size);
+            memcpy(header + 4, type, 4);
+
+            uint32_t crc = crc32(0L, (const Bytef *)type, 4);
+            if (size > 0) {
+                crc = crc32(crc, data, (uInt)size);
+            }
+            uint8_t footer[4];
+            put_be32(footer, crc);
+
+            if (fwrite(header, 1, 8, fp) != 8 || (size > 0 && fwrite(data, 1, size, fp) != size) || fwrite(footer, 1, 4, fp) != 4) {
+                throw std::runtime_error("PNG: Write failed.");
+            }
+        }
+
+        inline uint8_t paeth(int a, int b, int c) {
+            int p = a + b - c;
+            int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc) {
+                return a;
+            }
+            return pb <= pc ? b : c;
+        }
+
+        // png rows are big endian and hold only the channels we keep
+        void pack_row(const uint8_t * src, int32_t width, int32_t bytes_per_channel, int32_t channels, uint8_t * dst) {
+            if (bytes_per_channel == 1) {
+                if (channels == 4) {
+                    memcpy(dst, src, (size_t)width * 4);
+                    return;
+                }
+                for (int32_t x = 0; x < width; ++x) {
+                    dst[x * 3 + 0] = src[x * 4 + 0];
+                    dst[x * 3 + 1] = src[x * 4 + 1];
+                    dst[x * 3 + 2] = src[x * 4 + 2];
+                }
+                return;
+            }
+
+            auto in = (const uint16_t *)src;
+            for (int32_t x = 0; x < width; ++x) {
+                for (int32_t c = 0; c < channels; ++c) {
+                    uint16_t v = in[x * 4 + c];
+                    dst[(x * channels + c) * 2 + 0] = v >> 8;
+                    dst[(x * channels + c) * 2 + 1] = v & 0xFF;
+                }
+            }
+        }
+
+        void filter_row(ImageWriteSettings::PngFilter filter, const uint8_t * row, const uint8_t * prev, size_t row_bytes, size_t bpp, uint8_t * out) {
+            using PngFilter = ImageWriteSettings::PngFilter;
+            auto left = [&](size_t i) -> int { return i >= bpp ? row[i - bpp] : 0; };
+            auto up = [&](size_t i) -> int { return prev ? prev[i] : 0; };
+            auto up_left = [&](size_t i) -> int { return (prev && i >= bpp) ? prev[i - bpp] : 0; };
+
+            out[0] = (uint8_t)filter;
+            uint8_t * dst = out + 1;
+            switch (filter) {
+            case PngFilter::None:
+                memcpy(dst, row, row_bytes);
+                break;
+            case PngFilter::Sub:
+                for (size_t i = 0; i < row_bytes; ++i) { dst[i] = row[i] - left(i); }
+                break;
+            case PngFilter::Up:
+                for (size_t i = 0; i < row_bytes; ++i) { dst[i] = row[i] - up(i); }
+                break;
+            case PngFilter::Average:
+                for (size_t i = 0; i < row_bytes; ++i) { dst[i] = row[i] - ((left(i) + up(i)) >> 1); }
+                break;
+            case PngFilter::Paeth:
+                for (size_t i = 0; i < row_bytes; ++i) { dst[i] = row[i] - paeth(left(i), up(i), up_left(i)); }
+                break;
+            default:
+                break;
+            }
+        }
+
+        void filter_row_adaptive(const uint8_t * row, const uint8_t * prev, size_t row_bytes, size_t bpp, uint8_t * out, std::vector<uint8_t>& scratch) {
+            using PngFilter = ImageWriteSettings::PngFilter;
+            scratch.resize(row_bytes + 1);
+            uint64_t best = UINT64_MAX;
+            for (auto filter : {PngFilter::None, PngFilter::Sub, PngFilter::Up, PngFilter::Average, PngFilter::Paeth}) {
+                filter_row(filter, row, prev, row_bytes, bpp, scratch.data());
+                uint64_t sum = 0;
+                for (size_t i = 1; i <= row_bytes; ++i) {
+                    sum += std::abs((int)(int8_t)scratch[i]);
+                }
+                if (sum < best) {
+                    best = sum;
+                    memcpy(out, scratch.data(), row_bytes + 1);
+                }
+            }
+        }
+    }
+
+    namespace image_writer {
+        ImageWriteSettings defaults() {
+            std::scoped_lock lock(_defaults_mutex);
+            return _defaults;
+        }
+
+        void set_defaults(const ImageWriteSettings& settings) {
+            std::scoped_lock lock(_defaults_mutex);
+            _defaults = settings;
+        }
+
+        void write_jpeg(const std::string& path, const uint8_t * rgbx, int32_t width, int32_t height, const ImageWriteSettings& settings) {
+            VKD_TRACE("write jpeg");
+            FILE * fp = fopen(path.c_str(), "wb");
+            if (fp == nullptr) {
+                throw std::runtime_error("JPEG: Could not open file for writing.");
+            }
+
+            jpeg_compress_struct cinfo;
+            JpegError err;
+            cinfo.err = jpeg_std_error(&err.mgr);
+            err.mgr.error_exit = jpeg_error_exit;
+            err.mgr.output_message = jpeg_quiet;
+            if (setjmp(err.jump)) {
+                jpeg_destroy_compress(&cinfo);
+                fclose(fp);
+                throw std::runtime_error(std::string("JPEG: ") + err.message);
+            }
+
+            jpeg_create_compress(&cinfo);
+            jpeg_stdio_dest(&cinfo, fp);
+            cinfo.image_width = width;
+            cinfo.image_height = height;
+            // turbo reads the padded pixels itself, no repacking
+            cinfo.input_components = 4;
+            cinfo.in_color_space = JCS_EXT_RGBX;
+            jpeg_set_defaults(&cinfo);
+            jpeg_set_quality(&cinfo, std::clamp(settings.jpeg_quality, 1, 100), TRUE);
+
+            int h = 2, v = 2;
+            if (settings.jpeg_subsampling == ImageWriteSettings::Subsampling::s444) {
+                h = 1; v = 1;
+            } else if (settings.jpeg_subsampling == ImageWriteSettings::Subsampling::s422) {
+                h = 2; v = 1;
+            }
+            cinfo.comp_info[0].h_samp_factor = h;
+            cinfo.comp_info[0].v_samp_factor = v;
+            for (int c = 1; c < cinfo.num_components; ++c) {
+                cinfo.comp_info[c].h_samp_factor = 1;
+                cinfo.comp_info[c].v_samp_factor = 1;
+            }
+
+            jpeg_start_compress(&cinfo, TRUE);
+
+            constexpr int batch = 16;
+            JSAMPROW rows[batch];
+            while (cinfo.next_scanline < cinfo.image_height) {
+                int count = std::min<int>(batch, cinfo.image_height - cinfo.next_scanline);
+                for (int i = 0; i < count; ++i) {
+                    rows[i] = const_cast<uint8_t *>(rgbx) + (size_t)(cinfo.next_scanline + i) * width * 4;
+                }
+                jpeg_write_scanlines(&cinfo, rows, count);
+            }
+
+            jpeg_finish_compress(&cinfo);
+            jpeg_destroy_compress(&cinfo);
+            fclose(fp);
+        }
+
+        void write_png(const std::string& path, const void * rgba, int32_t width, int32_t height, int32_t bit_depth, bool alpha, const ImageWriteSettings& settings) {
+            write_png(path, rgba, width, height, bit_depth, alpha, settings, ts());
+        }
+
+        void write_png(const std::string& path, const void * rgba, int32_t width, int32_t height, int32_t bit_depth, bool alpha, const ImageWriteSettings& settings, HostScheduler& scheduler) {
+            VKD_TRACE("write png");
+            if (bit_depth != 8 && bit_depth != 16) {
+                throw std::runtime_error("PNG: Unsupported bit depth.");
+            }
+            const int32_t bytes_per_channel = bit_depth / 8;
+            const int32_t channels = alpha ? 4 : 3;
+            const size_t bpp = (size_t)bytes_per_channel * channels;
+            const size_t row_bytes = bpp * width;
+            const size_t src_stride = (size_t)width * 4 * bytes_per_channel;
+            const int32_t level = std::clamp(settings.png_level, 0, 9);
+
+            // png's filters only look one row up, so rows split into runs that filter and deflate
+            // independently. each run is primed with the tail of the last so little ratio is lost
+            const int32_t rows_per_chunk = std::max<int32_t>(1, (int32_t)(png_chunk_bytes / (row_bytes + 1)));
+            const int32_t chunk_count = (height + rows_per_chunk - 1) / rows_per_chunk;
+
+            struct Chunk {
+                std::vector<uint8_t> filtered;
+                std::vector<uint8_t> deflated;
+                uLong adler = 1;
+            };
+            std::vector<Chunk> chunks(chunk_count);
+            std::atomic<bool> failed = false;
+
+            auto src = (const uint8_t *)rgba;
+            auto filter_chunk = [&, src](int32_t index) {
+                auto& chunk = chunks[index];
+                int32_t y0 = index * rows_per_chunk;
+                int32_t y1 = std::min(height, y0 + rows_per_chunk);
+                chunk.filtered.resize((size_t)(y1 - y0) * (row_bytes + 1));
+
+                std::vector<uint8_t> prev(row_bytes), row(row_bytes), scratch;
+                if (y0 > 0) {
+                    pack_row(src + (y0 - 1) * src_stride, width, bytes_per_channel, channels, prev.data());
+                }
+                for (int32_t y = y0; y < y1; ++y) {
+                    pack_row(src + y * src_stride, width, bytes_per_channel, channels, row.data());
+                    auto out = chunk.filtered.data() + (size_t)(y - y0) * (row_bytes + 1);
+                    auto above = y > 0 ? prev.data() : nullptr;
+                    if (settings.png_filter == ImageWriteSettings::PngFilter::Adaptive) {
+                        filter_row_adaptive(row.data(), above, row_bytes, bpp, out, scratch);
+                    } else {
+                        filter_row(settings.png_filter, row.data(), above, row_bytes, bpp, out);
+                    }
+                    std::swap(prev, row);
+                }
+                chunk.adler = adler32(adler32(0L, Z_NULL, 0), chunk.filtered.data(), (uInt)chunk.filtered.size());
+            };
+
+            auto deflate_chunk = [&](int32_t index) {
+                auto& chunk = chunks[index];
+                bool last = index == chunk_count - 1;
+
+                z_stream zs = {};
+                if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+                    failed = true;
+                    return;
+                }
+                if (index > 0) {
+                    auto&& before = chunks[index - 1].filtered;
+                    size_t dict = std::min(before.size(), zlib_window);
+                    deflateSetDictionary(&zs, before.data() + before.size() - dict, (uInt)dict);
+                }
+
+                chunk.deflated.resize(deflateBound(&zs, (uLong)chunk.filtered.size()) + 16);
+                zs.next_in = chunk.filtered.data();
+                zs.avail_in = (uInt)chunk.filtered.size();
+                zs.next_out = chunk.deflated.data();
+                zs.avail_out = (uInt)chunk.deflated.size();
+                // a sync flush ends on a byte boundary without finishing the stream, so the runs just concatenate
+                int ret = deflate(&zs, last ? Z_FINISH : Z_SYNC_FLUSH);
+                if ((last && ret != Z_STREAM_END) || (!last && ret != Z_OK) || zs.avail_in != 0) {
+                    failed = true;
+                }
+                chunk.deflated.resize(zs.total_out);
+                deflateEnd(&zs);
+            };
+
+            std::vector<TaskHandle> filtered(chunk_count), deflated(chunk_count);
+            for (int32_t i = 0; i < chunk_count; ++i) {
+                filtered[i] = scheduler.add("png filter", [i, &filter_chunk]() { filter_chunk(i); });
+            }
+            for (int32_t i = 0; i < chunk_count; ++i) {
+                std::vector<TaskHandle> deps = {filtered[i]};
+                if (i > 0) {
+                    deps.push_back(filtered[i - 1]);
+                }
+                deflated[i] = scheduler.after(deps, "png deflate", [i, &deflate_chunk]() { deflate_chunk(i); });
+            }
+            // we're often on a worker ourselves. the filters are runnable so waiting on them helps
+            // run them, a deflate still waiting on its filters can only be yielded to
+            for (auto&& task : filtered) {
+                scheduler.wait(task);
+            }
+            for (auto&& task : deflated) {
+                scheduler.wait(task);
+            }
+            for (auto&& chunk : chunks) {
+                if (chunk.filtered.empty()) {
+                    failed = true;
+                }
+            }
+            if (failed) {
+                throw std::runtime_error("PNG: Compression failed.");
+            }
+
+            FILE * fp = fopen(path.c_str(), "wb");
+            if (fp == nullptr) {
+                throw std::runtime_error("PNG: Could not open file for writing.");
+            }
+            struct Closer { FILE * fp; ~Closer() { fclose(fp); } } closer{fp};
+
+            static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+            if (fwrite(signature, 1, 8, fp) != 8) {
+                throw std::runtime_error("PNG: Write failed.");
+            }
+
+            uint8_t ihdr[13];
+            put_be32(ihdr, width);
+            put_be32(ihdr + 4, height);
+            ihdr[8] = (uint8_t)bit_depth;
+            ihdr[9] = alpha ? 6 : 2; // truecolour with or without alpha
+            ihdr[10] = 0;
+            ihdr[11] = 0;
+            ihdr[12] = 0;
+            write_png_chunk(fp, "IHDR", ihdr, sizeof(ihdr));
+
+            // zlib header up front, the adler of the whole lot at the end
+            uint8_t cmf = 0x78;
+            uint8_t flevel = level < 2 ? 0 : (level < 6 ? 1 : (level == 6 ? 2 : 3));
+            uint8_t flg = flevel << 6;
+            flg += 31 - ((cmf * 256 + flg) % 31);
+            uint8_t zlib_header[2] = {cmf, flg};
+            write_png_chunk(fp, "IDAT", zlib_header, 2);
+
+            uLong adler = adler32(0L, Z_NULL, 0);
+            for (auto&& chunk : chunks) {
+                write_png_chunk(fp, "IDAT", chunk.deflated.data(), chunk.deflated.size());
+                adler = adler32_combine(adler, chunk.adler, (z_off_t)chunk.filtered.size());
+            }
+            uint8_t trailer[4];
+            put_be32(trailer, (uint32_t)adler);
+            write_png_chunk(fp, "IDAT", trailer, 4);
+            write_png_chunk(fp, "IEND", nullptr, 0);
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "vkd_dll.h"
+
+namespace vkd {
+    class HostScheduler;
+
+    struct ImageWriteSettings {
+        enum class Subsampling {
+            s444,
+            s422,
+            s420
+        };
+        enum class PngFilter {
+            None,
+            Sub,
+            Up,
+            Average,
+            Paeth,
+            Adaptive // per row, smallest sum of residuals
+        };
+
+        int32_t jpeg_quality = 90;
+        Subsampling jpeg_subsampling = Subsampling::s420;
+        int32_t png_level = 6; // zlib 0-9
+        PngFilter png_filter = PngFilter::Adaptive;
+        bool png_16bit = false;
+    };
+
+    // encoders for the non-exr outputs. they read the downloader's mapped buffer as is and are safe to call from any thread
+    namespace image_writer {
+        // the defaults from preferences, for exports that don't have their own
+        ImageWriteSettings defaults();
+        void set_defaults(const ImageWriteSettings& settings);
+
+        // four bytes a pixel, the fourth ignored
+        void write_jpeg(const std::string& path, const uint8_t * rgbx, int32_t width, int32_t height, const ImageWriteSettings& settings);
+        // four channels a pixel, eight or sixteen bits (native endian) a channel. rows are deflated
+        // in parallel on the host scheduler
+        void write_png(const std::string& path, const void * rgba, int32_t width, int32_t height, int32_t bit_depth, bool alpha, const ImageWriteSettings& settings);
+        VKDEXPORT void write_png(const std::string& path, const void * rgba, int32_t width, int32_t height, int32_t bit_depth, bool alpha, const ImageWriteSettings& settings, HostScheduler& scheduler);
+    }
+}
@@ -3,9 +3,7 @@
 #include <memory>
 #include <string>
 
-namespace enki {
-	class TaskSet;
-}
+#include "task_handle.hpp"
 
 namespace vkd {
     class Device;
@@ -15,5 +13,5 @@ namespace vkd {
         PNG,
         JPG
     };
-    std::string immediate_exr(const std::shared_ptr<Device>& device, std::string filename, ImmediateFormat format, const std::shared_ptr<Image>& image, enki::TaskSet *& task);
+    std::string immediate_exr(const std::shared_ptr<Device>& device, std::string filename, ImmediateFormat format, const std::shared_ptr<Image>& image, TaskHandle& task);
 }
\ No newline at end of file
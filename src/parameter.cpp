@@ -28,6 +28,37 @@ PARAM_MACRO(vkd::Parameter<vkd::Frame>, PARAMETER_VERSION);
 PARAM_MACRO(vkd::Parameter<bool>, PARAMETER_VERSION);
 
 namespace vkd {
+    namespace {
+        thread_local bool deferring_writes = false;
+        // only touched from the deferring thread
+        std::vector<std::weak_ptr<ParameterInterface>> deferred_writes;
+    }
+
+    void ParameterInterface::defer(bool set) {
+        deferring_writes = set;
+        if (!set) {
+            auto deferred = std::move(deferred_writes);
+            deferred_writes.clear();
+            for (auto&& weak : deferred) {
+                if (auto param = weak.lock()) {
+                    param->_apply_deferred();
+                }
+            }
+        }
+    }
+
+    bool ParameterInterface::deferring() {
+        return deferring_writes;
+    }
+
+    bool ParameterInterface::any_deferred() {
+        return !deferred_writes.empty();
+    }
+
+    void ParameterInterface::_deferred(std::weak_ptr<ParameterInterface> param) {
+        deferred_writes.push_back(std::move(param));
+    }
+
     std::unique_ptr<ParameterCache> ParameterCache::_singleton = nullptr;
     std::mutex ParameterCache::_param_mutex;
     
@@ -61,6 +92,21 @@ namespace vkd {
         return _singleton->_remove(make_hash(p, name));
     }
 
+    bool ParameterCache::user_changed() {
+        std::scoped_lock lock(_param_mutex);
+        _make();
+        for (auto&& pair : _singleton->_params) {
+            auto name = pair.second->name();
+            if (name == "frame" || (!name.empty() && name[0] == '_')) {
+                continue;
+            }
+            if (pair.second->changed()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
     std::string ParameterCache::make_hash(ParameterType p, const std::string& name) {
         return std::to_string((int32_t)p) + name;
     }
@@ -10,8 +10,10 @@
 
 #include <memory>
 #include <mutex>
+#include <optional>
 
 #include "glm/glm.hpp"
+#include "vkd_dll.h"
 
 namespace glm {
     template<class Archive>
@@ -134,6 +136,12 @@ namespace vkd {
         
         auto&& ui_changed_last_tick() { return _ui_changed_last_tick; }
 
+        // while a batch is on the engine thread, sets from the thread that turned this on are held
+        // and read back only by it. turning it off applies them
+        VKDEXPORT static void defer(bool set);
+        VKDEXPORT static bool deferring();
+        VKDEXPORT static bool any_deferred();
+
         template <class Archive>
         void serialize(Archive& ar, const uint32_t version)
         {
@@ -149,6 +157,9 @@ namespace vkd {
             }
         }
     protected:
+        VKDEXPORT static void _deferred(std::weak_ptr<ParameterInterface> param);
+        virtual void _apply_deferred() = 0;
+
         //bool _changed = true;
         int64_t _version_index = 0;
         int64_t _execution_index = 0;
@@ -236,6 +247,16 @@ namespace vkd {
         }
 
         void set_force(P p) {
+            if (deferring()) {
+                auto self = weak_from_this();
+                if (!self.expired()) {
+                    if (!_pending) {
+                        _deferred(std::move(self));
+                    }
+                    _pending = p;
+                    return;
+                }
+            }
             if constexpr (is_numeric<P>()) {
                 min(glm::min(p, min()));
                 max(glm::max(p, max()));
@@ -274,7 +295,7 @@ namespace vkd {
 
         void set_from(const std::shared_ptr<ParameterInterface>& rhs) override { set_from(rhs->as<P>()); }
 
-        P get() const { return _value; }
+        P get() const { return deferring() && _pending ? *_pending : _value; }
         P get_default() const { return _default; }
 
         P min() const { return _min; }
@@ -320,6 +341,14 @@ namespace vkd {
             }
         }
     private:
+        void _apply_deferred() override {
+            if (_pending) {
+                auto p = std::move(*_pending);
+                _pending = std::nullopt;
+                set_force(p);
+            }
+        }
+
         Type _type;
         P _value;
         P _min;
@@ -334,9 +363,11 @@ namespace vkd {
         std::vector<int32_t> _enum_values;
 
         std::atomic_bool _set_default = false;
+
+        std::optional<P> _pending;
     };
 
-    class ParameterCache {
+    class VKDEXPORT ParameterCache {
     public:
         ~ParameterCache() = default;
 
@@ -346,6 +377,8 @@ namespace vkd {
         static bool remove(ParameterType p, const std::string& name);
 
         static void reset_changed() { _singleton->_reset_changed(); }
+        // anything but the frame and hidden params changed since the last reset
+        static bool user_changed();
 
         static std::string make_hash(ParameterType p, const std::string& name);
     private:
@@ -1,4 +1,6 @@
 #include "draw_fullscreen.hpp"
+#include <algorithm>
+#include <cmath>
 #include "draw_triangle.hpp"
 #include "buffer.hpp"
 #include "command_buffer.hpp"
@@ -64,10 +66,6 @@ namespace vkd {
 
         flush_command_buffer(_device->logical_device(), _device->queue(), _device->command_pool(), buf);
 
-        _desc_pool = std::make_shared<DescriptorPool>(_device);
-        _desc_pool->add_combined_image_sampler(3);
-        _desc_pool->create(3);
-
         _desc_set_layout = std::make_shared<DescriptorLayout>(_device);
         _desc_set_layout->add(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT);
         _desc_set_layout->create();
@@ -84,6 +82,7 @@ namespace vkd {
 		vertex_input->add_attribute(0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(FSVertex, position));
 		vertex_input->add_attribute(0, 1, VK_FORMAT_R32G32_SFLOAT, offsetof(FSVertex, texcoord));
 
+        _pipeline->layout()->add_constant(VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec4));
         _pipeline->create(_desc_set_layout->get(), std::move(shader_stages), std::move(vertex_input));
         
         _ocio_params = std::make_unique<OcioParams>(*this);
@@ -91,41 +90,24 @@ namespace vkd {
 
     void DrawFullscreen::init() {
         auto image = _image_node->get_output_image();
-        _input_image = image;
-        glm::ivec2 size = {256, 256};
-        if (image) {
-            size = image->dim();
-        } else {
+        if (!image) {
             console << "Warning: output node could not get image from attached node." << std::endl;
         }
-
-        _image = Image::float_image(_device, size, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-        _image->debug_name("UI Fullscreen");
-
-        {
-            auto buf = CommandBuffer::make_immediate(_device);
-            _image->allocate(buf->get());
+        if (_input_image != image) {
+            _input_image = image;
+            _factor = 0; // display image is made at the next run, at whatever size the zoom wants
         }
-
-        _desc_sets[_desc_set_to_use] = std::make_shared<DescriptorSet>(_device, _desc_set_layout, _desc_pool);
-        _desc_sets[_desc_set_to_use]->debug_name(std::string("UI Fullscreen (desc set) ") + std::to_string(_desc_set_to_use));
-        _desc_sets[_desc_set_to_use]->add_image(_image, _image->sampler());
-        _desc_sets[_desc_set_to_use]->create();
-        _desc_set = _desc_sets[_desc_set_to_use];
-        _desc_set_to_use = (_desc_set_to_use + 1) % 3;
-
     }
     
     bool DrawFullscreen::update(ExecutionType type) {
+        _run_level = level();
 
         auto image = _image_node->get_output_image();
         if (image) {
             if (_input_image != image) {
-                _image = Image::float_image(_device, image->dim(), VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
-                _image->debug_name("UI Fullscreen");
                 _input_image = image;
+                _factor = 0;
                 _ocio_kernel = nullptr;
-                _desc_set = nullptr;
             }
             return true;
         } else {
@@ -150,9 +132,6 @@ namespace vkd {
     }
 
     void DrawFullscreen::commands(VkCommandBuffer buf, uint32_t width, uint32_t height) {
-        if (!(_image && _image->allocated())) {
-            return;
-        }
         //if (!_desc_set) {
         /*} else {
             _desc_set->flush();
@@ -179,11 +158,44 @@ namespace vkd {
             offy = (height - vh) / 2;
         }
 
-        viewport_and_scissor_with_offset(buf, offx, offy, vw, vh, width, height);
+        _fit = {offx, offy, vw, vh};
+
+        // zoomed, the image is bigger than the fit and only the part inside the window is drawn
+        glm::vec2 size = glm::vec2(vw, vh) * _zoom;
+        glm::vec2 origin = glm::vec2{offx + vw / 2.0f, offy + vh / 2.0f} - _centre * size;
+        glm::vec2 lo = glm::max(origin, glm::vec2{0.0f});
+        glm::vec2 hi = glm::min(origin + size, glm::vec2(width, height));
+        if (hi.x - lo.x < 1.0f || hi.y - lo.y < 1.0f) {
+            return;
+        }
+        _uv_rect = {(lo - origin) / size, (hi - origin) / size};
+
+        // the coarsest power of two that still has a pixel for each one on screen
+        float per_screen = _input_image ? _input_image->dim().x / std::max(size.x, 1.0f) : 1.0f;
+        _level = std::max((int32_t)std::floor(std::log2(std::max(per_screen, 1.0f))), 0);
+
+        std::shared_ptr<DescriptorSet> set = _present_set;
+        {
+            std::scoped_lock lock(_slot_mutex);
+            if (_pending >= 0) {
+                _front = _pending;
+                _pending = -1;
+            }
+            if (!set && _front >= 0) {
+                set = _slots[_front].set;
+            }
+        }
+        if (!set) {
+            return;
+        }
+
+        viewport_and_scissor_with_offset(buf, lo.x, lo.y, hi.x - lo.x, hi.y - lo.y, width, height);
 
-        _offset_w_h = {offx, offy, vw, vh};
+        _offset_w_h = glm::ivec4(origin, size);
         
-        _pipeline->bind(buf, _desc_set);
+        _pipeline->bind(buf, set);
+
+        vkCmdPushConstants(buf, _pipeline->layout()->get(), VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(glm::vec4), &_uv_rect);
 
         // Bind triangle vertex buffer (contains position and colors)
         std::array<VkDeviceSize, 1> offsets = { 0 };
@@ -198,6 +210,65 @@ namespace vkd {
     }
 
 
+    void DrawFullscreen::navigate(glm::vec2 mouse, float wheel, glm::vec2 drag) {
+        glm::vec2 fit_size = glm::max(glm::vec2(_fit.z, _fit.w), glm::vec2{1.0f});
+        glm::vec2 fit_middle = glm::vec2(_fit.x, _fit.y) + fit_size / 2.0f;
+
+        if (wheel != 0.0f) {
+            // keep the uv under the mouse where it is
+            glm::vec2 size = fit_size * _zoom;
+            glm::vec2 under = (mouse - (fit_middle - _centre * size)) / size;
+            _zoom = glm::clamp(_zoom * std::pow(1.25f, wheel), 1.0f, 64.0f);
+            _centre = (fit_middle - mouse) / (fit_size * _zoom) + under;
+        }
+        _centre -= drag / (fit_size * _zoom);
+
+        if (_zoom <= 1.0f) {
+            _centre = {0.5f, 0.5f};
+        }
+        _centre = glm::clamp(_centre, glm::vec2{0.0f}, glm::vec2{1.0f});
+    }
+
+    glm::ivec4 DrawFullscreen::visible_region() const {
+        glm::vec2 dim = _input_image ? glm::vec2(_input_image->dim()) : glm::vec2{0.0f};
+        glm::ivec2 lo = glm::ivec2(glm::floor(glm::vec2{_uv_rect.x, _uv_rect.y} * dim));
+        glm::ivec2 hi = glm::ivec2(glm::ceil(glm::vec2{_uv_rect.z, _uv_rect.w} * dim));
+        return {lo, hi};
+    }
+
+    std::shared_ptr<DescriptorSet> DrawFullscreen::make_present_set(const std::shared_ptr<Image>& image) {
+        // a pool each, cached frames come and go independently
+        auto pool = std::make_shared<DescriptorPool>(_device);
+        pool->add_combined_image_sampler(1);
+        pool->create(1);
+
+        auto set = std::make_shared<DescriptorSet>(_device, _desc_set_layout, pool);
+        set->debug_name("UI Fullscreen (present desc set)");
+        set->add_image(image, image->sampler());
+        set->create();
+        return set;
+    }
+
+    std::shared_ptr<Image> DrawFullscreen::get_image() const {
+        std::scoped_lock lock(_slot_mutex);
+        int32_t newest = _pending >= 0 ? _pending : _front;
+        return newest >= 0 ? _slots[newest].image : nullptr;
+    }
+
+    void DrawFullscreen::_make_display(glm::ivec2 size, bool downsampled) {
+        auto buf = CommandBuffer::make_immediate(_device);
+        _image = Image::float_image(_device, size, VK_IMAGE_USAGE_STORAGE_BIT);
+        _image->debug_name("UI Fullscreen");
+        _image->allocate(buf->get());
+
+        _level_image = nullptr;
+        if (downsampled) {
+            _level_image = Image::float_image(_device, size);
+            _level_image->debug_name("UI Fullscreen (level)");
+            _level_image->allocate(buf->get());
+        }
+    }
+
     void DrawFullscreen::allocate(VkCommandBuffer buf) {
     }
 
@@ -208,11 +279,26 @@ namespace vkd {
 
         _ocio_params->update();
 
+        auto input = _image_node->get_output_image();
+        if (!input || input != _input_image) {
+            return;
+        }
+
+        // a display pixel covers factor full resolution ones, the proxy's own shrink included
+        int32_t scale = proxy_scale();
+        int32_t step = std::max((1 << _run_level) / scale, 1);
+        int32_t factor = scale * step;
+        glm::ivec2 size = (input->dim() + factor - 1) / factor;
+        if (factor != _factor || !_image || (step > 1) != (_level_image != nullptr)) {
+            _make_display(size, step > 1);
+            _factor = factor;
+        }
+
         if (!_ocio_kernel || _ocio_params->working_space->changed() || _ocio_params->display_space->changed()) {
             _ocio_images.clear();
 
             try {
-                _ocio_kernel = ocio_functional::make_shader(*this, _image_node->get_output_image(), _image, _ocio_params->working_space_index(), _ocio_params->display_space_index(), _ocio_images);
+                _ocio_kernel = ocio_functional::make_shader(*this, input, _image, _ocio_params->working_space_index(), _ocio_params->display_space_index(), _ocio_images);
             } catch (OcioException& e) {
                 std::stringstream strm;
                 strm << "Display OCIO shader build failed: " << e.what();
@@ -224,20 +310,89 @@ namespace vkd {
                 std::cerr << strm.str() << std::endl;
                 _ocio_kernel = nullptr;
             }
-        } else if (_ocio_kernel) {
-            _ocio_kernel->set_arg(0, _image_node->get_output_image());
-            _ocio_kernel->set_arg(1, _image);
         }
 
-        if (_ocio_kernel && _image_node->get_output_image() && _image_node->get_output_image() == _input_image) {
-            auto sz = _image_node->get_output_image()->dim();
+        if (!_ocio_kernel) {
+            return;
+        }
+
+        // the graph's region, in display pixels
+        glm::ivec4 r = {0, 0, size.x, size.y};
+        if (region()) {
+            auto full = *region();
+            glm::ivec2 lo = glm::clamp(glm::ivec2{full.x, full.y} / factor, glm::ivec2{0}, size);
+            glm::ivec2 hi = glm::clamp((glm::ivec2{full.z, full.w} + factor - 1) / factor, lo, size);
+            r = {lo.x, lo.y, hi.x, hi.y};
+        }
+
+        // the transform only ever sees display sized images
+        auto source = input;
+        if (step > 1) {
+            if (!_downsample) {
+                _downsample = std::make_shared<Kernel>(_device, "____draw_level");
+                _downsample->init("shaders/compute/proxy_downsample.comp.spv", "main", Kernel::default_local_sizes);
+            }
+            _downsample->set_arg(0, input);
+            _downsample->set_arg(1, _level_image);
+            _downsample->set_push_arg_by_name("_scale", step);
+            _downsample->set_offset(r.x, r.y);
+            source = _level_image;
+        }
+        _ocio_kernel->set_arg(0, source);
+        _ocio_kernel->set_arg(1, _image);
+        _ocio_kernel->set_offset(r.x, r.y);
+
+        // the whole image goes over, the slot's older than the parts this run skipped
+        {
+            std::scoped_lock lock(_slot_mutex);
+            _writing = 0;
+            while (_writing == _front || _writing == _pending) {
+                _writing++;
+            }
+        }
+        auto complete = draw_frame_complete();
+        _retired_slots.erase(std::remove_if(_retired_slots.begin(), _retired_slots.end(), [complete](const auto& retired) { return retired.first <= complete; }), _retired_slots.end());
+
+        auto&& slot = _slots[_writing];
+        if (!slot.image || slot.image->dim() != size) {
+            if (slot.image) {
+                _retired_slots.emplace_back(draw_frame(), std::move(slot));
+            }
+            slot.image = Image::float_image(_device, size, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+            slot.image->debug_name("UI Fullscreen (slot)");
             {
-                auto scope = command_buffer().record();
-                _ocio_kernel->dispatch(command_buffer(), sz.x, sz.y);
+                auto buf = CommandBuffer::make_immediate(_device);
+                slot.image->allocate(buf->get());
             }
+            slot.set = make_present_set(slot.image);
+        }
+        if (!_copy) {
+            _copy = std::make_shared<Kernel>(_device, "____draw_slot");
+            _copy->init("shaders/compute/crop.comp.spv", "main", Kernel::default_local_sizes);
+            _copy->set_push_arg_by_name("_crop_offset", glm::ivec2{0, 0});
+        }
+        _copy->set_arg(0, _image);
+        _copy->set_arg(1, slot.image);
+
+        {
+            auto scope = command_buffer().record();
+            if (step > 1) {
+                _downsample->dispatch(command_buffer(), r.z - r.x, r.w - r.y);
+            }
+            _ocio_kernel->dispatch(command_buffer(), r.z - r.x, r.w - r.y);
+            _copy->dispatch(command_buffer(), size.x, size.y);
+        }
+
+        stream.submit(command_buffer());
+    }
 
-            stream.submit(command_buffer());
+    void DrawFullscreen::post_execute(ExecutionType type) {
+        // the draw comes after the run on the stream's timeline, there's no need to wait for it here
+        std::scoped_lock lock(_slot_mutex);
+        if (_writing >= 0) {
+            _pending = _writing;
+            _writing = -1;
         }
     }
 
-}
\ No newline at end of file
+}
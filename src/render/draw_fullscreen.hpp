@@ -3,6 +3,7 @@
 #include <memory>
 #include <vector>
 #include <array>
+#include <mutex>
 #include <glm/glm.hpp>
 #include "vulkan.hpp"
 
@@ -59,16 +60,39 @@ namespace vkd {
         bool update(ExecutionType type) override;
         void commands(VkCommandBuffer buf, uint32_t width, uint32_t height) override;
         void execute(ExecutionType type, Stream& stream) override;
+        void post_execute(ExecutionType type) override;
 
         void allocate(VkCommandBuffer buf) override;
         void deallocate() override;
-
-        auto get_image() const { return _image; }
+        bool supports_proxy() const override { return true; }
+        bool supports_region() const override { return true; }
+
+        // the newest finished frame: the display transformed image at the size it's drawn,
+        // downsampled by display_factor from the input. always the whole image
+        std::shared_ptr<Image> get_image() const;
+        int32_t display_factor() const { return _factor; }
+        // the power of two the viewer downsamples by at this zoom and window size
+        int32_t level() const { return _full_resolution ? 0 : _level; }
+        // no downsampling whatever the zoom, eg. to export what's on screen
+        void full_resolution(bool full) { _full_resolution = full; }
+
+        // a descriptor set that draws image in place of ours, for the playback cache
+        std::shared_ptr<DescriptorSet> make_present_set(const std::shared_ptr<Image>& image);
+        // draw this instead of the live image until given nullptr
+        void present(const std::shared_ptr<DescriptorSet>& set) { _present_set = set; }
 
         auto input_node() const { return _image_node; }
 
+        // the whole image on screen, running off the window when zoomed in
         const auto& offset_w_h() const { return _offset_w_h; }
 
+        // zoom about the mouse with the wheel, pan by dragging, both in window pixels
+        void navigate(glm::vec2 mouse, float wheel, glm::vec2 drag);
+        void reset_view() { _zoom = 1.0f; _centre = {0.5f, 0.5f}; }
+        bool shows_whole_image() const { return _zoom <= 1.0f; }
+        // the image pixels drawn at the last commands, x0, y0, x1, y1
+        glm::ivec4 visible_region() const;
+
         struct FSVertex {
             glm::vec2 position;
             glm::vec2 texcoord;
@@ -76,23 +100,45 @@ namespace vkd {
     private:
         std::shared_ptr<ImageNode> _image_node = nullptr;
 
-        std::shared_ptr<DescriptorPool> _desc_pool = nullptr;
-
         std::shared_ptr<VertexBuffer> _vertex_buffer = nullptr;
         std::shared_ptr<IndexBuffer> _index_buffer = nullptr;
 
         std::shared_ptr<DescriptorLayout> _desc_set_layout = nullptr;
-        int _desc_set_to_use = 0;
-        std::array<std::shared_ptr<DescriptorSet>, 3> _desc_sets;
-        std::shared_ptr<DescriptorSet> _desc_set;
+        std::shared_ptr<DescriptorSet> _present_set = nullptr;
 
         std::shared_ptr<GraphicsPipeline> _pipeline = nullptr;
         
+        void _make_display(glm::ivec2 size, bool downsampled);
+
         std::shared_ptr<Kernel> _ocio_kernel = nullptr;
+        std::shared_ptr<Kernel> _downsample = nullptr;
         std::map<int, std::shared_ptr<Image>> _ocio_images;
 
         std::shared_ptr<Image> _input_image = nullptr;
         std::shared_ptr<Image> _image = nullptr;
+        // the input box filtered down to the display size, what the display transform reads
+        std::shared_ptr<Image> _level_image = nullptr;
+
+        // finished frames go to the ui through these. runs write one the ui isn't drawing or about
+        // to, it's pending once the run's done and the next draw swaps it to the front
+        struct Slot {
+            std::shared_ptr<Image> image = nullptr;
+            std::shared_ptr<DescriptorSet> set = nullptr;
+        };
+        std::array<Slot, 3> _slots;
+        // replaced slots, by the draw frame they went in. a draw in flight may still sample them
+        std::vector<std::pair<uint64_t, Slot>> _retired_slots;
+        mutable std::mutex _slot_mutex;
+        int32_t _front = -1;
+        int32_t _pending = -1;
+        int32_t _writing = -1;
+        std::shared_ptr<Kernel> _copy = nullptr;
+        // full resolution pixels to a display pixel, proxy scale included. 0 before the first run
+        int32_t _factor = 0;
+        int32_t _level = 0;
+        // the level as of the last update, what runs use while the ui moves on
+        int32_t _run_level = 0;
+        bool _full_resolution = false;
 
         CommandBufferPtr _command_buffer = nullptr;
         //ScopedSamplerPtr _sampler = nullptr;
@@ -102,6 +148,12 @@ namespace vkd {
 
         
         glm::ivec4 _offset_w_h;
+        // the image fitted to the window, what zoom 1 shows
+        glm::ivec4 _fit = {0, 0, 1, 1};
+        float _zoom = 1.0f;
+        // the uv at the middle of the fit
+        glm::vec2 _centre = {0.5f, 0.5f};
+        glm::vec4 _uv_rect = {0.0f, 0.0f, 1.0f, 1.0f};
 
         OcioParamsPtr _ocio_params = nullptr;
     };
@@ -1,6 +1,7 @@
 #pragma once
 #include "vulkan.hpp"
 #include "device.hpp"
+#include "vkd_dll.h"
 
 namespace vkd {
     static VkSemaphore create_semaphore(VkDevice logical_device) {
@@ -17,7 +18,7 @@ namespace vkd {
 	using SemaphorePtr = std::shared_ptr<Semaphore>;
 	class TimelineSemaphore;
 	using TimelineSemaphorePtr = std::shared_ptr<TimelineSemaphore>;
-	class Semaphore {
+	class VKDEXPORT Semaphore {
 	public:
         Semaphore(const std::shared_ptr<Device>& device) : _device(device) {}
         ~Semaphore() {
@@ -60,7 +61,7 @@ namespace vkd {
         return semaphore;
     }
 
-	class TimelineSemaphore : public Semaphore {
+	class VKDEXPORT TimelineSemaphore : public Semaphore {
 	public:
         TimelineSemaphore(const std::shared_ptr<Device>& device) : Semaphore(device) {}
         ~TimelineSemaphore() {}
@@ -25,6 +25,7 @@ namespace vkd {
         GraphRequests::Request request;
         request.type = ExecutionType::UI;
         request.extra_nodes = {terminal};
+        request.cancellable = true;
         add(request);
     }
 
@@ -35,4 +36,20 @@ namespace vkd {
         _execution_requests.pop_front();
         return {r};
     }
+
+    std::vector<GraphRequests::Request> GraphRequests::take_all() {
+        std::scoped_lock lock(_request_mutex);
+        std::vector<Request> requests;
+        for (auto&& request : _execution_requests) {
+            // the later refresh does everything this one would
+            bool repeat = request.cancellable && !requests.empty() && requests.back().cancellable && requests.back().extra_nodes == request.extra_nodes;
+            if (repeat) {
+                requests.back() = std::move(request);
+            } else {
+                requests.push_back(std::move(request));
+            }
+        }
+        _execution_requests.clear();
+        return requests;
+    }
 }
\ No newline at end of file
@@ -17,6 +17,8 @@ namespace vkd {
         struct Request {
             std::vector<std::shared_ptr<EngineNode>> extra_nodes;
             ExecutionType type;
+            // a viewer refresh, stale as soon as another's asked for
+            bool cancellable = false;
         };
 
         static GraphRequests& Get();
@@ -25,6 +27,8 @@ namespace vkd {
         void add(const Request& request);
         void add_ui_run_with(std::shared_ptr<EngineNode> terminal);
         std::optional<Request> take();
+        // everything queued, repeated refreshes only once
+        std::vector<Request> take_all();
     private:
         static std::mutex _singleton_mutex;
         static std::unique_ptr<GraphRequests> _singleton; 
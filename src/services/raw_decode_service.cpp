@@ -0,0 +1,424 @@
+#include "raw_decode_service.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#define LIBRAW_NO_WINSOCK2
+#include "libraw/libraw.h"
+
+#include "vulkan.hpp"
+#include "device.hpp"
+#include "host_cache.hpp"
+#include "host_scheduler.hpp"
+#include "console.hpp"
+#include "trace.hpp"
+
+namespace vkd {
+    std::mutex RawDecodeService::_singleton_mutex;
+    std::unique_ptr<RawDecodeService> RawDecodeService::_singleton = nullptr;
+
+    RawDecodeService& RawDecodeService::Get() {
+        std::scoped_lock lock(_singleton_mutex);
+        if (_singleton == nullptr) { _singleton = std::make_unique<RawDecodeService>(); }
+        return *_singleton;
+    }
+
+    void RawDecodeService::Shutdown() {
+        std::scoped_lock lock(_singleton_mutex);
+        if (_singleton != nullptr) { _singleton = nullptr; }
+    }
+
+    RawDecodeService::RawDecodeService() {
+        // leave a core for the ui thread
+        _max_concurrent = std::max(1, (int32_t)std::thread::hardware_concurrency() - 1);
+    }
+
+    RawDecodeService::~RawDecodeService() {
+        std::vector<JobPtr> running;
+        {
+            std::scoped_lock lock(_mutex);
+            _shutting_down = true;
+            for (auto&& job : _pending) {
+                job->_state.store(Job::State::Cancelled, std::memory_order_release);
+            }
+            _pending.clear();
+            _jobs.clear();
+            running = _running;
+        }
+        for (auto&& job : running) {
+            wait(job);
+        }
+    }
+
+    std::string RawDecodeService::metadata(LibRaw& imProc) {
+        std::stringstream strm;
+
+        strm << "make: " << imProc.imgdata.idata.make << "\n";
+        strm << "model: " << imProc.imgdata.idata.model << "\n";
+        strm << "n-make: " << imProc.imgdata.idata.normalized_make << "\n";
+        strm << "n-model: " << imProc.imgdata.idata.normalized_model << "\n";
+        strm << "software: " << imProc.imgdata.idata.software << "\n";
+        strm << "raw count: " << imProc.imgdata.idata.raw_count << "\n";
+        strm << "colours: " << imProc.imgdata.idata.colors << "\n";
+        strm << "filters: " << std::hex << imProc.imgdata.idata.colors << std::dec <<"\n";
+        strm << "raw width: " << imProc.imgdata.sizes.raw_width <<"\n";
+        strm << "raw height: " << imProc.imgdata.sizes.raw_height <<"\n";
+        strm << "width: " << imProc.imgdata.sizes.width <<"\n";
+        strm << "height: " << imProc.imgdata.sizes.height <<"\n";
+        strm << "black level: " << imProc.imgdata.color.black <<"\n";
+        strm << "c-black level: r: " << imProc.imgdata.color.cblack[0] << " g: " << imProc.imgdata.color.cblack[1] << " b: " << imProc.imgdata.color.cblack[2] << "\n";
+        strm << "c-black level: r2: " << imProc.imgdata.color.cblack[3] << " g2: " << imProc.imgdata.color.cblack[4] << " b2: " << imProc.imgdata.color.cblack[5] << "\n";
+        strm << "data max: " << imProc.imgdata.color.data_maximum <<"\n";
+        strm << "max: " << imProc.imgdata.color.maximum <<"\n";
+        strm << "iso: " << imProc.imgdata.other.iso_speed <<"\n";
+        strm << "shutter: " << imProc.imgdata.other.shutter <<"\n";
+        strm << "aperture: " << imProc.imgdata.other.aperture <<"\n";
+        strm << "focal length: " << imProc.imgdata.other.focal_len <<"\n";
+        strm << "time: " << imProc.imgdata.other.timestamp <<"\n";
+        strm << "num: " << imProc.imgdata.other.shot_order <<"\n";
+
+        return strm.str();
+    }
+
+    RawDecodeService::JobPtr RawDecodeService::unpack(const std::shared_ptr<Device>& device, const EngineNode * owner, const std::string& path, int32_t width, int32_t height) {
+        // the raw as libraw holds it plus our copy
+        size_t bytes = (size_t)width * height * sizeof(uint16_t) * 2;
+        return _request(Job::Kind::Unpack, device, owner, path, 0, bytes, nullptr);
+    }
+
+    RawDecodeService::JobPtr RawDecodeService::develop(const std::shared_ptr<Device>& device, const EngineNode * owner, const std::string& path, int32_t colour_space, int32_t width, int32_t height, JobPtr after) {
+        // raw, libraw's four channel image, and the copy for the host cache
+        size_t bytes = (size_t)width * height * sizeof(uint16_t) * (1 + 4 + 4);
+        return _request(Job::Kind::Develop, device, owner, path, colour_space, bytes, std::move(after));
+    }
+
+    RawDecodeService::JobPtr RawDecodeService::_request(Job::Kind kind, const std::shared_ptr<Device>& device, const EngineNode * owner, const std::string& path, int32_t colour_space, size_t bytes, JobPtr after) {
+        auto key = kind == Job::Kind::Unpack ? unpack_key(path) : develop_key(path, colour_space);
+        JobPtr job = nullptr;
+        {
+            std::scoped_lock lock(_mutex);
+            auto search = _jobs.find(key);
+            if (search != _jobs.end()) {
+                search->second->_owners.insert(owner);
+                return search->second;
+            }
+
+            // a mosaic someone else still holds is as good as a fresh one
+            auto finished = _finished.find(key);
+            if (finished != _finished.end()) {
+                if (auto done = finished->second.lock()) {
+                    done->_owners.insert(owner);
+                    return done;
+                }
+                _finished.erase(finished);
+            }
+
+            job = std::make_shared<Job>();
+            job->_kind = kind;
+            job->_key = key;
+            job->_path = path;
+            job->_colour_space = colour_space;
+            job->_bytes = bytes;
+            job->_order = _next_order++;
+            job->_device = device;
+            job->_after = std::move(after);
+            job->_owners.insert(owner);
+
+            if (_shutting_down) {
+                job->_state.store(Job::State::Cancelled, std::memory_order_release);
+                return job;
+            }
+
+            _jobs.emplace(key, job);
+            _pending.push_back(job);
+        }
+        _pump();
+
+        return job;
+    }
+
+    void RawDecodeService::release(const JobPtr& job, const EngineNode * owner) {
+        if (!job) {
+            return;
+        }
+        std::scoped_lock lock(_mutex);
+        job->_owners.erase(owner);
+        if (job->_owners.empty() && job->_state.load(std::memory_order_acquire) == Job::State::Pending) {
+            job->_state.store(Job::State::Cancelled, std::memory_order_release);
+            _pending.erase(std::remove(_pending.begin(), _pending.end(), job), _pending.end());
+            _jobs.erase(job->_key);
+            if (job->_after) {
+                _drop_libraw(*job->_after);
+            }
+        }
+        _drop_libraw(*job);
+    }
+
+    void RawDecodeService::_drop_libraw(Job& job) {
+        if (!job._libraw || !job._owners.empty()) {
+            return;
+        }
+        auto waiting = [&job](const JobPtr& other) { return other->_after.get() == &job; };
+        if (std::any_of(_pending.begin(), _pending.end(), waiting) || std::any_of(_running.begin(), _running.end(), waiting)) {
+            return;
+        }
+        job._libraw = nullptr;
+        _bytes_in_flight -= job._held;
+        job._held = 0;
+    }
+
+    void RawDecodeService::wait(const JobPtr& job) {
+        while (job && !job->complete()) {
+            TaskHandle task;
+            {
+                std::scoped_lock lock(_mutex);
+                task = job->_task;
+            }
+            if (task) {
+                ts().wait(task);
+            } else {
+                std::this_thread::yield(); // still queued behind others
+            }
+        }
+    }
+
+    void RawDecodeService::set_visible(std::set<const EngineNode *> visible) {
+        {
+            std::scoped_lock lock(_mutex);
+            _visible_owners = std::move(visible);
+        }
+        _pump();
+    }
+
+    bool RawDecodeService::_visible(const Job& job) const {
+        for (auto&& owner : job._owners) {
+            if (_visible_owners.count(owner)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void RawDecodeService::_pump() {
+        std::vector<std::pair<JobPtr, TaskPriority>> launch;
+        {
+            std::scoped_lock lock(_mutex);
+            if (_shutting_down) {
+                return;
+            }
+
+            // on screen first, previews before full renders, then first come first served
+            std::stable_sort(_pending.begin(), _pending.end(), [this](const JobPtr& lhs, const JobPtr& rhs) {
+                bool lhs_visible = _visible(*lhs), rhs_visible = _visible(*rhs);
+                if (lhs_visible != rhs_visible) {
+                    return lhs_visible;
+                }
+                if (lhs->_kind != rhs->_kind) {
+                    return lhs->_kind == Job::Kind::Unpack;
+                }
+                return lhs->_order < rhs->_order;
+            });
+
+            for (auto it = _pending.begin(); it != _pending.end() && (int32_t)_running.size() < _max_concurrent; ) {
+                auto job = *it;
+                if (job->_after && !job->_after->complete()) {
+                    ++it;
+                    continue;
+                }
+                // always let one through, or a file bigger than the budget would never decode
+                if (!_running.empty() && _bytes_in_flight + job->_bytes > _budget) {
+                    break;
+                }
+
+                job->_state.store(Job::State::Running, std::memory_order_release);
+                _bytes_in_flight += job->_bytes;
+                _running.push_back(job);
+                it = _pending.erase(it);
+
+                TaskPriority priority = TaskPriority::Low;
+                if (_visible(*job)) {
+                    priority = TaskPriority::High;
+                } else if (job->_kind == Job::Kind::Unpack) {
+                    priority = TaskPriority::Normal;
+                }
+                launch.emplace_back(job, priority);
+            }
+        }
+
+        for (auto&& pair : launch) {
+            auto job = pair.first;
+            auto task = ts().add(job->_kind == Job::Kind::Unpack ? "raw unpack" : "raw develop", [this, job]() {
+                _run(job);
+            }, pair.second);
+
+            std::scoped_lock lock(_mutex);
+            if (!job->complete()) {
+                job->_task = task;
+            }
+        }
+    }
+
+    void RawDecodeService::_run(const JobPtr& job) {
+        try {
+            if (job->_kind == Job::Kind::Unpack) {
+                _unpack(*job);
+            } else {
+                _develop(*job);
+            }
+        } catch (std::exception& e) {
+            job->_error = e.what();
+        }
+        if (job->failed()) {
+            console << "Raw decode of " << job->_path << " failed: " << job->_error << std::endl;
+        }
+
+        {
+            std::scoped_lock lock(_mutex);
+            auto after = std::move(job->_after);
+            if (after) {
+                _drop_libraw(*after);
+            }
+            // libraw's copy of the raw stays counted while it's kept for the develop
+            job->_held = job->_libraw ? job->_bytes / 2 : 0;
+            _bytes_in_flight -= job->_bytes - job->_held;
+            _drop_libraw(*job);
+            _running.erase(std::remove(_running.begin(), _running.end(), job), _running.end());
+            auto search = _jobs.find(job->_key);
+            if (search != _jobs.end() && search->second == job) {
+                _jobs.erase(search);
+            }
+            if (job->_kind == Job::Kind::Unpack) {
+                _finished[job->_key] = job;
+            }
+            job->_task = {};
+            job->_state.store(Job::State::Done, std::memory_order_release);
+        }
+
+        _pump();
+    }
+
+    bool RawDecodeService::_open(Job& job, LibRaw& imProc) {
+        auto err = imProc.open_file(job._path.c_str());
+        if (err != LIBRAW_SUCCESS) {
+            job._error = std::string("opening: ") + libraw_strerror(err);
+            return false;
+        }
+
+        VKD_TRACE("libraw unpack");
+        err = imProc.unpack();
+        if (err != LIBRAW_SUCCESS) {
+            job._error = std::string("unpacking: ") + libraw_strerror(err);
+            return false;
+        }
+        return true;
+    }
+
+    void RawDecodeService::_unpack(Job& job) {
+        VKD_TRACE("RawDecodeService::unpack", job._path);
+
+        std::unique_ptr<LibRaw> imProcPtr = std::make_unique<LibRaw>();
+        auto&& imProc = *imProcPtr;
+
+        if (!_open(job, imProc)) {
+            return;
+        }
+
+        job._metadata = metadata(imProc);
+
+        auto&& sizes = imProc.imgdata.sizes;
+        auto&& color = imProc.imgdata.color;
+        auto raw = imProc.imgdata.rawdata.raw_image;
+
+        // foveon, linear dngs and sraws are already three colour, fuji's rotated sensors need dcraw's own path
+        bool mosaiced = raw && imProc.imgdata.idata.filters != 0 && imProc.imgdata.idata.colors == 3 && !imProc.is_fuji_rotated();
+        if (mosaiced) {
+            VKD_TRACE("raw mosaic");
+            auto mosaic = std::make_shared<RawMosaic>();
+            mosaic->width = sizes.width;
+            mosaic->height = sizes.height;
+
+            mosaic->data.resize((size_t)mosaic->width * mosaic->height);
+            size_t pitch = sizes.raw_pitch / sizeof(uint16_t);
+            for (int32_t y = 0; y < mosaic->height; ++y) {
+                memcpy(mosaic->data.data() + y * mosaic->width, raw + (y + sizes.top_margin) * pitch + sizes.left_margin, mosaic->width * sizeof(uint16_t));
+            }
+
+            // 6x6 covers both the bayer and x-trans repeats
+            for (int32_t y = 0; y < 6; ++y) {
+                for (int32_t x = 0; x < 6; ++x) {
+                    uint32_t c = imProc.COLOR(y, x);
+                    c = c == 3 ? 1 : c; // second green
+                    int32_t i = y * 6 + x;
+                    mosaic->cfa[i / 16] |= (c & 3u) << ((i % 16) * 2);
+                }
+            }
+
+            float pattern_black = 0.0f;
+            int32_t pattern = std::min((int32_t)(color.cblack[4] * color.cblack[5]), 6 * 6);
+            for (int32_t i = 0; i < pattern; ++i) {
+                pattern_black += color.cblack[6 + i];
+            }
+            if (pattern > 0) {
+                pattern_black /= pattern;
+            }
+
+            for (int32_t c = 0; c < 3; ++c) {
+                mosaic->black[c] = color.black + color.cblack[c] + pattern_black;
+                mosaic->wb[c] = color.pre_mul[c] > 0.0f ? color.pre_mul[c] : 1.0f;
+                for (int32_t j = 0; j < 3; ++j) {
+                    mosaic->rgb_cam[j][c] = color.rgb_cam[c][j];
+                }
+            }
+            mosaic->white = color.maximum;
+            // dcraw normalises to the smallest multiplier and clips
+            mosaic->wb /= std::min(mosaic->wb.r, std::min(mosaic->wb.g, mosaic->wb.b));
+
+            job._mosaic = std::move(mosaic);
+        }
+
+        std::scoped_lock lock(_mutex);
+        job._libraw = std::move(imProcPtr);
+    }
+
+    void RawDecodeService::_develop(Job& job) {
+        VKD_TRACE("RawDecodeService::develop", job._path);
+
+        // pick up where the unpack left off if we can
+        std::unique_ptr<LibRaw> imProcPtr = nullptr;
+        if (job._after) {
+            std::scoped_lock lock(_mutex);
+            imProcPtr = std::move(job._after->_libraw);
+            // charged to this job now
+            _bytes_in_flight -= job._after->_held;
+            job._after->_held = 0;
+        }
+        if (!imProcPtr) {
+            imProcPtr = std::make_unique<LibRaw>();
+            if (!_open(job, *imProcPtr)) {
+                return;
+            }
+        }
+        auto&& imProc = *imProcPtr;
+
+        imProc.imgdata.params.output_bps = 16;
+        imProc.imgdata.params.output_color = job._colour_space + 1;
+
+        {
+            VKD_TRACE("libraw dcraw_process");
+            auto err = imProc.dcraw_process();
+            if (err != LIBRAW_SUCCESS) {
+                job._error = std::string("processing: ") + libraw_strerror(err);
+                return;
+            }
+        }
+
+        job._metadata = metadata(imProc);
+
+        auto cr = StaticHostImage::make(imProc.imgdata.sizes.width, imProc.imgdata.sizes.height, 4, sizeof(uint16_t));
+        memcpy(cr->data(), imProc.imgdata.image, cr->size());
+
+        job._device->host_cache().add(job._key, std::move(cr));
+    }
+}
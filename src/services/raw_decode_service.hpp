@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "glm/glm.hpp"
+#include "hash.hpp"
+#include "task_handle.hpp"
+#include "vkd_dll.h"
+
+class LibRaw;
+
+namespace vkd {
+    class Device;
+    class EngineNode;
+
+    // the unpacked sensor data and what the gpu needs to develop it
+    struct RawMosaic {
+        int32_t width = 0;
+        int32_t height = 0;
+        std::vector<uint16_t> data; // one photosite per pixel, visible area only
+        glm::uvec4 cfa = {0, 0, 0, 0}; // 6x6 repeat, two bits a site
+        glm::vec3 black = {0.0f, 0.0f, 0.0f};
+        float white = 65535.0f;
+        glm::vec3 wb = {1.0f, 1.0f, 1.0f};
+        glm::mat3 rgb_cam = glm::mat3(1.0f);
+    };
+
+    // every raw node's decodes go through here. requests for the same file and settings share one job,
+    // and only as many run at once as there are cores and memory for. the graph on screen goes first.
+    class VKDEXPORT RawDecodeService {
+    public:
+        RawDecodeService();
+        ~RawDecodeService();
+        RawDecodeService(RawDecodeService&&) = delete;
+        RawDecodeService(const RawDecodeService&) = delete;
+
+        static RawDecodeService& Get();
+        static void Shutdown();
+
+        class Job {
+        public:
+            enum class Kind {
+                Unpack, // just the mosaic, for the gpu preview
+                Develop // full dcraw_process into the host cache
+            };
+
+            bool complete() const {
+                auto state = _state.load(std::memory_order_acquire);
+                return state == State::Done || state == State::Cancelled;
+            }
+            // only valid once complete
+            bool failed() const { return !_error.empty(); }
+            const std::string& error() const { return _error; }
+            std::shared_ptr<RawMosaic> mosaic() const { return _mosaic; }
+            const std::string& metadata() const { return _metadata; }
+            Kind kind() const { return _kind; }
+            const Hash& key() const { return _key; }
+
+        private:
+            friend class RawDecodeService;
+            enum class State {
+                Pending,
+                Running,
+                Done,
+                Cancelled
+            };
+
+            Kind _kind = Kind::Develop;
+            Hash _key;
+            std::string _path;
+            int32_t _colour_space = 0;
+            size_t _bytes = 0;
+            uint64_t _order = 0;
+
+            std::shared_ptr<Device> _device = nullptr;
+            std::shared_ptr<Job> _after = nullptr; // develop waits on the unpack so it can reuse it
+            std::set<const EngineNode *> _owners;
+
+            std::atomic<State> _state = State::Pending;
+            TaskHandle _task;
+
+            std::unique_ptr<LibRaw> _libraw = nullptr; // left by an unpack for the develop that follows
+            size_t _held = 0; // of _bytes, still in flight while _libraw's around
+            std::shared_ptr<RawMosaic> _mosaic = nullptr;
+            std::string _metadata;
+            std::string _error; // why it finished with nothing, empty if it didn't
+        };
+        using JobPtr = std::shared_ptr<Job>;
+
+        JobPtr unpack(const std::shared_ptr<Device>& device, const EngineNode * owner, const std::string& path, int32_t width, int32_t height);
+        JobPtr develop(const std::shared_ptr<Device>& device, const EngineNode * owner, const std::string& path, int32_t colour_space, int32_t width, int32_t height, JobPtr after = nullptr);
+        // drops the owner's interest, a job nobody wants any more is cancelled if it hasn't started
+        void release(const JobPtr& job, const EngineNode * owner);
+        void wait(const JobPtr& job);
+
+        // nodes feeding the viewer, their jobs jump the queue
+        void set_visible(std::set<const EngineNode *> visible);
+
+        void set_budget(size_t bytes) { std::scoped_lock lock(_mutex); _budget = bytes; }
+        size_t budget() const { return _budget; }
+        size_t bytes_in_flight() const { return _bytes_in_flight; }
+        int32_t max_concurrent() const { return _max_concurrent; }
+        size_t queued() const { std::scoped_lock lock(_mutex); return _pending.size(); }
+
+        static Hash develop_key(const std::string& path, int32_t colour_space) { return Hash{path, colour_space}; }
+        static Hash unpack_key(const std::string& path) { return Hash{path, std::string("mosaic")}; }
+
+        static std::string metadata(LibRaw& improc);
+
+    private:
+        JobPtr _request(Job::Kind kind, const std::shared_ptr<Device>& device, const EngineNode * owner, const std::string& path, int32_t colour_space, size_t bytes, JobPtr after);
+        bool _visible(const Job& job) const;
+        // an unpack's libraw stays charged to the budget until a develop takes it or it's dropped
+        // here, once nobody holds the job and no queued develop is waiting on it. with the lock held
+        void _drop_libraw(Job& job);
+        void _pump();
+        void _run(const JobPtr& job);
+        // open and unpack, false with the job's error set if either fails
+        static bool _open(Job& job, LibRaw& imProc);
+        void _unpack(Job& job);
+        void _develop(Job& job);
+
+        static std::mutex _singleton_mutex;
+        static std::unique_ptr<RawDecodeService> _singleton;
+
+        mutable std::mutex _mutex;
+        std::map<Hash, JobPtr> _jobs; // pending and running, by file and settings
+        std::map<Hash, std::weak_ptr<Job>> _finished; // unpacks, alive while a node still holds the mosaic
+        std::deque<JobPtr> _pending;
+        std::vector<JobPtr> _running;
+        std::set<const EngineNode *> _visible_owners;
+        uint64_t _next_order = 0;
+
+        size_t _budget = 4ull << 30;
+        std::atomic<size_t> _bytes_in_flight = 0;
+        int32_t _max_concurrent = 1;
+        bool _shutting_down = false;
+    };
+}
@@ -0,0 +1,586 @@
+#include "thumbnail_service.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <csetjmp>
+#include <cstdio>
+
+#include "platform_folders.h"
+#include "ghc/filesystem.hpp"
+
+#include "ImfRgbaFile.h"
+#include "ImfHeader.h"
+#include "ImfPreviewImage.h"
+
+#define LIBRAW_NO_WINSOCK2
+#include "libraw/libraw.h"
+
+extern "C" {
+#include <jpeglib.h>
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+}
+
+#include "ffmpeg_init.hpp"
+#include "host_scheduler.hpp"
+#include "hash.hpp"
+#include "image.hpp"
+#include "buffer.hpp"
+#include "command_buffer.hpp"
+#include "console.hpp"
+#include "trace.hpp"
+#include "vulkan.hpp"
+
+namespace vkd {
+    std::mutex ThumbnailService::_singleton_mutex;
+    std::unique_ptr<ThumbnailService> ThumbnailService::_singleton = nullptr;
+
+    namespace {
+        using Pixels = ThumbnailService::Pixels;
+
+        glm::ivec2 fit(int32_t width, int32_t height) {
+            float scale = std::min(1.0f, ThumbnailService::max_dimension / (float)std::max(width, height));
+            return {std::max(1, (int32_t)std::round(width * scale)), std::max(1, (int32_t)std::round(height * scale))};
+        }
+
+        // box filter down to the thumbnail size, input is tightly packed with `channels` bytes a pixel
+        Pixels shrink(const uint8_t * data, int32_t width, int32_t height, int32_t channels) {
+            auto sz = fit(width, height);
+            Pixels out;
+            out.width = sz.x;
+            out.height = sz.y;
+            out.rgba.resize(sz.x * sz.y * 4);
+
+            for (int32_t y = 0; y < sz.y; ++y) {
+                int32_t y0 = (y * height) / sz.y;
+                int32_t y1 = std::max(y0 + 1, ((y + 1) * height) / sz.y);
+                for (int32_t x = 0; x < sz.x; ++x) {
+                    int32_t x0 = (x * width) / sz.x;
+                    int32_t x1 = std::max(x0 + 1, ((x + 1) * width) / sz.x);
+
+                    uint32_t acc[4] = {0, 0, 0, 0};
+                    for (int32_t sy = y0; sy < y1; ++sy) {
+                        const uint8_t * row = data + ((size_t)sy * width + x0) * channels;
+                        for (int32_t sx = x0; sx < x1; ++sx) {
+                            for (int32_t c = 0; c < 3; ++c) {
+                                acc[c] += row[std::min(c, channels - 1)];
+                            }
+                            acc[3] += channels == 4 ? row[3] : 255;
+                            row += channels;
+                        }
+                    }
+                    uint32_t count = (y1 - y0) * (x1 - x0);
+                    uint8_t * dst = out.rgba.data() + ((size_t)y * sz.x + x) * 4;
+                    for (int c = 0; c < 4; ++c) {
+                        dst[c] = (uint8_t)(acc[c] / count);
+                    }
+                }
+            }
+            return out;
+        }
+
+        // libraw flip: 3 = 180, 5 = 90 ccw, 6 = 90 cw
+        Pixels orient(Pixels in, int flip) {
+            if (flip != 3 && flip != 5 && flip != 6) {
+                return in;
+            }
+            Pixels out;
+            bool swap = flip != 3;
+            out.width = swap ? in.height : in.width;
+            out.height = swap ? in.width : in.height;
+            out.rgba.resize(in.rgba.size());
+            for (int32_t y = 0; y < in.height; ++y) {
+                for (int32_t x = 0; x < in.width; ++x) {
+                    int32_t dx, dy;
+                    if (flip == 3) {
+                        dx = in.width - 1 - x; dy = in.height - 1 - y;
+                    } else if (flip == 5) {
+                        dx = y; dy = in.width - 1 - x;
+                    } else {
+                        dx = in.height - 1 - y; dy = x;
+                    }
+                    memcpy(&out.rgba[((size_t)dy * out.width + dx) * 4], &in.rgba[((size_t)y * in.width + x) * 4], 4);
+                }
+            }
+            return out;
+        }
+
+        struct JpegError {
+            jpeg_error_mgr mgr;
+            jmp_buf jump;
+        };
+
+        void jpeg_error_exit(j_common_ptr cinfo) {
+            auto err = reinterpret_cast<JpegError *>(cinfo->err);
+            longjmp(err->jump, 1);
+        }
+
+        void jpeg_quiet(j_common_ptr cinfo) {}
+
+        // uses libjpeg's dct scaling so big embedded previews are decoded at 1/2..1/8 size directly.
+        // a local changed after setjmp can't be trusted once longjmp lands, so this and write_jpeg
+        // keep only the libjpeg structs and fill in what the caller owns
+        bool read_jpeg(const uint8_t * data, size_t size, std::vector<uint8_t>& rgb, int32_t& width, int32_t& height) {
+            jpeg_decompress_struct cinfo;
+            JpegError err;
+            cinfo.err = jpeg_std_error(&err.mgr);
+            err.mgr.error_exit = jpeg_error_exit;
+            err.mgr.output_message = jpeg_quiet;
+            if (setjmp(err.jump)) {
+                jpeg_destroy_decompress(&cinfo);
+                return false;
+            }
+
+            jpeg_create_decompress(&cinfo);
+            jpeg_mem_src(&cinfo, const_cast<uint8_t *>(data), (unsigned long)size);
+            jpeg_read_header(&cinfo, TRUE);
+
+            cinfo.out_color_space = JCS_RGB;
+            cinfo.scale_num = 1;
+            cinfo.scale_denom = 1;
+            for (unsigned int denom = 8; denom > 1; denom /= 2) {
+                if (std::max(cinfo.image_width, cinfo.image_height) / denom >= (unsigned int)ThumbnailService::max_dimension) {
+                    cinfo.scale_denom = denom;
+                    break;
+                }
+            }
+
+            jpeg_start_decompress(&cinfo);
+            width = cinfo.output_width;
+            height = cinfo.output_height;
+            rgb.resize((size_t)width * height * 3);
+            while (cinfo.output_scanline < cinfo.output_height) {
+                JSAMPROW row = rgb.data() + (size_t)cinfo.output_scanline * width * 3;
+                jpeg_read_scanlines(&cinfo, &row, 1);
+            }
+            jpeg_finish_decompress(&cinfo);
+            jpeg_destroy_decompress(&cinfo);
+            return true;
+        }
+
+        std::optional<Pixels> decode_jpeg(const uint8_t * data, size_t size) {
+            std::vector<uint8_t> rgb;
+            int32_t width = 0, height = 0;
+            if (!read_jpeg(data, size, rgb, width, height)) {
+                return std::nullopt;
+            }
+            return shrink(rgb.data(), width, height, 3);
+        }
+
+        bool write_jpeg(const Pixels& pixels, FILE * fp, std::vector<uint8_t>& row) {
+            jpeg_compress_struct cinfo;
+            JpegError err;
+            cinfo.err = jpeg_std_error(&err.mgr);
+            err.mgr.error_exit = jpeg_error_exit;
+            err.mgr.output_message = jpeg_quiet;
+            if (setjmp(err.jump)) {
+                jpeg_destroy_compress(&cinfo);
+                return false;
+            }
+
+            jpeg_create_compress(&cinfo);
+            jpeg_stdio_dest(&cinfo, fp);
+            cinfo.image_width = pixels.width;
+            cinfo.image_height = pixels.height;
+            cinfo.input_components = 3;
+            cinfo.in_color_space = JCS_RGB;
+            jpeg_set_defaults(&cinfo);
+            jpeg_set_quality(&cinfo, 85, TRUE);
+            jpeg_start_compress(&cinfo, TRUE);
+
+            while (cinfo.next_scanline < cinfo.image_height) {
+                const uint8_t * src = pixels.rgba.data() + (size_t)cinfo.next_scanline * pixels.width * 4;
+                for (int32_t x = 0; x < pixels.width; ++x) {
+                    row[x * 3 + 0] = src[x * 4 + 0];
+                    row[x * 3 + 1] = src[x * 4 + 1];
+                    row[x * 3 + 2] = src[x * 4 + 2];
+                }
+                JSAMPROW ptr = row.data();
+                jpeg_write_scanlines(&cinfo, &ptr, 1);
+            }
+
+            jpeg_finish_compress(&cinfo);
+            jpeg_destroy_compress(&cinfo);
+            return true;
+        }
+
+        bool encode_jpeg(const Pixels& pixels, const std::string& path) {
+            FILE * fp = fopen(path.c_str(), "wb");
+            if (fp == nullptr) {
+                return false;
+            }
+
+            std::vector<uint8_t> row(pixels.width * 3);
+            bool written = write_jpeg(pixels, fp, row);
+            fclose(fp);
+            return written;
+        }
+
+        std::optional<Pixels> load_raw(const std::string& path) {
+            auto proc = std::make_unique<LibRaw>();
+            if (proc->open_file(path.c_str()) != LIBRAW_SUCCESS) {
+                return std::nullopt;
+            }
+            int flip = proc->imgdata.sizes.flip;
+
+            if (proc->unpack_thumb() == LIBRAW_SUCCESS) {
+                auto&& thumb = proc->imgdata.thumbnail;
+                std::optional<Pixels> ret = std::nullopt;
+                if (thumb.tformat == LIBRAW_THUMBNAIL_JPEG) {
+                    ret = decode_jpeg((const uint8_t *)thumb.thumb, thumb.tlength);
+                } else if (thumb.tformat == LIBRAW_THUMBNAIL_BITMAP && thumb.tcolors == 3) {
+                    ret = shrink((const uint8_t *)thumb.thumb, thumb.twidth, thumb.theight, 3);
+                }
+                if (ret) {
+                    return orient(std::move(*ret), flip);
+                }
+            }
+
+            // no usable embedded preview, fall back to a quick half size 8 bit render
+            proc->imgdata.params.half_size = 1;
+            proc->imgdata.params.output_bps = 8;
+            if (proc->unpack() != LIBRAW_SUCCESS || proc->dcraw_process() != LIBRAW_SUCCESS) {
+                return std::nullopt;
+            }
+            int err = 0;
+            auto mem = proc->dcraw_make_mem_image(&err);
+            if (mem == nullptr) {
+                return std::nullopt;
+            }
+            // dcraw_make_mem_image already applies the flip
+            auto ret = shrink(mem->data, mem->width, mem->height, mem->colors);
+            LibRaw::dcraw_clear_mem(mem);
+            return ret;
+        }
+
+        uint8_t to_display(float v) {
+            v = std::clamp(v, 0.0f, 1.0f);
+            v = v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+            return (uint8_t)std::round(v * 255.0f);
+        }
+
+        std::optional<Pixels> load_exr(const std::string& path) {
+            Imf::RgbaInputFile file(path.c_str());
+
+            if (file.header().hasPreviewImage()) {
+                auto&& preview = file.header().previewImage();
+                return shrink((const uint8_t *)preview.pixels(), preview.width(), preview.height(), 4);
+            }
+
+            auto dw = file.dataWindow();
+            int32_t width = dw.max.x - dw.min.x + 1;
+            int32_t height = dw.max.y - dw.min.y + 1;
+
+            // only every step-th scanline. uncompressed and rle files are read a line at a time so the
+            // rest are skipped, zip and piz decode 16 and 32 line blocks so for steps under that
+            // every block is still decoded, only the conversion is saved
+            auto sz = fit(width, height);
+            int32_t step = std::max(1, (int32_t)std::floor(std::max(width, height) / (float)std::max(sz.x, sz.y)));
+            int32_t sub_width = (width + step - 1) / step;
+            int32_t sub_height = (height + step - 1) / step;
+
+            std::vector<Imf::Rgba> row(width);
+            std::vector<uint8_t> rgba((size_t)sub_width * sub_height * 4);
+            for (int32_t sy = 0; sy < sub_height; ++sy) {
+                int32_t y = dw.min.y + sy * step;
+                file.setFrameBuffer(row.data() - (int64_t)dw.min.x - (int64_t)y * width, 1, width);
+                file.readPixels(y, y);
+                for (int32_t sx = 0; sx < sub_width; ++sx) {
+                    auto&& px = row[sx * step];
+                    uint8_t * dst = &rgba[((size_t)sy * sub_width + sx) * 4];
+                    dst[0] = to_display(px.r);
+                    dst[1] = to_display(px.g);
+                    dst[2] = to_display(px.b);
+                    dst[3] = 255;
+                }
+            }
+
+            return shrink(rgba.data(), sub_width, sub_height, 4);
+        }
+
+        std::optional<Pixels> load_movie(const std::string& path) {
+            ffmpeg_static_init();
+
+            AVFormatContext * format_context = nullptr;
+            if (avformat_open_input(&format_context, path.c_str(), nullptr, nullptr) != 0) {
+                return std::nullopt;
+            }
+            std::shared_ptr<AVFormatContext> format_guard(format_context, [](AVFormatContext * f) { avformat_close_input(&f); });
+
+            if (avformat_find_stream_info(format_context, nullptr) < 0) {
+                return std::nullopt;
+            }
+
+            int stream_index = av_find_best_stream(format_context, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+            if (stream_index < 0) {
+                return std::nullopt;
+            }
+            auto stream = format_context->streams[stream_index];
+
+            auto codec = avcodec_find_decoder(stream->codecpar->codec_id);
+            if (codec == nullptr) {
+                return std::nullopt;
+            }
+            std::shared_ptr<AVCodecContext> codec_context(avcodec_alloc_context3(codec), [](AVCodecContext * c) { avcodec_free_context(&c); });
+            avcodec_parameters_to_context(codec_context.get(), stream->codecpar);
+            codec_context->skip_frame = AVDISCARD_NONKEY;
+            codec_context->thread_count = 1; // already on a worker
+            if (avcodec_open2(codec_context.get(), codec, nullptr) < 0) {
+                return std::nullopt;
+            }
+
+            std::shared_ptr<AVFrame> frame(av_frame_alloc(), [](AVFrame * a) { av_frame_free(&a); });
+            std::shared_ptr<AVPacket> packet(av_packet_alloc(), [](AVPacket * a) { av_packet_free(&a); });
+
+            bool got_frame = false;
+            bool eof = false;
+            while (!got_frame) {
+                int ret = avcodec_receive_frame(codec_context.get(), frame.get());
+                if (ret == 0) {
+                    got_frame = true;
+                } else if (ret == AVERROR(EAGAIN)) {
+                    if (eof) {
+                        return std::nullopt;
+                    }
+                    if (av_read_frame(format_context, packet.get()) < 0) {
+                        eof = true;
+                        avcodec_send_packet(codec_context.get(), nullptr);
+                        continue;
+                    }
+                    if (packet->stream_index == stream_index) {
+                        avcodec_send_packet(codec_context.get(), packet.get());
+                    }
+                    av_packet_unref(packet.get());
+                } else {
+                    return std::nullopt;
+                }
+            }
+
+            auto sz = fit(frame->width, frame->height);
+            auto sws = sws_getContext(frame->width, frame->height, (AVPixelFormat)frame->format, sz.x, sz.y, AV_PIX_FMT_RGBA, SWS_AREA, nullptr, nullptr, nullptr);
+            if (sws == nullptr) {
+                return std::nullopt;
+            }
+
+            Pixels out;
+            out.width = sz.x;
+            out.height = sz.y;
+            out.rgba.resize((size_t)sz.x * sz.y * 4);
+            uint8_t * dst[4] = {out.rgba.data(), nullptr, nullptr, nullptr};
+            int dst_stride[4] = {sz.x * 4, 0, 0, 0};
+            sws_scale(sws, frame->data, frame->linesize, 0, frame->height, dst, dst_stride);
+            sws_freeContext(sws);
+
+            return out;
+        }
+
+        std::optional<Pixels> load_cached(const std::string& cache_file) {
+            FILE * fp = fopen(cache_file.c_str(), "rb");
+            if (fp == nullptr) {
+                return std::nullopt;
+            }
+            fseek(fp, 0, SEEK_END);
+            auto size = ftell(fp);
+            fseek(fp, 0, SEEK_SET);
+            std::vector<uint8_t> data(size > 0 ? size : 0);
+            auto read = fread(data.data(), 1, data.size(), fp);
+            fclose(fp);
+            if (read != data.size() || data.empty()) {
+                return std::nullopt;
+            }
+            return decode_jpeg(data.data(), data.size());
+        }
+    }
+
+    ThumbnailService& ThumbnailService::Get() {
+        std::scoped_lock lock(_singleton_mutex);
+        if (_singleton == nullptr) { _singleton = std::make_unique<ThumbnailService>(); }
+        return *_singleton;
+    }
+
+    void ThumbnailService::Shutdown() {
+        std::scoped_lock lock(_singleton_mutex);
+        if (_singleton != nullptr) { _singleton = nullptr; }
+    }
+
+    ThumbnailService::~ThumbnailService() {
+        std::vector<TaskHandle> tasks;
+        {
+            std::scoped_lock lock(_entry_mutex);
+            for (auto&& entry : _entries) {
+                tasks.push_back(entry.second.task);
+            }
+        }
+        for (auto&& task : tasks) {
+            ts().wait(task);
+        }
+    }
+
+    std::string ThumbnailService::cache_path(const std::string& path) {
+        std::error_code ec;
+        auto size = ghc::filesystem::file_size(path, ec);
+        auto time = ghc::filesystem::last_write_time(path, ec).time_since_epoch().count();
+
+        Hash h{path, (uint64_t)size, (int64_t)time, max_dimension};
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.jpg", (unsigned long long)h.value());
+
+        return sago::getCacheDir() + "/vkd/thumbnails/" + name;
+    }
+
+    std::optional<ThumbnailService::Pixels> ThumbnailService::generate(const std::string& path) {
+        VKD_TRACE("thumbnail", path);
+
+        auto cache_file = cache_path(path);
+        if (auto cached = load_cached(cache_file)) {
+            return cached;
+        }
+
+        std::string ext = ghc::filesystem::path(path).extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c){ return std::tolower(c); });
+
+        std::optional<Pixels> ret = std::nullopt;
+        try {
+            if (ext == ".raf" || ext == ".cr2" || ext == ".cr3" || ext == ".nef" || ext == ".arw" || ext == ".dng") {
+                ret = load_raw(path);
+            } else if (ext == ".exr") {
+                ret = load_exr(path);
+            } else if (ext == ".mp4" || ext == ".mov" || ext == ".mkv") {
+                ret = load_movie(path);
+            }
+        } catch (std::exception& e) {
+            console << "Thumbnail for " << path << " failed: " << e.what() << std::endl;
+            return std::nullopt;
+        }
+
+        if (ret) {
+            std::error_code ec;
+            ghc::filesystem::create_directories(ghc::filesystem::path(cache_file).parent_path(), ec);
+            encode_jpeg(*ret, cache_file);
+        }
+        return ret;
+    }
+
+    std::optional<ImTextureID> ThumbnailService::get(const std::string& path) {
+        std::scoped_lock lock(_entry_mutex);
+        auto search = _entries.find(path);
+        if (search != _entries.end()) {
+            search->second.used = ++_use_count;
+            if (search->second.image) {
+                return (ImTextureID)search->second.image->ui_desc_set();
+            }
+            return std::nullopt;
+        }
+
+        auto&& entry = _entries[path];
+        entry.used = ++_use_count;
+        entry.task = ts().add("thumbnail", [this, path]() {
+            auto pixels = generate(path);
+            std::scoped_lock lock(_entry_mutex);
+            auto search = _entries.find(path);
+            if (search == _entries.end()) {
+                return;
+            }
+            if (pixels) {
+                search->second.pixels = std::move(pixels);
+            } else {
+                search->second.failed = true;
+            }
+        }, TaskPriority::Low);
+        _evict();
+        return std::nullopt;
+    }
+
+    void ThumbnailService::_evict() {
+        while (_entries.size() > max_entries) {
+            // ones still generating have no image yet and will look themselves up when done
+            auto victim = _entries.end();
+            for (auto it = _entries.begin(); it != _entries.end(); ++it) {
+                bool done = it->second.pixels || it->second.image || it->second.failed;
+                if (done && (victim == _entries.end() || it->second.used < victim->second.used)) {
+                    victim = it;
+                }
+            }
+            if (victim == _entries.end()) {
+                return;
+            }
+            _retire(victim->second);
+            _entries.erase(victim);
+        }
+    }
+
+    void ThumbnailService::_retire(Entry& entry) {
+        if (entry.image) {
+            _retired.emplace_back(draw_frame(), std::move(entry.image));
+        }
+    }
+
+    void ThumbnailService::upload(int32_t max_uploads) {
+        if (!_device) {
+            return;
+        }
+
+        std::vector<std::pair<std::string, Pixels>> ready;
+        {
+            std::scoped_lock lock(_entry_mutex);
+            auto complete = draw_frame_complete();
+            _retired.erase(std::remove_if(_retired.begin(), _retired.end(), [complete](auto&& r) { return r.first <= complete; }), _retired.end());
+
+            for (auto&& entry : _entries) {
+                if (entry.second.pixels && !entry.second.image) {
+                    ready.emplace_back(entry.first, std::move(*entry.second.pixels));
+                    entry.second.pixels = std::nullopt;
+                    if (ready.size() >= max_uploads) {
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (ready.empty()) {
+            return;
+        }
+
+        // one submit for the lot, staging has to outlive the flush
+        std::vector<std::shared_ptr<AutoMapStagingBuffer>> staging;
+        std::vector<std::pair<std::string, std::shared_ptr<Image>>> images;
+        {
+            auto buf = CommandBuffer::make_immediate(_device);
+            for (auto&& r : ready) {
+                auto&& pixels = r.second;
+                auto stage = AutoMapStagingBuffer::make(_device, AutoMapStagingBuffer::Mode::Upload, pixels.rgba.size());
+                memcpy(stage->get(), pixels.rgba.data(), pixels.rgba.size());
+
+                auto image = std::make_shared<Image>(_device);
+                image->debug_name("thumbnail " + r.first);
+                image->create_image(VK_FORMAT_R8G8B8A8_UNORM, {pixels.width, pixels.height}, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+                image->allocate(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+                image->create_view(VK_IMAGE_ASPECT_COLOR_BIT);
+
+                image->copy(buf->get(), *stage);
+                image->set_layout(buf->get(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+                staging.push_back(stage);
+                images.emplace_back(r.first, image);
+            }
+        }
+
+        std::scoped_lock lock(_entry_mutex);
+        for (auto&& im : images) {
+            auto search = _entries.find(im.first);
+            if (search != _entries.end()) {
+                search->second.image = im.second;
+            }
+        }
+    }
+
+    void ThumbnailService::forget(const std::string& path) {
+        std::scoped_lock lock(_entry_mutex);
+        auto search = _entries.find(path);
+        if (search != _entries.end()) {
+            _retire(search->second);
+            _entries.erase(search);
+        }
+    }
+}
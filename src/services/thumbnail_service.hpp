@@ -0,0 +1,74 @@
+#pragma once
+
+#include <mutex>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "imgui/imgui.h"
+#include "task_handle.hpp"
+
+namespace vkd {
+    class Device;
+    class Image;
+
+    // generates small previews for the photo browser on background workers.
+    // raws use the embedded jpeg, exrs the preview attribute or a strided read, movies the first keyframe.
+    // results are kept on disk so a folder only pays for this once.
+    class ThumbnailService {
+    public:
+        ThumbnailService() = default;
+        ~ThumbnailService();
+        ThumbnailService(ThumbnailService&&) = delete;
+        ThumbnailService(const ThumbnailService&) = delete;
+
+        static ThumbnailService& Get();
+        static void Shutdown();
+
+        struct Pixels {
+            int32_t width = 0;
+            int32_t height = 0;
+            std::vector<uint8_t> rgba;
+        };
+
+        static constexpr int32_t max_dimension = 256;
+        // past this many the finished ones asked for longest ago are dropped, about 128mb of thumbnails
+        static constexpr size_t max_entries = 512;
+
+        void set_device(const std::shared_ptr<Device>& device) { _device = device; }
+
+        // nullopt until the thumbnail has been made and uploaded, queues it on first ask
+        std::optional<ImTextureID> get(const std::string& path);
+        // ui thread only, moves finished thumbnails onto the gpu
+        void upload(int32_t max_uploads);
+        void forget(const std::string& path);
+
+        static std::optional<Pixels> generate(const std::string& path);
+        static std::string cache_path(const std::string& path);
+
+    private:
+        struct Entry {
+            TaskHandle task;
+            std::optional<Pixels> pixels;
+            std::shared_ptr<Image> image = nullptr;
+            bool failed = false;
+            uint64_t used = 0;
+        };
+
+        // under _entry_mutex
+        void _evict();
+        void _retire(Entry& entry);
+
+        static std::mutex _singleton_mutex;
+        static std::unique_ptr<ThumbnailService> _singleton;
+
+        std::shared_ptr<Device> _device = nullptr;
+        std::mutex _entry_mutex;
+        std::map<std::string, Entry> _entries;
+        uint64_t _use_count = 0;
+        // evicted images a draw may still sample, with the draw frame they went in
+        std::vector<std::pair<uint64_t, std::shared_ptr<Image>>> _retired;
+    };
+}
@@ -15,6 +15,32 @@ namespace vkd {
 
         void init() {
             _semaphore = TimelineSemaphore::make(_device);
+            if (_device->separate_transfer_queue()) {
+                _transfer_semaphore = TimelineSemaphore::make(_device);
+            }
+        }
+
+        // false on single queue devices, where copies just go in with the compute work
+        bool has_transfer() const { return _transfer_semaphore != nullptr; }
+
+        // runs buf on the transfer queue once compute has reached wait_compute. if gate_compute
+        // the next compute submit waits for the copy, otherwise only flush() does
+        void submit_transfer(CommandBuffer& buf, uint64_t wait_compute, bool gate_compute) {
+            if (buf.device() != _device) {
+                throw ExecutionException("Command buffer queued on stream with conflicting device.");
+            }
+            if (!_transfer_semaphore) {
+                buf.submit_timeline(*_semaphore);
+                return;
+            }
+            TimelineWait wait;
+            if (wait_compute > 0) {
+                wait = {_semaphore->get(), wait_compute};
+            }
+            buf.submit_transfer_timeline(*_transfer_semaphore, wait);
+            if (gate_compute) {
+                _gate = buf.last_timeline_value();
+            }
         }
 
         void submit(CommandBufferPtr& buf) {
@@ -25,23 +51,38 @@ namespace vkd {
             if (buf.device() != _device) {
                 throw ExecutionException("Command buffer queued on stream with conflicting device.");
             }
-            buf.submit_timeline(_semaphore);
+            buf.submit_timeline(_semaphore, _take_gate());
         }
 
         void submit(VkCommandBuffer buf) {
-            submit_compute_buffer_timeline(*_device, buf, _semaphore);
+            submit_compute_buffer_timeline(*_device, buf, _semaphore, _take_gate());
         }
 
         void flush() const {
             _semaphore->wait();
+            if (_transfer_semaphore) {
+                _transfer_semaphore->wait();
+            }
         }
 
         TimelineSemaphore& semaphore() { return *_semaphore; }
         const TimelineSemaphore& semaphore() const { return *_semaphore; }
 
     private:
+        TimelineWait _take_gate() {
+            TimelineWait wait;
+            if (_gate > 0) {
+                // compute is a chain, once one submit has waited everything after it has too
+                wait = {_transfer_semaphore->get(), _gate};
+                _gate = 0;
+            }
+            return wait;
+        }
+
         std::shared_ptr<Device> _device = nullptr;
         std::shared_ptr<TimelineSemaphore> _semaphore = nullptr;
+        std::shared_ptr<TimelineSemaphore> _transfer_semaphore = nullptr;
+        uint64_t _gate = 0;
     };
     using StreamPtr = std::shared_ptr<Stream>;
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+namespace vkd {
+    class HostTask;
+    class HostScheduler;
+
+    enum class TaskPriority {
+        High,   // ui-critical, eg. decoding the frame on screen
+        Normal,
+        Low     // background work, thumbnails, cache fills
+    };
+
+    // host tasks are pooled and reused, so a handle carries the generation it was issued for.
+    // a handle to a task that has since been recycled reads as complete.
+    class TaskHandle {
+    public:
+        TaskHandle() = default;
+
+        explicit operator bool() const { return _task != nullptr; }
+        bool operator==(const TaskHandle& rhs) const { return _task == rhs._task && _generation == rhs._generation; }
+        bool operator!=(const TaskHandle& rhs) const { return !(*this == rhs); }
+
+    private:
+        friend class HostScheduler;
+        TaskHandle(HostTask * task, uint32_t generation) : _task(task), _generation(generation) {}
+
+        HostTask * _task = nullptr;
+        uint32_t _generation = 0;
+    };
+}
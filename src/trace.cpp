@@ -0,0 +1,181 @@
+#include "trace.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <ctime>
+
+#include "platform_folders.h"
+#include "ghc/filesystem.hpp"
+
+#include "console.hpp"
+
+namespace vkd {
+    std::atomic<bool> Trace::_enabled{false};
+
+    namespace {
+        constexpr size_t max_events_per_thread = 1 << 20;
+
+        struct TraceEvent {
+            const char * name;
+            std::string detail;
+            int64_t start;
+            int64_t end;
+        };
+
+        struct ThreadBuffer {
+            uint32_t tid = 0;
+            std::string name;
+            std::mutex mutex; // only contended while writing out
+            std::vector<TraceEvent> events;
+        };
+
+        std::mutex _buffers_mutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> _buffers;
+        uint32_t _next_tid = 1;
+
+        const auto _epoch = std::chrono::steady_clock::now();
+
+        ThreadBuffer& local_buffer() {
+            thread_local std::shared_ptr<ThreadBuffer> buffer = [] {
+                auto buf = std::make_shared<ThreadBuffer>();
+                std::scoped_lock lock(_buffers_mutex);
+                buf->tid = _next_tid++;
+                _buffers.push_back(buf);
+                return buf;
+            }();
+            return *buffer;
+        }
+
+        void write_escaped(std::ostream& out, const std::string& str) {
+            out << '"';
+            for (auto c : str) {
+                switch (c) {
+                case '"': out << "\\\""; break;
+                case '\\': out << "\\\\"; break;
+                case '\n': out << "\\n"; break;
+                case '\t': out << "\\t"; break;
+                default:
+                    if ((unsigned char)c < 0x20) {
+                        out << ' ';
+                    } else {
+                        out << c;
+                    }
+                }
+            }
+            out << '"';
+        }
+    }
+
+    int64_t Trace::now() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _epoch).count();
+    }
+
+    void Trace::start() {
+        {
+            std::scoped_lock lock(_buffers_mutex);
+            for (auto&& buf : _buffers) {
+                std::scoped_lock block(buf->mutex);
+                buf->events.clear();
+            }
+        }
+        _enabled = true;
+        console << "Trace: recording started." << std::endl;
+    }
+
+    void Trace::stop() {
+        _enabled = false;
+    }
+
+    void Trace::thread_name(const std::string& name, bool force) {
+        auto&& buf = local_buffer();
+        std::scoped_lock lock(buf.mutex);
+        if (force || buf.name.empty()) {
+            buf.name = name;
+        }
+    }
+
+    void Trace::worker_thread(uint32_t threadnum) {
+        // enki thread 0 is whichever thread called Initialize, so leave that one alone
+        thread_local bool named = false;
+        if (!named && threadnum > 0) {
+            thread_name("enki worker " + std::to_string(threadnum));
+            named = true;
+        }
+    }
+
+    void Trace::record(const char * name, const std::string& detail, int64_t start, int64_t end) {
+        auto&& buf = local_buffer();
+        std::scoped_lock lock(buf.mutex);
+        if (buf.events.size() < max_events_per_thread) {
+            buf.events.push_back(TraceEvent{name, detail, start, end});
+        }
+    }
+
+    size_t Trace::event_count() {
+        std::scoped_lock lock(_buffers_mutex);
+        size_t count = 0;
+        for (auto&& buf : _buffers) {
+            std::scoped_lock block(buf->mutex);
+            count += buf->events.size();
+        }
+        return count;
+    }
+
+    std::string Trace::default_path() {
+        auto folder = sago::getDataHome() + "/vkd/traces";
+        ghc::filesystem::create_directories(folder);
+
+        auto t = std::time(nullptr);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&t));
+        return folder + "/vkd_trace_" + stamp + ".json";
+    }
+
+    bool Trace::write(const std::string& path) {
+        std::ofstream out(path, std::ios::out | std::ios::trunc);
+        if (!out) {
+            console << "Trace: could not open " << path << " for writing." << std::endl;
+            return false;
+        }
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool first = true;
+        auto sep = [&]() {
+            if (!first) { out << ",\n"; }
+            first = false;
+        };
+
+        size_t count = 0;
+        {
+            std::scoped_lock lock(_buffers_mutex);
+            for (auto&& buf : _buffers) {
+                std::scoped_lock block(buf->mutex);
+
+                sep();
+                out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buf->tid << ",\"args\":{\"name\":";
+                write_escaped(out, buf->name.empty() ? "thread " + std::to_string(buf->tid) : buf->name);
+                out << "}}";
+
+                for (auto&& ev : buf->events) {
+                    sep();
+                    out << "{\"ph\":\"X\",\"pid\":1,\"tid\":" << buf->tid << ",\"ts\":" << ev.start << ",\"dur\":" << (ev.end - ev.start) << ",\"name\":";
+                    write_escaped(out, ev.name);
+                    if (!ev.detail.empty()) {
+                        out << ",\"args\":{\"detail\":";
+                        write_escaped(out, ev.detail);
+                        out << "}";
+                    }
+                    out << "}";
+                }
+                count += buf->events.size();
+            }
+        }
+        out << "\n]}\n";
+
+        console << "Trace: wrote " << count << " events to " << path << std::endl;
+        return true;
+    }
+}
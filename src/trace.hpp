@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+#include "vkd_dll.h"
+
+namespace vkd {
+    // chrome://tracing / perfetto compatible cpu zones. events go into a per-thread buffer,
+    // when tracing is off a zone is one relaxed atomic load.
+    class VKDEXPORT Trace {
+    public:
+        static bool enabled() { return _enabled.load(std::memory_order_relaxed); }
+
+        static void start();
+        static void stop();
+        static bool write(const std::string& path);
+
+        // names the calling thread, won't rename one that already has a name unless forced
+        static void thread_name(const std::string& name, bool force = false);
+        static void worker_thread(uint32_t threadnum);
+
+        static int64_t now();
+        static void record(const char * name, const std::string& detail, int64_t start, int64_t end);
+
+        static std::string default_path();
+        static size_t event_count();
+    private:
+        static std::atomic<bool> _enabled;
+    };
+
+    class TraceZone {
+    public:
+        TraceZone(const char * name) : _name(Trace::enabled() ? name : nullptr) {
+            if (_name) { _start = Trace::now(); }
+        }
+
+        // detail is only called when tracing's on, VKD_TRACE wraps its second argument in one
+        template<typename Detail>
+        TraceZone(const char * name, Detail&& detail) : _name(Trace::enabled() ? name : nullptr) {
+            if (_name) {
+                _detail = detail();
+                _start = Trace::now();
+            }
+        }
+
+        ~TraceZone() {
+            if (_name) { Trace::record(_name, _detail, _start, Trace::now()); }
+        }
+
+        TraceZone(TraceZone&&) = delete;
+        TraceZone(const TraceZone&) = delete;
+    private:
+        const char * _name = nullptr;
+        std::string _detail;
+        int64_t _start = 0;
+    };
+}
+
+#define VKD_TRACE_CONCAT_(a, b) a##b
+#define VKD_TRACE_CONCAT(a, b) VKD_TRACE_CONCAT_(a, b)
+#define VKD_TRACE_EXPAND(x) x
+#define VKD_TRACE_PICK(_1, _2, macro, ...) macro
+#define VKD_TRACE_NAME(name) vkd::TraceZone VKD_TRACE_CONCAT(_vkd_trace_zone_, __LINE__){name}
+// the detail string isn't built unless tracing's on
+#define VKD_TRACE_DETAIL(name, detail) vkd::TraceZone VKD_TRACE_CONCAT(_vkd_trace_zone_, __LINE__){name, [&]() -> std::string { return detail; }}
+#define VKD_TRACE(...) VKD_TRACE_EXPAND(VKD_TRACE_PICK(__VA_ARGS__, VKD_TRACE_DETAIL, VKD_TRACE_NAME)(__VA_ARGS__))
@@ -0,0 +1,102 @@
+#include "engine_thread.hpp"
+
+#include <chrono>
+
+#include "graph/graph.hpp"
+#include "console.hpp"
+#include "trace.hpp"
+
+namespace vkd {
+    EngineThread::EngineThread() {
+        _thread = std::thread([this]() { _run(); });
+    }
+
+    EngineThread::~EngineThread() {
+        {
+            std::scoped_lock lock(_mutex);
+            _quit = true;
+            _cancel = true;
+        }
+        _wake.notify_all();
+        _thread.join();
+    }
+
+    bool EngineThread::start(Graph& graph, const StreamPtr& stream, std::vector<GraphRequests::Request> batch) {
+        std::scoped_lock lock(_mutex);
+        if (_busy) {
+            return false;
+        }
+        _graph = &graph;
+        _stream = stream;
+        _batch = std::move(batch);
+        _cancel = false;
+        _busy = true;
+        _wake.notify_one();
+        return true;
+    }
+
+    void EngineThread::wait() {
+        std::unique_lock lock(_mutex);
+        _idle.wait(lock, [this]() { return !_busy.load(); });
+    }
+
+    std::vector<EngineThread::Result> EngineThread::take_results() {
+        std::scoped_lock lock(_mutex);
+        if (_busy) {
+            return {};
+        }
+        auto results = std::move(_results);
+        _results.clear();
+        return results;
+    }
+
+    void EngineThread::_run() {
+        std::unique_lock lock(_mutex);
+        while (true) {
+            _wake.wait(lock, [this]() { return _quit || _busy.load(); });
+            if (_quit) {
+                _busy = false;
+                _idle.notify_all();
+                return;
+            }
+
+            auto batch = std::move(_batch);
+            _batch.clear();
+            auto graph = _graph;
+            auto stream = _stream;
+            lock.unlock();
+
+            std::vector<Result> results;
+            for (auto&& request : batch) {
+                Result result;
+                result.request = request;
+                if (request.cancellable && _cancel) {
+                    result.cancelled = true;
+                    results.push_back(std::move(result));
+                    continue;
+                }
+
+                VKD_TRACE("EngineThread::run");
+                auto before = std::chrono::high_resolution_clock::now();
+                try {
+                    graph->execute(request.type, stream, request.extra_nodes, request.cancellable ? &_cancel : nullptr);
+                } catch (std::exception& e) {
+                    console << "Error in graph execution: " << e.what() << std::endl;
+                }
+                auto after = std::chrono::high_resolution_clock::now();
+
+                result.micros = std::chrono::duration_cast<std::chrono::microseconds>(after - before).count();
+                result.cancelled = request.cancellable && _cancel;
+                result.proxy = graph->proxy_in_use();
+                result.region = graph->region_in_use();
+                result.frame = graph->frame();
+                results.push_back(std::move(result));
+            }
+
+            lock.lock();
+            _results.insert(_results.end(), std::make_move_iterator(results.begin()), std::make_move_iterator(results.end()));
+            _busy = false;
+            _idle.notify_all();
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "engine_node.hpp"
+#include "stream.hpp"
+#include "services/graph_requests.hpp"
+
+namespace vkd {
+    class Graph;
+
+    // runs the graph off the ui thread. the ui hands over everything queued as one batch once the
+    // last has finished, and leaves the graph, its nodes and the stream alone until it's idle again
+    class EngineThread {
+    public:
+        EngineThread();
+        ~EngineThread();
+        EngineThread(EngineThread&&) = delete;
+        EngineThread(const EngineThread&) = delete;
+
+        struct Result {
+            GraphRequests::Request request;
+            int64_t micros = 0;
+            bool cancelled = false;
+            // the graph as this run left it
+            int32_t proxy = 1;
+            std::optional<glm::ivec4> region;
+            Frame frame;
+        };
+
+        // false while the last batch is still running
+        bool start(Graph& graph, const StreamPtr& stream, std::vector<GraphRequests::Request> batch);
+        bool busy() const { return _busy.load(); }
+        // viewer refreshes left in the batch are skipped and the one running stops at the next node
+        void cancel() { _cancel = true; }
+        void wait();
+        // everything finished since the last take, empty while busy
+        std::vector<Result> take_results();
+
+    private:
+        void _run();
+
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::condition_variable _idle;
+        bool _quit = false;
+        std::atomic<bool> _busy = false;
+        std::atomic<bool> _cancel = false;
+
+        Graph * _graph = nullptr;
+        StreamPtr _stream = nullptr;
+        std::vector<GraphRequests::Request> _batch;
+        std::vector<Result> _results;
+
+        std::thread _thread;
+    };
+}
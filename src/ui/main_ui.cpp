@@ -19,7 +19,12 @@
 
 #include "host_scheduler.hpp"
 #include "image.hpp"
+#include "device.hpp"
+#include "memory/memory_pool.hpp"
+#include "memory/residency.hpp"
 #include "services/graph_requests.hpp"
+#include "services/raw_decode_service.hpp"
+#include "trace.hpp"
 
 
 CEREAL_CLASS_VERSION(vkd::MainUI, 4);
@@ -33,6 +38,7 @@ namespace vkd {
         _inspector = std::make_unique<Inspector>();
         _bin = std::make_unique<Bin>();
         _photo_browser = std::make_unique<PhotoBrowser>();
+        _engine = std::make_unique<EngineThread>();
 
         _load_dialog.SetTitle("load graph");
         _load_dialog.SetTypeFilters({ ".bin" });
@@ -70,6 +76,10 @@ namespace vkd {
         }
 
 
+        if (_baking_graph && _baking_graph->init_complete()) {
+            _finish_bake();
+        }
+
         // must run first so no naughty node windows can enqueue things including the existing graph
         if (_execution_to_run) {
             _execute_graph(*_execution_to_run);
@@ -153,9 +163,30 @@ namespace vkd {
                     ImGui::PopItemFlag();
                 }
 
+                ImGui::Separator();
+                if (ImGui::BeginMenu("Trace")) {
+                    bool recording = Trace::enabled();
+                    if (ImGui::MenuItem("Record", NULL, recording)) {
+                        if (recording) {
+                            Trace::stop();
+                        } else {
+                            Trace::start();
+                        }
+                    }
+                    if (ImGui::MenuItem("Write Trace")) {
+                        Trace::write(Trace::default_path());
+                    }
+                    ImGui::EndMenu();
+                }
+
                 ImGui::EndMenu();
             }
 
+            if (_baking_graph) {
+                auto progress = _baking_graph->init_progress();
+                ImGui::TextDisabled("Building %d/%d", progress.first, progress.second);
+            }
+
             ImGui::EndMainMenuBar();
         }
 
@@ -175,7 +206,7 @@ namespace vkd {
             _performance.draw();
         }
 
-        if (_graph != nullptr) {
+        if (_graph != nullptr && !_engine->busy()) {
             _graph->ui();
         }
 
@@ -183,6 +214,9 @@ namespace vkd {
             for (auto&& node : _node_windows) {
                 node->draw(graph_changed, *_inspector);
             }
+            if (Mode() == ApplicationMode::Photo) {
+                _update_residency();
+            }
             // should grey out the node graphs, really
             if (graph_changed) {
                 _execution_to_run = std::optional<ExecutionType>{ExecutionType::UI};
@@ -219,14 +253,16 @@ namespace vkd {
             } else if (file.extension() == ".png") {
                 format = ImmediateFormat::PNG;
             }
-            if (_viewer_draw && _viewer_draw->get_image() && _viewer_draw->get_image()->allocated()) {
-                _export_name = immediate_exr(_device, file.string(), format, _viewer_draw->get_image(), _export_task);
+            if (_viewer_draw) {
+                _pending_export = std::make_pair(file.string(), format);
+                _viewer_draw->full_resolution(true);
+                GraphRequests::Get().add_ui_run_with(_viewer_draw);
             }
             _export_dialog.ClearSelected();
         }
 
         if (_export_task && ts().is_complete(_export_task)) {
-            _export_task = nullptr;
+            _export_task = {};
             ImGui::OpenPopup("export");
         }
 
@@ -246,12 +282,27 @@ namespace vkd {
         _console_window->draw();
         _preferences.draw();
         _memory_window->draw(*_device);
-        if (_viewer_draw && _viewer_draw->input_node() && _viewer_draw->input_node()->get_output_image()) {
+        if (_viewer_draw) {
+            auto& io = ImGui::GetIO();
+            if (!io.WantCaptureMouse) {
+                // wheel zooms, left drag pans, double click fits the image again
+                if (io.MouseDoubleClicked[0]) {
+                    _viewer_draw->reset_view();
+                } else {
+                    glm::vec2 drag = io.MouseDown[0] ? glm::vec2{io.MouseDelta.x, io.MouseDelta.y} : glm::vec2{0.0f};
+                    _viewer_draw->navigate({io.MousePos.x, io.MousePos.y}, io.MouseWheel, drag);
+                }
+            }
+        }
+        if (_viewer_draw && _viewer_draw->get_image() && _viewer_draw->input_node() && _viewer_draw->input_node()->get_output_image()) {
             _inspector->draw(*_device, *_viewer_draw->get_image(), _viewer_draw->offset_w_h());
         }
     }
 
     void MainUI::clear() {
+        _wait_engine();
+        _baking_graph = nullptr;
+        _baking_builder = nullptr;
         _loaded_path = std::nullopt;
         _node_windows.clear();
         _render_window = nullptr;
@@ -273,6 +324,9 @@ namespace vkd {
     }
 
     void MainUI::load(std::string path) {
+        _wait_engine();
+        _baking_graph = nullptr;
+        _baking_builder = nullptr;
         _graph = nullptr;
         try {
             {
@@ -374,7 +428,9 @@ namespace vkd {
             auto graph_builder = std::make_unique<vkd::GraphBuilder>();
             
             for (auto&& node : _node_windows) {
-                node->build_nodes(*graph_builder);
+                if (node->resident()) {
+                    node->build_nodes(*graph_builder);
+                }
             }
 
             auto graph = graph_builder->bake(_device);
@@ -391,7 +447,7 @@ namespace vkd {
     }
 
     void MainUI::commands(VkCommandBuffer buf, uint32_t width, uint32_t height) {
-        if (_graph != nullptr) {
+        if (_graph != nullptr && !_engine->busy()) {
             _graph->commands(buf, width, height);
         }
 
@@ -402,34 +458,119 @@ namespace vkd {
     }
 
     void MainUI::update() {
+        VKD_TRACE("MainUI::update");
         
         if (_stream == nullptr) {
             _stream = std::make_shared<Stream>(_device);
             _stream->init();
+            _playback_cache = std::make_unique<PlaybackCache>(_device);
+        }
+        _device->pool().headroom(static_cast<VkDeviceSize>(std::max(_preferences.memory_headroom_mb(), 0)) * 1024 * 1024);
+        _device->residency().half(_preferences.spill_half());
+        if (!_engine->busy()) {
+            // edits held while the last batch ran
+            ParameterInterface::defer(false);
         }
         if (_graph != nullptr) {
             if (!_render_window->rendering()) {
-                if (_timeline->play()) {
-                    _timeline->increment();
+                auto now = std::chrono::steady_clock::now();
+                // the graph, its nodes and the stream are the engine's until it's done
+                bool idle = !_engine->busy();
+                _playback_cache->budget(static_cast<size_t>(std::max(_preferences.playback_cache_mb(), 0)) * 1024 * 1024);
+                _playback_cache->range(0, _timeline->last_frame());
+                if (ParameterCache::user_changed() || ParameterInterface::any_deferred()) {
+                    _playback_cache->invalidate();
+                    _last_user_change = now;
+                    if (!idle && _engine_proxy == 1) {
+                        // a full resolution run that's already stale, the proxied one after it is sooner
+                        _engine->cancel();
+                    }
                 }
 
-                _graph->set_frame(_timeline->current_frame());
+                if (idle) {
+                    // while params are moving run at whichever proxy scale fits a frame, refine once they stop
+                    constexpr int64_t proxy_budget_us = 1000000 / 30;
+                    int32_t proxy = 1;
+                    if (now - _last_user_change < std::chrono::milliseconds(250)) {
+                        while (proxy < 8 && _full_run_us / (proxy * proxy) > proxy_budget_us) {
+                            proxy *= 2;
+                        }
+                    }
+                    if (proxy != _graph->proxy()) {
+                        _graph->proxy(proxy);
+                        if (proxy == 1) {
+                            GraphRequests::Get().add_ui_run_with(_viewer_draw);
+                        }
+                    }
+
+                    if (_viewer_draw && _viewer_draw->level() != _viewer_level) {
+                        // the viewer remakes its image at the new size, nothing in it is kept
+                        _viewer_level = _viewer_draw->level();
+                        _graph->invalidate_region();
+                        GraphRequests::Get().add_ui_run_with(_viewer_draw);
+                    }
+                }
 
-                auto update = _graph->update(ExecutionType::UI, _stream);
-                if (update == Graph::GraphUpdate::Rebake) {
-                    _execution_to_run = std::optional<ExecutionType>{ExecutionType::UI};
-                } else if (update == Graph::GraphUpdate::Updated || _timeline->play()) {
-                    GraphRequests::Get().add_ui_run_with(_viewer_draw);
+                // zoomed in, ui runs only compute what's on screen and nothing goes in the cache
+                bool regional = !_pending_export && _viewer_draw && !_viewer_draw->shows_whole_image() && _graph->supports_region();
+                if (idle) {
+                    _graph->region(regional ? std::optional<glm::ivec4>{_viewer_draw->visible_region()} : std::nullopt);
                 }
+
+                bool playing = _timeline->play();
+                if (playing) {
+                    auto frame = _timeline->clock_frame(now);
+                    bool cacheable = !regional && _playback_cache->enabled() && _viewer_draw && _viewer_draw->range_contains(Frame{frame});
+                    if (!cacheable || _playback_cache->ready(frame)) {
+                        // on time, anything the clock skipped is dropped
+                        _timeline->scrub(frame);
+                    } else {
+                        // wait on the graph for this one
+                        _timeline->hold(frame, now);
+                    }
+                }
+
+                int64_t current = _timeline->current_frame().index;
+                _playback_cache->playhead(current);
+
+                auto cached = _playback_cache->get(current);
+                if (_viewer_draw) {
+                    // while playing a miss keeps the last frame up until the graph catches up
+                    if (cached || !playing) {
+                        _viewer_draw->present(cached);
+                    }
+                }
+
+                std::optional<int64_t> fill;
+                bool settled = std::chrono::duration_cast<std::chrono::milliseconds>(now - _last_user_change).count() > 500;
+                if (cached && !regional && (playing || settled)) {
+                    fill = _playback_cache->next_to_fill();
+                }
+
+                if (idle && !(playing && cached && !fill)) {
+                    _graph->set_frame(Frame{fill ? *fill : current});
+
+                    auto update = _graph->update(ExecutionType::UI, _stream);
+                    if (_graph->updated_itself()) {
+                        _playback_cache->invalidate();
+                    }
+                    if (update == Graph::GraphUpdate::Rebake) {
+                        _execution_to_run = std::optional<ExecutionType>{ExecutionType::UI};
+                    } else if (update == Graph::GraphUpdate::Updated || fill || _graph->region_dirty() || (playing && !regional && !_playback_cache->contains(current))) {
+                        GraphRequests::Get().add_ui_run_with(_viewer_draw);
+                    }
+                }
+                _updated_idle = idle;
             }
         }
-        if (_viewer_draw) {
+        if (_viewer_draw && !_engine->busy()) {
             _viewer_draw->update(ExecutionType::UI);
         }
     }
 
     void MainUI::execute() {
-        if (_graph) { 
+        VKD_TRACE("MainUI::execute");
+        if (_graph && !_engine->busy()) { 
             _render_window->execute(*_graph, _stream);
         }
 
@@ -448,39 +589,81 @@ namespace vkd {
         } */
 
         if (_graph != nullptr) {
-            std::optional<GraphRequests::Request> orequest = GraphRequests::Get().take();
-            while (orequest.has_value()) {
-                auto&& request = *orequest;
-                int i = 0;
-                for (auto&& node : request.extra_nodes) {
-                    if (node) {
-                        std::string name = std::string("____extra_") + std::to_string(i);
-                        vkd::engine_node_init(node, name);
-                        node->init();
+            _collect_engine();
+
+            // only straight after an update the engine wasn't running through
+            if (_updated_idle && !_engine->busy()) {
+                auto batch = GraphRequests::Get().take_all();
+                if (!batch.empty()) {
+                    for (auto&& request : batch) {
+                        int i = 0;
+                        for (auto&& node : request.extra_nodes) {
+                            if (node) {
+                                std::string name = std::string("____extra_") + std::to_string(i);
+                                vkd::engine_node_init(node, name);
+                                node->init();
+                            }
+                            ++i;
+                        }
                     }
-                    ++i;
+                    _engine_started = std::chrono::steady_clock::now();
+                    _engine_proxy = _graph->proxy();
+                    _engine->start(*_graph, _stream, std::move(batch));
+                    // the engine's reading params until it's done, the ui's edits wait for it
+                    ParameterInterface::defer(true);
                 }
+            }
+            _updated_idle = false;
+        }
 
-                auto before = std::chrono::high_resolution_clock::now();
-                _graph->execute(request.type, _stream, request.extra_nodes);
+    }
 
-                auto after = std::chrono::high_resolution_clock::now();
-                auto diff = std::chrono::duration_cast<std::chrono::microseconds>(after - before).count();
-                
-                std::string report = "R Graph (" + std::to_string(_graph->graph().size()) + ")";
+    void MainUI::_collect_engine() {
+        auto results = _engine->take_results();
 
-                _performance.add(report, diff, "stream");
+        // the viewer only holds the last refresh's frame
+        const EngineThread::Result * shown = nullptr;
+        for (auto&& result : results) {
+            if (!result.cancelled) {
+                std::string report = "R Graph (" + std::to_string(_graph ? _graph->graph().size() : 0) + ")";
+                _performance.add(report, result.micros, "stream");
 
-                _live_nodes.insert(_live_nodes.end(), request.extra_nodes.begin(), request.extra_nodes.end());
+                auto&& extra = result.request.extra_nodes;
+                if (_viewer_draw && result.request.type == ExecutionType::UI && std::find(extra.begin(), extra.end(), _viewer_draw) != extra.end()) {
+                    shown = &result;
+                }
+            }
+            _live_nodes.insert(_live_nodes.end(), result.request.extra_nodes.begin(), result.request.extra_nodes.end());
+        }
 
-                orequest = GraphRequests::Get().take();
+        // a run over part of the image says nothing about the whole
+        if (shown && !shown->region) {
+            int64_t scale = shown->proxy;
+            _full_run_us = shown->micros * scale * scale;
+            // params moved while it ran, it's not the frame any more
+            bool current = _engine_started >= _last_user_change;
+            if (scale == 1 && current && _playback_cache && _stream) {
+                _playback_cache->store(shown->frame.index, _viewer_draw, *_stream);
+            }
+            if (_pending_export && scale == 1 && _viewer_draw->display_factor() == 1) {
+                _export_name = immediate_exr(_device, _pending_export->first, _pending_export->second, _viewer_draw->get_image(), _export_task);
+                _pending_export = std::nullopt;
+                _viewer_draw->full_resolution(false);
             }
         }
+    }
 
+    void MainUI::_wait_engine() {
+        _engine->wait();
+        ParameterInterface::defer(false);
+        _collect_engine();
     }
 
     void MainUI::_rebuild_draws() {
         _previous_viewer_draw = _viewer_draw; // can't destroy this until the frame draw has happened which could be whenever
+        if (_playback_cache) {
+            _playback_cache->invalidate();
+        }
         if (!_graph || _graph->terminals().empty()) {
             _viewer_draw = nullptr;
             return;
@@ -495,6 +678,20 @@ namespace vkd {
 
         auto&& term = terms[sel];
 
+        // whatever feeds the viewer decodes first
+        std::set<const EngineNode *> visible;
+        std::deque<EngineNode *> upstream = {term.get()};
+        while (!upstream.empty()) {
+            auto node = upstream.front();
+            upstream.pop_front();
+            if (node && visible.insert(node).second) {
+                for (auto&& input : node->graph_inputs()) {
+                    upstream.push_back(input.get());
+                }
+            }
+        }
+        RawDecodeService::Get().set_visible(std::move(visible));
+
         auto cast = std::dynamic_pointer_cast<vkd::ImageNode>(term);
         if (cast != nullptr) {
             _viewer_draw = std::make_shared<vkd::DrawFullscreen>();
@@ -505,23 +702,62 @@ namespace vkd {
             _viewer_draw->set_range(term->range());
 
             std::static_pointer_cast<EngineNode>(_viewer_draw)->output_count(1);
+            // the new viewer's image starts empty
+            _graph->invalidate_region();
+            _viewer_level = -1;
+            _viewer_draw->full_resolution(_pending_export.has_value());
         } else {
             _viewer_draw = nullptr;
         }
     }
 
+    void MainUI::_update_residency() {
+        // graphs hold the device while they're on screen, and the last one hidden stays so flipping
+        // back to it is instant. the rest are baked out and rebuilt when they're shown again
+        NodeWindow * spare = nullptr;
+        for (auto&& window : _node_windows) {
+            if (!window->visible() && (!spare || window->last_visible() > spare->last_visible())) {
+                spare = window.get();
+            }
+        }
+
+        bool changed = false;
+        for (auto&& window : _node_windows) {
+            bool resident = window->visible() || window.get() == spare;
+            if (resident != window->resident()) {
+                window->resident(resident);
+                changed = true;
+            }
+        }
+        if (changed) {
+            _execution_to_run = std::optional<ExecutionType>{ExecutionType::UI};
+        }
+    }
+
     void MainUI::_execute_graph(ExecutionType type) {
+        VKD_TRACE("MainUI::_execute_graph");
         auto before = std::chrono::high_resolution_clock::now();
 
         std::deque<int32_t> node_queue;
 
         auto graph_builder = std::make_unique<vkd::GraphBuilder>();
 
+        if (_baking_graph) {
+            // the last bake's nodes are still on workers, let them land before replacing them
+            _baking_graph->wait_init();
+            _finish_bake();
+        }
+
+        _bake_start = before;
+
+        _wait_engine();
         _stream->flush();
         _graph = nullptr;
         
         for (auto&& node : _node_windows) {
-            node->build_nodes(*graph_builder);
+            if (node->resident()) {
+                node->build_nodes(*graph_builder);
+            }
         }
 
         if (type == ExecutionType::Execution) {
@@ -530,16 +766,28 @@ namespace vkd {
             _render_window->attach_renderer(*graph_builder.get(), terms);
         }
 
-        _graph = graph_builder->bake(_device);
+        _baking_type = type;
+        _baking_graph = graph_builder->bake_async(_device);
+        _baking_builder = std::move(graph_builder);
+        if (!_baking_graph || _baking_graph->init_complete()) {
+            _finish_bake();
+        }
+    }
+
+    void MainUI::_finish_bake() {
+        VKD_TRACE("MainUI::_finish_bake");
+        _wait_engine();
+        _graph = _baking_builder->finish_bake(std::move(_baking_graph));
+        _baking_builder = nullptr;
         _rebuild_draws();
 
-        if (_graph && type == ExecutionType::UI && _viewer_draw) {
+        if (_graph && _baking_type == ExecutionType::UI && _viewer_draw) {
             GraphRequests::Get().add_ui_run_with(_viewer_draw);
         }
 
         auto after = std::chrono::high_resolution_clock::now();
 
-        auto diff = std::chrono::duration_cast<std::chrono::microseconds>(after - before).count();
+        auto diff = std::chrono::duration_cast<std::chrono::microseconds>(after - _bake_start).count();
 
         std::string report = _graph ? "Build" : "Build (failed)";
 
@@ -14,13 +14,17 @@
 #include "memory_window.hpp"
 #include "console_window.hpp"
 #include "inspector.hpp"
+#include "playback_cache.hpp"
+#include "engine_thread.hpp"
 
-#include "TaskScheduler.h"
+#include "task_handle.hpp"
 
 namespace vkd {
     class Graph;
+    class GraphBuilder;
     class DrawFullscreen;
     class Stream;
+    enum class ImmediateFormat;
     class MainUI {
     public:
         MainUI();
@@ -78,9 +82,21 @@ namespace vkd {
     private:
         void _rebuild_draws();
         void _execute_graph(ExecutionType type);
+        void _finish_bake();
+        // photo mode, which node windows keep their graphs on the device
+        void _update_residency();
+        // results of the engine's last batch, if it's done
+        void _collect_engine();
+        // before anything replaces the graph
+        void _wait_engine();
 
         std::shared_ptr<Device> _device = nullptr;
         std::shared_ptr<Stream> _stream = nullptr;
+        std::unique_ptr<PlaybackCache> _playback_cache = nullptr;
+        // cache filling waits for edits to settle
+        std::chrono::steady_clock::time_point _last_user_change;
+        // a full resolution ui run's cost, estimated from the last run at whatever scale
+        int64_t _full_run_us = 0;
 
         std::unique_ptr<Bin> _bin = nullptr;
         std::unique_ptr<PhotoBrowser> _photo_browser = nullptr;
@@ -88,6 +104,11 @@ namespace vkd {
         std::shared_ptr<Timeline> _timeline = nullptr;
         
         std::unique_ptr<vkd::Graph> _graph = nullptr;
+        // a bake whose nodes are still initialising on workers, swapped in when done
+        std::unique_ptr<vkd::GraphBuilder> _baking_builder = nullptr;
+        std::unique_ptr<vkd::Graph> _baking_graph = nullptr;
+        ExecutionType _baking_type = ExecutionType::UI;
+        std::chrono::high_resolution_clock::time_point _bake_start;
         std::shared_ptr<vkd::DrawFullscreen> _viewer_draw = nullptr;
         std::shared_ptr<vkd::DrawFullscreen> _previous_viewer_draw = nullptr;
         int64_t _viewer_count = 0;
@@ -117,13 +138,23 @@ namespace vkd {
         std::optional<std::string> _loaded_path;
 
         std::string _current_loaded = "untitled";
-        enki::TaskSet * _export_task = nullptr;
+        TaskHandle _export_task;
         std::string _export_name = "";
+        // the viewer only keeps display resolution, exports wait on a full resolution run
+        std::optional<std::pair<std::string, ImmediateFormat>> _pending_export;
+        int32_t _viewer_level = -1;
 
         std::deque<std::pair<std::string, std::string>> _popups;
 
         bool _trigger_renderdoc = false;
         
         std::chrono::high_resolution_clock::time_point _last_saved_prefs;
+
+        // declared last, so it's stopped before the graph and stream go
+        std::unique_ptr<EngineThread> _engine = nullptr;
+        // batches only start after an update the engine wasn't running through
+        bool _updated_idle = false;
+        std::chrono::steady_clock::time_point _engine_started;
+        int32_t _engine_proxy = 1;
     };
 }
\ No newline at end of file
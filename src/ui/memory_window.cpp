@@ -2,6 +2,7 @@
 #include "memory_window.hpp"
 #include "device.hpp"
 #include "memory/memory_pool.hpp"
+#include "memory/residency.hpp"
 
 namespace vkd {
     namespace {
@@ -63,6 +64,22 @@ host buffer count: %lld
                                    c.host_buffer_memory / (1024 * 1024),
                                    c.host_buffer_count);
 
+        const char * source = d.has_memory_budget() ? "VK_EXT_memory_budget" : "estimated, no VK_EXT_memory_budget";
+        ImGui::Text("heap budgets (%s), %lld mb headroom", source, (long long)(d.pool().headroom() / (1024 * 1024)));
+        auto heaps = d.pool().heaps();
+        for (size_t i = 0; i < heaps.size(); ++i) {
+            auto&& heap = heaps[i];
+            ImGui::Text("heap %d%s: %lld / %lld mb used of %lld mb, %lld mb allocated, %lld mb pooled", (int)i, heap.device_local ? " (device local)" : "",
+                (long long)(heap.usage / (1024 * 1024)),
+                (long long)(heap.budget / (1024 * 1024)),
+                (long long)(heap.size / (1024 * 1024)),
+                (long long)(heap.allocated / (1024 * 1024)),
+                (long long)(heap.pooled / (1024 * 1024)));
+        }
+
+        auto residency = d.residency().report();
+        ImGui::Text("node images: %lld, %lld spilled to host (%lld mb)", (long long)residency.tracked, (long long)residency.spilled, (long long)(residency.spilled_memory / (1024 * 1024)));
+
         auto pool = d.pool().pool();
 
         std::string poolt;
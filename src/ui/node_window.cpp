@@ -147,7 +147,10 @@ namespace vkd {
 
         ImGui::PushID(_id);
 
-        ImGui::Begin(_window_name.c_str());
+        _visible = ImGui::Begin(_window_name.c_str());
+        if (_visible) {
+            _last_visible = std::chrono::steady_clock::now();
+        }
 
         if (_focus) {
             _focus = false;
@@ -213,7 +216,9 @@ namespace vkd {
             imnodes::BeginNodeTitleBar();
             auto titlestr = node.second.display_name;
 
-            if (node.second.node && node.second.node->real_node() && node.second.node->real_node()->working()) {
+            // initialising first: its acquire is what makes init's writes safe for working() to read
+            auto real_node = node.second.node ? node.second.node->real_node() : nullptr;
+            if (real_node && (real_node->initialising() || real_node->working())) {
                 titlestr += " ";
                 static int tick = 0;
                 for (int i = 0; i < tick / 30; ++i) {
@@ -352,7 +357,11 @@ namespace vkd {
                         }
                         tot = 30*tot;
                         
-                        auto real_image_node = std::dynamic_pointer_cast<ImageNode>(fake_node->real_node());
+                        // init() on a worker makes and changes the same cached params this window draws,
+                        // keep off them and the node until it's done
+                        auto real_node = fake_node->real_node();
+                        bool initialising = real_node && real_node->initialising();
+                        auto real_image_node = initialising ? nullptr : std::dynamic_pointer_cast<ImageNode>(real_node);
                         if (real_image_node && real_image_node->get_output_image()) {
                             tot += (290 + 30);
                         }
@@ -370,7 +379,13 @@ namespace vkd {
                             //_open_node_windows.erase
                         }
 
-                        if (fake_node->get_state() == UINodeState::normal)
+                        if (initialising) {
+                            ImGui::Text("initialising...");
+                            ImGui::End();
+                            continue;
+                        }
+
+                        if (fake_node->get_state() == UINodeState::normal && fake_node->real_node())
                         {
                             auto block_ = fake_node->real_node()->block_edit_params();
                             if (block_.has_value()) {
@@ -674,6 +689,21 @@ namespace vkd {
         return pin;
     }
 
+    void NodeWindow::resident(bool set) {
+        if (set == _resident) {
+            return;
+        }
+        _resident = set;
+        if (!_resident) {
+            // the graph being replaced still holds them until the rebake
+            for (auto&& node : _nodes) {
+                if (node.second.node) {
+                    node.second.node->real_node(nullptr);
+                }
+            }
+        }
+    }
+
     void NodeWindow::build_nodes(GraphBuilder& graph_builder) {
         Frame frame_start_block = {_sequencer_line->blocks[0].start};
         Frame frame_end_block = {_sequencer_line->blocks[0].end};
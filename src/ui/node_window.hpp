@@ -7,6 +7,7 @@
 #include <memory>
 #include <mutex>
 #include <future>
+#include <chrono>
 
 #include "TaskScheduler.h"
 
@@ -116,6 +117,14 @@ namespace vkd {
         const auto& name_id() const { return _name_id; }
 
         void focus() { _focus = true; }
+
+        // drawn, and not collapsed or behind another tab, as of the last draw
+        bool visible() const { return _visible; }
+        auto last_visible() const { return _last_visible; }
+        // photo mode unloads graphs nobody's looking at. their engine nodes go with the next bake and
+        // only the params are kept, a bake after coming back makes them again
+        bool resident() const { return _resident; }
+        void resident(bool set);
     private:
         imnodes::EditorContext * _imnodes_context = nullptr;
         std::string _window_name = "node window ";
@@ -161,6 +170,9 @@ namespace vkd {
         std::vector<std::pair<int32_t, std::future<bool>>> _save_tasks;
 
         bool _focus = false;
+        bool _visible = true;
+        std::chrono::steady_clock::time_point _last_visible = std::chrono::steady_clock::now();
+        bool _resident = true;
     };
 
     struct SerialiseGraph {
@@ -4,6 +4,7 @@
 #include "cereal/cereal.hpp"
 #include "bin.hpp"
 #include "ghc/filesystem.hpp"
+#include "services/thumbnail_service.hpp"
 
 CEREAL_CLASS_VERSION(vkd::PhotoBrowser, 0);
 
@@ -32,16 +33,15 @@ namespace vkd {
 
         float window_width = ImGui::GetWindowWidth();
 
-        fs::path dir{"../../../../data"};
+        refresh_listing();
+        ThumbnailService::Get().upload(4);
 
-        int width = std::max((int)std::floor((float)(window_width) / (thumbnail_width + 20)), 0);
+        int width = std::max((int)std::floor((float)(window_width) / (thumbnail_width + 20)), 1);
 
         int i = 0;
-        for (auto&& entry : fs::directory_iterator(dir)) {
-            if (valid_extension(entry.path().extension())) {
-                draw_entry(ui, entry.path(), i, width);
-                i++;
-            }
+        for (auto&& entry : _listing) {
+            draw_entry(ui, entry, i, width);
+            i++;
         }
 
 
@@ -52,6 +52,35 @@ namespace vkd {
         ImGui::End();
     }
     
+    void PhotoBrowser::refresh_listing() {
+        auto now = std::chrono::steady_clock::now();
+        if (_listing_valid && now - _last_listing_check < std::chrono::milliseconds(500)) {
+            return;
+        }
+        _last_listing_check = now;
+
+        std::error_code ec;
+        auto time = fs::last_write_time(_directory, ec);
+        if (ec) {
+            _listing.clear();
+            _listing_valid = true;
+            return;
+        }
+        if (_listing_valid && time == _listing_time) {
+            return;
+        }
+
+        _listing.clear();
+        for (auto&& entry : fs::directory_iterator(_directory, ec)) {
+            if (valid_extension(entry.path().extension())) {
+                _listing.push_back(entry.path());
+            }
+        }
+        std::sort(_listing.begin(), _listing.end());
+        _listing_time = time;
+        _listing_valid = true;
+    }
+
     void PhotoBrowser::draw_entry(MainUI& ui, const fs::path& entry, int i, int width) {
         
 
@@ -64,7 +93,10 @@ namespace vkd {
         // bool ImGui::ImageButton(ImTextureID user_texture_id, const ImVec2& size, const ImVec2& uv0, const ImVec2& uv1, int frame_padding, const ImVec4& bg_col, const ImVec4& tint_col)
         std::string chname = std::to_string(i);
 
-        std::optional<ImTextureID> thumbnail_id = {};//ThumbnailManager::get(entry);
+        std::optional<ImTextureID> thumbnail_id = {};
+        if (ImGui::IsRectVisible({thumbnail_width + 10, 140})) {
+            thumbnail_id = ThumbnailService::Get().get(entry.string());
+        }
 
         ImGui::BeginChild(chname.c_str(), {thumbnail_width + 10, 140});
 
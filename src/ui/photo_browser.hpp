@@ -3,6 +3,7 @@
 #include <memory>
 #include <string>
 #include <vector>
+#include <chrono>
 #include "imgui/imgui.h"
 #include "imgui/imfilebrowser.h"
 
@@ -31,7 +32,16 @@ namespace vkd {
 
     private:
         void draw_entry(MainUI& ui, const fs::path& entry, int i, int width);
+        void refresh_listing();
+
         std::set<std::string> _entries;
+
+        // directory_iterator every frame is slow on big folders, only rescan when the folder changes
+        fs::path _directory{"../../../../data"};
+        std::vector<fs::path> _listing;
+        fs::file_time_type _listing_time;
+        std::chrono::steady_clock::time_point _last_listing_check;
+        bool _listing_valid = false;
         ImGui::FileBrowser _file_dialog;
         int _selected = -1;
 
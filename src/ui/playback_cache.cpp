@@ -0,0 +1,246 @@
+#include "playback_cache.hpp"
+
+#include <algorithm>
+
+#include "vulkan.hpp"
+#include "image.hpp"
+#include "stream.hpp"
+#include "descriptor_set.hpp"
+#include "compute/kernel.hpp"
+#include "render/draw_fullscreen.hpp"
+
+namespace vkd {
+    PlaybackCache::~PlaybackCache() = default;
+
+    void PlaybackCache::budget(size_t bytes) {
+        _free_retired();
+        if (bytes == _budget) {
+            return;
+        }
+        _budget = bytes;
+        _trim();
+    }
+
+    void PlaybackCache::invalidate() {
+        _free_retired();
+        for (auto&& frame : _frames) {
+            _spare.push_back(std::move(frame.second));
+        }
+        _frames.clear();
+    }
+
+    void PlaybackCache::range(int64_t first, int64_t last) {
+        last = std::max(first, last);
+        if (first == _first && last == _last) {
+            return;
+        }
+        _first = first;
+        _last = last;
+        for (auto it = _frames.begin(); it != _frames.end();) {
+            if (it->first < _first || it->first > _last) {
+                _spare.push_back(std::move(it->second));
+                it = _frames.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    bool PlaybackCache::ready(int64_t frame) const {
+        auto search = _frames.find(frame);
+        if (search == _frames.end() || !_stream) {
+            return false;
+        }
+        return _stream->semaphore().value_from_device() >= search->second.done;
+    }
+
+    std::shared_ptr<DescriptorSet> PlaybackCache::get(int64_t frame) {
+        if (!ready(frame)) {
+            return nullptr;
+        }
+        auto&& entry = _frames.at(frame);
+        // the next draw recorded is the first that can pick this up, the one it replaces is drawn until then
+        uint64_t next_draw = draw_frame() + 1;
+        if (_shown && _shown != entry.image) {
+            for (auto&& other : _frames) {
+                if (other.second.image == _shown) {
+                    other.second.drawn_at = next_draw;
+                }
+            }
+            for (auto&& spare : _spare) {
+                if (spare.image == _shown) {
+                    spare.drawn_at = next_draw;
+                }
+            }
+        }
+        entry.drawn_at = next_draw;
+        _shown = entry.image;
+        return entry.set;
+    }
+
+    bool PlaybackCache::_reusable(const Entry& entry) const {
+        return entry.image != _shown && entry.drawn_at <= draw_frame_complete();
+    }
+
+    int64_t PlaybackCache::_distance(int64_t frame) const {
+        int64_t length = _last - _first + 1;
+        return ((frame - _playhead) % length + length) % length;
+    }
+
+    std::optional<int64_t> PlaybackCache::_victim() const {
+        std::optional<int64_t> victim;
+        for (auto&& frame : _frames) {
+            if (!victim || _distance(frame.first) > _distance(*victim)) {
+                victim = frame.first;
+            }
+        }
+        return victim;
+    }
+
+    void PlaybackCache::_retire(Entry&& entry) {
+        entry.retired_at = std::max(draw_frame(), entry.drawn_at);
+        _retired_bytes += entry.image ? entry.image->size_in_memory() : 0;
+        _retired.push_back(std::move(entry));
+    }
+
+    void PlaybackCache::_free_retired() {
+        if (_retired.empty()) {
+            return;
+        }
+        uint64_t copied = _stream ? _stream->semaphore().value_from_device() : 0;
+        uint64_t drawn = draw_frame_complete();
+        for (auto it = _retired.begin(); it != _retired.end();) {
+            if (it->done <= copied && it->retired_at <= drawn) {
+                _retired_bytes -= it->image ? it->image->size_in_memory() : 0;
+                it = _retired.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void PlaybackCache::_trim() {
+        if (_frame_bytes == 0) {
+            return;
+        }
+        // retiring doesn't free anything straight away, so only what's live is trimmed to the budget
+        while (!_spare.empty() && _live() > _budget) {
+            _retire(std::move(_spare.back()));
+            _spare.pop_back();
+        }
+        while (!_frames.empty() && _live() > _budget) {
+            auto victim = *_victim();
+            _retire(std::move(_frames.at(victim)));
+            _frames.erase(victim);
+        }
+    }
+
+    std::optional<int64_t> PlaybackCache::next_to_fill() const {
+        // nothing's been stored yet to size frames by
+        auto viewer = _viewer.lock();
+        if (!viewer || !enabled()) {
+            return std::nullopt;
+        }
+
+        int64_t length = _last - _first + 1;
+        for (int64_t d = 0; d < length; ++d) {
+            int64_t frame = _first + ((_playhead - _first + d) % length + length) % length;
+            if (contains(frame) || !viewer->range_contains(Frame{frame})) {
+                continue;
+            }
+            if (!_spare.empty() || used() + _frame_bytes <= _budget) {
+                return frame;
+            }
+            // only worth it if it pushes out something needed later
+            auto victim = _victim();
+            if (victim && _distance(*victim) > d) {
+                return frame;
+            }
+            return std::nullopt;
+        }
+        return std::nullopt;
+    }
+
+    void PlaybackCache::store(int64_t frame, const std::shared_ptr<DrawFullscreen>& viewer, Stream& stream) {
+        auto source = viewer->get_image();
+        if (_budget == 0 || !source || !source->allocated() || frame < _first || frame > _last || !viewer->range_contains(Frame{frame})) {
+            return;
+        }
+
+        _stream = &stream;
+        _free_retired();
+
+        if (viewer != _viewer.lock() || source->dim() != _dim) {
+            // sets belong to the viewer that made them, images to the size
+            invalidate();
+            bool resized = source->dim() != _dim;
+            for (auto&& spare : _spare) {
+                if (resized) {
+                    _retire(std::move(spare));
+                } else {
+                    _retire(Entry{nullptr, spare.set, nullptr, spare.done, 0, spare.drawn_at});
+                    spare.set = nullptr;
+                }
+            }
+            if (resized) {
+                _spare.clear();
+            }
+            _viewer = viewer;
+            _dim = source->dim();
+            _frame_bytes = Image::size_in_memory(_dim, VK_FORMAT_R16G16B16A16_SFLOAT);
+        }
+
+        // only images no draw can still be sampling are copied over, the rest are left to retire
+        auto existing = _frames.find(frame);
+        if (existing != _frames.end() && !_reusable(existing->second)) {
+            _retire(std::move(existing->second));
+            _frames.erase(existing);
+            existing = _frames.end();
+        }
+        auto spare = std::find_if(_spare.begin(), _spare.end(), [this](const Entry& e) { return _reusable(e); });
+
+        Entry entry;
+        if (existing != _frames.end()) {
+            entry = std::move(existing->second);
+            _frames.erase(existing);
+        } else if (spare != _spare.end()) {
+            entry = std::move(*spare);
+            _spare.erase(spare);
+        } else if (used() + _frame_bytes <= _budget) {
+            entry.image = Image::half_image(_device, _dim);
+            entry.image->debug_name("Playback Cache");
+        } else {
+            auto victim = _victim();
+            if (!victim || _distance(*victim) <= _distance(frame) || !_reusable(_frames.at(*victim))) {
+                return;
+            }
+            entry = std::move(_frames.at(*victim));
+            _frames.erase(*victim);
+        }
+
+        if (!entry.commands) {
+            entry.commands = CommandBuffer::make(_device);
+            entry.commands->debug_name("Playback Cache");
+        }
+        // the last copy into this image has to have landed before it's recorded over
+        stream.semaphore().wait(entry.done);
+
+        if (!_copy) {
+            _copy = std::make_shared<Kernel>(_device, "____playback_cache");
+            _copy->init("shaders/compute/image_to_half_image.comp.spv", "main", Kernel::default_local_sizes);
+        }
+        _copy->set_arg(0, source);
+        _copy->set_arg(1, entry.image);
+        {
+            auto scope = entry.commands->record();
+            _copy->dispatch(*entry.commands, _dim.x, _dim.y);
+        }
+        stream.submit(*entry.commands);
+        entry.done = entry.commands->last_timeline_value();
+
+        if (!entry.set) {
+            entry.set = viewer->make_present_set(entry.image);
+        }
+        _frames.emplace(frame, std::move(entry));
+    }
+}
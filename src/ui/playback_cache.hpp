@@ -0,0 +1,98 @@
+#pragma once
+
+#include <memory>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "command_buffer.hpp"
+
+namespace vkd {
+    class Device;
+    class Image;
+    class Kernel;
+    class Stream;
+    class DescriptorSet;
+    class DrawFullscreen;
+
+    // the viewer's finished frames, as half float images on the device. once a range has been
+    // through the graph it plays back from here without running anything
+    class PlaybackCache {
+    public:
+        PlaybackCache(const std::shared_ptr<Device>& device) : _device(device) {}
+        ~PlaybackCache();
+        PlaybackCache(PlaybackCache&&) = delete;
+        PlaybackCache(const PlaybackCache&) = delete;
+
+        void budget(size_t bytes);
+        // room for at least a frame
+        bool enabled() const { return _budget > 0 && _frame_bytes <= _budget; }
+        // a new graph, params or viewer, nothing held is right any more
+        void invalidate();
+        // the frames played, inclusive, and where the player is. decides what's kept
+        void range(int64_t first, int64_t last);
+        void playhead(int64_t frame) { _playhead = frame; }
+
+        // stored, maybe still copying
+        bool contains(int64_t frame) const { return _frames.find(frame) != _frames.end(); }
+        // stored and copied
+        bool ready(int64_t frame) const;
+        // what the viewer draws for frame, nullptr unless ready. the viewer's taken to keep
+        // drawing whatever this last handed out until it hands out something else
+        std::shared_ptr<DescriptorSet> get(int64_t frame);
+
+        // copies the viewer's current image in as frame, on the stream
+        void store(int64_t frame, const std::shared_ptr<DrawFullscreen>& viewer, Stream& stream);
+        // the next frame worth running the graph for, nearest ahead of the playhead first.
+        // nothing once the budget is full of frames needed sooner
+        std::optional<int64_t> next_to_fill() const;
+
+        // retired images count until they're freed, the budget's what's really held
+        size_t used() const { return _live() + _retired_bytes; }
+        size_t count() const { return _frames.size(); }
+    private:
+        struct Entry {
+            std::shared_ptr<Image> image = nullptr;
+            std::shared_ptr<DescriptorSet> set = nullptr;
+            CommandBufferPtr commands = nullptr;
+            uint64_t done = 0; // on the stream's timeline
+            uint64_t retired_at = 0; // the draw frame, see draw_frame()
+            uint64_t drawn_at = 0; // the last draw frame that could have sampled it
+        };
+
+        // how far ahead of the playhead, playback loops
+        int64_t _distance(int64_t frame) const;
+        // the frame needed last
+        std::optional<int64_t> _victim() const;
+        void _retire(Entry&& entry);
+        // no draw in flight or to come samples it, so it can be copied over
+        bool _reusable(const Entry& entry) const;
+        // once the copy into them and every draw that could have sampled them are done
+        void _free_retired();
+        void _trim();
+        size_t _live() const { return (_frames.size() + _spare.size()) * _frame_bytes; }
+
+        std::shared_ptr<Device> _device = nullptr;
+        std::shared_ptr<Kernel> _copy = nullptr;
+        Stream * _stream = nullptr;
+        std::weak_ptr<DrawFullscreen> _viewer;
+
+        size_t _budget = 0;
+        size_t _frame_bytes = 0;
+        glm::ivec2 _dim = {0, 0};
+
+        int64_t _first = 0, _last = 0;
+        int64_t _playhead = 0;
+
+        std::map<int64_t, Entry> _frames;
+        // images from invalidated frames, reused before allocating more
+        std::vector<Entry> _spare;
+        // may still be in a draw in flight
+        std::vector<Entry> _retired;
+        size_t _retired_bytes = 0;
+        // the image behind the set get() last handed out, drawn until it's replaced
+        std::shared_ptr<Image> _shown = nullptr;
+    };
+}
@@ -17,7 +17,7 @@
 
 #include "inputs/sane/sane_wrapper.hpp"
 
-CEREAL_CLASS_VERSION(vkd::Preferences, 5);
+CEREAL_CLASS_VERSION(vkd::Preferences, 9);
 
 namespace {
     std::string vkd_folder = "/vkd";
@@ -71,6 +71,8 @@ namespace vkd {
         }
 
         sane_wrapper::set_sane_library_location(sane_library());
+
+        image_writer::set_defaults(_image_write);
     }
 
     namespace {
@@ -194,6 +196,37 @@ namespace vkd {
             }
         } */
 
+        {
+            bool changed = false;
+            changed |= ImGui::SliderInt("jpeg quality", &_image_write.jpeg_quality, 1, 100);
+
+            const char * subsampling[] = {"4:4:4", "4:2:2", "4:2:0"};
+            int sub = (int)_image_write.jpeg_subsampling;
+            if (ImGui::Combo("jpeg subsampling", &sub, subsampling, IM_ARRAYSIZE(subsampling))) {
+                _image_write.jpeg_subsampling = (ImageWriteSettings::Subsampling)sub;
+                changed = true;
+            }
+
+            changed |= ImGui::SliderInt("png compression", &_image_write.png_level, 0, 9);
+
+            const char * filters[] = {"none", "sub", "up", "average", "paeth", "adaptive"};
+            int filter = (int)_image_write.png_filter;
+            if (ImGui::Combo("png filter", &filter, filters, IM_ARRAYSIZE(filters))) {
+                _image_write.png_filter = (ImageWriteSettings::PngFilter)filter;
+                changed = true;
+            }
+
+            changed |= ImGui::Checkbox("16 bit png", &_image_write.png_16bit);
+
+            if (changed) {
+                image_writer::set_defaults(_image_write);
+            }
+        }
+
+        ImGui::SliderInt("playback cache (MB)", &_playback_cache_mb, 0, 16384);
+        ImGui::SliderInt("memory headroom (MB)", &_memory_headroom_mb, 0, 4096);
+        ImGui::Checkbox("spill images as half float", &_spill_half);
+
         {
             constexpr int strsize = 1024;
             char path[strsize];
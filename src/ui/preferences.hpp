@@ -4,6 +4,8 @@
 #include <string>
 #include <deque>
 
+#include "outputs/image_writer.hpp"
+
 namespace vkd {
     class Preferences {
     public:
@@ -42,6 +44,21 @@ namespace vkd {
         auto& sane_library() { return _sane_library; }
         const auto sane_library() const { return _sane_library; }
 
+        auto& image_write() { return _image_write; }
+        const auto& image_write() const { return _image_write; }
+
+        // the viewer's playback cache, in MB of device memory
+        auto& playback_cache_mb() { return _playback_cache_mb; }
+        const auto playback_cache_mb() const { return _playback_cache_mb; }
+
+        // left free on each heap by the memory pool, in MB
+        auto& memory_headroom_mb() { return _memory_headroom_mb; }
+        const auto memory_headroom_mb() const { return _memory_headroom_mb; }
+
+        // images spilled to host memory under device memory pressure are kept as half float
+        auto& spill_half() { return _spill_half; }
+        const auto spill_half() const { return _spill_half; }
+
         const auto& recently_opened() const { return _recently_opened; }
 
         void add_recently_opened(std::string str) {
@@ -83,6 +100,18 @@ namespace vkd {
             if (version >= 5) {
                 ar(_scan_space, _screenshot_space);
             }
+            if (version >= 6) {
+                ar(_image_write.jpeg_quality, _image_write.jpeg_subsampling, _image_write.png_level, _image_write.png_filter, _image_write.png_16bit);
+            }
+            if (version >= 7) {
+                ar(_playback_cache_mb);
+            }
+            if (version >= 8) {
+                ar(_memory_headroom_mb);
+            }
+            if (version >= 9) {
+                ar(_spill_half);
+            }
         }
     private:
         std::string _last_opened_project = "";
@@ -98,6 +127,12 @@ namespace vkd {
 
         std::string _sane_library = ""; 
 
+        ImageWriteSettings _image_write;
+
+        int32_t _playback_cache_mb = 2048;
+        int32_t _memory_headroom_mb = 512;
+        bool _spill_half = false;
+
         bool _open = false;
 
     };
@@ -7,7 +7,7 @@
 CEREAL_CLASS_VERSION(vkd::SequencerLine::Block, 0);
 CEREAL_CLASS_VERSION(vkd::SequencerLine, 0);
 CEREAL_CLASS_VERSION(vkd::SequencerImpl, 0);
-CEREAL_CLASS_VERSION(vkd::Timeline, 0);
+CEREAL_CLASS_VERSION(vkd::Timeline, 1);
 
 namespace vkd {
 
@@ -29,8 +29,15 @@ namespace vkd {
         } else {
             if (ImGui::Button("play")) {
                 _play = true;
+                _clock_running = false;
             }
         }
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(100);
+        if (ImGui::InputInt("fps", &_fps)) {
+            _fps = std::clamp(_fps, 1, 240);
+            _clock_running = false;
+        }
         int32_t current_frame = _current_frame.index;
         ImSequencer::Sequencer(_sequencer.get(), &current_frame, &_expanded, &_sequencer->selected_entry, &_sequencer->first_frame, ImSequencer::SEQUENCER_CHANGE_FRAME | ImSequencer::SEQUENCER_EDIT_STARTEND);
 
@@ -50,6 +57,7 @@ namespace vkd {
 
         if (current_frame != _current_frame.index) {
             _current_frame.index = current_frame;
+            _clock_running = false;
             for (auto&& line : _sequencer->lines) {
                 line->frame_jumped = true;
             }
@@ -106,4 +114,21 @@ namespace vkd {
         _current_frame.index = std::clamp(_current_frame.index + 1, (int64_t)0, _sequencer->frame_max);
         //std::cout << _sequencer->frame_max << std::endl;
     }
+
+    int64_t Timeline::clock_frame(Clock::time_point now) {
+        if (!_clock_running) {
+            hold(_current_frame.index, now);
+        }
+        double seconds = std::chrono::duration<double>(now - _clock_start).count();
+        int64_t length = _sequencer->frame_max + 1;
+        int64_t frame = _clock_start_frame + static_cast<int64_t>(seconds * _fps);
+        return ((frame % length) + length) % length;
+    }
+
+    void Timeline::hold(int64_t frame, Clock::time_point now) {
+        _clock_running = true;
+        _clock_start = now;
+        _clock_start_frame = frame;
+        _current_frame.index = frame;
+    }
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <memory>
 #include <vector>
 #include <string>
+#include <chrono>
 #include "parameter.hpp"
 #include "imgui/imgui.h"
 #include "imgui/ImSequencer.h"
@@ -139,12 +140,23 @@ namespace vkd {
         auto current_frame() const { return _current_frame; }
         void scrub(int new_frame) { _current_frame = {new_frame}; }
         void increment();
+        int64_t last_frame() const { return _sequencer->frame_max; }
+
+        using Clock = std::chrono::steady_clock;
+        // the frame playback should be showing now at _fps, looping. starts the clock from
+        // the current frame if it isn't running
+        int64_t clock_frame(Clock::time_point now);
+        // playback is waiting on frame, restart the clock from it
+        void hold(int64_t frame, Clock::time_point now);
 
         template <class Archive>
         void serialize(Archive & ar, const uint32_t version) {
-            if (version == 0) {
+            if (version >= 0) {
                 ar(_sequencer, _play, _current_frame, _expanded);
             }
+            if (version >= 1) {
+                ar(_fps);
+            }
         }
     private:
         std::unique_ptr<SequencerImpl> _sequencer = nullptr;
@@ -153,6 +165,11 @@ namespace vkd {
 
         bool _expanded = true;
 
+        int32_t _fps = 25;
+        bool _clock_running = false;
+        Clock::time_point _clock_start;
+        int64_t _clock_start_frame = 0;
+
         std::set<int32_t> _open_bar_editors;
     };
 }
\ No newline at end of file
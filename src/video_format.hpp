@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace vkd {
+    // how a decoder wants or an encoder gives its planes. shared by the uploader and downloader kernels
+    struct VideoFormat {
+        enum class Layout {
+            Planar,     // y, u, v planes
+            SemiPlanar, // y plane, interleaved uv plane
+            PackedRGB,
+            PlanarGBR
+        };
+        Layout layout = Layout::Planar;
+        int32_t bytes = 1; // a sample
+        int32_t depth = 8; // significant bits a sample
+        bool msb = false; // bits kept at the top of the sample, eg. p010
+        int32_t chroma_shift_x = 1;
+        int32_t chroma_shift_y = 1;
+
+        bool rgb() const { return layout == Layout::PackedRGB || layout == Layout::PlanarGBR; }
+    };
+
+    enum class VideoMatrix {
+        BT601,
+        BT709,
+        BT2020
+    };
+
+    struct VideoPlane {
+        size_t offset = 0;
+        size_t stride = 0; // bytes a row
+        int32_t rows = 0;
+    };
+
+    inline void video_matrix_weights(VideoMatrix matrix, float& kr, float& kb) {
+        kr = 0.2126f; kb = 0.0722f;
+        if (matrix == VideoMatrix::BT601) {
+            kr = 0.299f; kb = 0.114f;
+        } else if (matrix == VideoMatrix::BT2020) {
+            kr = 0.2627f; kb = 0.0593f;
+        }
+    }
+
+    // back to back in one buffer. rows are padded to whole blocks of block luma samples, and to whole uints
+    // so kernels never share a word. returns the plane count
+    inline int32_t layout_video_planes(int32_t width, int32_t height, const VideoFormat& f, int32_t block, std::array<VideoPlane, 3>& planes) {
+        auto round_up = [](size_t v, size_t m) { return (v + m - 1) / m * m; };
+        size_t luma_samples = round_up(width, block);
+        size_t chroma_samples = (luma_samples + (1 << f.chroma_shift_x) - 1) >> f.chroma_shift_x;
+        int32_t chroma_rows = (height + (1 << f.chroma_shift_y) - 1) >> f.chroma_shift_y;
+
+        int32_t count = 3;
+        planes = {};
+        if (f.layout == VideoFormat::Layout::PackedRGB) {
+            count = 1;
+            planes[0] = {0, luma_samples * 3 * f.bytes, height};
+        } else if (f.layout == VideoFormat::Layout::PlanarGBR) {
+            for (int i = 0; i < 3; ++i) {
+                planes[i] = {0, luma_samples * f.bytes, height};
+            }
+        } else if (f.layout == VideoFormat::Layout::SemiPlanar) {
+            count = 2;
+            planes[0] = {0, luma_samples * f.bytes, height};
+            planes[1] = {0, chroma_samples * 2 * f.bytes, chroma_rows};
+        } else {
+            planes[0] = {0, luma_samples * f.bytes, height};
+            planes[1] = {0, chroma_samples * f.bytes, chroma_rows};
+            planes[2] = planes[1];
+        }
+
+        for (int i = 0; i < count; ++i) {
+            planes[i].stride = round_up(planes[i].stride, 4);
+            if (i > 0) {
+                planes[i].offset = planes[i - 1].offset + planes[i - 1].stride * planes[i - 1].rows;
+            }
+        }
+        return count;
+    }
+
+    inline size_t video_buffer_size(const std::array<VideoPlane, 3>& planes, int32_t count) {
+        auto&& last = planes[count - 1];
+        return last.offset + last.stride * last.rows;
+    }
+}
@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <sstream>
 #include <mutex>
+#include <atomic>
 
 #include "device.hpp"
 #include "fence.hpp"
@@ -43,11 +44,15 @@
 #include "glm/glm.hpp"
 
 #include "host_scheduler.hpp"
+#include "trace.hpp"
 
 #include <chrono>
 #include <random>
+#include <cstdlib>
 
 #include "inputs/sane/sane_service.hpp"
+#include "services/thumbnail_service.hpp"
+#include "services/raw_decode_service.hpp"
 
 namespace vkd {
 
@@ -71,6 +76,10 @@ namespace vkd {
         VkSemaphore _present_complete;
         VkSemaphore _render_complete;
         std::vector<FencePtr> _command_buffer_complete;
+        // the draw frame each command buffer was last submitted with, zero once its fence is waited on
+        std::vector<uint64_t> _buffer_frames;
+        std::atomic<uint64_t> _draw_frame = 0;
+        std::atomic<uint64_t> _draw_frame_complete = 0;
 
         std::shared_ptr<Renderpass> _renderpass = nullptr;
         std::shared_ptr<PipelineCache> _pipeline_cache = nullptr;
@@ -81,24 +90,37 @@ namespace vkd {
         uint32_t _height = 0;
         std::unique_ptr<HostScheduler> _task_scheduler = nullptr;
 
+        // VKD_TRACE=path records from startup and writes the trace on exit, for headless/farm runs
+        std::string _trace_on_exit = "";
     }
 
     HostScheduler& ts() { return *_task_scheduler; }
 
+    uint64_t draw_frame() { return _draw_frame.load(std::memory_order_acquire); }
+    uint64_t draw_frame_complete() { return _draw_frame_complete.load(std::memory_order_acquire); }
+
     void shutdown() {
 
+        if (!_trace_on_exit.empty()) {
+            Trace::stop();
+            Trace::write(_trace_on_exit);
+        }
+
         sane::Service::Shutdown();
 
         vkDeviceWaitIdle(_device->logical_device());
+        // its images can be in the last frame drawn
+        ThumbnailService::Shutdown();
 
         vkDestroySemaphore(_device->logical_device(), _present_complete, nullptr);
         vkDestroySemaphore(_device->logical_device(), _render_complete, nullptr);
 
 	    _ui = nullptr;
+        RawDecodeService::Shutdown(); // after the ui, raw nodes let go of their jobs on the way out
 
         _draw_ui = nullptr;
 
-        _task_scheduler->cleanup();
+        _task_scheduler->wait_all();
 
         _pipeline_cache = nullptr;
         _renderpass = nullptr;
@@ -124,6 +146,35 @@ namespace vkd {
         _task_scheduler = nullptr;
     }
 
+    std::shared_ptr<Device> init_headless() {
+        Trace::thread_name("main", true);
+
+        _task_scheduler = std::make_unique<HostScheduler>();
+        _task_scheduler->init();
+
+        _instance = createInstance(false);
+        _device = std::make_shared<Device>(_instance);
+        _device->create(_instance->get_physical_device());
+
+        _pipeline_cache = std::make_shared<PipelineCache>(_device);
+        _pipeline_cache->create();
+
+        return _device;
+    }
+
+    void shutdown_headless() {
+        vkDeviceWaitIdle(_device->logical_device());
+        RawDecodeService::Shutdown();
+
+        _task_scheduler->wait_all();
+
+        _pipeline_cache = nullptr;
+        _device = nullptr;
+        _instance = nullptr;
+
+        _task_scheduler = nullptr;
+    }
+
 	Device& device() { return *_device; }
 	DrawUI& get_ui() { return *_draw_ui; }
 
@@ -135,6 +186,12 @@ namespace vkd {
 
     void init(SDL_Window * window, SDL_Renderer * renderer) {
         
+        Trace::thread_name("main", true);
+        if (auto env = std::getenv("VKD_TRACE")) {
+            _trace_on_exit = env;
+            Trace::start();
+        }
+
         _task_scheduler = std::make_unique<HostScheduler>();
         _task_scheduler->init();
 
@@ -185,6 +242,7 @@ namespace vkd {
         _present_complete = create_semaphore(_device->logical_device());
         _render_complete = create_semaphore(_device->logical_device());
         _command_buffer_complete.resize(_swapchain->count());
+        _buffer_frames.assign(_swapchain->count(), 0);
         for (auto&& fence : _command_buffer_complete) {
             fence = Fence::create(_device, true);
         }
@@ -198,6 +256,7 @@ namespace vkd {
 
         _ui = std::make_unique<MainUI>();
         _ui->set_device(_device);
+        ThumbnailService::Get().set_device(_device);
 
         sane::Service::Get().init();
     }
@@ -315,7 +374,7 @@ namespace vkd {
     }
 
     namespace {
-        enki::TaskSet * _callback_task = nullptr;
+        TaskHandle _callback_task;
     }
 
     void render_callback(uint32_t current_buffer, Stream& stream) {
@@ -323,18 +382,18 @@ namespace vkd {
         if (_callback_task) {
             _task_scheduler->wait(_callback_task);
         }
-        auto task = std::make_unique<enki::TaskSet>(1, [current_buffer, &stream](enki::TaskSetPartition range, uint32_t threadnum) {
+        _callback_task = _task_scheduler->add("render callback", [current_buffer, &stream]() {
             try {
                 stream.flush();
                 _draw_ui->flush();
             } catch (...) {
 
             }
-        });
-        _callback_task = _task_scheduler->add(std::move(task));
+        }, TaskPriority::High);
     }
 
 	void draw() {
+        VKD_TRACE("draw");
 
         _ui->update();
 
@@ -344,6 +403,19 @@ namespace vkd {
         _command_buffer_complete[current_buffer]->wait();
         _command_buffer_complete[current_buffer]->reset();
 
+        // this buffer's last frame is done, the oldest still in another holds the rest up
+        _buffer_frames[current_buffer] = 0;
+        uint64_t frame = _draw_frame.load(std::memory_order_relaxed) + 1;
+        uint64_t complete = frame - 1;
+        for (auto&& in_flight : _buffer_frames) {
+            if (in_flight > 0) {
+                complete = std::min(complete, in_flight - 1);
+            }
+        }
+        _buffer_frames[current_buffer] = frame;
+        _draw_frame_complete.store(complete, std::memory_order_release);
+        _draw_frame.store(frame, std::memory_order_release);
+
         if (_draw_ui->update(ExecutionType::UI)) {
             build_command_buffers(_command_buffers[current_buffer], current_buffer);
         }
@@ -358,8 +430,6 @@ namespace vkd {
 		// Pass the semaphore signaled by the command buffer submission from the submit info as the wait semaphore for swap chain presentation
 		// This ensures that the image is not presented to the windowing system until all commands have been submitted
 		_swapchain->present(_render_complete, current_buffer);
-
-        _task_scheduler->cleanup();
 	}
 
     void ui(bool& quit) {
@@ -491,6 +561,7 @@ namespace vkd {
                 std::stringstream strm2;
                 strm2 << "Created device: " << (_device->logical_device() ?  "true" : "false") << "\n";
                 strm2 << "Created queue: " << (_device->queue() ?  "true" : "false") << "\n";
+                strm2 << "Transfer queue: " << (_device->separate_transfer_queue() ? "family " + std::to_string(_device->transfer_queue_index()) : std::string("shared")) << "\n";
                 strm2 << "Enabled extensions:" << "\n";
                 for (auto&& ext : _device->device_extensions_enabled()) {
                     strm2 << "\t" << ext << "\n";
@@ -61,11 +61,19 @@ namespace vkd {
 	VKDEXPORT void shutdown();
     void engine_node_init(const std::shared_ptr<EngineNode>& node, const std::string& param_hash_name);
     VKDEXPORT void init(SDL_Window * window, SDL_Renderer * renderer);
+    // no window, ui or swapchain, just the device and host scheduler for making and running graphs
+    VKDEXPORT std::shared_ptr<Device> init_headless();
+    VKDEXPORT void shutdown_headless();
 	VKDEXPORT void ui(bool& quit);
 	VKDEXPORT void draw();
     //void submit_buffer(VkQueue queue, VkCommandBuffer buf, Fence * fence);
 
     HostScheduler& ts();
+    // the swapchain frame being recorded, and the newest that's finished on the device along with
+    // every one before it. something a draw may sample is safe to free once complete reaches the
+    // frame it was replaced in. both stay at zero without a window
+    VKDEXPORT uint64_t draw_frame();
+    VKDEXPORT uint64_t draw_frame_complete();
 
     void build_command_buffers();
 
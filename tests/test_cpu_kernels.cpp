@@ -0,0 +1,194 @@
+#include <cmath>
+
+#include "catch.hpp"
+#include "cpu/cpu_kernels.hpp"
+#include "cpu/host_graph.hpp"
+#include "graph/fake_node.hpp"
+#include "graph_exception.hpp"
+#include "host_cache.hpp"
+#include "host_scheduler.hpp"
+
+namespace {
+    std::unique_ptr<vkd::StaticHostImage> make_image(int32_t width, int32_t height) {
+        auto image = vkd::StaticHostImage::make(width, height, 4, sizeof(float));
+        auto p = reinterpret_cast<float *>(image->data());
+        for (int32_t i = 0; i < width * height * 4; ++i) {
+            p[i] = float((i * 7919) % 1000) / 1000.0f;
+        }
+        return image;
+    }
+
+    glm::vec4 pixel(const vkd::StaticHostImage& image, int32_t x, int32_t y) {
+        auto dim = image.dim();
+        if (x < 0 || y < 0 || x >= dim.x || y >= dim.y) {
+            return glm::vec4(0.0f);
+        }
+        auto p = reinterpret_cast<const float *>(image.data()) + (y * dim.x + x) * 4;
+        return {p[0], p[1], p[2], p[3]};
+    }
+
+    bool close(glm::vec4 a, glm::vec4 b) {
+        auto d = glm::abs(a - b);
+        return glm::max(glm::max(d.x, d.y), glm::max(d.z, d.w)) < 1e-4f;
+    }
+}
+
+// scalar transcriptions of the .comp files, pixel by pixel
+TEST_CASE("CPU kernels match the shaders", "[cpu]") {
+    vkd::HostScheduler scheduler;
+    scheduler.init();
+    vkd::cpu::Kernels kernels(scheduler);
+
+    const int32_t width = 67, height = 301;
+    auto in = make_image(width, height);
+    auto out = vkd::StaticHostImage::make(width, height, 4, sizeof(float));
+
+    SECTION("saturation") {
+        float sat = 0.3f, isat = 1.0f - sat;
+        kernels.saturation(*in, *out, sat);
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = 0; x < width; ++x) {
+                auto i = pixel(*in, x, y);
+                glm::vec4 e;
+                e.x = (isat * 0.2126f + sat) * i.x + (isat * 0.7152f) * i.y + (isat * 0.0722f) * i.z;
+                e.y = (isat * 0.2126f) * i.x + (isat * 0.7152f + sat) * i.y + (isat * 0.0722f) * i.z;
+                e.z = (isat * 0.2126f) * i.x + (isat * 0.7152f) * i.y + (isat * 0.0722f + sat) * i.z;
+                e.w = i.w;
+                REQUIRE(close(pixel(*out, x, y), e));
+            }
+        }
+    }
+
+    SECTION("cdl") {
+        vkd::cpu::Kernels::Cdl params;
+        params.slope = {0.1f, -0.2f, 0.0f};
+        params.offset = {0.05f, 0.0f, -0.1f};
+        params.power = {0.2f, 0.0f, -0.3f};
+        params.saturation = 1.4f;
+        kernels.cdl(*in, *out, params);
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = 0; x < width; ++x) {
+                auto i = pixel(*in, x, y);
+                glm::vec4 e;
+                for (int c = 0; c < 3; ++c) {
+                    float s = std::fmax(params.slope_master + params.slope[c], 0.0f);
+                    float p = std::fmax(params.power_master + params.power[c], 0.0f);
+                    e[c] = std::pow(std::fmax(i[c] * s + params.offset_master + params.offset[c], 0.0f), p);
+                }
+                float luma = 0.2126f * e.x + 0.7152f * e.y + 0.0722f * e.z;
+                e = glm::vec4(glm::vec3(luma) + params.saturation * (glm::vec3(e) - glm::vec3(luma)), i.w);
+                REQUIRE(close(pixel(*out, x, y), e));
+            }
+        }
+    }
+
+    SECTION("log and back") {
+        auto logged = vkd::StaticHostImage::make(width, height, 4, sizeof(float));
+        kernels.log_image(*in, *logged);
+        kernels.exp_image(*logged, *out);
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = 0; x < width; ++x) {
+                REQUIRE(close(pixel(*out, x, y), pixel(*in, x, y)));
+            }
+        }
+    }
+
+    SECTION("rotate") {
+        auto rotated = vkd::StaticHostImage::make(height, width, 4, sizeof(float));
+        kernels.rotate(*in, *rotated, 3, in->dim());
+        for (int32_t y = 0; y < width; ++y) {
+            for (int32_t x = 0; x < height; ++x) {
+                REQUIRE(pixel(*rotated, x, y) == pixel(*in, height - y - 1, width - x - 1));
+            }
+        }
+    }
+
+    SECTION("merge") {
+        auto final = make_image(width, height);
+        auto under = make_image(width, height);
+        kernels.merge(*final, *in);
+        for (int32_t y = 0; y < height; ++y) {
+            for (int32_t x = 0; x < width; ++x) {
+                auto n = pixel(*in, x, y);
+                REQUIRE(close(pixel(*final, x, y), n + pixel(*under, x, y) * (1.0f - n.w)));
+            }
+        }
+    }
+
+    SECTION("gaussian") {
+        const float sigma = 2.5f;
+        const int32_t half_window = 7;
+        kernels.gaussian(*in, *out, sigma, half_window);
+
+        float mult_fac = 1.0f / std::sqrt(3.14159265358979f * 2.0f * sigma * sigma);
+        float denom = 2.0f * sigma * sigma;
+        auto weight = [&](int32_t j) { return mult_fac * std::exp(-(float(j * j) / denom)); };
+        auto horiz = [&](int32_t x, int32_t y) {
+            if (x < 0 || y < 0 || x >= width || y >= height) {
+                return glm::vec4(0.0f);
+            }
+            glm::vec4 sum(0.0f);
+            float div = 0.0f;
+            for (int32_t j = -half_window; j < half_window; ++j) {
+                sum += weight(j) * pixel(*in, x + j, y);
+                div += weight(j);
+            }
+            return sum / div;
+        };
+        for (int32_t y = 0; y < height; y += 13) {
+            for (int32_t x = 0; x < width; ++x) {
+                glm::vec4 sum(0.0f);
+                float div = 0.0f;
+                for (int32_t j = -half_window; j < half_window; ++j) {
+                    sum += weight(j) * horiz(x, y + j);
+                    div += weight(j);
+                }
+                REQUIRE(close(pixel(*out, x, y), sum / div));
+            }
+        }
+    }
+}
+
+TEST_CASE("Host graph runs without a device", "[cpu]") {
+    vkd::HostScheduler scheduler;
+    scheduler.init();
+
+    const glm::vec4 colour = {0.5f, 0.25f, 1.0f, 0.5f};
+    vkd::GraphBuilder builder;
+    auto constant = std::make_shared<vkd::FakeNode>(9001, "constant", "constant");
+    constant->set_param("size", glm::ivec2{37, 23});
+    constant->set_param("colour", colour);
+    auto exposure = std::make_shared<vkd::FakeNode>(9002, "exposure", "exposure");
+    exposure->set_param("exposure", 1.0f);
+    exposure->add_input(constant);
+    auto saturation = std::make_shared<vkd::FakeNode>(9003, "saturation", "saturation");
+    saturation->set_param("saturation", 0.0f);
+    saturation->add_input(exposure);
+    auto rotate = std::make_shared<vkd::FakeNode>(9004, "rotate", "rotate");
+    rotate->set_param("mode", 1);
+    rotate->add_input(saturation);
+    for (auto&& node : {constant, exposure, saturation, rotate}) {
+        builder.add(node);
+    }
+
+    vkd::cpu::HostGraph graph(scheduler);
+    graph.build(builder);
+    REQUIRE(graph.output(*rotate) == nullptr);
+    graph.execute();
+
+    auto out = graph.output(*rotate);
+    REQUIRE(out);
+    REQUIRE(out->dim() == glm::ivec2{23, 37});
+    // exposure doubles alpha too, as the shader does
+    float luma = 2.0f * (0.2126f * colour.x + 0.7152f * colour.y + 0.0722f * colour.z);
+    for (int32_t y = 0; y < 37; ++y) {
+        for (int32_t x = 0; x < 23; ++x) {
+            REQUIRE(close(pixel(*out, x, y), glm::vec4(luma, luma, luma, 2.0f * colour.w)));
+        }
+    }
+
+    auto median = std::make_shared<vkd::FakeNode>(9005, "median", "median");
+    median->add_input(rotate);
+    builder.add(median);
+    REQUIRE_THROWS_AS(graph.build(builder), vkd::GraphException);
+}
@@ -0,0 +1,110 @@
+#include <csetjmp>
+#include <cstdio>
+#include <vector>
+
+#include <png.h>
+
+#include "catch.hpp"
+#include "ghc/filesystem.hpp"
+#include "host_scheduler.hpp"
+#include "outputs/image_writer.hpp"
+
+namespace {
+    struct Decoded {
+        int32_t width = 0, height = 0;
+        int32_t bit_depth = 0, channels = 0;
+        std::vector<uint8_t> rows; // as libpng hands them back, 16 bit big endian
+    };
+
+    bool read_png(const std::string& path, Decoded& out) {
+        FILE * fp = fopen(path.c_str(), "rb");
+        if (!fp) {
+            return false;
+        }
+        auto png = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+        auto info = png_create_info_struct(png);
+        if (setjmp(png_jmpbuf(png))) {
+            png_destroy_read_struct(&png, &info, nullptr);
+            fclose(fp);
+            return false;
+        }
+        png_init_io(png, fp);
+        png_read_info(png, info);
+        out.width = png_get_image_width(png, info);
+        out.height = png_get_image_height(png, info);
+        out.bit_depth = png_get_bit_depth(png, info);
+        out.channels = png_get_channels(png, info);
+
+        size_t row_bytes = png_get_rowbytes(png, info);
+        out.rows.resize(row_bytes * out.height);
+        std::vector<png_bytep> rows(out.height);
+        for (int32_t y = 0; y < out.height; ++y) {
+            rows[y] = out.rows.data() + row_bytes * y;
+        }
+        png_read_image(png, rows.data());
+        png_read_end(png, nullptr);
+        png_destroy_read_struct(&png, &info, nullptr);
+        fclose(fp);
+        return true;
+    }
+}
+
+// tall enough to split into several independently deflated runs
+TEST_CASE("PNG round trip", "[png]") {
+    vkd::HostScheduler scheduler;
+    scheduler.init();
+
+    const int32_t width = 613, height = 1201;
+    auto path = (ghc::filesystem::temp_directory_path() / "vkd_test.png").string();
+
+    using PngFilter = vkd::ImageWriteSettings::PngFilter;
+    for (auto filter : {PngFilter::None, PngFilter::Sub, PngFilter::Up, PngFilter::Average, PngFilter::Paeth, PngFilter::Adaptive}) {
+        for (int32_t bit_depth : {8, 16}) {
+            for (bool alpha : {false, true}) {
+                int32_t bytes = bit_depth / 8;
+                std::vector<uint8_t> rgba((size_t)width * height * 4 * bytes);
+                for (size_t i = 0; i < rgba.size(); ++i) {
+                    rgba[i] = (uint8_t)((i * 7919 + i / 4093) % 251);
+                }
+
+                vkd::ImageWriteSettings settings;
+                settings.png_filter = filter;
+                vkd::image_writer::write_png(path, rgba.data(), width, height, bit_depth, alpha, settings, scheduler);
+
+                Decoded decoded;
+                REQUIRE(read_png(path, decoded));
+                REQUIRE(decoded.width == width);
+                REQUIRE(decoded.height == height);
+                REQUIRE(decoded.bit_depth == bit_depth);
+                int32_t channels = alpha ? 4 : 3;
+                REQUIRE(decoded.channels == channels);
+
+                bool match = true;
+                for (int32_t y = 0; y < height && match; ++y) {
+                    for (int32_t x = 0; x < width && match; ++x) {
+                        for (int32_t c = 0; c < channels; ++c) {
+                            size_t src = ((size_t)y * width + x) * 4 + c;
+                            size_t dst = ((size_t)y * width + x) * channels + c;
+                            uint32_t expected, got;
+                            if (bit_depth == 8) {
+                                expected = rgba[src];
+                                got = decoded.rows[dst];
+                            } else {
+                                expected = reinterpret_cast<const uint16_t *>(rgba.data())[src];
+                                got = (decoded.rows[dst * 2] << 8) | decoded.rows[dst * 2 + 1];
+                            }
+                            if (expected != got) {
+                                match = false;
+                                break;
+                            }
+                        }
+                    }
+                }
+                INFO("filter " << (int)filter << ", " << bit_depth << " bit, alpha " << alpha);
+                REQUIRE(match);
+            }
+        }
+    }
+
+    ghc::filesystem::remove(path);
+}
@@ -0,0 +1,98 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "catch.hpp"
+#include "vulkan.hpp"
+#include "instance.hpp"
+#include "device.hpp"
+#include "image.hpp"
+#include "buffer.hpp"
+#include "command_buffer.hpp"
+#include "compute/kernel.hpp"
+
+// the running histogram median against a sort, on values well past 1
+TEST_CASE("Median histogram on hdr values", "[median]") {
+    auto instance = vkd::createInstance(true);
+    auto device = std::make_shared<vkd::Device>(instance);
+    device->create(instance->get_physical_device());
+
+    const int32_t width = 96, height = 80, radius = 4, strip = 64;
+
+    // a ramp to 12 with a little noise on it, so windows aren't flat
+    std::vector<float> pixels((size_t)width * height * 4);
+    for (int32_t y = 0; y < height; ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            float * p = &pixels[((size_t)y * width + x) * 4];
+            p[0] = 0.1f + 12.0f * x / width + 0.6f * ((x * 7 + y * 13) % 5);
+            p[1] = p[2] = 0.0f;
+            p[3] = 1.0f;
+        }
+    }
+    float lo = pixels[0], hi = pixels[0];
+    for (size_t i = 0; i < pixels.size(); i += 4) {
+        lo = std::min(lo, pixels[i]);
+        hi = std::max(hi, pixels[i]);
+    }
+
+    auto make_image = [&]() {
+        auto image = std::make_shared<vkd::Image>(device);
+        image->create_image(VK_FORMAT_R32G32B32A32_SFLOAT, {width, height}, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+        image->allocate(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        image->create_view(VK_IMAGE_ASPECT_COLOR_BIT);
+        auto buf = vkd::CommandBuffer::make_immediate(device);
+        image->set_layout(buf->get(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+        return image;
+    };
+    auto in = make_image();
+    auto out = make_image();
+
+    auto upload = vkd::AutoMapStagingBuffer::make(device, vkd::AutoMapStagingBuffer::Mode::Upload, pixels.size() * sizeof(float));
+    memcpy(upload->get(), pixels.data(), pixels.size() * sizeof(float));
+    {
+        auto buf = vkd::CommandBuffer::make_immediate(device);
+        in->copy(buf->get(), *upload);
+    }
+
+    auto kernel = std::make_shared<vkd::Kernel>(device, "test_median");
+    kernel->init("shaders/compute/median_histogram.comp.spv", "main", {32, 1, 1});
+    kernel->set_arg(0, in);
+    kernel->set_arg(1, out);
+    kernel->set_push_arg_by_name("_radius", radius);
+    kernel->set_push_arg_by_name("_channel", 0);
+    kernel->set_push_arg_by_name("_strip", strip);
+    {
+        auto buf = vkd::CommandBuffer::make_immediate(device);
+        kernel->dispatch(*buf, (width + 31) / 32 * 32, (height + strip - 1) / strip);
+    }
+
+    vkd::AutoMapStagingBuffer download{device, vkd::AutoMapStagingBuffer::Mode::Download, pixels.size() * sizeof(float)};
+    {
+        auto buf = vkd::CommandBuffer::make_immediate(device);
+        out->set_layout(buf->get(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+        download.copy(buf->get(), *out, 0, 0, 0, width, height);
+    }
+    auto result = reinterpret_cast<const float *>(download.get());
+
+    // within a bin of the sort. binned over 0-1 as it was, everything past 1 here came back as 1
+    const float tolerance = (hi - lo) / 255.0f + 1e-4f;
+    std::vector<float> window;
+    for (int32_t y = 0; y < height; ++y) {
+        for (int32_t x = 0; x < width; ++x) {
+            window.clear();
+            for (int32_t dy = -radius; dy <= radius; ++dy) {
+                for (int32_t dx = -radius; dx <= radius; ++dx) {
+                    int32_t sx = std::clamp(x + dx, 0, width - 1);
+                    int32_t sy = std::clamp(y + dy, 0, height - 1);
+                    window.push_back(pixels[((size_t)sy * width + sx) * 4]);
+                }
+            }
+            std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+            float expected = window[window.size() / 2];
+            float got = result[((size_t)y * width + x) * 4];
+            INFO("at " << x << ", " << y);
+            REQUIRE(std::abs(got - expected) <= tolerance);
+        }
+    }
+}